@@ -0,0 +1,381 @@
+//
+// Local work-size and build-option autotuner
+//
+// tune() times candidate local work sizes for a kernel with profiling
+// events and records the fastest one per device, kernel (its program's
+// source and build options) and global size bucket. enqueueNDRangeKernel
+// consults the cache whenever the caller omits localWorkSize.
+//
+// tuneBuildOptions() does the same for the options a program is built
+// with, and program.build() appends the recorded winner.
+//
+// The cache is a JSON file, by default ~/.webcl/tuning.json; set
+// WEBCL_TUNING_CACHE to use another location.
+//
+
+var fs = require('fs');
+var path = require('path');
+var crypto = require('crypto');
+
+// values mirrored from webcl.js, which requires this module
+var QUEUE_CONTEXT                            =0x1090;
+var QUEUE_DEVICE                             =0x1091;
+var QUEUE_PROPERTIES                         =0x1093;
+var QUEUE_PROFILING_ENABLE                   =(1 << 1);
+var DEVICE_MAX_WORK_ITEM_SIZES               =0x1005;
+var DEVICE_LOCAL_MEM_SIZE                    =0x1023;
+var DEVICE_NAME                              =0x102B;
+var DEVICE_VENDOR                            =0x102C;
+var DRIVER_VERSION                           =0x102D;
+var KERNEL_FUNCTION_NAME                     =0x1190;
+var KERNEL_PROGRAM                           =0x1194;
+var KERNEL_WORK_GROUP_SIZE                   =0x11B0;
+var KERNEL_LOCAL_MEM_SIZE                    =0x11B2;
+var KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE =0x11B3;
+var PROGRAM_CONTEXT                          =0x1161;
+var PROGRAM_DEVICES                          =0x1163;
+var PROGRAM_SOURCE                           =0x1164;
+var PROGRAM_BUILD_OPTIONS                    =0x1182;
+var PROFILING_COMMAND_START                  =0x1282;
+var PROFILING_COMMAND_END                    =0x1283;
+
+var cacheFile = process.env.WEBCL_TUNING_CACHE ||
+    path.join(process.env.HOME || '.', '.webcl', 'tuning.json');
+var cache = null;
+
+function loadCache() {
+    if (cache)
+        return cache;
+    try {
+        cache = JSON.parse(fs.readFileSync(cacheFile, 'utf8'));
+    } catch (e) {
+        cache = {};
+    }
+    return cache;
+}
+
+function saveCache() {
+    var dir = path.dirname(cacheFile);
+    try {
+        try { fs.mkdirSync(dir); } catch (e) { /* already there */ }
+        fs.writeFileSync(cacheFile, JSON.stringify(cache, null, 1));
+    } catch (e) {
+        // a read-only home directory only costs us the persistence
+    }
+}
+
+// Device identity survives process restarts, the handle does not.
+function deviceKey(device) {
+    if (!device._tuneKey)
+        device._tuneKey = [device.getInfo(DEVICE_VENDOR),
+                           device.getInfo(DEVICE_NAME),
+                           device.getInfo(DRIVER_VERSION)].join('/');
+    return device._tuneKey;
+}
+
+// A hash of the program source, or null for a program created from
+// binaries: those have no source to tell them apart, so nothing about
+// them is cached.
+function sourceKey(program) {
+    if (program._tuneKey === undefined) {
+        var source = program.getInfo(PROGRAM_SOURCE);
+        var hash = crypto.createHash('sha1');
+        hash.update(source);
+        program._tuneKey = source ? hash.digest('hex').substr(0, 16) : null;
+    }
+    return program._tuneKey;
+}
+
+// Kernel name, a hash of the program source it came from and the options
+// the program was built with for device (-D options can change the best
+// local size as much as the source does); null if the program has no
+// source. A program can't be rebuilt while it has kernels, so the key is
+// kept on the kernel.
+function kernelKey(kernel, device) {
+    var keys = kernel._tuneKeys || (kernel._tuneKeys = {});
+    var dk = deviceKey(device);
+    if (keys[dk] === undefined) {
+        var program = kernel.getInfo(KERNEL_PROGRAM);
+        var source = sourceKey(program);
+        keys[dk] = source && kernel.getInfo(KERNEL_FUNCTION_NAME) + '@' + source + '|' +
+            program.getBuildInfo(device, PROGRAM_BUILD_OPTIONS).trim();
+    }
+    return keys[dk];
+}
+
+// Global sizes are bucketed to the next power of two per dimension so a
+// tuning run covers nearby problem sizes too.
+function sizeBucket(globalWorkSize) {
+    var b = [];
+    for (var i = 0; i < globalWorkSize.length; i++) {
+        var p = 1;
+        while (p < globalWorkSize[i])
+            p *= 2;
+        b.push(p);
+    }
+    return b.join('x');
+}
+
+function cacheKey(device, kernel, globalWorkSize) {
+    var k = kernelKey(kernel, device);
+    return k && deviceKey(device) + '|' + k + '|' + sizeBucket(globalWorkSize);
+}
+
+function divides(local, global) {
+    if (local.length != global.length)
+        return false;
+    for (var i = 0; i < local.length; i++) {
+        if (!local[i] || global[i] % local[i])
+            return false;
+    }
+    return true;
+}
+
+// All power-of-two local sizes that fit the kernel's work-group limit and
+// the device's per-dimension limits, and evenly divide the global size.
+function candidates(kernel, device, globalWorkSize) {
+    var maxGroup = kernel.getWorkGroupInfo(device, KERNEL_WORK_GROUP_SIZE);
+    var multiple = kernel.getWorkGroupInfo(device, KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE) || 1;
+    var maxItems = device.getInfo(DEVICE_MAX_WORK_ITEM_SIZES);
+    var dims = globalWorkSize.length;
+    var result = [];
+
+    function visit(d, prefix, product) {
+        if (d == dims) {
+            // a group smaller than the SIMD width wastes lanes
+            if (product >= Math.min(multiple, maxGroup) && divides(prefix, globalWorkSize))
+                result.push(prefix);
+            return;
+        }
+        for (var s = 1; s <= maxItems[d] && s * product <= maxGroup; s *= 2)
+            visit(d + 1, prefix.concat([s]), product * s);
+    }
+    visit(0, [], 1);
+    return result;
+}
+
+function timeLaunch(queue, kernel, offset, globalWorkSize, localWorkSize) {
+    var ev = queue.enqueueNDRangeKernel(kernel, globalWorkSize.length, offset,
+                                        globalWorkSize, localWorkSize, []);
+    queue.finish();
+    return ev.getProfilingInfo(PROFILING_COMMAND_END) -
+        ev.getProfilingInfo(PROFILING_COMMAND_START);
+}
+
+function median(a) {
+    a.sort(function(x, y) { return x - y; });
+    return a[a.length >> 1];
+}
+
+//  Object tune(WebCLCommandQueue queue, WebCLKernel kernel,
+//              sequence<long> globalWorkSize, optional Object options);
+//
+// The kernel arguments must already be set; every candidate runs the
+// kernel on them. options.iterations (default 5) launches are timed per
+// candidate after one warm-up launch, and the median wins. Returns
+// { localWorkSize, time } with time in nanoseconds; localWorkSize is null
+// when letting the implementation choose was fastest. Kernels of programs
+// created from binaries are tuned but the result isn't recorded.
+exports.tune = function(queue, kernel, globalWorkSize, options) {
+    options = options || {};
+    var iterations = options.iterations || 5;
+    var offset = options.globalWorkOffset || [];
+    var device = queue.getInfo(QUEUE_DEVICE);
+
+    // __local arguments count against the device limit whatever we pick
+    if (kernel.getWorkGroupInfo(device, KERNEL_LOCAL_MEM_SIZE) >
+        device.getInfo(DEVICE_LOCAL_MEM_SIZE))
+        throw new Error("CL_OUT_OF_RESOURCES");
+
+    var tq = queue;
+    if (!(queue.getInfo(QUEUE_PROPERTIES) & QUEUE_PROFILING_ENABLE))
+        tq = queue.getInfo(QUEUE_CONTEXT).createCommandQueue(device, QUEUE_PROFILING_ENABLE);
+
+    var list = [[]].concat(candidates(kernel, device, globalWorkSize));
+    var best = null, bestTime = Infinity;
+    for (var i = 0; i < list.length; i++) {
+        var times = [];
+        try {
+            timeLaunch(tq, kernel, offset, globalWorkSize, list[i]);
+            for (var n = 0; n < iterations; n++)
+                times.push(timeLaunch(tq, kernel, offset, globalWorkSize, list[i]));
+        } catch (e) {
+            // CL_INVALID_WORK_GROUP_SIZE and friends just rule a candidate out
+            continue;
+        }
+        var t = median(times);
+        if (t < bestTime) {
+            bestTime = t;
+            best = list[i];
+        }
+    }
+    if (!best)
+        throw new Error("no local work size could be launched");
+
+    var result = { localWorkSize: best.length ? best : null, time: bestTime };
+    var key = cacheKey(device, kernel, globalWorkSize);
+    if (key) {
+        loadCache()[key] = result;
+        saveCache();
+    }
+    return result;
+};
+
+//  sequence<long>? lookup(WebCLDevice device, WebCLKernel kernel,
+//                         sequence<long> globalWorkSize);
+//
+// The tuned local size for this launch, or null if there is none or it
+// does not divide globalWorkSize.
+exports.lookup = function(device, kernel, globalWorkSize) {
+    var key = cacheKey(device, kernel, globalWorkSize);
+    var entry = key && loadCache()[key];
+    if (!entry || !entry.localWorkSize || !divides(entry.localWorkSize, globalWorkSize))
+        return null;
+    return entry.localWorkSize;
+};
+
+// The base options are part of the key: a winner tuned on top of one
+// set of -D options says nothing about another. Null for a program
+// created from binaries.
+function buildKey(device, program, options) {
+    var source = sourceKey(program);
+    return source && 'build|' + deviceKey(device) + '|' + source + '|' +
+        (options || '').trim();
+}
+
+// Largest error relative to the reference, scaled so values near zero are
+// compared absolutely.
+function maxError(ref, out) {
+    if (ref.length != out.length)
+        return Infinity;
+    var err = 0;
+    for (var i = 0; i < ref.length; i++) {
+        var e = Math.abs(out[i] - ref[i]) / Math.max(1, Math.abs(ref[i]));
+        if (isNaN(e))
+            return Infinity;
+        err = Math.max(err, e);
+    }
+    return err;
+}
+
+exports.buildOptionCandidates = [
+    '',
+    '-cl-mad-enable',
+    '-cl-denorms-are-zero',
+    '-cl-mad-enable -cl-denorms-are-zero',
+    '-cl-no-signed-zeros -cl-mad-enable',
+    '-cl-unsafe-math-optimizations',
+    '-cl-fast-relaxed-math',
+    '-cl-fast-relaxed-math -cl-denorms-are-zero'
+];
+
+//  Object tuneBuildOptions(WebCLCommandQueue queue, WebCLProgram program,
+//                          Function run, optional Object options);
+//
+// Rebuilds program's source once per candidate option set (appended to
+// options.options, the base options) and calls run(variant, queue).
+// run must create its kernels from variant, enqueue a representative
+// workload on queue and return { events: [WebCLEvent...], result: typed
+// array }. The base options are always built and run first, as the
+// accuracy reference; if that fails tuning is aborted. The candidate with
+// the lowest median kernel time whose result is within options.tolerance
+// (default 1e-4, relative) of the reference is recorded for this device,
+// source and base options (the base options themselves if nothing beats
+// them). Returns { options, extra, time }, extra being the candidate
+// flags added to the base options ('' for none). Only programs created
+// from source can be tuned.
+exports.tuneBuildOptions = function(queue, program, run, options) {
+    options = options || {};
+    var iterations = options.iterations || 3;
+    var tolerance = options.tolerance === undefined ? 1e-4 : options.tolerance;
+    var base = options.options || '';
+    var list = options.candidates || exports.buildOptionCandidates;
+    var device = queue.getInfo(QUEUE_DEVICE);
+    var ctx = program.getInfo(PROGRAM_CONTEXT);
+    var source = program.getInfo(PROGRAM_SOURCE);
+    if (!source)
+        throw new Error("only programs created from source can be tuned");
+
+    var tq = queue;
+    if (!(queue.getInfo(QUEUE_PROPERTIES) & QUEUE_PROFILING_ENABLE))
+        tq = ctx.createCommandQueue(device, QUEUE_PROFILING_ENABLE);
+
+    // Builds source with opts and returns the median kernel time and the
+    // result of the last run; throws if it doesn't build or run.
+    function measure(opts) {
+        var variant = ctx.createProgram(source);
+        variant._tuning = true;
+        variant.build([device], opts);
+        var times = [], out;
+        for (var n = 0; n <= iterations; n++) {
+            out = run(variant, tq);
+            tq.finish();
+            var t = 0;
+            for (var j = 0; j < out.events.length; j++)
+                t += out.events[j].getProfilingInfo(PROFILING_COMMAND_END) -
+                    out.events[j].getProfilingInfo(PROFILING_COMMAND_START);
+            // the first run pays the warm-up
+            if (n > 0)
+                times.push(t);
+        }
+        return { time: median(times), result: Array.prototype.slice.call(out.result) };
+    }
+
+    // The unmodified base options are the accuracy reference; without
+    // them there is nothing to check the candidates against.
+    var reference;
+    try {
+        reference = measure(base);
+    } catch (e) {
+        throw new Error("program does not build and run with its base options: " +
+                        (e && e.message));
+    }
+
+    base = base.trim();
+    var best = base, bestExtra = '', bestTime = reference.time;
+    for (var i = 0; i < list.length; i++) {
+        var extra = list[i].trim();
+        var opts = (base + ' ' + extra).trim();
+        if (!extra)
+            continue;
+        var m;
+        try {
+            m = measure(opts);
+        } catch (e) {
+            // unsupported option on this compiler
+            continue;
+        }
+        if (maxError(reference.result, m.result) > tolerance)
+            continue;
+        if (m.time < bestTime) {
+            bestTime = m.time;
+            best = opts;
+            bestExtra = extra;
+        }
+    }
+    var result = { options: best, extra: bestExtra, time: bestTime };
+    loadCache()[buildKey(device, program, base)] = result;
+    saveCache();
+    return result;
+};
+
+//  DOMString buildOptions(WebCLDevice device, WebCLProgram program,
+//                         DOMString options);
+//
+// options with the flags tuned on top of exactly these options for this
+// device and source appended, or unchanged if it was never tuned with them.
+exports.buildOptions = function(device, program, options) {
+    var key = buildKey(device, program, options);
+    var entry = key && loadCache()[key];
+    if (!entry || !entry.extra)
+        return options;
+    return ((options || '') + ' ' + entry.extra).trim();
+};
+
+//  void clear();
+exports.clear = function() {
+    cache = {};
+    saveCache();
+};
+
+exports.enabled = true;
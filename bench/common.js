@@ -0,0 +1,91 @@
+//
+// Helpers shared by the benchmarks in this directory
+//
+
+var fs = require('fs');
+var WebCL = require('../webcl');
+
+// Parses "--name value" pairs into a copy of defaults; numbers stay
+// numbers, --only takes a comma separated list.
+exports.parseArgs = function(argv, defaults) {
+    var opts = {};
+    for (var k in defaults)
+        opts[k] = defaults[k];
+    for (var i = 2; i < argv.length; i++) {
+        var m = /^--([a-z-]+)$/.exec(argv[i]);
+        var name = m && m[1].replace(/-([a-z])/g, function(s, c) { return c.toUpperCase(); });
+        if (!m || !(name in defaults))
+            throw new Error("unknown option " + argv[i]);
+        var v = argv[++i];
+        if (name == 'only')
+            opts.only = v.split(',');
+        else if (typeof defaults[name] == 'number')
+            opts[name] = parseInt(v, 10);
+        else
+            opts[name] = v;
+    }
+    return opts;
+};
+
+// milliseconds, with sub-millisecond resolution where the runtime has it
+exports.now = process.hrtime ? function() {
+    var t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+} : Date.now;
+
+// First device of the given type ("cpu", "gpu" or "all") on any platform.
+exports.pickDevice = function(type) {
+    var types = { cpu: WebCL.DEVICE_TYPE_CPU, gpu: WebCL.DEVICE_TYPE_GPU,
+                  all: WebCL.DEVICE_TYPE_ALL };
+    if (types[type] === undefined)
+        throw new Error("unknown device type " + type);
+    var platforms = WebCL.getPlatforms();
+    for (var i = 0; i < platforms.length; i++) {
+        try {
+            var devices = platforms[i].getDevices(types[type]);
+            if (devices.length > 0)
+                return { platform: platforms[i], device: devices[0] };
+        } catch (e) {
+            // no device of that type on this platform
+        }
+    }
+    throw new Error("no OpenCL device of type " + type);
+};
+
+// Context and profiling queue on the picked device.
+exports.setup = function(opts) {
+    var p = exports.pickDevice(opts.device);
+    var ctx = WebCL.createContext([WebCL.CONTEXT_PLATFORM, p.platform], [p.device]);
+    var queue = ctx.createCommandQueue(p.device, WebCL.QUEUE_PROFILING_ENABLE);
+    return { platform: p.platform, device: p.device, ctx: ctx, queue: queue };
+};
+
+// Header common to every report, so runs on different versions and
+// devices can be told apart.
+exports.report = function(env, opts) {
+    return {
+        date: new Date().toISOString(),
+        node: process.version,
+        binding: require('../package.json').version,
+        platform: env.platform.getInfo(WebCL.PLATFORM_NAME),
+        platformVersion: env.platform.getInfo(WebCL.PLATFORM_VERSION),
+        device: env.device.getInfo(WebCL.DEVICE_NAME),
+        driver: env.device.getInfo(WebCL.DRIVER_VERSION),
+        options: opts,
+        results: {}
+    };
+};
+
+exports.write = function(report, out) {
+    var json = JSON.stringify(report, null, 2);
+    if (out)
+        fs.writeFileSync(out, json + '\n');
+    else
+        console.log(json);
+};
+
+// Device time of an event in nanoseconds.
+exports.eventTime = function(ev) {
+    return ev.getProfilingInfo(WebCL.PROFILING_COMMAND_END) -
+        ev.getProfilingInfo(WebCL.PROFILING_COMMAND_START);
+};
@@ -0,0 +1,335 @@
+#!/usr/bin/env node
+//
+// Microbenchmarks for the binding itself
+//
+//   node bench/micro.js [--out results.json] [--device cpu|gpu|all]
+//                       [--max-size bytes] [--iterations n] [--only group,...]
+//
+// Groups:
+//   calls      per-call cost of the CLContext, WebCLKernel and
+//              WebCLCommandQueue methods on tiny arguments; the image
+//              methods and createSampler only run where the device has
+//              DEVICE_IMAGE_SUPPORT
+//   bandwidth  write/read/copy/map throughput from 4 B up to --max-size
+//              (1 GB by default, capped at DEVICE_MAX_MEM_ALLOC_SIZE)
+//   launch     empty kernel launch latency, host and device side
+//   alloc      event and wrapper allocation cost
+//
+// Left out of calls:
+//   enqueueNativeKernel   needs a function registered by a native addon
+//                         (registerNativeKernel) and a device with
+//                         EXEC_NATIVE_KERNEL, neither of which this
+//                         script can provide
+//   createImage3D         3D images are optional even with image support
+//
+// The JSON written to --out (stdout by default) carries the device and
+// binding versions, so two runs can be diffed to spot regressions. Any
+// OpenCL implementation works, including CPU-only ones and the mock
+// library in src/mock (node-waf configure --opencl-lib=mock).
+//
+
+var WebCL = require('../webcl');
+var common = require('./common');
+var now = common.now;
+
+var EMPTY_KERNEL = "__kernel void empty(__global uint *a, uint n) { }";
+
+// Runs fn iterations times after a short warm-up and reports the
+// mean per-call time in microseconds.
+function time(iterations, fn) {
+    for (var i = 0; i < Math.min(10, iterations); i++)
+        fn(i);
+    var start = now();
+    for (var i = 0; i < iterations; i++)
+        fn(i);
+    var total = now() - start;
+    return { iterations: iterations, totalMs: total, perCallUs: total * 1e3 / iterations };
+}
+
+function setup(opts) {
+    var env = common.setup(opts);
+    var program = env.ctx.createProgram(EMPTY_KERNEL);
+    program.build([env.device], "");
+    env.program = program;
+    env.kernel = program.createKernel("empty");
+    env.buf = env.ctx.createBuffer(WebCL.MEM_READ_WRITE, 4096);
+    env.kernel.setArg(0, env.buf, WebCL.types.MEMORY_OBJECT);
+    env.kernel.setArg(1, 0, WebCL.types.UINT);
+    return env;
+}
+
+function calls(env, opts) {
+    var n = opts.iterations;
+    var ctx = env.ctx, queue = env.queue, kernel = env.kernel, device = env.device;
+    var host = new Uint8Array(4);
+    var dst = ctx.createBuffer(WebCL.MEM_READ_WRITE, 4096);
+    var results = {};
+
+    // drain the queue now and then so commands don't pile up
+    function drained(fn) {
+        return function(i) {
+            var r = fn(i);
+            if (i % 64 == 63)
+                queue.finish();
+            return r;
+        };
+    }
+
+    results['CLContext.getInfo'] = time(n, function() {
+        ctx.getInfo(WebCL.CONTEXT_NUM_DEVICES);
+    });
+    results['CLContext.createBuffer'] = time(n, function() {
+        ctx.createBuffer(WebCL.MEM_READ_WRITE, 4);
+    });
+    results['CLContext.createCommandQueue'] = time(Math.min(n, 100), function() {
+        ctx.createCommandQueue(device, 0);
+    });
+    results['CLContext.createProgram'] = time(Math.min(n, 100), function() {
+        ctx.createProgram(EMPTY_KERNEL);
+    });
+    results['CLContext.createUserEvent'] = time(n, function() {
+        ctx.createUserEvent();
+    });
+
+    results['WebCLKernel.getInfo'] = time(n, function() {
+        kernel.getInfo(WebCL.KERNEL_FUNCTION_NAME);
+    });
+    results['WebCLKernel.getWorkGroupInfo'] = time(n, function() {
+        kernel.getWorkGroupInfo(device, WebCL.KERNEL_WORK_GROUP_SIZE);
+    });
+    results['WebCLKernel.setArg(UINT)'] = time(n, function(i) {
+        kernel.setArg(1, i, WebCL.types.UINT);
+    });
+    results['WebCLKernel.setArg(MEMORY_OBJECT)'] = time(n, function() {
+        kernel.setArg(0, env.buf, WebCL.types.MEMORY_OBJECT);
+    });
+
+    results['WebCLCommandQueue.getInfo'] = time(n, function() {
+        queue.getInfo(WebCL.QUEUE_CONTEXT);
+    });
+    results['WebCLCommandQueue.enqueueNDRangeKernel'] = time(n, drained(function() {
+        queue.enqueueNDRangeKernel(kernel, 1, [], [1], [], []);
+    }));
+    results['WebCLCommandQueue.enqueueTask'] = time(n, drained(function() {
+        queue.enqueueTask(kernel, []);
+    }));
+    results['WebCLCommandQueue.enqueueWriteBuffer'] = time(n, drained(function() {
+        queue.enqueueWriteBuffer(env.buf, false, 0, 4, host, []);
+    }));
+    results['WebCLCommandQueue.enqueueReadBuffer'] = time(n, drained(function() {
+        queue.enqueueReadBuffer(env.buf, false, 0, 4, host, []);
+    }));
+    results['WebCLCommandQueue.enqueueCopyBuffer'] = time(n, drained(function() {
+        queue.enqueueCopyBuffer(env.buf, dst, 0, 0, 4, []);
+    }));
+    results['WebCLCommandQueue.enqueueMapBuffer+Unmap'] = time(n, drained(function() {
+        var m = queue.enqueueMapBuffer(env.buf, true, WebCL.MAP_READ, 0, 4, []);
+        queue.enqueueUnmapMemObject(env.buf, m, []);
+    }));
+    results['WebCLCommandQueue.enqueueMarker'] = time(n, drained(function() {
+        queue.enqueueMarker();
+    }));
+    results['WebCLCommandQueue.enqueueBarrier'] = time(n, drained(function() {
+        queue.enqueueBarrier();
+    }));
+    // two 4 B rows at a 16 B row pitch
+    var origin = [0, 0, 0], region = [4, 2, 1], rectHost = new Uint8Array(32);
+    results['WebCLCommandQueue.enqueueWriteBufferRect'] = time(n, drained(function() {
+        queue.enqueueWriteBufferRect(env.buf, false, origin, origin, region,
+                                     16, 0, 16, 0, rectHost, []);
+    }));
+    results['WebCLCommandQueue.enqueueReadBufferRect'] = time(n, drained(function() {
+        queue.enqueueReadBufferRect(env.buf, false, origin, origin, region,
+                                    16, 0, 16, 0, rectHost, []);
+    }));
+    results['WebCLCommandQueue.enqueueCopyBufferRect'] = time(n, drained(function() {
+        queue.enqueueCopyBufferRect(env.buf, dst, origin, origin, region, 16, 0, 16, 0, []);
+    }));
+
+    if (device.getInfo(WebCL.DEVICE_IMAGE_SUPPORT))
+        images(env, n, drained, results);
+
+    var marker = queue.enqueueMarker();
+    results['WebCLCommandQueue.enqueueWaitForEvents'] = time(n, drained(function() {
+        queue.enqueueWaitForEvents([marker]);
+    }));
+    results['WebCLCommandQueue.flush'] = time(n, function() {
+        queue.flush();
+    });
+    results['WebCLCommandQueue.finish'] = time(n, function() {
+        queue.finish();
+    });
+    queue.finish();
+    return results;
+}
+
+// 2x2 RGBA8 images, 16 B per transfer
+function images(env, n, drained, results) {
+    var ctx = env.ctx, queue = env.queue;
+    var format = { cl_channel_order: WebCL.RGBA, cl_channel_type: WebCL.UNORM_INT8 };
+    var origin = [0, 0, 0], region = [2, 2, 1], host = new Uint8Array(16);
+    var img = ctx.createImage2D(WebCL.MEM_READ_WRITE, format, 2, 2, 0);
+    var img2 = ctx.createImage2D(WebCL.MEM_READ_WRITE, format, 2, 2, 0);
+
+    results['CLContext.getSupportedImageFormats'] = time(n, function() {
+        ctx.getSupportedImageFormats(WebCL.MEM_READ_WRITE, WebCL.MEM_OBJECT_IMAGE2D);
+    });
+    results['CLContext.createImage2D'] = time(n, function() {
+        ctx.createImage2D(WebCL.MEM_READ_WRITE, format, 2, 2, 0);
+    });
+    results['CLContext.createSampler'] = time(n, function() {
+        ctx.createSampler(false, WebCL.ADDRESS_CLAMP, WebCL.FILTER_NEAREST);
+    });
+
+    results['WebCLCommandQueue.enqueueWriteImage'] = time(n, drained(function() {
+        queue.enqueueWriteImage(img, false, origin, region, 0, 0, host, []);
+    }));
+    results['WebCLCommandQueue.enqueueReadImage'] = time(n, drained(function() {
+        queue.enqueueReadImage(img, false, origin, region, 0, 0, host, []);
+    }));
+    results['WebCLCommandQueue.enqueueCopyImage'] = time(n, drained(function() {
+        queue.enqueueCopyImage(img, img2, origin, origin, region, []);
+    }));
+    results['WebCLCommandQueue.enqueueCopyImageToBuffer'] = time(n, drained(function() {
+        queue.enqueueCopyImageToBuffer(img, env.buf, origin, region, 0, []);
+    }));
+    results['WebCLCommandQueue.enqueueCopyBufferToImage'] = time(n, drained(function() {
+        queue.enqueueCopyBufferToImage(env.buf, img, 0, origin, region, []);
+    }));
+    results['WebCLCommandQueue.enqueueMapImage+Unmap'] = time(n, drained(function() {
+        var m = queue.enqueueMapImage(img, true, WebCL.MAP_READ, origin, region, []);
+        queue.enqueueUnmapMemObject(img, m, []);
+    }));
+}
+
+function sizes(max) {
+    var s = [];
+    for (var size = 4; size <= max; size *= 4)
+        s.push(size);
+    return s;
+}
+
+// bytes per second, repeating small sizes up to ~64 MB per measurement
+function bandwidth(env, opts) {
+    var ctx = env.ctx, queue = env.queue;
+    var maxAlloc = env.device.getInfo(WebCL.DEVICE_MAX_MEM_ALLOC_SIZE);
+    var list = sizes(Math.min(opts.maxSize, maxAlloc));
+    var results = [];
+
+    for (var i = 0; i < list.length; i++) {
+        var size = list[i];
+        var host, a, b;
+        try {
+            host = new Uint8Array(size);
+            a = ctx.createBuffer(WebCL.MEM_READ_WRITE, size);
+            b = ctx.createBuffer(WebCL.MEM_READ_WRITE, size);
+        } catch (e) {
+            results.push({ bytes: size, error: e.message });
+            break;
+        }
+
+        var reps = Math.max(1, Math.min(opts.iterations, Math.floor((64 << 20) / size)));
+        var rate = function(fn) {
+            fn();
+            queue.finish();
+            var start = now();
+            for (var r = 0; r < reps; r++)
+                fn();
+            queue.finish();
+            var ms = now() - start;
+            return { bytesPerSec: size * reps / (ms / 1e3), usPerOp: ms * 1e3 / reps };
+        }
+
+        results.push({
+            bytes: size,
+            write: rate(function() { queue.enqueueWriteBuffer(a, false, 0, size, host, []); }),
+            read: rate(function() { queue.enqueueReadBuffer(a, false, 0, size, host, []); }),
+            copy: rate(function() { queue.enqueueCopyBuffer(a, b, 0, 0, size, []); }),
+            map: rate(function() {
+                var m = queue.enqueueMapBuffer(a, true, WebCL.MAP_READ | WebCL.MAP_WRITE,
+                                               0, size, []);
+                queue.enqueueUnmapMemObject(a, m, []);
+            })
+        });
+    }
+    return results;
+}
+
+// Host latency is enqueue + finish as seen from JS; device latency is
+// the profiled START..END of the same launches, in microseconds.
+function launch(env, opts) {
+    var queue = env.queue, kernel = env.kernel;
+    var n = Math.min(opts.iterations, 1000);
+    var host = [], device = [];
+
+    for (var i = 0; i < n; i++) {
+        var start = now();
+        var ev = queue.enqueueNDRangeKernel(kernel, 1, [], [1], [], []);
+        queue.finish();
+        host.push((now() - start) * 1e3);
+        device.push(common.eventTime(ev) / 1e3);
+    }
+    return { iterations: n, hostUs: summary(host), deviceUs: summary(device) };
+}
+
+function summary(values) {
+    values = values.slice().sort(function(a, b) { return a - b; });
+    var sum = 0;
+    for (var i = 0; i < values.length; i++)
+        sum += values[i];
+    function pct(p) {
+        return values[Math.min(values.length - 1, Math.floor(p * values.length))];
+    }
+    return { mean: sum / values.length, min: values[0], p50: pct(0.5),
+             p99: pct(0.99), max: values[values.length - 1] };
+}
+
+function alloc(env, opts) {
+    var ctx = env.ctx, queue = env.queue, n = opts.iterations;
+    var results = {};
+
+    // one event object per enqueue
+    results['event(marker)'] = time(n, function(i) {
+        queue.enqueueMarker();
+        if (i % 64 == 63)
+            queue.finish();
+    });
+    queue.finish();
+    results['event(user)'] = time(n, function() {
+        ctx.createUserEvent();
+    });
+    // wrapper and JS object, no device memory behind it yet
+    results['buffer(4 B)'] = time(n, function() {
+        ctx.createBuffer(WebCL.MEM_READ_WRITE, 4);
+    });
+    results['subBuffer'] = time(n, function() {
+        env.buf.createSubBuffer(WebCL.BUFFER_CREATE_TYPE_REGION, { origin: 0, size: 4 });
+    });
+    // lookup of an existing handle, no new wrapper
+    results['getInfo(QUEUE_CONTEXT)'] = time(n, function() {
+        queue.getInfo(WebCL.QUEUE_CONTEXT);
+    });
+    return results;
+}
+
+var groups = { calls: calls, bandwidth: bandwidth, launch: launch, alloc: alloc };
+
+function main() {
+    var opts = common.parseArgs(process.argv, { out: null, device: 'all', maxSize: 1 << 30,
+                                                iterations: 1000, only: null });
+    var env = setup(opts);
+    var report = common.report(env, opts);
+
+    for (var name in groups) {
+        if (opts.only && opts.only.indexOf(name) < 0)
+            continue;
+        try {
+            report.results[name] = groups[name](env, opts);
+        } catch (e) {
+            report.results[name] = { error: e.message };
+        }
+    }
+    common.write(report, opts.out);
+}
+
+main();
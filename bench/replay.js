@@ -0,0 +1,288 @@
+#!/usr/bin/env node
+//
+// Replays a capture made with WebCL.capture (see capture.js)
+//
+//   node bench/replay.js --trace capture.wclt [--out results.json]
+//                        [--device cpu|gpu|all] [--iterations n]
+//
+// Every recorded call is made again, as fast as possible, on the objects
+// the replay itself created. With --device, recorded platforms and devices
+// are replaced by the first device of that type, so a capture from one
+// machine runs on another (or on the mock library in src/mock). Arrays
+// recorded without their contents are replaced by zeroed arrays of the
+// same type and length.
+//
+// The report has the wall time of each pass, and per method the number of
+// calls, the recorded and the replayed host time and the calls that threw
+// where the recorded one did not. A capture whose last record was cut
+// short (the process died while writing it) is replayed up to that record.
+//
+
+var fs = require('fs');
+var WebCL = require('../webcl');
+var capture = require('../capture');
+var common = require('./common');
+var now = common.now;
+
+var V = capture.V;
+
+function Truncated() {
+}
+
+function Reader(buf) {
+    this.buf = buf;
+    this.pos = 0;
+}
+
+Reader.prototype.eof = function() {
+    return this.pos >= this.buf.length;
+};
+
+// Throws a Truncated if fewer than n bytes are left.
+Reader.prototype.need = function(n) {
+    if (this.pos + n > this.buf.length)
+        throw new Truncated();
+};
+
+Reader.prototype.u8 = function() {
+    this.need(1);
+    return this.buf[this.pos++];
+};
+
+Reader.prototype.u16 = function() {
+    this.need(2);
+    var v = this.buf.readUInt16LE(this.pos);
+    this.pos += 2;
+    return v;
+};
+
+Reader.prototype.u32 = function() {
+    this.need(4);
+    var v = this.buf.readUInt32LE(this.pos);
+    this.pos += 4;
+    return v;
+};
+
+Reader.prototype.f64 = function() {
+    this.need(8);
+    var v = this.buf.readDoubleLE(this.pos);
+    this.pos += 8;
+    return v;
+};
+
+Reader.prototype.bytes = function(n) {
+    this.need(n);
+    var b = this.buf.slice(this.pos, this.pos + n);
+    this.pos += n;
+    return b;
+};
+
+Reader.prototype.string = function() {
+    return this.bytes(this.u32()).toString('utf8');
+};
+
+// Recorded values are kept as trees so they can be decoded again on
+// every pass, against that pass's objects.
+function readValue(r) {
+    var tag = r.u8();
+    switch (tag) {
+    case V.UNDEFINED: return { tag: tag };
+    case V.NULL: return { tag: tag };
+    case V.FALSE: return { tag: tag };
+    case V.TRUE: return { tag: tag };
+    case V.FUNCTION: return { tag: tag };
+    case V.NUMBER: return { tag: tag, value: r.f64() };
+    case V.STRING: return { tag: tag, value: r.string() };
+    case V.JSON: return { tag: tag, value: JSON.parse(r.string()) };
+    case V.OPAQUE: return { tag: tag, value: r.string() };
+    case V.ARRAY:
+        var n = r.u32(), items = [];
+        for (var i = 0; i < n; i++)
+            items.push(readValue(r));
+        return { tag: tag, items: items };
+    case V.OBJECT: return { tag: tag, id: r.u32() };
+    case V.NEW_OBJECT: return { tag: tag, id: r.u32(), cls: r.u8() };
+    case V.TYPED:
+        var v = { tag: tag, type: r.u8(), length: r.u32() };
+        if (r.u8())
+            v.data = r.bytes(v.length);
+        return v;
+    default:
+        throw new Error("bad value tag " + tag + " at offset " + (r.pos - 1));
+    }
+}
+
+function load(file) {
+    var r = new Reader(fs.readFileSync(file));
+    if (r.bytes(4).toString('ascii') != capture.MAGIC)
+        throw new Error(file + " is not a WebCL capture");
+    var version = r.u32();
+    if (version < 1 || version > capture.VERSION)
+        throw new Error("unsupported capture version " + version);
+    var header = JSON.parse(r.bytes(r.u32()).toString('utf8'));
+
+    var names = [], calls = [], truncated = false;
+    while (!r.eof()) {
+        var offset = r.pos;
+        try {
+            var kind = r.u8();
+            if (kind == capture.REC_NAME) {
+                var idx = r.u16();
+                names[idx] = r.bytes(r.u16()).toString('utf8');
+            } else if (kind == capture.REC_CALL) {
+                var call = { target: r.u32(), name: names[r.u16()], start: r.f64(),
+                             duration: r.f64(), flags: r.u8(), args: [] };
+                var argc = r.u8();
+                for (var i = 0; i < argc; i++)
+                    call.args.push(readValue(r));
+                call.result = readValue(r);
+                calls.push(call);
+            } else {
+                throw new Error("bad record kind " + kind + " at offset " + offset);
+            }
+        } catch (e) {
+            if (!(e instanceof Truncated))
+                throw e;
+            console.error(file + ": last record, at offset " + offset + ", is cut short");
+            truncated = true;
+            break;
+        }
+    }
+    return { header: header, calls: calls, truncated: truncated };
+}
+
+function newArray(header, v) {
+    var type = header.arrayTypes[v.type];
+    var a;
+    if (type == 'Buffer') {
+        a = new Buffer(v.length);
+        a.fill(0);
+    } else {
+        var T = global[type];
+        a = new T(v.length / T.BYTES_PER_ELEMENT);
+    }
+    if (v.data) {
+        var u8 = type == 'Buffer' ? a : new Uint8Array(a.buffer, a.byteOffset, a.byteLength);
+        for (var i = 0; i < v.length; i++)
+            u8[i] = v.data[i];
+    }
+    return a;
+}
+
+function Pass(trace, opts) {
+    this.header = trace.header;
+    this.objects = { 0: WebCL.WebCL };
+    this.classes = {};
+    if (opts.device != 'recorded')
+        this.target = common.pickDevice(opts.device);
+}
+
+// Recorded platforms and devices are swapped for the target's.
+Pass.prototype.object = function(id) {
+    var cls = this.header.classes[this.classes[id]];
+    if (this.target && cls == 'WebCLPlatform')
+        return this.target.platform;
+    if (this.target && cls == 'WebCLDevice')
+        return this.target.device;
+    return this.objects[id];
+};
+
+Pass.prototype.decode = function(v) {
+    switch (v.tag) {
+    case V.UNDEFINED: return undefined;
+    case V.NULL: return null;
+    case V.FALSE: return false;
+    case V.TRUE: return true;
+    case V.FUNCTION: return function() {};
+    case V.NUMBER:
+    case V.STRING:
+    case V.JSON:
+        return v.value;
+    case V.ARRAY:
+        var self = this;
+        return v.items.map(function(item) { return self.decode(item); });
+    case V.OBJECT:
+        return this.object(v.id);
+    case V.NEW_OBJECT:
+        // first seen as an argument: made before the capture started
+        this.classes[v.id] = v.cls;
+        return this.object(v.id);
+    case V.TYPED:
+        return newArray(this.header, v);
+    case V.OPAQUE:
+        return {};
+    }
+};
+
+// Binds the objects a call returned to the ids they were recorded with.
+Pass.prototype.bind = function(v, actual) {
+    if (v.tag == V.NEW_OBJECT && actual && typeof actual == 'object') {
+        this.objects[v.id] = actual;
+        this.classes[v.id] = v.cls;
+    } else if (v.tag == V.ARRAY && actual && actual.length !== undefined) {
+        for (var i = 0; i < v.items.length && i < actual.length; i++)
+            this.bind(v.items[i], actual[i]);
+    }
+};
+
+Pass.prototype.run = function(calls, methods) {
+    var start = now();
+    for (var i = 0; i < calls.length; i++) {
+        var c = calls[i];
+        var m = methods[c.name] || (methods[c.name] = {
+            calls: 0, recordedMs: 0, replayedMs: 0, errors: 0, skipped: 0 });
+        var target = this.object(c.target);
+        if (!target || typeof target[c.name] != 'function') {
+            m.skipped++;
+            continue;
+        }
+        var args = [];
+        for (var j = 0; j < c.args.length; j++)
+            args.push(this.decode(c.args[j]));
+
+        var t = now(), result, threw = false;
+        try {
+            result = target[c.name].apply(target, args);
+        } catch (e) {
+            threw = true;
+        }
+        m.replayedMs += now() - t;
+        m.recordedMs += c.duration;
+        m.calls++;
+        if (threw && !(c.flags & capture.FLAG_THREW))
+            m.errors++;
+        if (!threw)
+            this.bind(c.result, result);
+    }
+    return now() - start;
+};
+
+function main() {
+    var opts = common.parseArgs(process.argv, {
+        trace: "", out: "", device: "recorded", iterations: 1
+    });
+    if (!opts.trace)
+        throw new Error("--trace is required");
+
+    var trace = load(opts.trace);
+    var report = {
+        date: new Date().toISOString(),
+        node: process.version,
+        binding: require('../package.json').version,
+        capture: trace.header,
+        options: opts,
+        calls: trace.calls.length,
+        truncated: trace.truncated,
+        recordedMs: trace.calls.length ?
+            trace.calls[trace.calls.length - 1].start + trace.calls[trace.calls.length - 1].duration : 0,
+        passes: [],
+        methods: {}
+    };
+    for (var i = 0; i < opts.iterations; i++) {
+        var pass = new Pass(trace, opts);
+        report.passes.push({ wallMs: pass.run(trace.calls, report.methods) });
+    }
+    common.write(report, opts.out);
+}
+
+main();
@@ -0,0 +1,639 @@
+#!/usr/bin/env node
+//
+// Application level benchmarks
+//
+//   node bench/workloads.js [--out results.json] [--device cpu|gpu|all]
+//                           [--iterations n] [--only sgemm,conv2d,...]
+//
+// Each workload uploads its inputs, runs its kernels and reads the
+// result back, and is checked against a reference computed in JS.
+// Per workload the report has:
+//
+//   wallMs     best end-to-end time (transfers, launches and waits)
+//   kernelMs   best total device time of its kernels (profiling events)
+//   gflops     useful flops / kernelMs
+//   gbps       minimal device memory traffic / kernelMs
+//   maxError   largest relative error against the reference
+//   verified   maxError within the workload's tolerance
+//
+// Verification is expected to fail on the mock library, which does not
+// execute kernels.
+//
+
+var WebCL = require('../webcl');
+var common = require('./common');
+var now = common.now;
+
+var T = WebCL.types;
+
+// deterministic inputs, so every run checks the same data
+function random(seed) {
+    var s = seed >>> 0;
+    return function() {
+        s = (mul32(s, 1103515245) + 12345) >>> 0;
+        return s / 4294967296;
+    };
+}
+
+function fill(array, rand, scale) {
+    for (var i = 0; i < array.length; i++)
+        array[i] = rand() * scale;
+    return array;
+}
+
+function relError(a, b) {
+    var err = Math.abs(a - b);
+    return err / Math.max(Math.abs(b), 1);
+}
+
+function maxError(result, reference) {
+    var max = 0;
+    for (var i = 0; i < reference.length; i++) {
+        var e = relError(result[i], reference[i]);
+        if (!(e <= max))
+            max = e;	// NaN sticks
+    }
+    return max;
+}
+
+function build(env, source, options) {
+    var program = env.ctx.createProgram(source);
+    try {
+        program.build([env.device], options || "");
+    } catch (e) {
+        throw new Error(e.message + "\n" +
+                        program.getBuildInfo(env.device, WebCL.PROGRAM_BUILD_LOG));
+    }
+    return program;
+}
+
+function buffer(env, array) {
+    return env.ctx.createBuffer(WebCL.MEM_READ_WRITE, array.byteLength);
+}
+
+function write(env, buf, array) {
+    env.queue.enqueueWriteBuffer(buf, false, 0, array.byteLength, array, []);
+}
+
+function read(env, buf, array) {
+    env.queue.enqueueReadBuffer(buf, true, 0, array.byteLength, array, []);
+}
+
+function setArgs(kernel, args) {
+    for (var i = 0; i < args.length; i++)
+        kernel.setArg(i, args[i][0], args[i][1]);
+}
+
+// Largest power of two square tile that fits the kernel's work-group limit.
+function tileSize(env, kernel, max) {
+    var limit = kernel.getWorkGroupInfo(env.device, WebCL.KERNEL_WORK_GROUP_SIZE);
+    var tile = max;
+    while (tile > 1 && tile * tile > limit)
+        tile /= 2;
+    return tile;
+}
+
+function groupSize(env, kernel, max) {
+    var limit = kernel.getWorkGroupInfo(env.device, WebCL.KERNEL_WORK_GROUP_SIZE);
+    var size = max;
+    while (size > 1 && size > limit)
+        size /= 2;
+    return size;
+}
+
+//
+// Tiled SGEMM, C = A * B for square N x N matrices
+//
+
+var SGEMM = [
+    "__kernel void sgemm(__global const float *A, __global const float *B,",
+    "                    __global float *C, uint N)",
+    "{",
+    "    __local float As[TILE][TILE];",
+    "    __local float Bs[TILE][TILE];",
+    "    uint col = get_global_id(0), row = get_global_id(1);",
+    "    uint lx = get_local_id(0), ly = get_local_id(1);",
+    "    float acc = 0.0f;",
+    "    for (uint t = 0; t < N; t += TILE) {",
+    "        As[ly][lx] = A[row * N + t + lx];",
+    "        Bs[ly][lx] = B[(t + ly) * N + col];",
+    "        barrier(CLK_LOCAL_MEM_FENCE);",
+    "        for (uint k = 0; k < TILE; k++)",
+    "            acc += As[ly][k] * Bs[k][lx];",
+    "        barrier(CLK_LOCAL_MEM_FENCE);",
+    "    }",
+    "    C[row * N + col] = acc;",
+    "}"
+].join("\n");
+
+var sgemm = {
+    tolerance: 1e-3,
+
+    setup: function(env) {
+        var N = 512;
+        // the tile has to be known at compile time; probe with the largest
+        var probe = build(env, SGEMM, "-D TILE=16").createKernel("sgemm");
+        var tile = tileSize(env, probe, 16);
+        var kernel = tile == 16 ? probe :
+            build(env, SGEMM, "-D TILE=" + tile).createKernel("sgemm");
+        var rand = random(1);
+        var s = { N: N, tile: tile, kernel: kernel,
+                  A: fill(new Float32Array(N * N), rand, 1),
+                  B: fill(new Float32Array(N * N), rand, 1),
+                  C: new Float32Array(N * N) };
+        s.a = buffer(env, s.A);
+        s.b = buffer(env, s.B);
+        s.c = buffer(env, s.C);
+        setArgs(kernel, [[s.a, T.MEMORY_OBJECT], [s.b, T.MEMORY_OBJECT],
+                         [s.c, T.MEMORY_OBJECT], [N, T.UINT]]);
+        s.flops = 2 * N * N * N;
+        s.bytes = 3 * N * N * 4;
+        return s;
+    },
+
+    run: function(env, s) {
+        write(env, s.a, s.A);
+        write(env, s.b, s.B);
+        var ev = env.queue.enqueueNDRangeKernel(s.kernel, 2, [], [s.N, s.N],
+                                                [s.tile, s.tile], []);
+        read(env, s.c, s.C);
+        return [ev];
+    },
+
+    check: function(s) {
+        var N = s.N, A = s.A, B = s.B, C = s.C, max = 0;
+        var row = new Float64Array(N);
+        for (var i = 0; i < N; i++) {
+            for (var j = 0; j < N; j++)
+                row[j] = 0;
+            for (var k = 0; k < N; k++) {
+                var a = A[i * N + k];
+                for (var j = 0; j < N; j++)
+                    row[j] += a * B[k * N + j];
+            }
+            for (var j = 0; j < N; j++) {
+                var e = relError(C[i * N + j], row[j]);
+                if (!(e <= max))
+                    max = e;
+            }
+        }
+        return max;
+    }
+};
+
+//
+// 2D convolution with a (2R+1)^2 filter, clamped at the edges
+//
+
+var CONV2D = [
+    "__kernel void conv2d(__global const float *in, __global float *out,",
+    "                     __constant float *filter, uint W, uint H, int R)",
+    "{",
+    "    int x = get_global_id(0), y = get_global_id(1);",
+    "    if (x >= W || y >= H)",
+    "        return;",
+    "    float acc = 0.0f;",
+    "    for (int dy = -R; dy <= R; dy++)",
+    "        for (int dx = -R; dx <= R; dx++) {",
+    "            int sx = clamp(x + dx, 0, (int)W - 1), sy = clamp(y + dy, 0, (int)H - 1);",
+    "            acc += in[sy * W + sx] * filter[(dy + R) * (2 * R + 1) + dx + R];",
+    "        }",
+    "    out[y * W + x] = acc;",
+    "}"
+].join("\n");
+
+var conv2d = {
+    tolerance: 1e-4,
+
+    setup: function(env) {
+        var W = 2048, H = 2048, R = 2, F = 2 * R + 1;
+        var kernel = build(env, CONV2D).createKernel("conv2d");
+        var rand = random(2);
+        var s = { W: W, H: H, R: R, kernel: kernel,
+                  input: fill(new Float32Array(W * H), rand, 1),
+                  filter: fill(new Float32Array(F * F), rand, 1 / (F * F)),
+                  output: new Float32Array(W * H) };
+        s.in = buffer(env, s.input);
+        s.out = buffer(env, s.output);
+        s.f = buffer(env, s.filter);
+        setArgs(kernel, [[s.in, T.MEMORY_OBJECT], [s.out, T.MEMORY_OBJECT],
+                         [s.f, T.MEMORY_OBJECT], [W, T.UINT], [H, T.UINT], [R, T.INT]]);
+        s.local = tileSize(env, kernel, 16);
+        s.flops = 2 * W * H * F * F;
+        s.bytes = 2 * W * H * 4;
+        return s;
+    },
+
+    run: function(env, s) {
+        write(env, s.in, s.input);
+        write(env, s.f, s.filter);
+        var ev = env.queue.enqueueNDRangeKernel(s.kernel, 2, [], [s.W, s.H],
+                                                [s.local, s.local], []);
+        read(env, s.out, s.output);
+        return [ev];
+    },
+
+    check: function(s) {
+        var W = s.W, H = s.H, R = s.R, F = 2 * R + 1, max = 0;
+        for (var y = 0; y < H; y++) {
+            for (var x = 0; x < W; x++) {
+                var acc = 0;
+                for (var dy = -R; dy <= R; dy++) {
+                    var sy = Math.min(Math.max(y + dy, 0), H - 1);
+                    for (var dx = -R; dx <= R; dx++) {
+                        var sx = Math.min(Math.max(x + dx, 0), W - 1);
+                        acc += s.input[sy * W + sx] * s.filter[(dy + R) * F + dx + R];
+                    }
+                }
+                var e = relError(s.output[y * W + x], acc);
+                if (!(e <= max))
+                    max = e;
+            }
+        }
+        return max;
+    }
+};
+
+//
+// Parallel sum: one partial sum per work-group, finished on the host
+//
+
+var REDUCE = [
+    "__kernel void reduce(__global const float *in, __global float *partial,",
+    "                     __local float *scratch, uint n)",
+    "{",
+    "    uint lid = get_local_id(0);",
+    "    float sum = 0.0f;",
+    "    for (uint i = get_global_id(0); i < n; i += get_global_size(0))",
+    "        sum += in[i];",
+    "    scratch[lid] = sum;",
+    "    barrier(CLK_LOCAL_MEM_FENCE);",
+    "    for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {",
+    "        if (lid < s)",
+    "            scratch[lid] += scratch[lid + s];",
+    "        barrier(CLK_LOCAL_MEM_FENCE);",
+    "    }",
+    "    if (lid == 0)",
+    "        partial[get_group_id(0)] = scratch[0];",
+    "}"
+].join("\n");
+
+var reduction = {
+    tolerance: 1e-4,
+
+    setup: function(env) {
+        var n = 16 << 20, groups = 256;
+        var kernel = build(env, REDUCE).createKernel("reduce");
+        var local = groupSize(env, kernel, 256);
+        var s = { n: n, groups: groups, local: local, kernel: kernel,
+                  input: fill(new Float32Array(n), random(3), 1),
+                  partial: new Float32Array(groups) };
+        s.in = buffer(env, s.input);
+        s.out = buffer(env, s.partial);
+        setArgs(kernel, [[s.in, T.MEMORY_OBJECT], [s.out, T.MEMORY_OBJECT],
+                         [local * 4, T.LOCAL_MEMORY_SIZE], [n, T.UINT]]);
+        s.flops = n;
+        s.bytes = n * 4;
+        return s;
+    },
+
+    run: function(env, s) {
+        write(env, s.in, s.input);
+        var ev = env.queue.enqueueNDRangeKernel(s.kernel, 1, [], [s.groups * s.local],
+                                                [s.local], []);
+        read(env, s.out, s.partial);
+        var sum = 0;
+        for (var i = 0; i < s.groups; i++)
+            sum += s.partial[i];
+        s.sum = sum;
+        return [ev];
+    },
+
+    check: function(s) {
+        var sum = 0;
+        for (var i = 0; i < s.n; i++)
+            sum += s.input[i];
+        return relError(s.sum, sum);
+    }
+};
+
+//
+// Exclusive prefix sum: scan within work-groups, scan the group totals on
+// the host, then add each group's offset
+//
+
+var SCAN = [
+    "__kernel void scan_block(__global const uint *in, __global uint *out,",
+    "                         __global uint *sums, __local uint *tmp, uint n)",
+    "{",
+    "    uint gid = get_global_id(0), lid = get_local_id(0), L = get_local_size(0);",
+    "    uint v = gid < n ? in[gid] : 0;",
+    "    tmp[lid] = v;",
+    "    barrier(CLK_LOCAL_MEM_FENCE);",
+    "    for (uint off = 1; off < L; off <<= 1) {",
+    "        uint t = lid >= off ? tmp[lid - off] : 0;",
+    "        barrier(CLK_LOCAL_MEM_FENCE);",
+    "        tmp[lid] += t;",
+    "        barrier(CLK_LOCAL_MEM_FENCE);",
+    "    }",
+    "    if (gid < n)",
+    "        out[gid] = tmp[lid] - v;",
+    "    if (lid == L - 1)",
+    "        sums[get_group_id(0)] = tmp[lid];",
+    "}",
+    "",
+    "__kernel void scan_add(__global uint *out, __global const uint *offsets, uint n)",
+    "{",
+    "    uint gid = get_global_id(0);",
+    "    if (gid < n)",
+    "        out[gid] += offsets[get_group_id(0)];",
+    "}"
+].join("\n");
+
+var scan = {
+    tolerance: 0,
+
+    setup: function(env) {
+        var n = 4 << 20;
+        var program = build(env, SCAN);
+        var block = program.createKernel("scan_block");
+        var add = program.createKernel("scan_add");
+        var local = groupSize(env, block, 256);
+        var groups = Math.ceil(n / local);
+        var rand = random(4);
+        var s = { n: n, local: local, groups: groups, block: block, add: add,
+                  input: new Uint32Array(n), output: new Uint32Array(n),
+                  sums: new Uint32Array(groups) };
+        for (var i = 0; i < n; i++)
+            s.input[i] = Math.floor(rand() * 16);
+        s.in = buffer(env, s.input);
+        s.out = buffer(env, s.output);
+        s.totals = buffer(env, s.sums);
+        setArgs(block, [[s.in, T.MEMORY_OBJECT], [s.out, T.MEMORY_OBJECT],
+                        [s.totals, T.MEMORY_OBJECT], [local * 4, T.LOCAL_MEMORY_SIZE],
+                        [n, T.UINT]]);
+        setArgs(add, [[s.out, T.MEMORY_OBJECT], [s.totals, T.MEMORY_OBJECT], [n, T.UINT]]);
+        s.flops = 2 * n;
+        s.bytes = 4 * n * 4;
+        return s;
+    },
+
+    run: function(env, s) {
+        var global = [s.groups * s.local];
+        write(env, s.in, s.input);
+        var ev1 = env.queue.enqueueNDRangeKernel(s.block, 1, [], global, [s.local], []);
+        read(env, s.totals, s.sums);
+        for (var i = 0, acc = 0; i < s.groups; i++) {
+            var t = s.sums[i];
+            s.sums[i] = acc;
+            acc = (acc + t) >>> 0;
+        }
+        write(env, s.totals, s.sums);
+        var ev2 = env.queue.enqueueNDRangeKernel(s.add, 1, [], global, [s.local], []);
+        read(env, s.out, s.output);
+        return [ev1, ev2];
+    },
+
+    check: function(s) {
+        for (var i = 0, acc = 0; i < s.n; i++) {
+            if (s.output[i] !== acc)
+                return 1;
+            acc = (acc + s.input[i]) >>> 0;
+        }
+        return 0;
+    }
+};
+
+//
+// All-pairs N-body, one time step
+//
+
+var NBODY = [
+    "__kernel void nbody(__global const float4 *pos, __global const float4 *vel,",
+    "                    __global float4 *newPos, __global float4 *newVel,",
+    "                    uint n, float dt, float eps2)",
+    "{",
+    "    uint i = get_global_id(0);",
+    "    if (i >= n)",
+    "        return;",
+    "    float4 p = pos[i];",
+    "    float4 a = (float4)(0.0f);",
+    "    for (uint j = 0; j < n; j++) {",
+    "        float4 q = pos[j];",
+    "        float4 d = q - p;",
+    "        d.w = 0.0f;",
+    "        float inv = rsqrt(d.x * d.x + d.y * d.y + d.z * d.z + eps2);",
+    "        a += d * (q.w * inv * inv * inv);",
+    "    }",
+    "    float4 v = vel[i] + a * dt;",
+    "    float4 np = p + v * dt;",
+    "    np.w = p.w;",
+    "    newPos[i] = np;",
+    "    newVel[i] = v;",
+    "}"
+].join("\n");
+
+var nbody = {
+    tolerance: 1e-3,
+
+    setup: function(env) {
+        var n = 4096;
+        var kernel = build(env, NBODY).createKernel("nbody");
+        var rand = random(5);
+        var s = { n: n, dt: 0.01, eps2: 0.01, kernel: kernel,
+                  pos: new Float32Array(n * 4), vel: new Float32Array(n * 4),
+                  newPos: new Float32Array(n * 4), newVel: new Float32Array(n * 4) };
+        for (var i = 0; i < n; i++) {
+            for (var k = 0; k < 3; k++) {
+                s.pos[i * 4 + k] = rand() * 2 - 1;
+                s.vel[i * 4 + k] = (rand() * 2 - 1) * 0.1;
+            }
+            s.pos[i * 4 + 3] = 1 / n;
+        }
+        s.p = buffer(env, s.pos);
+        s.v = buffer(env, s.vel);
+        s.np = buffer(env, s.newPos);
+        s.nv = buffer(env, s.newVel);
+        setArgs(kernel, [[s.p, T.MEMORY_OBJECT], [s.v, T.MEMORY_OBJECT],
+                         [s.np, T.MEMORY_OBJECT], [s.nv, T.MEMORY_OBJECT],
+                         [n, T.UINT], [s.dt, T.FLOAT], [s.eps2, T.FLOAT]]);
+        s.local = groupSize(env, kernel, 256);
+        s.flops = 20 * n * n;
+        s.bytes = 4 * n * 16;
+        return s;
+    },
+
+    run: function(env, s) {
+        write(env, s.p, s.pos);
+        write(env, s.v, s.vel);
+        var ev = env.queue.enqueueNDRangeKernel(s.kernel, 1, [], [s.n], [s.local], []);
+        read(env, s.np, s.newPos);
+        return [ev];
+    },
+
+    check: function(s) {
+        var n = s.n, pos = s.pos, ref = new Float64Array(n * 4);
+        for (var i = 0; i < n; i++) {
+            var ax = 0, ay = 0, az = 0;
+            var px = pos[i * 4], py = pos[i * 4 + 1], pz = pos[i * 4 + 2];
+            for (var j = 0; j < n; j++) {
+                var dx = pos[j * 4] - px, dy = pos[j * 4 + 1] - py, dz = pos[j * 4 + 2] - pz;
+                var inv = 1 / Math.sqrt(dx * dx + dy * dy + dz * dz + s.eps2);
+                var f = pos[j * 4 + 3] * inv * inv * inv;
+                ax += dx * f;
+                ay += dy * f;
+                az += dz * f;
+            }
+            ref[i * 4] = px + (s.vel[i * 4] + ax * s.dt) * s.dt;
+            ref[i * 4 + 1] = py + (s.vel[i * 4 + 1] + ay * s.dt) * s.dt;
+            ref[i * 4 + 2] = pz + (s.vel[i * 4 + 2] + az * s.dt) * s.dt;
+            ref[i * 4 + 3] = pos[i * 4 + 3];
+        }
+        return maxError(s.newPos, ref);
+    }
+};
+
+//
+// Monte Carlo pricing of a European call (geometric Brownian motion,
+// xorshift32 + Box-Muller per work-item)
+//
+
+var MONTECARLO = [
+    "uint xorshift(uint *s)",
+    "{",
+    "    uint x = *s;",
+    "    x ^= x << 13;",
+    "    x ^= x >> 17;",
+    "    x ^= x << 5;",
+    "    *s = x;",
+    "    return x;",
+    "}",
+    "",
+    "__kernel void mc_call(__global float *sums, uint paths, float S0, float K,",
+    "                      float r, float sigma, float T, uint seed)",
+    "{",
+    "    uint id = get_global_id(0);",
+    "    uint s = seed ^ (id * 2654435761u);",
+    "    if (s == 0)",
+    "        s = 1;",
+    "    float drift = (r - 0.5f * sigma * sigma) * T, vol = sigma * sqrt(T);",
+    "    float sum = 0.0f;",
+    "    for (uint i = 0; i < paths; i += 2) {",
+    "        float u1 = ((xorshift(&s) >> 8) + 0.5f) / 16777216.0f;",
+    "        float u2 = ((xorshift(&s) >> 8) + 0.5f) / 16777216.0f;",
+    "        float rad = sqrt(-2.0f * log(u1)), th = 2.0f * M_PI_F * u2;",
+    "        sum += fmax(S0 * exp(drift + vol * rad * cos(th)) - K, 0.0f);",
+    "        sum += fmax(S0 * exp(drift + vol * rad * sin(th)) - K, 0.0f);",
+    "    }",
+    "    sums[id] = sum;",
+    "}"
+].join("\n");
+
+// 32 bit unsigned multiply without Math.imul
+function mul32(a, b) {
+    var lo = (a & 0xffff) * b;
+    var hi = ((a >>> 16) * b) & 0xffff;
+    return (lo + hi * 65536) >>> 0;
+}
+
+var montecarlo = {
+    tolerance: 1e-3,
+
+    setup: function(env) {
+        var items = 64 * 1024, paths = 64;
+        var kernel = build(env, MONTECARLO).createKernel("mc_call");
+        var s = { items: items, paths: paths, S0: 100, K: 105, r: 0.05, sigma: 0.2,
+                  T: 1, seed: 12345, kernel: kernel, sums: new Float32Array(items) };
+        s.out = buffer(env, s.sums);
+        setArgs(kernel, [[s.out, T.MEMORY_OBJECT], [paths, T.UINT], [s.S0, T.FLOAT],
+                         [s.K, T.FLOAT], [s.r, T.FLOAT], [s.sigma, T.FLOAT],
+                         [s.T, T.FLOAT], [s.seed, T.UINT]]);
+        s.local = groupSize(env, kernel, 256);
+        // rng, Box-Muller and payoff, roughly 20 flops per path
+        s.flops = 20 * items * paths;
+        s.bytes = items * 4;
+        return s;
+    },
+
+    run: function(env, s) {
+        var ev = env.queue.enqueueNDRangeKernel(s.kernel, 1, [], [s.items], [s.local], []);
+        read(env, s.out, s.sums);
+        var sum = 0;
+        for (var i = 0; i < s.items; i++)
+            sum += s.sums[i];
+        s.price = Math.exp(-s.r * s.T) * sum / (s.items * s.paths);
+        return [ev];
+    },
+
+    check: function(s) {
+        var drift = (s.r - 0.5 * s.sigma * s.sigma) * s.T, vol = s.sigma * Math.sqrt(s.T);
+        var sum = 0;
+        for (var id = 0; id < s.items; id++) {
+            var st = (s.seed ^ mul32(id, 2654435761)) >>> 0;
+            if (st == 0)
+                st = 1;
+            var next = function() {
+                st = (st ^ (st << 13)) >>> 0;
+                st = (st ^ (st >>> 17)) >>> 0;
+                st = (st ^ (st << 5)) >>> 0;
+                return ((st >>> 8) + 0.5) / 16777216;
+            };
+            for (var i = 0; i < s.paths; i += 2) {
+                var u1 = next(), u2 = next();
+                var rad = Math.sqrt(-2 * Math.log(u1)), th = 2 * Math.PI * u2;
+                sum += Math.max(s.S0 * Math.exp(drift + vol * rad * Math.cos(th)) - s.K, 0);
+                sum += Math.max(s.S0 * Math.exp(drift + vol * rad * Math.sin(th)) - s.K, 0);
+            }
+        }
+        return relError(s.price, Math.exp(-s.r * s.T) * sum / (s.items * s.paths));
+    }
+};
+
+var workloads = { sgemm: sgemm, conv2d: conv2d, reduction: reduction, scan: scan,
+                  nbody: nbody, montecarlo: montecarlo };
+
+function measure(env, w, opts) {
+    var s = w.setup(env);
+    w.run(env, s);	// warm-up, also compiles lazily on some drivers
+    var wall = Infinity, kernel = Infinity;
+    for (var i = 0; i < opts.iterations; i++) {
+        var start = now();
+        var events = w.run(env, s);
+        env.queue.finish();
+        wall = Math.min(wall, now() - start);
+        var ns = 0;
+        for (var j = 0; j < events.length; j++)
+            ns += common.eventTime(events[j]);
+        kernel = Math.min(kernel, ns / 1e6);
+    }
+    var err = w.check(s);
+    return {
+        wallMs: wall,
+        kernelMs: kernel,
+        gflops: s.flops / (kernel * 1e6),
+        gbps: s.bytes / (kernel * 1e6),
+        endToEndGflops: s.flops / (wall * 1e6),
+        maxError: err,
+        verified: err <= w.tolerance
+    };
+}
+
+function main() {
+    var opts = common.parseArgs(process.argv, { out: null, device: 'all',
+                                                iterations: 5, only: null });
+    var env = common.setup(opts);
+    var report = common.report(env, opts);
+
+    for (var name in workloads) {
+        if (opts.only && opts.only.indexOf(name) < 0)
+            continue;
+        try {
+            report.results[name] = measure(env, workloads[name], opts);
+        } catch (e) {
+            report.results[name] = { error: e.message };
+        }
+    }
+    common.write(report, opts.out);
+}
+
+main();
@@ -0,0 +1,444 @@
+//
+// API call capture
+//
+// capture.start(path, options) records every WebCL call made from then on
+// (the arguments, the objects each call returns and its host time) into a
+// compact binary file, until capture.stop(). bench/replay.js plays such a
+// file back against any device, or the mock library in src/mock, at full
+// speed. Setting WEBCL_CAPTURE=path in the environment starts a capture
+// when the binding is loaded and stops it at exit.
+//
+// Typed array and Buffer arguments are recorded with their contents when
+// options.contents is set, or when they are at most SMALL_ARRAY bytes (as
+// kernel argument values are); otherwise only their type and length are
+// kept and the replayer passes zeroed arrays. Objects created before the
+// capture started can't be replayed, so start it before creating any.
+//
+// Calls made from inside another captured call (e.g. the getInfo done by
+// enqueueNDRangeKernel's autotuning) are not recorded, and neither are
+// the commands a WebCLSubmitter thread reads from its ring. Methods in
+// UNWRAPPED return JS objects the replayer can't rebuild, so the calls
+// they make are recorded instead (createMirroredBuffer's createBuffer,
+// and the writes of each WebCLMirror sync).
+//
+// Recording never changes what a call returns or throws: if a record
+// can't be written the capture stops, and capture.error() reports why.
+// Records reach the file whole, so a capture that stopped early still
+// ends at a record boundary.
+//
+// File layout, all little endian:
+//
+//   "WCLT" u32 version  u32 length  JSON header of that length
+//   records:
+//     u8 REC_NAME  u16 index  u16 length  utf8       method name
+//     u8 REC_CALL  u32 target  u16 name  f64 start  f64 duration
+//                  u8 flags  u8 argc  argc values  result value
+//
+// Times are in milliseconds from the start of the capture. Target 0 is
+// the WebCL object itself; every other object gets an id the first time
+// it is seen. A value is a u8 tag followed by:
+//
+//   V_UNDEFINED, V_NULL, V_FALSE, V_TRUE, V_FUNCTION   nothing
+//   V_NUMBER      f64
+//   V_STRING      u32 length  utf8
+//   V_JSON        u32 length  utf8 JSON (plain objects)
+//   V_OPAQUE      u32 length  utf8 constructor name (any other object)
+//   V_ARRAY       u32 n  n values
+//   V_OBJECT      u32 id (seen before)
+//   V_NEW_OBJECT  u32 id  u8 class (index into header.classes)
+//   V_TYPED       u8 type (index into header.arrayTypes)  u32 byteLength
+//                 u8 hasData  [byteLength bytes]
+//
+
+var fs = require('fs');
+var cl = require('_webcl');
+
+var MAGIC = 'WCLT';
+var VERSION = 2;
+var SMALL_ARRAY = 256;
+var CHUNK = 64 * 1024;
+
+var REC_NAME = 1;
+var REC_CALL = 2;
+
+var FLAG_THREW = 1;
+
+var V_UNDEFINED = 0;
+var V_NULL = 1;
+var V_FALSE = 2;
+var V_TRUE = 3;
+var V_NUMBER = 4;
+var V_STRING = 5;
+var V_ARRAY = 6;
+var V_OBJECT = 7;
+var V_NEW_OBJECT = 8;
+var V_TYPED = 9;
+var V_JSON = 10;
+var V_FUNCTION = 11;
+var V_OPAQUE = 12;
+
+var UNWRAPPED = ['createMirroredBuffer'];
+
+var classes = ['WebCL', 'WebCLPlatform', 'WebCLDevice', 'WebCLContext',
+               'WebCLCommandQueue', 'WebCLMemoryObject', 'WebCLProgram',
+               'WebCLKernel', 'WebCLEvent', 'WebCLSampler', 'WebCLSubmitter'];
+
+// index 0 is node's Buffer
+var arrayTypes = ['Buffer', 'Int8Array', 'Uint8Array', 'Int16Array', 'Uint16Array',
+                  'Int32Array', 'Uint32Array', 'Float32Array', 'Float64Array'];
+
+exports.MAGIC = MAGIC;
+exports.VERSION = VERSION;
+exports.REC_NAME = REC_NAME;
+exports.REC_CALL = REC_CALL;
+exports.FLAG_THREW = FLAG_THREW;
+exports.V = { UNDEFINED: V_UNDEFINED, NULL: V_NULL, FALSE: V_FALSE, TRUE: V_TRUE,
+              NUMBER: V_NUMBER, STRING: V_STRING, ARRAY: V_ARRAY, OBJECT: V_OBJECT,
+              NEW_OBJECT: V_NEW_OBJECT, TYPED: V_TYPED, JSON: V_JSON, FUNCTION: V_FUNCTION,
+              OPAQUE: V_OPAQUE };
+exports.classes = classes;
+exports.arrayTypes = arrayTypes;
+
+var now = process.hrtime ? function() {
+    var t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+} : Date.now;
+
+//
+// Buffered file writer
+//
+// Only the bytes before this.start, the records already ended, are
+// written out; the one being encoded stays in the buffer, which grows if
+// it doesn't fit, until end() or it is dropped by cancel().
+//
+
+function Writer(fd) {
+    this.fd = fd;
+    this.buf = new Buffer(CHUNK);
+    this.pos = 0;
+    this.start = 0;
+}
+
+Writer.prototype.end = function() {
+    this.start = this.pos;
+};
+
+Writer.prototype.cancel = function() {
+    this.pos = this.start;
+};
+
+Writer.prototype.flush = function() {
+    var n = this.start;
+    for (var done = 0; done < n; )
+        done += fs.writeSync(this.fd, this.buf, done, n - done, null);
+    if (n > 0 && this.pos > n)
+        this.buf.copy(this.buf, 0, n, this.pos);
+    this.pos -= n;
+    this.start = 0;
+};
+
+Writer.prototype.reserve = function(n) {
+    if (this.pos + n <= this.buf.length)
+        return;
+    this.flush();
+    if (this.pos + n > this.buf.length) {
+        var grown = new Buffer(Math.max(this.buf.length * 2, this.pos + n));
+        this.buf.copy(grown, 0, 0, this.pos);
+        this.buf = grown;
+    }
+};
+
+Writer.prototype.u8 = function(v) {
+    this.reserve(1);
+    this.buf[this.pos++] = v;
+};
+
+Writer.prototype.u16 = function(v) {
+    this.reserve(2);
+    this.buf.writeUInt16LE(v, this.pos);
+    this.pos += 2;
+};
+
+Writer.prototype.u32 = function(v) {
+    this.reserve(4);
+    this.buf.writeUInt32LE(v, this.pos);
+    this.pos += 4;
+};
+
+Writer.prototype.f64 = function(v) {
+    this.reserve(8);
+    this.buf.writeDoubleLE(v, this.pos);
+    this.pos += 8;
+};
+
+Writer.prototype.bytes = function(b) {
+    this.reserve(b.length);
+    b.copy(this.buf, this.pos);
+    this.pos += b.length;
+};
+
+Writer.prototype.string = function(s) {
+    var b = new Buffer(s, 'utf8');
+    this.u32(b.length);
+    this.bytes(b);
+};
+
+//
+// Capture state
+//
+
+var session = 0;
+var state = null;
+var failure = null;
+
+function arrayType(v) {
+    if (Buffer.isBuffer(v))
+        return 0;
+    for (var i = 1; i < arrayTypes.length; i++) {
+        var T = global[arrayTypes[i]];
+        if (T && v instanceof T)
+            return i;
+    }
+    return -1;
+}
+
+function classIndex(v) {
+    for (var i = 0; i < classes.length; i++) {
+        if (cl[classes[i]] && v instanceof cl[classes[i]])
+            return i;
+    }
+    return -1;
+}
+
+// JSON for a plain object, undefined for anything else or a cycle.
+function plainJSON(v) {
+    var proto = Object.getPrototypeOf(v);
+    if (proto !== Object.prototype && proto !== null)
+        return undefined;
+    try {
+        return JSON.stringify(v);
+    } catch (e) {
+        return undefined;
+    }
+}
+
+function arrayBytes(v, type) {
+    if (type == 0)
+        return v;
+    var u8 = new Uint8Array(v.buffer, v.byteOffset, v.byteLength);
+    var b = new Buffer(u8.length);
+    for (var i = 0; i < u8.length; i++)
+        b[i] = u8[i];
+    return b;
+}
+
+function writeValue(w, v, withData) {
+    if (v === undefined) return w.u8(V_UNDEFINED);
+    if (v === null) return w.u8(V_NULL);
+    if (v === false) return w.u8(V_FALSE);
+    if (v === true) return w.u8(V_TRUE);
+    if (typeof v == 'number') {
+        w.u8(V_NUMBER);
+        return w.f64(v);
+    }
+    if (typeof v == 'string') {
+        w.u8(V_STRING);
+        return w.string(v);
+    }
+    if (typeof v == 'function')
+        return w.u8(V_FUNCTION);
+    if (Array.isArray(v)) {
+        w.u8(V_ARRAY);
+        w.u32(v.length);
+        for (var i = 0; i < v.length; i++)
+            writeValue(w, v[i], withData);
+        return;
+    }
+
+    var id = v[state.key];
+    if (id !== undefined) {
+        w.u8(V_OBJECT);
+        return w.u32(id);
+    }
+    var cls = classIndex(v);
+    if (cls >= 0) {
+        id = state.nextId++;
+        Object.defineProperty(v, state.key, { value: id, enumerable: false });
+        w.u8(V_NEW_OBJECT);
+        w.u32(id);
+        return w.u8(cls);
+    }
+
+    var type = arrayType(v);
+    if (type >= 0) {
+        var n = type == 0 ? v.length : v.byteLength;
+        var data = withData && (state.contents || n <= SMALL_ARRAY);
+        w.u8(V_TYPED);
+        w.u8(type);
+        w.u32(n);
+        w.u8(data ? 1 : 0);
+        if (data)
+            w.bytes(arrayBytes(v, type));
+        return;
+    }
+
+    var json = plainJSON(v);
+    if (json !== undefined) {
+        w.u8(V_JSON);
+        return w.string(json);
+    }
+    var ctor = v.constructor;
+    w.u8(V_OPAQUE);
+    w.string(typeof ctor == 'function' && ctor.name ? ctor.name : 'Object');
+}
+
+function nameIndex(name) {
+    var idx = state.names[name];
+    if (idx === undefined) {
+        idx = state.names[name] = state.nameCount++;
+        state.writer.u8(REC_NAME);
+        state.writer.u16(idx);
+        var b = new Buffer(name, 'utf8');
+        state.writer.u16(b.length);
+        state.writer.bytes(b);
+    }
+    return idx;
+}
+
+function record(target, name, start, duration, threw, args, result) {
+    var w = state.writer;
+    var id = target[state.key];
+    if (id === undefined)
+        return; // created before the capture started
+    var idx = nameIndex(name);
+    w.u8(REC_CALL);
+    w.u32(id);
+    w.u16(idx);
+    w.f64(start - state.start);
+    w.f64(duration);
+    w.u8(threw ? FLAG_THREW : 0);
+    w.u8(args.length);
+    for (var i = 0; i < args.length; i++)
+        writeValue(w, args[i], true);
+    writeValue(w, result, false);
+    w.end();
+}
+
+function wrap(name, fn) {
+    return function() {
+        if (!state || state.depth > 0)
+            return fn.apply(this, arguments);
+        var args = Array.prototype.slice.call(arguments);
+        var result, threw = false;
+        state.depth++;
+        var start = now();
+        try {
+            result = fn.apply(this, arguments);
+        } catch (e) {
+            threw = true;
+            throw e;
+        } finally {
+            var duration = now() - start;
+            state.depth--;
+            if (state) {
+                try {
+                    record(this, name, start, duration, threw, args, result);
+                } catch (e) {
+                    abort(e);
+                }
+            }
+        }
+        return result;
+    };
+}
+
+function restore() {
+    state.saved.forEach(function(s) {
+        s.proto[s.name] = s.fn;
+    });
+}
+
+// Ends the capture after a record failed, dropping the partial record.
+function abort(e) {
+    failure = e;
+    restore();
+    var w = state.writer;
+    w.cancel();
+    try {
+        w.flush();
+    } catch (ignored) {
+    }
+    try {
+        fs.closeSync(w.fd);
+    } catch (ignored) {
+    }
+    state = null;
+}
+
+exports.capturing = function() {
+    return state !== null;
+};
+
+// The error that ended the last capture early, or null.
+exports.error = function() {
+    return failure;
+};
+
+exports.start = function(path, options) {
+    if (state)
+        throw new Error("capture already running");
+    options = options || {};
+    failure = null;
+    var root = require('./webcl').WebCL;
+
+    state = {
+        key: '_capture' + (++session),
+        contents: !!options.contents,
+        writer: new Writer(fs.openSync(path, 'w')),
+        names: {},
+        nameCount: 0,
+        nextId: 1,
+        depth: 0,
+        start: now(),
+        saved: []
+    };
+    Object.defineProperty(root, state.key, { value: 0, enumerable: false });
+
+    var header = new Buffer(JSON.stringify({
+        date: new Date().toISOString(),
+        node: process.version,
+        binding: require('./package.json').version,
+        contents: state.contents,
+        classes: classes,
+        arrayTypes: arrayTypes
+    }), 'utf8');
+    var w = state.writer;
+    w.bytes(new Buffer(MAGIC, 'ascii'));
+    w.u32(VERSION);
+    w.u32(header.length);
+    w.bytes(header);
+    w.end();
+
+    classes.forEach(function(c) {
+        var proto = cl[c] && cl[c].prototype;
+        if (!proto)
+            return;
+        Object.getOwnPropertyNames(proto).forEach(function(name) {
+            var fn = proto[name];
+            if (name == 'constructor' || name[0] == '_' || typeof fn != 'function' ||
+                UNWRAPPED.indexOf(name) >= 0)
+                return;
+            state.saved.push({ proto: proto, name: name, fn: fn });
+            proto[name] = wrap(name, fn);
+        });
+    });
+};
+
+exports.stop = function() {
+    if (!state)
+        return;
+    restore();
+    state.writer.flush();
+    fs.closeSync(state.writer.fd);
+    state = null;
+};
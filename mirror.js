@@ -0,0 +1,174 @@
+//
+// Host-mirrored buffers
+//
+// ctx.createMirroredBuffer(flags, host[, options]) creates a buffer the
+// size of host (any binary view) and returns a WebCLMirror keeping the two
+// in step: the host side is modified in place, the modified byte ranges
+// are noted, and mirror.sync(queue) uploads only those.
+//
+//   var m = ctx.createMirroredBuffer(WebCL.MEM_READ_ONLY, state);
+//   state[i] = x;
+//   m.markDirty(i * 4, 4);
+//   m.sync(queue);
+//
+// Ranges are noted with markDirty(offset, length) (in bytes), or, with
+// options.track = 'pages', found at sync time by comparing each page of
+// options.pageSize bytes with a shadow copy of what was last uploaded.
+// On sync the ranges are sorted and merged, also across gaps of at most
+// options.mergeGap bytes, since uploading a short gap is cheaper than
+// another command; one range is a plain enqueueWriteBuffer, more go
+// through enqueueWriteScatter (see scatter.js), which packs them into one
+// upload or one rect write per run of evenly spaced ranges.
+//
+// The first sync uploads everything. sync is non-blocking: host must not
+// be modified until the returned event completes.
+//
+
+var DEFAULT_PAGE_SIZE = 4096;
+var DEFAULT_MERGE_GAP = 256;
+
+exports.DEFAULT_PAGE_SIZE = DEFAULT_PAGE_SIZE;
+exports.DEFAULT_MERGE_GAP = DEFAULT_MERGE_GAP;
+
+var bytesOf = require('./scatter').bytesOf;
+
+function slice(bytes, offset, length) {
+    return Buffer.isBuffer(bytes) ? bytes.slice(offset, offset + length)
+                                  : bytes.subarray(offset, offset + length);
+}
+
+// Whole 32-bit words of bytes, for faster page compares, or null.
+function wordsOf(bytes) {
+    if (Buffer.isBuffer(bytes) || bytes.byteOffset % 4)
+        return null;
+    return new Uint32Array(bytes.buffer, bytes.byteOffset, bytes.length >> 2);
+}
+
+function WebCLMirror(ctx, flags, host, options) {
+    options = options || {};
+    this.host = host;
+    this.bytes = bytesOf(host);
+    this.size = this.bytes.length;
+    this.buffer = ctx.createBuffer(flags, this.size);
+    this.track = options.track || 'explicit';
+    this.pageSize = options.pageSize || DEFAULT_PAGE_SIZE;
+    this.mergeGap = options.mergeGap === undefined ? DEFAULT_MERGE_GAP : options.mergeGap;
+    if (this.track != 'explicit' && this.track != 'pages')
+        throw new Error("CL_INVALID_VALUE");
+    if (this.pageSize <= 0 || this.pageSize % 4)
+        throw new Error("CL_INVALID_VALUE");
+
+    this._dirty = [];
+    this._all = true;
+    if (this.track == 'pages') {
+        this._shadow = new Uint8Array(this.size);
+        this._words = wordsOf(this.bytes);
+        this._shadowWords = new Uint32Array(this._shadow.buffer, 0, this.size >> 2);
+    }
+}
+
+exports.WebCLMirror = WebCLMirror;
+
+//  void markDirty(uint offset, uint length);
+WebCLMirror.prototype.markDirty = function(offset, length) {
+    if (offset !== Math.floor(offset) || length !== Math.floor(length) ||
+        offset < 0 || length < 0 || offset + length > this.size)
+        throw new Error("CL_INVALID_VALUE");
+    if (length > 0 && !this._all)
+        this._dirty.push({ offset: offset, length: length });
+};
+
+//  void markAllDirty();
+WebCLMirror.prototype.markAllDirty = function() {
+    this._all = true;
+    this._dirty = [];
+};
+
+// Pages that differ from the shadow copy.
+WebCLMirror.prototype._changedPages = function() {
+    var pages = [], bytes = this.bytes, shadow = this._shadow;
+    var words = this._words, shadowWords = this._shadowWords;
+    for (var start = 0; start < this.size; start += this.pageSize) {
+        var end = Math.min(start + this.pageSize, this.size);
+        var i = start, changed = false;
+        if (words) {
+            var wend = Math.min(end, words.length * 4) >> 2;
+            for (var w = i >> 2; w < wend; w++) {
+                if (words[w] !== shadowWords[w]) {
+                    changed = true;
+                    break;
+                }
+            }
+            i = wend * 4;
+        }
+        for (; !changed && i < end; i++)
+            changed = bytes[i] !== shadow[i];
+        if (changed)
+            pages.push({ offset: start, length: end - start });
+    }
+    return pages;
+};
+
+// Sorted, merged dirty ranges as { offset, length } objects.
+WebCLMirror.prototype._ranges = function() {
+    if (this._all)
+        return this.size > 0 ? [{ offset: 0, length: this.size }] : [];
+    var list = this._dirty;
+    if (this.track == 'pages')
+        list = list.concat(this._changedPages());
+    list.sort(function(a, b) { return a.offset - b.offset; });
+
+    var merged = [];
+    for (var i = 0; i < list.length; i++) {
+        var last = merged[merged.length - 1];
+        if (last && list[i].offset <= last.offset + last.length + this.mergeGap) {
+            var end = Math.max(last.offset + last.length, list[i].offset + list[i].length);
+            last.length = end - last.offset;
+        } else {
+            merged.push({ offset: list[i].offset, length: list[i].length });
+        }
+    }
+    return merged;
+};
+
+//  uint[] dirtyRanges();
+WebCLMirror.prototype.dirtyRanges = function() {
+    var ranges = this._ranges(), flat = [];
+    for (var i = 0; i < ranges.length; i++)
+        flat.push(ranges[i].offset, ranges[i].length);
+    return flat;
+};
+
+//  WebCLEvent sync(WebCLCommandQueue queue, optional WebCLEvent[] eventWaitList);
+// Returns null when nothing changed.
+WebCLMirror.prototype.sync = function(queue, eventWaitList) {
+    var ranges = this._ranges();
+    var waitList = eventWaitList || [];
+    var event = null;
+
+    if (ranges.length == 1) {
+        var r = ranges[0];
+        event = queue.enqueueWriteBuffer(this.buffer, false, r.offset, r.length,
+                                         slice(this.bytes, r.offset, r.length), waitList);
+    } else if (ranges.length > 1) {
+        var flat = [];
+        for (var i = 0; i < ranges.length; i++)
+            flat.push(ranges[i].offset, ranges[i].length);
+        event = queue.enqueueWriteScatter(this.buffer, flat, this.bytes, waitList);
+    }
+
+    if (this._shadow) {
+        for (var i = 0; i < ranges.length; i++)
+            this._shadow.set(slice(this.bytes, ranges[i].offset, ranges[i].length),
+                             ranges[i].offset);
+    }
+    this._dirty = [];
+    this._all = false;
+    return event;
+};
+
+//  not in spec
+//  WebCLMirror createMirroredBuffer(CLenum memFlags, ArrayBufferView host, optional Object options);
+exports.createMirroredBuffer = function(flags, host, options) {
+    return new WebCLMirror(this, flags, host, options);
+};
@@ -0,0 +1,262 @@
+//
+// Scatter/gather transfers
+//
+// queue.enqueueWriteScatter(buffer, ranges, src[, eventWaitList]) copies
+// byte ranges of src to the same offsets in buffer, and
+// queue.enqueueReadGather(buffer, ranges, dst[, eventWaitList]) copies
+// ranges of buffer to the same offsets in dst. ranges is an array (or
+// typed array) of offset, length pairs in bytes; src and dst are any
+// binary view. Both return the event of the whole transfer; the gather
+// blocks until dst is filled. A range past the end of the view or of
+// buffer throws CL_INVALID_VALUE.
+//
+//   queue.enqueueWriteScatter(buf, [0, 64, 4096, 16, 81920, 256], mirror);
+//
+// With MIN_KERNEL_RANGES or more ranges, a write packs them, behind a
+// table of (offset, length, position) entries, into one staging upload
+// and a scatter kernel moves each range into place; a gather runs the
+// reverse kernel and reads the packed ranges back in one transfer. The
+// kernels are built once per queue. Fewer ranges, overlapping ones,
+// offsets past 4 GB or a device that can't build the kernels take the
+// fallback: runs of equal-length ranges at a constant stride become one
+// rect transfer each.
+//
+
+var MIN_KERNEL_RANGES = 8;
+var TABLE_ENTRY = 3;
+var MAX_LOCAL = 64;
+var MAX_UINT = 0xffffffff;
+
+// must match the layout written by pack()
+var source = [
+    "__kernel void webcl_scatter(__global const uint *table, uint n, __global uchar *dst)",
+    "{",
+    "    __global const uchar *packed = (__global const uchar *) (table + 3 * n);",
+    "    uint r = get_group_id(0);",
+    "    uint offset = table[3 * r], length = table[3 * r + 1], at = table[3 * r + 2];",
+    "    for (uint i = get_local_id(0); i < length; i += get_local_size(0))",
+    "        dst[offset + i] = packed[at + i];",
+    "}",
+    "",
+    "__kernel void webcl_gather(__global uint *table, uint n, __global const uchar *src)",
+    "{",
+    "    __global uchar *packed = (__global uchar *) (table + 3 * n);",
+    "    uint r = get_group_id(0);",
+    "    uint offset = table[3 * r], length = table[3 * r + 1], at = table[3 * r + 2];",
+    "    for (uint i = get_local_id(0); i < length; i += get_local_size(0))",
+    "        packed[at + i] = src[offset + i];",
+    "}"
+].join("\n");
+
+exports.MIN_KERNEL_RANGES = MIN_KERNEL_RANGES;
+
+// Byte-indexed view of any binary view, sharing its memory.
+function bytesOf(view) {
+    if (Buffer.isBuffer(view) || view instanceof Uint8Array)
+        return view;
+    if (view instanceof ArrayBuffer)
+        return new Uint8Array(view);
+    return new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+}
+
+exports.bytesOf = bytesOf;
+
+function copyBytes(dst, dstPos, src, srcPos, n) {
+    if (dst.set && src.subarray) {
+        dst.set(src.subarray(srcPos, srcPos + n), dstPos);
+        return;
+    }
+    for (var i = 0; i < n; i++)
+        dst[dstPos + i] = src[srcPos + i];
+}
+
+// Checked { offset, length } list, without empty ranges. Every range
+// must lie within both the host view and the buffer, before any path is
+// chosen: the kernels would otherwise write past the end of the buffer.
+function parseRanges(ranges, hostBytes, buffer) {
+    var WebCL = require('./webcl');
+    var limit = Math.min(hostBytes, buffer.getInfo(WebCL.MEM_SIZE));
+    if (!ranges || ranges.length % 2)
+        throw new Error("CL_INVALID_VALUE");
+    var list = [];
+    for (var i = 0; i < ranges.length; i += 2) {
+        var offset = ranges[i], length = ranges[i + 1];
+        if (offset !== Math.floor(offset) || length !== Math.floor(length) ||
+            offset < 0 || length < 0 || offset + length > limit)
+            throw new Error("CL_INVALID_VALUE");
+        if (length > 0)
+            list.push({ offset: offset, length: length });
+    }
+    return list;
+}
+
+// Ranges the kernels can handle: uint offsets, and no overlaps, since
+// the work-groups run in no particular order.
+function kernelFriendly(list) {
+    var total = TABLE_ENTRY * 4 * list.length;
+    var sorted = list.slice().sort(function(a, b) { return a.offset - b.offset; });
+    for (var i = 0; i < sorted.length; i++) {
+        if (sorted[i].offset + sorted[i].length > MAX_UINT)
+            return false;
+        if (i > 0 && sorted[i].offset < sorted[i - 1].offset + sorted[i - 1].length)
+            return false;
+        total += sorted[i].length;
+    }
+    return total <= MAX_UINT;
+}
+
+function state(queue) {
+    if (queue._scatter)
+        return queue._scatter;
+    var WebCL = require('./webcl');
+    var s = queue._scatter = { kernels: false, staging: null, stagingSize: 0,
+                              last: null, upload: null, packed: null };
+    try {
+        s.ctx = queue.getInfo(WebCL.QUEUE_CONTEXT);
+        s.device = queue.getInfo(WebCL.QUEUE_DEVICE);
+        var program = s.ctx.createProgram(source);
+        program.build([s.device], "");
+        s.scatter = program.createKernel("webcl_scatter");
+        s.gather = program.createKernel("webcl_gather");
+        s.local = Math.min(MAX_LOCAL,
+                           s.scatter.getWorkGroupInfo(s.device, WebCL.KERNEL_WORK_GROUP_SIZE),
+                           s.gather.getWorkGroupInfo(s.device, WebCL.KERNEL_WORK_GROUP_SIZE));
+        s.kernels = s.local > 0;
+    } catch (e) {
+        s.kernels = false;
+    }
+    return s;
+}
+
+function staging(s, size) {
+    if (s.stagingSize < size) {
+        var WebCL = require('./webcl');
+        var n = 4096;
+        while (n < size)
+            n *= 2;
+        s.staging = s.ctx.createBuffer(WebCL.MEM_READ_WRITE, n);
+        s.stagingSize = n;
+        s.last = null;
+    }
+    return s.staging;
+}
+
+// The table, followed (for a scatter) by the packed ranges of host.
+function pack(list, host) {
+    var tableBytes = TABLE_ENTRY * 4 * list.length;
+    var total = tableBytes;
+    if (host) {
+        for (var i = 0; i < list.length; i++)
+            total += list[i].length;
+    }
+    var bytes = new Uint8Array(total);
+    var table = new Uint32Array(bytes.buffer, 0, TABLE_ENTRY * list.length);
+    var at = 0;
+    for (var i = 0; i < list.length; i++) {
+        table[TABLE_ENTRY * i] = list[i].offset;
+        table[TABLE_ENTRY * i + 1] = list[i].length;
+        table[TABLE_ENTRY * i + 2] = at;
+        if (host)
+            copyBytes(bytes, tableBytes + at, host, list[i].offset, list[i].length);
+        at += list[i].length;
+    }
+    return { bytes: bytes, tableBytes: tableBytes, packedBytes: at };
+}
+
+function launch(queue, s, kernel, buffer, count, waitList) {
+    var WebCL = require('./webcl');
+    kernel.setArg(0, s.staging, WebCL.types.MEMORY_OBJECT);
+    kernel.setArg(1, count, WebCL.types.UINT);
+    kernel.setArg(2, buffer, WebCL.types.MEMORY_OBJECT);
+    return queue.enqueueNDRangeKernel(kernel, 1, [], [count * s.local], [s.local], waitList);
+}
+
+// Runs of ranges with one length at a constant stride, one rect each.
+function rects(list) {
+    var runs = [];
+    for (var i = 0; i < list.length; ) {
+        var first = list[i], rows = 1, stride = first.length;
+        if (i + 1 < list.length && list[i + 1].length == first.length &&
+            list[i + 1].offset - first.offset >= first.length) {
+            stride = list[i + 1].offset - first.offset;
+            while (i + rows < list.length && list[i + rows].length == first.length &&
+                   list[i + rows].offset == first.offset + rows * stride)
+                rows++;
+        }
+        runs.push({ offset: first.offset, length: first.length, rows: rows, stride: stride });
+        i += rows;
+    }
+    return runs;
+}
+
+function rectTransfers(queue, write, buffer, list, host, waitList) {
+    var runs = rects(list), events = [];
+    for (var i = 0; i < runs.length; i++) {
+        var r = runs[i];
+        var origin = [r.offset, 0, 0], region = [r.length, r.rows, 1];
+        if (write)
+            events.push(queue.enqueueWriteBufferRect(buffer, false, origin, origin, region,
+                                                     r.stride, 0, r.stride, 0, host, waitList));
+        else
+            events.push(queue.enqueueReadBufferRect(buffer, false, origin, origin, region,
+                                                    r.stride, 0, r.stride, 0, host, waitList));
+    }
+    return events;
+}
+
+//  WebCLEvent enqueueWriteScatter(WebCLMemoryObject buffer, uint[] ranges,
+//                                 ArrayBufferView src, optional WebCLEvent[] eventWaitList);
+exports.enqueueWriteScatter = function(buffer, ranges, src, eventWaitList) {
+    var WebCL = require('./webcl');
+    var host = bytesOf(src);
+    var list = parseRanges(ranges, host.length, buffer);
+    var waitList = eventWaitList || [];
+    var s = state(this);
+
+    if (list.length < MIN_KERNEL_RANGES || !s.kernels || !kernelFriendly(list)) {
+        var events = rectTransfers(this, true, buffer, list, src, waitList);
+        return events.length == 1 ? events[0] : this.enqueueMarker();
+    }
+
+    // The packed copy is ours, so the upload can be non-blocking; it is
+    // kept alive until the next scatter's upload is enqueued, and the
+    // staging buffer is reused once the previous scatter has read it.
+    var p = pack(list, host);
+    var stage = staging(s, p.bytes.length);
+    var uploadWait = s.last ? waitList.concat([s.last]) : waitList;
+    if (s.upload)
+        WebCL.WebCL.waitForEvents([s.upload]);
+    s.upload = this.enqueueWriteBuffer(stage, false, 0, p.bytes.length, p.bytes, uploadWait);
+    s.packed = p.bytes;
+    s.last = launch(this, s, s.scatter, buffer, list.length, [s.upload]);
+    return s.last;
+};
+
+//  WebCLEvent enqueueReadGather(WebCLMemoryObject buffer, uint[] ranges,
+//                               ArrayBufferView dst, optional WebCLEvent[] eventWaitList);
+exports.enqueueReadGather = function(buffer, ranges, dst, eventWaitList) {
+    var WebCL = require('./webcl');
+    var host = bytesOf(dst);
+    var list = parseRanges(ranges, host.length, buffer);
+    var waitList = eventWaitList || [];
+    var s = state(this);
+
+    if (list.length < MIN_KERNEL_RANGES || !s.kernels || !kernelFriendly(list)) {
+        var events = rectTransfers(this, false, buffer, list, dst, waitList);
+        if (events.length > 0)
+            WebCL.WebCL.waitForEvents(events);
+        return events.length == 1 ? events[0] : this.enqueueMarker();
+    }
+
+    var p = pack(list, null);
+    var stage = staging(s, p.tableBytes + p.packedBytes);
+    var tableWait = s.last ? waitList.concat([s.last]) : waitList;
+    var table = this.enqueueWriteBuffer(stage, false, 0, p.tableBytes, p.bytes, tableWait);
+    var gathered = launch(this, s, s.gather, buffer, list.length, [table]);
+    var packed = new Uint8Array(p.packedBytes);
+    s.last = this.enqueueReadBuffer(stage, true, p.tableBytes, p.packedBytes, packed, [gathered]);
+
+    for (var i = 0, at = 0; i < list.length; at += list[i].length, i++)
+        copyBytes(host, list[i].offset, packed, at, list[i].length);
+    return s.last;
+};
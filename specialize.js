@@ -0,0 +1,89 @@
+//
+// Compile-time specialization of programs
+//
+// program.specialize({N: 1024, TILE: 16}) returns a copy of the program
+// built with "-D N=1024 -D TILE=16" appended to its build options. A
+// variant is compiled when its first kernel is created (or by an explicit
+// build()), so asking for define sets that are never launched costs
+// nothing, and build errors surface from createKernel. Variants are
+// cached on the parent program, keyed by its build options and the
+// defines; the least recently used variant is dropped once a program
+// holds more than exports.maxVariants of them.
+//
+
+// values mirrored from webcl.js, which requires this module
+var PROGRAM_CONTEXT                          =0x1161;
+var PROGRAM_DEVICES                          =0x1163;
+var PROGRAM_SOURCE                           =0x1164;
+var PROGRAM_BUILD_OPTIONS                    =0x1182;
+
+exports.maxVariants = 16;
+
+// Options are normalised (names sorted) so {A:1, B:2} and {B:2, A:1}
+// share a variant.
+function defineOptions(defines) {
+    var names = Object.keys(defines).sort();
+    var opts = [];
+    for (var i = 0; i < names.length; i++) {
+        var name = names[i], value = defines[name];
+        if (!/^[A-Za-z_][A-Za-z0-9_]*$/.test(name))
+            throw new Error("CL_INVALID_BUILD_OPTIONS");
+        if (value === false || value === null || value === undefined)
+            continue;
+        if (value === true)
+            opts.push('-D ' + name);
+        else if (typeof value == 'number' || /^[A-Za-z0-9_.+-]+$/.test(value))
+            opts.push('-D ' + name + '=' + value);
+        else
+            throw new Error("CL_INVALID_BUILD_OPTIONS");
+    }
+    return opts.join(' ');
+}
+
+function baseOptions(program, devices) {
+    try {
+        return program.getBuildInfo(devices[0], PROGRAM_BUILD_OPTIONS) || '';
+    } catch (e) {
+        // never built
+        return '';
+    }
+}
+
+//  WebCLProgram specialize(Object defines, optional DOMString options);
+exports.specialize = function(defines, options) {
+    // the parent's own build options are part of every variant's, so a
+    // rebuild of the parent with other options gets other variants
+    var devices = this.getInfo(PROGRAM_DEVICES);
+    var key = (baseOptions(this, devices) + ' ' + (options || '') + ' ' +
+               defineOptions(defines || {})).trim();
+
+    var variants = this._variants;
+    if (!variants)
+        variants = this._variants = { programs: {}, order: [] };
+
+    var v = variants.programs[key];
+    if (v) {
+        variants.order.splice(variants.order.indexOf(key), 1);
+        variants.order.push(key);
+        return v;
+    }
+
+    var ctx = this.getInfo(PROGRAM_CONTEXT);
+    v = ctx.createProgram(this.getInfo(PROGRAM_SOURCE));
+    v._specialized = { devices: devices, options: key };
+
+    variants.programs[key] = v;
+    variants.order.push(key);
+    while (variants.order.length > exports.maxVariants)
+        delete variants.programs[variants.order.shift()];
+    return v;
+};
+
+//  void ensureBuilt(WebCLProgram program);
+// Builds a variant from specialize() that hasn't been built yet; called
+// before its kernels are created. A failed build is retried next time.
+exports.ensureBuilt = function(program) {
+    var pending = program._specialized;
+    if (pending)
+        program.build(pending.devices, pending.options);
+};
@@ -8,8 +8,15 @@
 #include "kernelobject.h"
 
 #include "node_buffer.h"
+#include "token.h"
+#include "submitter.h"
+#include "stats.h"
+#include "nativekernel.h"
+#include "convert.h"
+#include "hostalloc.h"
 
 #include <iostream>
+#include <new>
 
 using namespace v8;
 using namespace webcl;
@@ -34,6 +41,105 @@ IS_BUFFER_FUNC(Int32Array, kExternalIntArray);
 IS_BUFFER_FUNC(Uint32Array, kExternalUnsignedIntArray);
 IS_BUFFER_FUNC(Float32Array, kExternalFloatArray);
 
+// Zero-copy view of mapped memory; Buffer::New(data, length) would copy
+// it, and enqueueUnmapMemObject needs the pointer the map returned. The
+// memory object keeps the view and detaches it on unmap.
+static void noFree(char *data, void *hint)
+{
+}
+
+static Handle<Value> MappedBuffer(void *ptr, size_t nbytes)
+{
+    return node::Buffer::New((char*)ptr, nbytes, noFree, 0)->handle_;
+}
+
+// Overflow-checked a * b + c; false if it doesn't fit in a cl_ulong.
+static bool MulAdd(cl_ulong a, cl_ulong b, cl_ulong c, cl_ulong *result)
+{
+    const cl_ulong max = ~(cl_ulong) 0;
+    if (a && b > max / a)
+	return false;
+    if (a * b > max - c)
+	return false;
+    *result = a * b + c;
+    return true;
+}
+
+// Host bytes a rect transfer touches, with the default pitches of
+// clEnqueueReadBufferRect for pitches of 0; false if that overflows.
+static bool RectExtent(const size_t origin[3], const size_t region[3],
+		       size_t row_pitch, size_t slice_pitch, cl_ulong *extent)
+{
+    *extent = 0;
+    if (!region[0] || !region[1] || !region[2])
+	return true;
+    cl_ulong row = row_pitch ? row_pitch : region[0];
+    cl_ulong slice = slice_pitch;
+    if (!slice && !MulAdd(region[1], row, 0, &slice))
+	return false;
+    cl_ulong last_row, last_slice, x;
+    return MulAdd(1, origin[1], region[1] - 1, &last_row)
+	&& MulAdd(1, origin[2], region[2] - 1, &last_slice)
+	&& MulAdd(1, origin[0], region[0], &x)
+	&& MulAdd(last_row, row, x, &x)
+	&& MulAdd(last_slice, slice, x, extent);
+}
+
+// Host bytes an image read or write touches; region[0] is in pixels.
+// False if mo is not an image or the extent overflows.
+static bool ImageExtent(MemoryObject *mo, const size_t region[3],
+			size_t row_pitch, size_t slice_pitch, cl_ulong *extent)
+{
+    size_t element_size = 0;
+    if (mo->getMemoryObjectWrapper()->getImageInfo(CL_IMAGE_ELEMENT_SIZE, element_size)
+	!= CL_SUCCESS)
+	return false;
+    cl_ulong row_bytes;
+    if (!MulAdd(region[0], element_size, 0, &row_bytes) || row_bytes != (size_t) row_bytes)
+	return false;
+    const size_t origin[3] = { 0, 0, 0 };
+    const size_t bytes[3] = { (size_t) row_bytes, region[1], region[2] };
+    return RectExtent(origin, bytes, row_pitch, slice_pitch, extent);
+}
+
+// Element type of a typed array (or Buffer) as a types:: value, for
+// converting transfers; UNKNOWN for anything else.
+static int HostElementType(Handle<Value> val)
+{
+    if (!val->IsObject())
+	return types::UNKNOWN;
+    Local<Object> obj = val->ToObject();
+    if (!obj->HasIndexedPropertiesInExternalArrayData())
+	return types::UNKNOWN;
+    switch (obj->GetIndexedPropertiesExternalArrayDataType()) {
+    case kExternalByteArray:
+	return types::CHAR;
+    case kExternalUnsignedByteArray:
+    case kExternalPixelArray:
+	return types::UCHAR;
+    case kExternalShortArray:
+	return types::SHORT;
+    case kExternalUnsignedShortArray:
+	return types::USHORT;
+    case kExternalIntArray:
+	return types::INT;
+    case kExternalUnsignedIntArray:
+	return types::UINT;
+    case kExternalFloatArray:
+	return types::FLOAT;
+    case kExternalDoubleArray:
+	return types::DOUBLE;
+    default:
+	return types::UNKNOWN;
+    }
+}
+
+// Frees the staging copy of a non-blocking converting write.
+static void CL_CALLBACK freeStaging(cl_event event, cl_int status, void *user_data)
+{
+    delete[] static_cast<char*>(user_data);
+}
+
 /* static  */
 void CommandQueue::Init(Handle<Object> target)
 {
@@ -46,18 +152,33 @@ void CommandQueue::Init(Handle<Object> target)
     constructor_template->SetClassName(String::NewSymbol("WebCLCommandQueue"));
 
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getInfo", getCommandQueueInfo);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "getToken", getToken);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "createSubmitter", createSubmitter);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "setNoThrow", setNoThrow);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "setTransferChunkSize", setTransferChunkSize);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueNDRangeKernel", enqueueNDRangeKernel);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueTask", enqueueTask);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueNativeKernel", enqueueNativeKernel);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueWriteBuffer", enqueueWriteBuffer);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueReadBuffer", enqueueReadBuffer);
-    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueCopyBuffer", enqueueCopyImage);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueCopyBuffer", enqueueCopyBuffer);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template,
+			      "enqueueWriteBufferConverted", enqueueWriteBufferConverted);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template,
+			      "enqueueReadBufferConverted", enqueueReadBufferConverted);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, 
 			      "enqueueWriteBufferRect", enqueueWriteBufferRect);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, 
 			      "enqueueReadBufferRect", enqueueReadBufferRect);
-    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueCopyBufferRect", enqueueCopyImage);
-    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueWriteImage", enqueueWriteBuffer);
-    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueReadImage", enqueueReadBuffer);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueCopyBufferRect", enqueueCopyBufferRect);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueWriteImage", enqueueWriteImage);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueReadImage", enqueueReadImage);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "enqueueCopyImage", enqueueCopyImage);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, 
 			      "enqueueCopyImageToBuffer", enqueueCopyImageToBuffer);
@@ -75,14 +196,143 @@ void CommandQueue::Init(Handle<Object> target)
     target->Set(String::NewSymbol("WebCLCommandQueue"), constructor_template->GetFunction());
 }
 
-CommandQueue::CommandQueue(Handle<Object> wrapper) : cw(0)
+CommandQueue::CommandQueue(Handle<Object> wrapper)
+    : cw(0), profiling(false), hostUnified(false), nativeKernels(false),
+      transferChunk(DEFAULT_TRANSFER_CHUNK), noThrow(false), statusSlot(0)
 {
     Wrap(wrapper);
 }
     
 CommandQueue::~CommandQueue()
 {
-    if (cw) cw->release();
+    if (cw) {
+	UncacheObject(cw, this);
+	cw->release();
+    }
+    if (!statusArray.IsEmpty())
+	statusArray.Dispose();
+}
+
+Handle<Value> CommandQueue::fail(cl_int ret)
+{
+    if (statusSlot)
+	*statusSlot = ret;
+    if (!noThrow)
+	return ThrowError(ret);
+    return Integer::New(ret);
+}
+
+cl_int CommandQueue::enqueueChunk(TransferKind kind, MemoryObjectWrapper *src,
+				  MemoryObjectWrapper *dst, cl_bool blocking,
+				  size_t src_offset, size_t dst_offset, size_t cb, char *ptr,
+				  std::vector<EventWrapper*> const& event_wait_list,
+				  EventWrapper **event)
+{
+    cl_int ret;
+    switch (kind) {
+    case TRANSFER_WRITE:
+	ret = cw->enqueueWriteBuffer(dst, blocking, dst_offset, cb, ptr, event_wait_list, event);
+	break;
+    case TRANSFER_READ:
+	ret = cw->enqueueReadBuffer(src, blocking, src_offset, cb, ptr, event_wait_list, event);
+	break;
+    default:
+	ret = cw->enqueueCopyBuffer(src, dst, src_offset, dst_offset, cb, event_wait_list, event);
+	break;
+    }
+    return ret;
+}
+
+bool CommandQueue::enqueueInPlace(TransferKind kind, MemoryObjectWrapper *mw, cl_bool blocking,
+				  size_t offset, size_t cb, char *ptr,
+				  std::vector<EventWrapper*> const& event_wait_list,
+				  EventWrapper **event, cl_int *ret)
+{
+    if (!hostUnified || !cb || !IsHostAllocation(ptr, cb))
+	return false;
+    cl_mem_flags flags = 0;
+    char *host_ptr = 0;
+    if (clGetMemObjectInfo(mw->getWrapped(), CL_MEM_FLAGS, sizeof(flags), &flags, 0) != CL_SUCCESS
+	|| !(flags & CL_MEM_USE_HOST_PTR)
+	|| clGetMemObjectInfo(mw->getWrapped(), CL_MEM_HOST_PTR, sizeof(host_ptr),
+			      &host_ptr, 0) != CL_SUCCESS
+	|| host_ptr + offset != ptr)
+	return false;
+
+    EventWrapper *mapped_event = 0;
+    void *mapped = 0;
+    if (cw->enqueueMapBuffer(mw, CL_FALSE, kind == TRANSFER_WRITE ? CL_MAP_WRITE : CL_MAP_READ,
+			     offset, cb, event_wait_list, &mapped_event, &mapped) != CL_SUCCESS)
+	return false; // let the copy report any error
+
+    std::vector<EventWrapper*> unmap_wait(1, mapped_event);
+    *ret = cw->enqueueUnmapMemObject(mw, mapped, unmap_wait, event);
+    mapped_event->release();
+    if (*ret == CL_SUCCESS && blocking) {
+	cl_event e = (*event)->getWrapped();
+	*ret = clWaitForEvents(1, &e);
+	if (*ret != CL_SUCCESS) {
+	    (*event)->release();
+	    *event = 0;
+	}
+    }
+    if (*ret == CL_SUCCESS)
+	RecordCommand(TransferStats(kind), *event, cb, profiling);
+    return true;
+}
+
+cl_int CommandQueue::enqueueTransfer(TransferKind kind, MemoryObjectWrapper *src,
+				     MemoryObjectWrapper *dst, cl_bool blocking,
+				     size_t src_offset, size_t dst_offset, size_t cb, char *ptr,
+				     std::vector<EventWrapper*> const& event_wait_list,
+				     EventWrapper **event)
+{
+    if (!transferChunk || cb <= transferChunk) {
+	cl_int ret = enqueueChunk(kind, src, dst, blocking, src_offset, dst_offset, cb, ptr,
+				  event_wait_list, event);
+	if (ret == CL_SUCCESS)
+	    RecordCommand(TransferStats(kind), *event, cb, profiling);
+	return ret;
+    }
+
+    // All chunks are enqueued non-blocking so the driver can pipeline
+    // them, each waiting on the caller's events only.
+    std::vector<EventWrapper*> chunks;
+    std::vector<cl_event> chunkEvents;
+    cl_int ret = CL_SUCCESS;
+    for (size_t done = 0; done < cb; done += transferChunk) {
+	size_t n = cb - done < transferChunk ? cb - done : transferChunk;
+	EventWrapper *chunk = 0;
+	ret = enqueueChunk(kind, src, dst, CL_FALSE, src_offset + done, dst_offset + done, n,
+			   ptr ? ptr + done : 0, event_wait_list, &chunk);
+	if (ret != CL_SUCCESS)
+	    break;
+	// run times are sampled per chunk, the transfer is counted once below
+	TimeCommand(TransferStats(kind), chunk, n, profiling);
+	chunks.push_back(chunk);
+	chunkEvents.push_back(chunk->getWrapped());
+    }
+
+    // One event for the whole transfer. A 1.1 marker completes once every
+    // command enqueued before it has, also on out-of-order queues.
+    if (ret == CL_SUCCESS)
+	ret = cw->enqueueMarker(event);
+    if (ret == CL_SUCCESS)
+	RecordCommand(TransferStats(kind), 0, cb, false);
+    if (ret == CL_SUCCESS && blocking) {
+	cl_event marker = (*event)->getWrapped();
+	ret = clWaitForEvents(1, &marker);
+	if (ret != CL_SUCCESS) {
+	    (*event)->release();
+	    *event = 0;
+	}
+    }
+    // Chunks already in flight still use ptr, don't hand it back early.
+    if (ret != CL_SUCCESS && !chunkEvents.empty())
+	clWaitForEvents(chunkEvents.size(), &chunkEvents[0]);
+    for (size_t i = 0; i < chunks.size(); i++)
+	chunks[i]->release();
+    return ret;
 }
 
 /* static */
@@ -110,12 +360,12 @@ Handle<Value> CommandQueue::getCommandQueueInfo(const Arguments& args)
     switch (param_name) {
     case CL_QUEUE_CONTEXT: {
 	cl_context ctx = *((cl_context*)param_value);
-	ContextWrapper *cw = new ContextWrapper(ctx);
+	ContextWrapper *cw = WrapQueriedHandle<ContextWrapper>(ctx, clRetainContext);
 	return scope.Close(CLContext::New(cw)->handle_);
     }
     case CL_QUEUE_DEVICE: {
 	cl_device_id dev = *((cl_device_id*)param_value);
-	DeviceWrapper *dw = new DeviceWrapper(dev);
+	DeviceWrapper *dw = DeviceWrapper::getNewOrExisting(dev);
 	return scope.Close(Device::New(dw)->handle_);
     }
     case CL_QUEUE_REFERENCE_COUNT:
@@ -173,25 +423,11 @@ Handle<Value> CommandQueue::enqueueNDRangeKernel(const Arguments& args)
 								    local_work_size,
 								    event_wait_list,
 								    &event);
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_PROGRAM_EXECUTABLE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_KERNEL);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_KERNEL_ARGS);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_WORK_DIMENSION);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_GLOBAL_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_WORK_GROUP_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_WORK_ITEM_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
 
+    RecordCommand(k->getStats(), event, 0, cq->profiling);
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -216,22 +452,78 @@ Handle<Value> CommandQueue::enqueueTask(const Arguments& args)
     cl_int ret = cq->getCommandQueueWrapper()->enqueueTask(k->getKernelWrapper(),
 							   event_wait_list, &event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_PROGRAM_EXECUTABLE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_KERNEL);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_KERNEL_ARGS);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_WORK_GROUP_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+
+    RecordCommand(k->getStats(), event, 0, cq->profiling);
+    cq->succeed();
+    return scope.Close(Event::New(event)->handle_);
+}
+
+/* static */
+Handle<Value> CommandQueue::enqueueNativeKernel(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+    // Checked here rather than left to the driver, some of which crash
+    // instead of returning CL_INVALID_OPERATION.
+    if (!cq->nativeKernels)
+	return scope.Close(cq->fail(CL_INVALID_OPERATION));
+
+    String::Utf8Value name(args[0]);
+    NativeKernelFunc fn = FindNativeKernel(*name);
+    if (!fn)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
+
+    size_t cb_args = 0;
+    void *ptr = 0;
+    if (!args[1]->IsUndefined() && !args[1]->IsNull()) {
+	ptr = BinaryViewBytes(args[1], &cb_args);
+	if (!ptr)
+	    return scope.Close(cq->fail(CL_INVALID_VALUE));
+    }
+
+    std::vector<MemoryObjectWrapper*> mem_objects;
+    std::vector<size_t> mem_offsets;
+    if (args[2]->IsArray()) {
+	if (!args[3]->IsArray())
+	    return scope.Close(cq->fail(CL_INVALID_VALUE));
+	Local<Array> memObjects = Array::Cast(*args[2]);
+	Local<Array> memOffsets = Array::Cast(*args[3]);
+	if (memOffsets->Length() != memObjects->Length())
+	    return scope.Close(cq->fail(CL_INVALID_VALUE));
+	for (int i=0; i<memObjects->Length(); i++) {
+	    Local<Value> v = memObjects->Get(i);
+	    if (!MemoryObject::HasInstance(v))
+		return scope.Close(cq->fail(CL_INVALID_MEM_OBJECT));
+	    MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(v->ToObject());
+	    size_t offset;
+	    if (!ToSize(memOffsets->Get(i), &offset))
+		return scope.Close(cq->fail(CL_INVALID_VALUE));
+	    mem_objects.push_back(mo->getMemoryObjectWrapper());
+	    mem_offsets.push_back(offset);
+	}
     }
 
+    std::vector<EventWrapper*> event_wait_list;
+    if (args[4]->IsArray()) {
+	Local<Array> eventWaitArray = Array::Cast(*args[4]);
+	for (int i=0; i<eventWaitArray->Length(); i++) {
+	    Local<Object> obj = eventWaitArray->Get(i)->ToObject();
+	    Event *e = ObjectWrap::Unwrap<Event>(obj);
+	    event_wait_list.push_back( e->getEventWrapper() );
+	}
+    }
+
+    EventWrapper *event = 0;
+    cl_int ret = cq->getCommandQueueWrapper()->enqueueNativeKernel(fn, ptr, cb_args,
+								   mem_objects, mem_offsets,
+								   event_wait_list, &event);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -244,9 +536,13 @@ Handle<Value> CommandQueue::enqueueWriteBuffer(const Arguments& args)
     
     // TODO: arg checking
     cl_bool blocking_write = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
-    size_t offset = args[2]->Uint32Value();
-    size_t cb = args[3]->Uint32Value();
-    void *ptr = args[4]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t offset, cb;
+    if (!ToSize(args[2], &offset) || !ToSize(args[3], &cb))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[4], &host_bytes);
+    if (!ptr || cb > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -257,27 +553,16 @@ Handle<Value> CommandQueue::enqueueWriteBuffer(const Arguments& args)
     }
 
     EventWrapper *event = 0;
-    cl_int ret = cq->getCommandQueueWrapper()->enqueueWriteBuffer(mo->getMemoryObjectWrapper(),
-								  blocking_write,
-								  offset,
-								  cb,
-								  ptr,
-								  event_wait_list,
-								  &event);
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    cl_int ret;
+    if (!cq->enqueueInPlace(TRANSFER_WRITE, mo->getMemoryObjectWrapper(), blocking_write,
+			    offset, cb, (char*)ptr, event_wait_list, &event, &ret))
+	ret = cq->enqueueTransfer(TRANSFER_WRITE, 0, mo->getMemoryObjectWrapper(),
+				  blocking_write, 0, offset, cb, (char*)ptr,
+				  event_wait_list, &event);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -290,9 +575,13 @@ Handle<Value> CommandQueue::enqueueReadBuffer(const Arguments& args)
     
     // TODO: arg checking
     cl_bool blocking_read = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
-    size_t offset = args[2]->NumberValue();
-    size_t cb = args[3]->NumberValue();
-    void *ptr = args[4]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t offset, cb;
+    if (!ToSize(args[2], &offset) || !ToSize(args[3], &cb))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[4], &host_bytes);
+    if (!ptr || cb > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
     
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -303,27 +592,16 @@ Handle<Value> CommandQueue::enqueueReadBuffer(const Arguments& args)
     }
 
     EventWrapper *event = 0;
-    cl_int ret = cq->getCommandQueueWrapper()->enqueueReadBuffer(mo->getMemoryObjectWrapper(),
-								 blocking_read,
-								 offset,
-								 cb,
-								 ptr,
-								 event_wait_list,
-								 &event);
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    cl_int ret;
+    if (!cq->enqueueInPlace(TRANSFER_READ, mo->getMemoryObjectWrapper(), blocking_read,
+			    offset, cb, (char*)ptr, event_wait_list, &event, &ret))
+	ret = cq->enqueueTransfer(TRANSFER_READ, mo->getMemoryObjectWrapper(), 0,
+				  blocking_read, offset, 0, cb, (char*)ptr,
+				  event_wait_list, &event);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -337,9 +615,10 @@ Handle<Value> CommandQueue::enqueueCopyBuffer(const Arguments& args)
     MemoryObject *mo_dst = ObjectWrap::Unwrap<MemoryObject>(args[1]->ToObject());
 
     // TODO: arg checking
-    size_t src_offset = args[2]->NumberValue();
-    size_t dst_offset = args[3]->NumberValue();
-    size_t cb = args[4]->NumberValue();
+    size_t src_offset, dst_offset, cb;
+    if (!ToSize(args[2], &src_offset) || !ToSize(args[3], &dst_offset) ||
+	!ToSize(args[4], &cb))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -350,28 +629,116 @@ Handle<Value> CommandQueue::enqueueCopyBuffer(const Arguments& args)
     }
 
     EventWrapper *event = 0;
-    cl_int ret = cq->getCommandQueueWrapper()->enqueueCopyBuffer(mo_src->getMemoryObjectWrapper(),
-								 mo_dst->getMemoryObjectWrapper(),
-								 src_offset,
-								 dst_offset,
-								 cb,
-								 event_wait_list,
-								 &event);
+    cl_int ret = cq->enqueueTransfer(TRANSFER_COPY, mo_src->getMemoryObjectWrapper(),
+				     mo_dst->getMemoryObjectWrapper(), CL_FALSE,
+				     src_offset, dst_offset, cb, 0, event_wait_list, &event);
+
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
 
+    cq->succeed();
+    return scope.Close(Event::New(event)->handle_);
+}
+
+// Writes src, a typed array, to the buffer as device_type elements,
+// converted on the host (see convert.h): e.g. a Float32Array stored as
+// HALF moves half the bytes. The converted copy is freed once the
+// transfer completes, so src can be reused as soon as this returns.
+/* static */
+Handle<Value> CommandQueue::enqueueWriteBufferConverted(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+    MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+    cl_bool blocking_write = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
+    size_t offset;
+    int device_type = args[3]->Int32Value();
+    int host_type = HostElementType(args[4]);
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[4], &host_bytes);
+    if (!ToSize(args[2], &offset) || !ptr || !CanConvert(host_type, device_type))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
+    size_t n = host_bytes / ConvertElementSize(host_type);
+    size_t cb = n * ConvertElementSize(device_type);
+
+    std::vector<EventWrapper*> event_wait_list;
+    Local<Array> eventWaitArray = Array::Cast(*args[5]);
+    for (int i=0; i<eventWaitArray->Length(); i++) {
+	Local<Object> obj = eventWaitArray->Get(i)->ToObject();
+	Event *e = ObjectWrap::Unwrap<Event>(obj);
+	event_wait_list.push_back( e->getEventWrapper() );
+    }
+
+    char *staging = new(std::nothrow) char[cb];
+    if (!staging)
+	return scope.Close(cq->fail(CL_OUT_OF_HOST_MEMORY));
+    ConvertElements(host_type, ptr, device_type, staging, n);
+
+    EventWrapper *event = 0;
+    cl_int ret = cq->enqueueTransfer(TRANSFER_WRITE, 0, mo->getMemoryObjectWrapper(),
+				     blocking_write, 0, offset, cb, staging,
+				     event_wait_list, &event);
     if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_MEM_COPY_OVERLAP);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
+	delete[] staging;
+	return scope.Close(cq->fail(ret));
+    }
+
+    if (blocking_write) {
+	delete[] staging;
+    } else if (clSetEventCallback(event->getWrapped(), CL_COMPLETE,
+				  freeStaging, staging) != CL_SUCCESS) {
+	cl_event e = event->getWrapped();
+	clWaitForEvents(1, &e);
+	delete[] staging;
     }
 
+    cq->succeed();
+    return scope.Close(Event::New(event)->handle_);
+}
+
+// Reads device_type elements from the buffer into dst, a typed array,
+// converting on the host. Always blocking, since the conversion needs
+// the data.
+/* static */
+Handle<Value> CommandQueue::enqueueReadBufferConverted(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+    MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+
+    size_t offset;
+    int device_type = args[2]->Int32Value();
+    int host_type = HostElementType(args[3]);
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[3], &host_bytes);
+    if (!ToSize(args[1], &offset) || !ptr || !CanConvert(device_type, host_type))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
+    size_t n = host_bytes / ConvertElementSize(host_type);
+    size_t cb = n * ConvertElementSize(device_type);
+
+    std::vector<EventWrapper*> event_wait_list;
+    Local<Array> eventWaitArray = Array::Cast(*args[4]);
+    for (int i=0; i<eventWaitArray->Length(); i++) {
+	Local<Object> obj = eventWaitArray->Get(i)->ToObject();
+	Event *e = ObjectWrap::Unwrap<Event>(obj);
+	event_wait_list.push_back( e->getEventWrapper() );
+    }
+
+    char *staging = new(std::nothrow) char[cb];
+    if (!staging)
+	return scope.Close(cq->fail(CL_OUT_OF_HOST_MEMORY));
+    EventWrapper *event = 0;
+    cl_int ret = cq->enqueueTransfer(TRANSFER_READ, mo->getMemoryObjectWrapper(), 0,
+				     CL_TRUE, offset, 0, cb, cb ? staging : 0,
+				     event_wait_list, &event);
+    if (ret == CL_SUCCESS)
+	ConvertElements(device_type, staging, host_type, ptr, n);
+    delete[] staging;
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -388,30 +755,26 @@ Handle<Value> CommandQueue::enqueueWriteBufferRect(const Arguments& args)
     size_t host_origin[3];
     size_t region[3];
 
-    Local<Array> bufferOrigin = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = bufferOrigin->Get(i)->NumberValue();
-	buffer_origin[i] = s;
-    }
+    if (!ToSize3(args[2], buffer_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> hostOrigin = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = hostOrigin->Get(i)->NumberValue();
-	host_origin[i] = s;
-    }
+    if (!ToSize3(args[3], host_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t buffer_row_pitch = args[5]->NumberValue();
-    size_t buffer_slice_pitch = args[6]->NumberValue();
-    size_t host_row_pitch = args[7]->NumberValue();
-    size_t host_slice_pitch = args[8]->NumberValue();
+    size_t buffer_row_pitch, buffer_slice_pitch, host_row_pitch, host_slice_pitch;
+    if (!ToSize(args[5], &buffer_row_pitch) || !ToSize(args[6], &buffer_slice_pitch) ||
+	!ToSize(args[7], &host_row_pitch) || !ToSize(args[8], &host_slice_pitch))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    void *ptr = args[9]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[9], &host_bytes);
+    cl_ulong extent;
+    if (!ptr || !RectExtent(host_origin, region, host_row_pitch, host_slice_pitch, &extent)
+	|| extent > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[10]);
@@ -435,20 +798,12 @@ Handle<Value> CommandQueue::enqueueWriteBufferRect(const Arguments& args)
 								      event_wait_list,
 								      &event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    RecordCommand(TransferStats(TRANSFER_WRITE), event,
+		  region[0] * region[1] * region[2], cq->profiling);
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -465,30 +820,26 @@ Handle<Value> CommandQueue::enqueueReadBufferRect(const Arguments& args)
     size_t host_origin[3];
     size_t region[3];
 
-    Local<Array> bufferOrigin = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = bufferOrigin->Get(i)->NumberValue();
-	buffer_origin[i] = s;
-    }
+    if (!ToSize3(args[2], buffer_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> hostOrigin = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = hostOrigin->Get(i)->NumberValue();
-	host_origin[i] = s;
-    }
+    if (!ToSize3(args[3], host_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t buffer_row_pitch = args[5]->NumberValue();
-    size_t buffer_slice_pitch = args[6]->NumberValue();
-    size_t host_row_pitch = args[7]->NumberValue();
-    size_t host_slice_pitch = args[8]->NumberValue();
+    size_t buffer_row_pitch, buffer_slice_pitch, host_row_pitch, host_slice_pitch;
+    if (!ToSize(args[5], &buffer_row_pitch) || !ToSize(args[6], &buffer_slice_pitch) ||
+	!ToSize(args[7], &host_row_pitch) || !ToSize(args[8], &host_slice_pitch))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    void *ptr = args[9]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[9], &host_bytes);
+    cl_ulong extent;
+    if (!ptr || !RectExtent(host_origin, region, host_row_pitch, host_slice_pitch, &extent)
+	|| extent > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[10]);
@@ -512,20 +863,12 @@ Handle<Value> CommandQueue::enqueueReadBufferRect(const Arguments& args)
 								     event_wait_list,
 								     &event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    RecordCommand(TransferStats(TRANSFER_READ), event,
+		  region[0] * region[1] * region[2], cq->profiling);
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -541,31 +884,22 @@ Handle<Value> CommandQueue::enqueueCopyBufferRect(const Arguments& args)
     size_t dst_origin[3];
     size_t region[3];
 
-    Local<Array> srcOrigin = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = srcOrigin->Get(i)->NumberValue();
-	src_origin[i] = s;
-    }
+    if (!ToSize3(args[2], src_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> dstOrigin = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = dstOrigin->Get(i)->NumberValue();
-	dst_origin[i] = s;
-    }
+    if (!ToSize3(args[3], dst_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t src_row_pitch = args[5]->NumberValue();
-    size_t src_slice_pitch = args[6]->NumberValue();
-    size_t dst_row_pitch = args[7]->NumberValue();
-    size_t dst_slice_pitch = args[8]->NumberValue();
+    size_t src_row_pitch, src_slice_pitch, dst_row_pitch, dst_slice_pitch;
+    if (!ToSize(args[5], &src_row_pitch) || !ToSize(args[6], &src_slice_pitch) ||
+	!ToSize(args[7], &dst_row_pitch) || !ToSize(args[8], &dst_slice_pitch))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
-    Local<Array> eventWaitArray = Array::Cast(*args[10]);
+    Local<Array> eventWaitArray = Array::Cast(*args[9]);
     for (int i=0; i<eventWaitArray->Length(); i++) {
 	Local<Object> obj = eventWaitArray->Get(i)->ToObject();
 	Event *e = ObjectWrap::Unwrap<Event>(obj);
@@ -585,21 +919,13 @@ Handle<Value> CommandQueue::enqueueCopyBufferRect(const Arguments& args)
 								     event_wait_list,
 								     &event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MEM_COPY_OVERLAP);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
 
-     return scope.Close(Event::New(event)->handle_);
+    RecordCommand(TransferStats(TRANSFER_COPY), event,
+		  region[0] * region[1] * region[2], cq->profiling);
+    cq->succeed();
+    return scope.Close(Event::New(event)->handle_);
 }
 
 /* static */
@@ -614,22 +940,21 @@ Handle<Value> CommandQueue::enqueueWriteImage(const Arguments& args)
     size_t origin[3];
     size_t region[3];
 
-    Local<Array> originArray = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = originArray->Get(i)->NumberValue();
-	origin[i] = s;
-    }
+    if (!ToSize3(args[2], origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[3], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t row_pitch = args[4]->NumberValue();
-    size_t slice_pitch = args[5]->NumberValue();
+    size_t row_pitch, slice_pitch;
+    if (!ToSize(args[4], &row_pitch) || !ToSize(args[5], &slice_pitch))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    void *ptr = args[6]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[6], &host_bytes);
+    cl_ulong extent;
+    if (!ptr || !ImageExtent(mo, region, row_pitch, slice_pitch, &extent) || extent > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[7]);
@@ -650,21 +975,10 @@ Handle<Value> CommandQueue::enqueueWriteImage(const Arguments& args)
 								 event_wait_list,
 								 &event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_OPERATION);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -680,22 +994,21 @@ Handle<Value> CommandQueue::enqueueReadImage(const Arguments& args)
     size_t origin[3];
     size_t region[3];
 
-    Local<Array> originArray = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = originArray->Get(i)->NumberValue();
-	origin[i] = s;
-    }
+    if (!ToSize3(args[2], origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[3], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t row_pitch = args[4]->NumberValue();
-    size_t slice_pitch = args[5]->NumberValue();
+    size_t row_pitch, slice_pitch;
+    if (!ToSize(args[4], &row_pitch) || !ToSize(args[5], &slice_pitch))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    void *ptr = args[6]->ToObject()->GetIndexedPropertiesExternalArrayData();
+    size_t host_bytes = 0;
+    void *ptr = BinaryViewBytes(args[6], &host_bytes);
+    cl_ulong extent;
+    if (!ptr || !ImageExtent(mo, region, row_pitch, slice_pitch, &extent) || extent > host_bytes)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[7]);
@@ -716,21 +1029,10 @@ Handle<Value> CommandQueue::enqueueReadImage(const Arguments& args)
 								event_wait_list,
 								&event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_OPERATION);
-	WEBCL_COND_RETURN_THROW(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -747,23 +1049,14 @@ Handle<Value> CommandQueue::enqueueCopyImage(const Arguments& args)
     size_t dst_origin[3];
     size_t region[3];
 
-    Local<Array> srcOriginArray = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = srcOriginArray->Get(i)->NumberValue();
-	src_origin[i] = s;
-    }
+    if (!ToSize3(args[2], src_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> dstOriginArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = dstOriginArray->Get(i)->NumberValue();
-	dst_origin[i] = s;
-    }
+    if (!ToSize3(args[3], dst_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -782,22 +1075,10 @@ Handle<Value> CommandQueue::enqueueCopyImage(const Arguments& args)
 								event_wait_list,
 								&event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_IMAGE_FORMAT_MISMATCH);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_OPERATION);
-	WEBCL_COND_RETURN_THROW(CL_MEM_COPY_OVERLAP);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -813,19 +1094,15 @@ Handle<Value> CommandQueue::enqueueCopyImageToBuffer(const Arguments& args)
     size_t src_origin[3];
     size_t region[3];
 
-    Local<Array> srcOriginArray = Array::Cast(*args[2]);
-    for (int i=0; i<3; i++) {
-	size_t s = srcOriginArray->Get(i)->NumberValue();
-	src_origin[i] = s;
-    }
+    if (!ToSize3(args[2], src_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[3], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    size_t dst_offset = args[4]->NumberValue();
+    size_t dst_offset;
+    if (!ToSize(args[4], &dst_offset))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -844,21 +1121,10 @@ Handle<Value> CommandQueue::enqueueCopyImageToBuffer(const Arguments& args)
 									event_wait_list,
 									&event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_OPERATION);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -874,19 +1140,15 @@ Handle<Value> CommandQueue::enqueueCopyBufferToImage(const Arguments& args)
     size_t dst_origin[3];
     size_t region[3];
 
-    size_t src_offset = args[2]->NumberValue();
+    size_t src_offset;
+    if (!ToSize(args[2], &src_offset))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> dstOriginArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = dstOriginArray->Get(i)->NumberValue();
-	dst_origin[i] = s;
-    }
+    if (!ToSize3(args[3], dst_origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -905,22 +1167,11 @@ Handle<Value> CommandQueue::enqueueCopyBufferToImage(const Arguments& args)
 									event_wait_list,
 									&event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_MISALIGNED_SUB_BUFFER_OFFSET);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_IMAGE_SIZE);
-	WEBCL_COND_RETURN_THROW(CL_MEM_OBJECT_ALLOCATION_FAILURE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_OPERATION);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
-    return scope.Close(Event::New(event)->handle_);  
+    cq->succeed();
+    return scope.Close(Event::New(event)->handle_);
 }
 
 /* static */
@@ -933,8 +1184,9 @@ Handle<Value> CommandQueue::enqueueMapBuffer(const Arguments& args)
     MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
     cl_bool blocking_map = args[1]->BooleanValue() ? CL_TRUE : CL_FALSE;
     cl_map_flags map_flags = args[2]->Uint32Value();
-    size_t offset = args[3]->NumberValue();
-    size_t cb = args[4]->NumberValue();
+    size_t offset, cb;
+    if (!ToSize(args[3], &offset) || !ToSize(args[4], &cb))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -955,7 +1207,15 @@ Handle<Value> CommandQueue::enqueueMapBuffer(const Arguments& args)
 								&event,
 								&result);
 
-    return scope.Close(node::Buffer::New((char*)result, cb)->handle_);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+    if (event) event->release();
+
+    Local<Object> buf = MappedBuffer(result, cb)->ToObject();
+    mo->addMapping(buf, result);
+
+    cq->succeed();
+    return scope.Close(buf);
 }
 
 /* static */
@@ -972,17 +1232,11 @@ Handle<Value> CommandQueue::enqueueMapImage(const Arguments& args)
     size_t origin[3];
     size_t region[3];
 
-    Local<Array> originArray = Array::Cast(*args[3]);
-    for (int i=0; i<3; i++) {
-	size_t s = originArray->Get(i)->NumberValue();
-	origin[i] = s;
-    }
+    if (!ToSize3(args[3], origin))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
-    Local<Array> regionArray = Array::Cast(*args[4]);
-    for (int i=0; i<3; i++) {
-	size_t s = regionArray->Get(i)->NumberValue();
-	region[i] = s;
-    }
+    if (!ToSize3(args[4], region))
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[5]);
@@ -992,26 +1246,47 @@ Handle<Value> CommandQueue::enqueueMapImage(const Arguments& args)
 	event_wait_list.push_back( e->getEventWrapper() );
     }
 
+    // before mapping, so a failure doesn't leave the image mapped
+    size_t element_size = 0;
+    cl_int ret = mo->getMemoryObjectWrapper()->getImageInfo(CL_IMAGE_ELEMENT_SIZE, element_size);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+
     EventWrapper *event = 0;
     void *result = 0;
-    size_t image_row_pitch;
-    size_t image_slice_pitch;
-
-    cl_int ret = cq->getCommandQueueWrapper()->enqueueMapImage(mo->getMemoryObjectWrapper(),
-							       blocking_map,
-							       map_flags,
-							       origin,
-							       region,
-							       event_wait_list,
-							       &event,
-							       &image_row_pitch,
-							       &image_slice_pitch,
-							       &result);
-
-    // TODO: return image_row_pitch, image_slice_pitch?
-
-    size_t nbytes = region[0] * region[1] * region[2];
-    return scope.Close(node::Buffer::New((char*)result, nbytes)->handle_);
+    size_t image_row_pitch = 0;
+    size_t image_slice_pitch = 0;
+
+    ret = cq->getCommandQueueWrapper()->enqueueMapImage(mo->getMemoryObjectWrapper(),
+							blocking_map,
+							map_flags,
+							origin,
+							region,
+							event_wait_list,
+							&event,
+							&image_row_pitch,
+							&image_slice_pitch,
+							&result);
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+    if (event) event->release();
+
+    // The view spans the pitched extent of the region: full rows and
+    // slices up to the last one, which ends after its last element.
+    // slice_pitch is 0 for 2D images, where region[2] is 1.
+    size_t nbytes = 0;
+    if (region[0] && region[1] && region[2])
+	nbytes = (region[2] - 1) * image_slice_pitch + (region[1] - 1) * image_row_pitch
+	    + region[0] * element_size;
+
+    Local<Object> buf = MappedBuffer(result, nbytes)->ToObject();
+    buf->Set(String::NewSymbol("rowPitch"), Number::New(image_row_pitch));
+    buf->Set(String::NewSymbol("slicePitch"), Number::New(image_slice_pitch));
+    buf->Set(String::NewSymbol("elementSize"), Number::New(element_size));
+    mo->addMapping(buf, result);
+
+    cq->succeed();
+    return scope.Close(buf);
 }
 
 /* static */
@@ -1022,8 +1297,10 @@ Handle<Value> CommandQueue::enqueueUnmapMemObject(const Arguments& args)
 
     // TODO: arg checking
     MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
-    node::Buffer *b = ObjectWrap::Unwrap<node::Buffer>(args[1]->ToObject());
-    void *mapped_ptr = node::Buffer::Data(b);
+    // only a view enqueueMapBuffer/enqueueMapImage returned for mo
+    void *mapped_ptr = mo->findMapping(args[1]);
+    if (!mapped_ptr)
+	return scope.Close(cq->fail(CL_INVALID_VALUE));
 
     std::vector<EventWrapper*> event_wait_list;
     Local<Array> eventWaitArray = Array::Cast(*args[2]);
@@ -1038,17 +1315,11 @@ Handle<Value> CommandQueue::enqueueUnmapMemObject(const Arguments& args)
 								     mapped_ptr,
 								     event_wait_list,
 								     &event);
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_MEM_OBJECT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT_WAIT_LIST);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+    mo->removeMapping(args[1]);
 
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -1061,14 +1332,10 @@ Handle<Value> CommandQueue::enqueueMarker(const Arguments& args)
     EventWrapper *event = 0;
     cl_int ret = cq->getCommandQueueWrapper()->enqueueMarker(&event);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return scope.Close(Event::New(event)->handle_);
 }
 
@@ -1089,16 +1356,10 @@ Handle<Value> CommandQueue::enqueueWaitForEvents(const Arguments& args)
     EventWrapper *event = 0;
     cl_int ret = cq->getCommandQueueWrapper()->enqueueWaitForEvents(event_wait_list);
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_CONTEXT);
-	WEBCL_COND_RETURN_THROW(CL_INVALID_EVENT);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
     
+    cq->succeed();
     return Undefined();
 }
 
@@ -1109,13 +1370,10 @@ Handle<Value> CommandQueue::enqueueBarrier(const Arguments& args)
     CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
     cl_int ret = cq->getCommandQueueWrapper()->enqueueBarrier();
 
-     if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
 
+    cq->succeed();
     return Undefined();
 }
 
@@ -1126,13 +1384,10 @@ Handle<Value> CommandQueue::finish(const Arguments& args)
     CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
     cl_int ret = cq->getCommandQueueWrapper()->finish();
 
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
-    }
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
 
+    cq->succeed();
     return Undefined();
 }
 
@@ -1143,16 +1398,79 @@ Handle<Value> CommandQueue::flush(const Arguments& args)
     CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
     cl_int ret = cq->getCommandQueueWrapper()->flush();
     
-    if (ret != CL_SUCCESS) {
-	WEBCL_COND_RETURN_THROW(CL_INVALID_COMMAND_QUEUE);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_RESOURCES);
-	WEBCL_COND_RETURN_THROW(CL_OUT_OF_HOST_MEMORY);
-	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
+    if (ret != CL_SUCCESS)
+	return scope.Close(cq->fail(ret));
+
+    cq->succeed();
+    return Undefined();
+}
+
+/* static */
+Handle<Value> CommandQueue::getToken(const Arguments& args)
+{
+    CommandQueue *obj = ObjectWrap::Unwrap<CommandQueue>(args.This());
+    return NewToken(TOKEN_COMMAND_QUEUE, obj->getCommandQueueWrapper());
+}
+
+// Descriptors are enqueued from the submitter thread, so kernel arguments
+// must be set before the descriptor that launches the kernel is published.
+/* static */
+Handle<Value> CommandQueue::createSubmitter(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+    cl_uint capacity = args[0]->IsUndefined() ? 256 : args[0]->Uint32Value();
+    if (capacity == 0)
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+
+    cq->getCommandQueueWrapper()->retain();
+    Submitter *s = Submitter::New(cq->getCommandQueueWrapper(), capacity);
+    return scope.Close(s->handle_);
+}
+
+// In no-throw mode a failed enqueue returns its (negative) status code
+// instead of throwing. If an Int32Array is given, element 0 receives the
+// status of every enqueue call, successful or not.
+/* static */
+Handle<Value> CommandQueue::setNoThrow(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+    cl_int *slot = 0;
+    if (!args[1]->IsUndefined() && !args[1]->IsNull()) {
+	if (!IsInt32Array(args[1]) ||
+	    args[1]->ToObject()->GetIndexedPropertiesExternalArrayDataLength() < 1)
+	    return ThrowError(CL_INVALID_VALUE);
+	slot = (cl_int*) args[1]->ToObject()->GetIndexedPropertiesExternalArrayData();
     }
 
+    if (!cq->statusArray.IsEmpty())
+	cq->statusArray.Dispose();
+    cq->statusArray.Clear();
+    if (slot)
+	cq->statusArray = Persistent<Object>::New(args[1]->ToObject());
+
+    cq->noThrow = args[0]->BooleanValue();
+    cq->statusSlot = slot;
     return Undefined();
 }
 
+// Buffer writes, reads and copies over this many bytes are split into
+// several commands (0 never splits). Returns the previous size; the
+// default is the smaller of 1 GB and the device's MAX_MEM_ALLOC_SIZE.
+/* static */
+Handle<Value> CommandQueue::setTransferChunkSize(const Arguments& args)
+{
+    HandleScope scope;
+    CommandQueue *cq = ObjectWrap::Unwrap<CommandQueue>(args.This());
+
+    size_t previous = cq->transferChunk;
+    if (!ToSize(args[0], &cq->transferChunk))
+	return ThrowError(CL_INVALID_VALUE);
+    return scope.Close(Number::New(previous));
+}
+
 /* static  */
 Handle<Value> CommandQueue::New(const Arguments& args)
 {
@@ -1167,11 +1485,45 @@ CommandQueue *CommandQueue::New(CommandQueueWrapper* cw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    CommandQueue *cached = FindCachedObject<CommandQueue>(cw);
+    if (cached) {
+	cw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     CommandQueue *commandqueue = ObjectWrap::Unwrap<CommandQueue>(obj);
     commandqueue->cw = cw;
+    CacheObject(cw, commandqueue);
+
+    // completion timestamps for the stats are only there with profiling
+    cl_command_queue_properties props = 0;
+    if (CommandQueueWrapper::commandQueueInfoHelper(cw, CL_QUEUE_PROPERTIES, sizeof(props),
+						    &props, 0) == CL_SUCCESS)
+	commandqueue->profiling = (props & CL_QUEUE_PROFILING_ENABLE) != 0;
+
+    cl_device_id device = 0;
+    if (CommandQueueWrapper::commandQueueInfoHelper(cw, CL_QUEUE_DEVICE, sizeof(device),
+						    &device, 0) == CL_SUCCESS) {
+	cl_device_exec_capabilities caps = 0;
+	if (clGetDeviceInfo(device, CL_DEVICE_EXECUTION_CAPABILITIES, sizeof(caps),
+			    &caps, 0) == CL_SUCCESS)
+	    commandqueue->nativeKernels = (caps & CL_EXEC_NATIVE_KERNEL) != 0;
+
+	cl_bool unified = CL_FALSE;
+	if (clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified),
+			    &unified, 0) == CL_SUCCESS)
+	    commandqueue->hostUnified = unified == CL_TRUE;
+
+	cl_ulong max_alloc = 0;
+	if (clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc),
+			    &max_alloc, 0) == CL_SUCCESS && max_alloc > 0
+	    && max_alloc < commandqueue->transferChunk)
+	    commandqueue->transferChunk = max_alloc;
+    }
 
     return commandqueue;
 }
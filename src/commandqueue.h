@@ -4,6 +4,7 @@
 
 #include "common.h"
 #include "wrapper/include/commandqueuewrapper.h"
+#include "stats.h"
 
 namespace webcl {
 
@@ -19,11 +20,18 @@ public:
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
 
     static v8::Handle<v8::Value> getCommandQueueInfo(const v8::Arguments& args);
+    static v8::Handle<v8::Value> getToken(const v8::Arguments& args);
+    static v8::Handle<v8::Value> createSubmitter(const v8::Arguments& args);
+    static v8::Handle<v8::Value> setNoThrow(const v8::Arguments& args);
+    static v8::Handle<v8::Value> setTransferChunkSize(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueNDRangeKernel(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueTask(const v8::Arguments& args);
+    static v8::Handle<v8::Value> enqueueNativeKernel(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueWriteBuffer(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueReadBuffer(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueCopyBuffer(const v8::Arguments& args);
+    static v8::Handle<v8::Value> enqueueWriteBufferConverted(const v8::Arguments& args);
+    static v8::Handle<v8::Value> enqueueReadBufferConverted(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueWriteBufferRect(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueReadBufferRect(const v8::Arguments& args);
     static v8::Handle<v8::Value> enqueueCopyBufferRect(const v8::Arguments& args);
@@ -48,7 +56,49 @@ public:
 
     static v8::Persistent<v8::FunctionTemplate> constructor_template;
 
+    // Failed enqueue: throws, or in no-throw mode returns the status.
+    v8::Handle<v8::Value> fail(cl_int ret);
+    // Successful enqueue: clears the status slot, if there is one.
+    void succeed() { if (statusSlot) *statusSlot = CL_SUCCESS; }
+
+    // Largest single buffer transfer: drivers mishandle some over 1 GB,
+    // and none can be over the device's CL_DEVICE_MAX_MEM_ALLOC_SIZE.
+    enum { DEFAULT_TRANSFER_CHUNK = 1 << 30 };
+
+    // Buffer write (src 0), read (dst 0) or copy, split into commands of
+    // at most transferChunk bytes with a marker as the event of the whole.
+    // The stats count it as one transfer.
+    cl_int enqueueTransfer(TransferKind kind, MemoryObjectWrapper *src,
+			   MemoryObjectWrapper *dst, cl_bool blocking,
+			   size_t src_offset, size_t dst_offset, size_t cb, char *ptr,
+			   std::vector<EventWrapper*> const& event_wait_list,
+			   EventWrapper **event);
+    cl_int enqueueChunk(TransferKind kind, MemoryObjectWrapper *src,
+			MemoryObjectWrapper *dst, cl_bool blocking,
+			size_t src_offset, size_t dst_offset, size_t cb, char *ptr,
+			std::vector<EventWrapper*> const& event_wait_list,
+			EventWrapper **event);
+    // Write or read between a MEM_USE_HOST_PTR buffer and its own
+    // allocHost memory, on a device sharing host memory: a map and unmap
+    // keep the two in step without a copy. False, with nothing enqueued,
+    // if the transfer isn't one of those.
+    bool enqueueInPlace(TransferKind kind, MemoryObjectWrapper *mw, cl_bool blocking,
+			size_t offset, size_t cb, char *ptr,
+			std::vector<EventWrapper*> const& event_wait_list,
+			EventWrapper **event, cl_int *ret);
+
     CommandQueueWrapper *cw;
+    bool profiling;
+    // device has CL_DEVICE_HOST_UNIFIED_MEMORY
+    bool hostUnified;
+    // device has CL_EXEC_NATIVE_KERNEL
+    bool nativeKernels;
+    // 0: never split
+    size_t transferChunk;
+
+    bool noThrow;
+    cl_int *statusSlot;
+    v8::Persistent<v8::Object> statusArray;
 };
 
 } // namespace
@@ -3,9 +3,157 @@
 
 #include <v8.h>
 #include <node.h>
+#include <node_buffer.h>
 
 #include <CL/cl.h>
 
+#include "wrapper/include/clwrappercommon.h"
+
+#include <cstdio>
+#include <string>
+
 #define WEBCL_COND_RETURN_THROW(error) if (ret == error) return ThrowException(Exception::Error(String::New(#error)));
 
+namespace webcl {
+
+// Name of an OpenCL error code, e.g. "CL_INVALID_VALUE" (see errors.cpp).
+const char *ErrorName(cl_int error);
+
+// Throws an Error named after the code.
+v8::Handle<v8::Value> ThrowError(cl_int error);
+
+// Each CL handle has at most one JS object. While its (weak) JS handle
+// is alive the binding object is kept in Wrapper::binding, so X::New
+// returns it instead of creating another one. node runs a single
+// isolate, so one unlocked field is enough; it needs keying per isolate
+// if tokens are ever imported into another one.
+template<typename T>
+inline T *FindCachedObject(Wrapper *w)
+{
+    return w ? static_cast<T*>(w->binding) : 0;
+}
+
+template<typename T>
+inline void CacheObject(Wrapper *w, T *obj)
+{
+    if (w)
+	w->binding = static_cast<void*>(obj);
+}
+
+template<typename T>
+inline void UncacheObject(Wrapper *w, T *obj)
+{
+    if (w && w->binding == static_cast<void*>(obj))
+	w->binding = 0;
+}
+
+// Size in bytes of one element of a typed array (or node Buffer).
+inline size_t ExternalArrayElementSize(v8::ExternalArrayType type)
+{
+    switch (type) {
+    case v8::kExternalByteArray:
+    case v8::kExternalUnsignedByteArray:
+    case v8::kExternalPixelArray:
+	return 1;
+    case v8::kExternalShortArray:
+    case v8::kExternalUnsignedShortArray:
+	return 2;
+    case v8::kExternalIntArray:
+    case v8::kExternalUnsignedIntArray:
+    case v8::kExternalFloatArray:
+	return 4;
+    case v8::kExternalDoubleArray:
+	return 8;
+    default:
+	return 0;
+    }
+}
+
+// Byte offset or size from JS: an integral Number in [0, 2^53]. Unlike
+// Uint32Value() this doesn't wrap at 4 GB, and negative, fractional or
+// non-number values are rejected instead of turning into garbage.
+inline bool ToSize(v8::Handle<v8::Value> val, size_t *out)
+{
+    if (!val->IsNumber())
+	return false;
+    double d = val->NumberValue();
+    if (!(d >= 0) || d > 9007199254740992.0 || d != (double) (cl_ulong) d
+	|| (cl_ulong) d != (size_t) d)
+	return false;
+    *out = (size_t) d;
+    return true;
+}
+
+// Three sizes (an origin or region) from a JS array.
+inline bool ToSize3(v8::Handle<v8::Value> val, size_t out[3])
+{
+    if (!val->IsArray())
+	return false;
+    v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(val);
+    if (array->Length() < 3)
+	return false;
+    for (int i=0; i<3; i++) {
+	if (!ToSize(array->Get(i), &out[i]))
+	    return false;
+    }
+    return true;
+}
+
+// Raw bytes of a binary view: node Buffer, ArrayBuffer, typed array or
+// DataView, from its byteOffset for byteLength bytes. 0 if val is none
+// of these (or its window doesn't fit its buffer).
+inline void *BinaryViewBytes(v8::Handle<v8::Value> val, size_t *nbytes)
+{
+    *nbytes = 0;
+    if (!val->IsObject())
+	return 0;
+    v8::Local<v8::Object> obj = val->ToObject();
+    if (node::Buffer::HasInstance(obj)) {
+	// an unmapped view, detached from the memory it mapped
+	if (node::Buffer::Length(obj) && !obj->GetIndexedPropertiesExternalArrayData())
+	    return 0;
+	*nbytes = node::Buffer::Length(obj);
+	return node::Buffer::Data(obj);
+    }
+
+    // Typed arrays and ArrayBuffers: the external data already starts at
+    // the view's byteOffset.
+    if (obj->HasIndexedPropertiesInExternalArrayData()) {
+	size_t elem_size = ExternalArrayElementSize(obj->GetIndexedPropertiesExternalArrayDataType());
+	if (!elem_size)
+	    return 0;
+	*nbytes = obj->GetIndexedPropertiesExternalArrayDataLength() * elem_size;
+	return obj->GetIndexedPropertiesExternalArrayData();
+    }
+
+    // DataView: a window on its ArrayBuffer
+    v8::Local<v8::Value> buffer = obj->Get(v8::String::NewSymbol("buffer"));
+    if (!buffer->IsObject() || buffer->StrictEquals(obj))
+	return 0;
+    size_t base_bytes, offset, length;
+    char *base = (char*) BinaryViewBytes(buffer, &base_bytes);
+    if (!base || !ToSize(obj->Get(v8::String::NewSymbol("byteOffset")), &offset) ||
+	!ToSize(obj->Get(v8::String::NewSymbol("byteLength")), &length) ||
+	offset > base_bytes || length > base_bytes - offset)
+	return 0;
+    *nbytes = length;
+    return base + offset;
+}
+
+// Wrap a handle returned by an info query. A wrapper created here owns
+// a reference the query did not give us, so retain the CL object for it.
+// Only getNewOrExisting knows whether it created the wrapper: another
+// thread can retain one just found at any time.
+template<typename W, typename H>
+inline W *WrapQueriedHandle(H h, cl_int (CL_API_CALL *retain)(H))
+{
+    bool created = false;
+    W *w = W::getNewOrExisting(h, &created);
+    if (created)
+	retain(h);
+    return w;
+}
+
+} // namespace
+
 #endif
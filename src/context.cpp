@@ -6,6 +6,8 @@
 #include "commandqueue.h"
 #include "event.h"
 #include "sampler.h"
+#include "token.h"
+#include "hostalloc.h"
 
 #include <iostream>
 
@@ -26,6 +28,8 @@ void CLContext::Init(Handle<Object> target)
     constructor_template->SetClassName(String::NewSymbol("WebCLContext"));
 
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getInfo", getContextInfo);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "getToken", getToken);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "createProgram", createProgramWithSource);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "createCommandQueue", createCommandQueue);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "createBuffer", createBuffer);
@@ -49,7 +53,10 @@ CLContext::CLContext(Handle<Object> wrapper) : cw(0)
     
 CLContext::~CLContext()
 {
-    if (cw) cw->release();
+    if (cw) {
+	UncacheObject(cw, this);
+	cw->release();
+    }
 }
 
 /* static */
@@ -83,7 +90,7 @@ Handle<Value> CLContext::getContextInfo(const Arguments& args)
 	Local<Array> deviceArray = Array::New(num_devices);
 	for (size_t i=0; i<num_devices; i++) {
 	    cl_device_id d = ((cl_device_id*)param_value)[i];
-	    DeviceWrapper *dw = new DeviceWrapper(d);
+	    DeviceWrapper *dw = DeviceWrapper::getNewOrExisting(d);
 	    deviceArray->Set(i, Device::New(dw)->handle_);
 	}
 	return scope.Close(deviceArray); }
@@ -144,6 +151,13 @@ Handle<Value> CLContext::createCommandQueue(const Arguments& args)
     return scope.Close(CommandQueue::New(cw)->handle_);
 }
 
+// Drops the reference a MEM_USE_HOST_PTR buffer held on its allocHost
+// block. Runs on a driver thread.
+static void CL_CALLBACK releaseHostPtr(cl_mem memobj, void *user_data)
+{
+    ReleaseHostAllocation(user_data);
+}
+
 /* static */
 Handle<Value> CLContext::createBuffer(const Arguments& args)
 {
@@ -151,11 +165,28 @@ Handle<Value> CLContext::createBuffer(const Arguments& args)
     CLContext *context = node::ObjectWrap::Unwrap<CLContext>(args.This());
     cl_mem_flags flags = args[0]->NumberValue();
     size_t size = args[1]->NumberValue();
-    
+
+    // With MEM_USE_HOST_PTR or MEM_COPY_HOST_PTR, args[2] is the host
+    // memory: any binary view of at least size bytes to copy from, but
+    // only memory from WebCL.allocHost to use. Nothing else can be kept
+    // allocated for as long as the driver may use it.
+    void *host_ptr = 0;
+    if (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) {
+	size_t host_bytes = 0;
+	host_ptr = BinaryViewBytes(args[2], &host_bytes);
+	if (!host_ptr || host_bytes < size)
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_HOST_PTR")));
+    }
+    bool pinned = flags & CL_MEM_USE_HOST_PTR;
+    if (pinned && !RetainHostAllocation(host_ptr, size))
+	return ThrowException(Exception::Error(String::New("CL_INVALID_HOST_PTR")));
+
     MemoryObjectWrapper *mw = 0;
-    cl_int ret = context->getContextWrapper()->createBuffer(flags, size, 0, &mw);
+    cl_int ret = context->getContextWrapper()->createBuffer(flags, size, host_ptr, &mw);
 
     if (ret != CL_SUCCESS) {
+	if (pinned)
+	    ReleaseHostAllocation(host_ptr);
 	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
 	WEBCL_COND_RETURN_THROW(CL_INVALID_BUFFER_SIZE);
 	WEBCL_COND_RETURN_THROW(CL_INVALID_HOST_PTR);
@@ -165,6 +196,11 @@ Handle<Value> CLContext::createBuffer(const Arguments& args)
 	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
     }
 
+    // If the callback can't be set the buffer's reference is never
+    // dropped: the block leaks rather than being freed under the driver.
+    if (pinned)
+	clSetMemObjectDestructorCallback(mw->getWrapped(), releaseHostPtr, host_ptr);
+
     return scope.Close(MemoryObject::New(mw)->handle_);
 }
 
@@ -334,6 +370,13 @@ Handle<Value> CLContext::createUserEvent(const Arguments& args)
     return scope.Close(Event::New(ew)->handle_);
 }
 
+/* static */
+Handle<Value> CLContext::getToken(const Arguments& args)
+{
+    CLContext *obj = ObjectWrap::Unwrap<CLContext>(args.This());
+    return NewToken(TOKEN_CONTEXT, obj->getContextWrapper());
+}
+
 /* static  */
 Handle<Value> CLContext::New(const Arguments& args)
 {
@@ -348,11 +391,19 @@ CLContext *CLContext::New(ContextWrapper* cw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    CLContext *cached = FindCachedObject<CLContext>(cw);
+    if (cached) {
+	cw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     CLContext *context = ObjectWrap::Unwrap<CLContext>(obj);
     context->cw = cw;
+    CacheObject(cw, context);
 
     return context;
 }
@@ -19,6 +19,7 @@ public:
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
 
     static v8::Handle<v8::Value> getContextInfo(const v8::Arguments& args);
+    static v8::Handle<v8::Value> getToken(const v8::Arguments& args);
     static v8::Handle<v8::Value> createProgramWithSource(const v8::Arguments& args);
     static v8::Handle<v8::Value> createCommandQueue(const v8::Arguments& args);
     static v8::Handle<v8::Value> createBuffer(const v8::Arguments& args);
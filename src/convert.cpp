@@ -0,0 +1,422 @@
+
+#include "convert.h"
+
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WEBCL_CONVERT_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace webcl;
+
+namespace {
+
+// Floats staged at a time for half -> double, which goes through float
+// (exactly: every half is a float, and every float a double).
+const size_t BLOCK = 256;
+
+#ifdef WEBCL_CONVERT_X86
+
+struct CpuFeatures {
+    bool avx;
+    bool f16c;
+
+    CpuFeatures() : avx(false), f16c(false)
+    {
+	unsigned int a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+	    return;
+	// AVX state must also be enabled by the OS (OSXSAVE, then XCR0)
+	bool osxsave = c & (1u << 27);
+	if (!osxsave || !(c & (1u << 28)))
+	    return;
+	unsigned int lo, hi;
+	__asm__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	avx = (lo & 6) == 6;
+	f16c = avx && (c & (1u << 29));
+    }
+};
+
+const CpuFeatures cpu;
+
+__attribute__((target("avx,f16c")))
+size_t floatToHalfF16C(const float *src, cl_half *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+	_mm_storeu_si128((__m128i*) (dst + i),
+			 _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+size_t halfToFloatF16C(const cl_half *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+	_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (src + i))));
+    return i;
+}
+
+__attribute__((target("avx")))
+size_t doubleToFloatAVX(const double *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+	_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+    return i;
+}
+
+__attribute__((target("avx")))
+size_t floatToDoubleAVX(const float *src, double *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+	_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+    return i;
+}
+
+#ifdef __SSE2__
+size_t doubleToFloatSSE2(const double *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+	__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+	__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+	_mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+    return i;
+}
+
+size_t floatToDoubleSSE2(const float *src, double *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+	__m128 v = _mm_loadu_ps(src + i);
+	_mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+	_mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    return i;
+}
+#endif
+
+#endif // WEBCL_CONVERT_X86
+
+void floatToHalf(const float *src, cl_half *dst, size_t n)
+{
+    size_t i = 0;
+#ifdef WEBCL_CONVERT_X86
+    if (cpu.f16c)
+	i = floatToHalfF16C(src, dst, n);
+#endif
+    for (; i < n; i++)
+	dst[i] = FloatToHalf(src[i]);
+}
+
+void halfToFloat(const cl_half *src, float *dst, size_t n)
+{
+    size_t i = 0;
+#ifdef WEBCL_CONVERT_X86
+    if (cpu.f16c)
+	i = halfToFloatF16C(src, dst, n);
+#endif
+    for (; i < n; i++)
+	dst[i] = HalfToFloat(src[i]);
+}
+
+void doubleToFloat(const double *src, float *dst, size_t n)
+{
+    size_t i = 0;
+#ifdef WEBCL_CONVERT_X86
+    if (cpu.avx)
+	i = doubleToFloatAVX(src, dst, n);
+#ifdef __SSE2__
+    else
+	i = doubleToFloatSSE2(src, dst, n);
+#endif
+#endif
+    for (; i < n; i++)
+	dst[i] = (float) src[i];
+}
+
+void floatToDouble(const float *src, double *dst, size_t n)
+{
+    size_t i = 0;
+#ifdef WEBCL_CONVERT_X86
+    if (cpu.avx)
+	i = floatToDoubleAVX(src, dst, n);
+#ifdef __SSE2__
+    else
+	i = floatToDoubleSSE2(src, dst, n);
+#endif
+#endif
+    for (; i < n; i++)
+	dst[i] = src[i];
+}
+
+// Not through float: rounding to float first and then to half can land
+// on a half-way point the double was not on, and round the wrong way.
+void doubleToHalf(const double *src, cl_half *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+	dst[i] = DoubleToHalf(src[i]);
+}
+
+void halfToDouble(const cl_half *src, double *dst, size_t n)
+{
+#ifdef WEBCL_CONVERT_X86
+    if (cpu.f16c) {
+	float block[BLOCK];
+	for (size_t i = 0; i < n; i += BLOCK) {
+	    size_t m = n - i < BLOCK ? n - i : BLOCK;
+	    halfToFloat(src + i, block, m);
+	    floatToDouble(block, dst + i, m);
+	}
+	return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++)
+	dst[i] = HalfToDouble(src[i]);
+}
+
+bool isInteger(int type)
+{
+    switch (type) {
+    case types::CHAR:
+    case types::UCHAR:
+    case types::SHORT:
+    case types::USHORT:
+    case types::INT:
+    case types::UINT:
+	return true;
+    default:
+	return false;
+    }
+}
+
+bool isFloat(int type)
+{
+    return type == types::HALF || type == types::FLOAT || type == types::DOUBLE;
+}
+
+template<typename S, typename D>
+void saturate(const S *src, D *dst, size_t n)
+{
+    const long long lo = (long long) std::numeric_limits<D>::min();
+    const long long hi = (long long) std::numeric_limits<D>::max();
+    for (size_t i = 0; i < n; i++) {
+	long long v = (long long) src[i];
+	dst[i] = (D) (v < lo ? lo : v > hi ? hi : v);
+    }
+}
+
+template<typename S>
+bool fromInteger(const S *src, int to, void *dst, size_t n)
+{
+    switch (to) {
+    case types::CHAR:   saturate(src, (cl_char*) dst, n); return true;
+    case types::UCHAR:  saturate(src, (cl_uchar*) dst, n); return true;
+    case types::SHORT:  saturate(src, (cl_short*) dst, n); return true;
+    case types::USHORT: saturate(src, (cl_ushort*) dst, n); return true;
+    case types::INT:    saturate(src, (cl_int*) dst, n); return true;
+    case types::UINT:   saturate(src, (cl_uint*) dst, n); return true;
+    default:
+	return false;
+    }
+}
+
+} // namespace
+
+size_t webcl::ConvertElementSize(int type)
+{
+    switch (type) {
+    case types::CHAR:
+    case types::UCHAR:
+	return 1;
+    case types::SHORT:
+    case types::USHORT:
+    case types::HALF:
+	return 2;
+    case types::INT:
+    case types::UINT:
+    case types::FLOAT:
+	return 4;
+    case types::DOUBLE:
+	return 8;
+    default:
+	return 0;
+    }
+}
+
+bool webcl::CanConvert(int from, int to)
+{
+    return (isInteger(from) && isInteger(to)) || (isFloat(from) && isFloat(to));
+}
+
+bool webcl::ConvertElements(int from, const void *src, int to, void *dst, size_t n)
+{
+    if (!CanConvert(from, to))
+	return false;
+    if (from == to) {
+	memcpy(dst, src, n * ConvertElementSize(from));
+	return true;
+    }
+
+    switch (from) {
+    case types::CHAR:   return fromInteger((const cl_char*) src, to, dst, n);
+    case types::UCHAR:  return fromInteger((const cl_uchar*) src, to, dst, n);
+    case types::SHORT:  return fromInteger((const cl_short*) src, to, dst, n);
+    case types::USHORT: return fromInteger((const cl_ushort*) src, to, dst, n);
+    case types::INT:    return fromInteger((const cl_int*) src, to, dst, n);
+    case types::UINT:   return fromInteger((const cl_uint*) src, to, dst, n);
+    case types::FLOAT:
+	if (to == types::HALF)
+	    floatToHalf((const float*) src, (cl_half*) dst, n);
+	else
+	    floatToDouble((const float*) src, (double*) dst, n);
+	return true;
+    case types::HALF:
+	if (to == types::FLOAT)
+	    halfToFloat((const cl_half*) src, (float*) dst, n);
+	else
+	    halfToDouble((const cl_half*) src, (double*) dst, n);
+	return true;
+    case types::DOUBLE:
+	if (to == types::FLOAT)
+	    doubleToFloat((const double*) src, (float*) dst, n);
+	else
+	    doubleToHalf((const double*) src, (cl_half*) dst, n);
+	return true;
+    }
+    return false;
+}
+
+cl_half webcl::FloatToHalf(float f)
+{
+    cl_uint x;
+    memcpy(&x, &f, sizeof(x));
+    cl_uint sign = (x >> 16) & 0x8000;
+    cl_uint abs = x & 0x7fffffff;
+
+    if (abs >= 0x7f800000) // inf, or NaN kept quiet
+	return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+    if (abs >= 0x47800000) // 65536 and up
+	return sign | 0x7c00;
+
+    cl_uint h, rem, halfway;
+    if (abs < 0x38800000) {
+	// half subnormal: below 2^-14
+	if (abs < 0x33000000)
+	    return sign;
+	cl_uint shift = 126 - (abs >> 23);
+	cl_uint m = (abs & 0x7fffff) | 0x800000;
+	h = m >> shift;
+	rem = m & ((1u << shift) - 1);
+	halfway = 1u << (shift - 1);
+    } else {
+	h = (abs - 0x38000000) >> 13;
+	rem = abs & 0x1fff;
+	halfway = 0x1000;
+    }
+    // round to nearest even; a carry correctly moves up an exponent
+    if (rem > halfway || (rem == halfway && (h & 1)))
+	h++;
+    return sign | h;
+}
+
+float webcl::HalfToFloat(cl_half h)
+{
+    cl_uint sign = (cl_uint) (h & 0x8000) << 16;
+    cl_uint exp = (h >> 10) & 0x1f;
+    cl_uint m = h & 0x3ff;
+    cl_uint x;
+
+    if (exp == 0) {
+	if (m == 0) {
+	    x = sign;
+	} else {
+	    cl_uint e = 113;
+	    while (!(m & 0x400)) {
+		m <<= 1;
+		e--;
+	    }
+	    x = sign | (e << 23) | ((m & 0x3ff) << 13);
+	}
+    } else if (exp == 31) {
+	x = sign | 0x7f800000 | (m << 13);
+    } else {
+	x = sign | ((exp + 112) << 23) | (m << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+cl_half webcl::DoubleToHalf(double d)
+{
+    cl_ulong x;
+    memcpy(&x, &d, sizeof(x));
+    cl_uint sign = (cl_uint) (x >> 48) & 0x8000;
+    cl_ulong abs = x & 0x7fffffffffffffffULL;
+
+    if (abs >= 0x7ff0000000000000ULL) // inf, or NaN kept quiet
+	return sign | 0x7c00 | (abs > 0x7ff0000000000000ULL
+				? 0x200 | (cl_uint) ((abs >> 42) & 0x3ff) : 0);
+    if (abs >= 0x40f0000000000000ULL) // 65536 and up
+	return sign | 0x7c00;
+
+    int exp = (int) (abs >> 52) - 1023;
+    cl_ulong m = abs & 0xfffffffffffffULL;
+    cl_ulong h, rem, halfway;
+    if (exp < -14) {
+	// half subnormal: units of 2^-24
+	if (exp < -25)
+	    return sign;
+	int shift = 28 - exp;
+	m |= 1ULL << 52;
+	h = m >> shift;
+	rem = m & ((1ULL << shift) - 1);
+	halfway = 1ULL << (shift - 1);
+    } else {
+	h = ((cl_ulong) (exp + 15) << 10) | (m >> 42);
+	rem = m & ((1ULL << 42) - 1);
+	halfway = 1ULL << 41;
+    }
+    // round to nearest even; a carry correctly moves up an exponent
+    if (rem > halfway || (rem == halfway && (h & 1)))
+	h++;
+    return sign | (cl_uint) h;
+}
+
+double webcl::HalfToDouble(cl_half h)
+{
+    cl_ulong sign = (cl_ulong) (h & 0x8000) << 48;
+    cl_ulong exp = (h >> 10) & 0x1f;
+    cl_ulong m = h & 0x3ff;
+    cl_ulong x;
+
+    if (exp == 0) {
+	if (m == 0) {
+	    x = sign;
+	} else {
+	    cl_ulong e = 1009;
+	    while (!(m & 0x400)) {
+		m <<= 1;
+		e--;
+	    }
+	    x = sign | (e << 52) | ((m & 0x3ff) << 42);
+	}
+    } else if (exp == 31) {
+	x = sign | 0x7ff0000000000000ULL | (m << 42);
+    } else {
+	x = sign | ((exp + 1008) << 52) | (m << 42);
+    }
+
+    double d;
+    memcpy(&d, &x, sizeof(d));
+    return d;
+}
@@ -0,0 +1,39 @@
+
+#ifndef WEBCL_CONVERT_H_
+#define WEBCL_CONVERT_H_
+
+#include <CL/cl.h>
+
+#include "wrapper/include/clwrappertypes.h"
+
+#include <cstddef>
+
+namespace webcl {
+
+// Element conversions done on the host while staging a converting
+// transfer (enqueueWriteBufferConverted / enqueueReadBufferConverted).
+//
+// Supported are CHAR, UCHAR, SHORT, USHORT, INT, UINT, HALF, FLOAT and
+// DOUBLE, in any pair within the integers or within the floating-point
+// types. Narrowing integers saturate; narrowing floats round to nearest
+// even, overflowing to infinity. The float/half and double/float loops
+// use F16C, AVX or SSE2 when the CPU has them.
+
+// Size of one element of type, 0 if it can't be converted.
+size_t ConvertElementSize(int type);
+
+// Whether ConvertElements supports from -> to.
+bool CanConvert(int from, int to);
+
+// Converts n elements; src and dst must not overlap.
+bool ConvertElements(int from, const void *src, int to, void *dst, size_t n);
+
+// Scalar IEEE half conversions; doubles are rounded to half directly.
+cl_half FloatToHalf(float f);
+float HalfToFloat(cl_half h);
+cl_half DoubleToHalf(double d);
+double HalfToDouble(cl_half h);
+
+} // namespace
+
+#endif
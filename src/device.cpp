@@ -1,8 +1,12 @@
 
 #include "platform.h"
 #include "device.h"
+#include "wrapper/include/clwrappertypes.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <vector>
 
 using namespace v8;
 using namespace webcl;
@@ -21,6 +25,7 @@ void Device::Init(Handle<Object> target)
     constructor_template->SetClassName(String::NewSymbol("WebCLDevice"));
 
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getInfo", getDeviceInfo);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "getAllInfo", getAllDeviceInfo);
     // TODO: getSupportedExtensions
     // TODO: getExtension
 
@@ -34,7 +39,139 @@ Device::Device(Handle<Object> wrapper) : dw(0)
     
 Device::~Device()
 {
-    if (dw) dw->release();
+    if (dw) {
+	UncacheObject(dw, this);
+	dw->release();
+    }
+}
+
+// Every device property with the type used to convert it to JS.
+static const struct {
+    cl_device_info name;
+    const char *key;
+    int type;
+} deviceInfoTable[] = {
+    { CL_DEVICE_TYPE, "DEVICE_TYPE", types::ULONG },
+    { CL_DEVICE_VENDOR_ID, "DEVICE_VENDOR_ID", types::UINT },
+    { CL_DEVICE_MAX_COMPUTE_UNITS, "DEVICE_MAX_COMPUTE_UNITS", types::UINT },
+    { CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, "DEVICE_MAX_WORK_ITEM_DIMENSIONS", types::UINT },
+    { CL_DEVICE_MAX_WORK_GROUP_SIZE, "DEVICE_MAX_WORK_GROUP_SIZE", types::SIZE_T },
+    { CL_DEVICE_MAX_WORK_ITEM_SIZES, "DEVICE_MAX_WORK_ITEM_SIZES", types::SIZE_T_V },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, "DEVICE_PREFERRED_VECTOR_WIDTH_CHAR", types::UINT },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT, "DEVICE_PREFERRED_VECTOR_WIDTH_SHORT", types::UINT },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, "DEVICE_PREFERRED_VECTOR_WIDTH_INT", types::UINT },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG, "DEVICE_PREFERRED_VECTOR_WIDTH_LONG", types::UINT },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, "DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT", types::UINT },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE, "DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE", types::UINT },
+    { CL_DEVICE_MAX_CLOCK_FREQUENCY, "DEVICE_MAX_CLOCK_FREQUENCY", types::UINT },
+    { CL_DEVICE_ADDRESS_BITS, "DEVICE_ADDRESS_BITS", types::UINT },
+    { CL_DEVICE_MAX_READ_IMAGE_ARGS, "DEVICE_MAX_READ_IMAGE_ARGS", types::UINT },
+    { CL_DEVICE_MAX_WRITE_IMAGE_ARGS, "DEVICE_MAX_WRITE_IMAGE_ARGS", types::UINT },
+    { CL_DEVICE_MAX_MEM_ALLOC_SIZE, "DEVICE_MAX_MEM_ALLOC_SIZE", types::ULONG },
+    { CL_DEVICE_IMAGE2D_MAX_WIDTH, "DEVICE_IMAGE2D_MAX_WIDTH", types::SIZE_T },
+    { CL_DEVICE_IMAGE2D_MAX_HEIGHT, "DEVICE_IMAGE2D_MAX_HEIGHT", types::SIZE_T },
+    { CL_DEVICE_IMAGE3D_MAX_WIDTH, "DEVICE_IMAGE3D_MAX_WIDTH", types::SIZE_T },
+    { CL_DEVICE_IMAGE3D_MAX_HEIGHT, "DEVICE_IMAGE3D_MAX_HEIGHT", types::SIZE_T },
+    { CL_DEVICE_IMAGE3D_MAX_DEPTH, "DEVICE_IMAGE3D_MAX_DEPTH", types::SIZE_T },
+    { CL_DEVICE_IMAGE_SUPPORT, "DEVICE_IMAGE_SUPPORT", types::BOOL },
+    { CL_DEVICE_MAX_PARAMETER_SIZE, "DEVICE_MAX_PARAMETER_SIZE", types::SIZE_T },
+    { CL_DEVICE_MAX_SAMPLERS, "DEVICE_MAX_SAMPLERS", types::UINT },
+    { CL_DEVICE_MEM_BASE_ADDR_ALIGN, "DEVICE_MEM_BASE_ADDR_ALIGN", types::UINT },
+    { CL_DEVICE_MIN_DATA_TYPE_ALIGN_SIZE, "DEVICE_MIN_DATA_TYPE_ALIGN_SIZE", types::UINT },
+    { CL_DEVICE_SINGLE_FP_CONFIG, "DEVICE_SINGLE_FP_CONFIG", types::ULONG },
+#ifdef CL_DEVICE_DOUBLE_FP_CONFIG
+    { CL_DEVICE_DOUBLE_FP_CONFIG, "DEVICE_DOUBLE_FP_CONFIG", types::ULONG },
+#endif
+#ifdef CL_DEVICE_HALF_FP_CONFIG
+    { CL_DEVICE_HALF_FP_CONFIG, "DEVICE_HALF_FP_CONFIG", types::ULONG },
+#endif
+    { CL_DEVICE_GLOBAL_MEM_CACHE_TYPE, "DEVICE_GLOBAL_MEM_CACHE_TYPE", types::UINT },
+    { CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE, "DEVICE_GLOBAL_MEM_CACHELINE_SIZE", types::UINT },
+    { CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, "DEVICE_GLOBAL_MEM_CACHE_SIZE", types::ULONG },
+    { CL_DEVICE_GLOBAL_MEM_SIZE, "DEVICE_GLOBAL_MEM_SIZE", types::ULONG },
+    { CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, "DEVICE_MAX_CONSTANT_BUFFER_SIZE", types::ULONG },
+    { CL_DEVICE_MAX_CONSTANT_ARGS, "DEVICE_MAX_CONSTANT_ARGS", types::UINT },
+    { CL_DEVICE_LOCAL_MEM_TYPE, "DEVICE_LOCAL_MEM_TYPE", types::UINT },
+    { CL_DEVICE_LOCAL_MEM_SIZE, "DEVICE_LOCAL_MEM_SIZE", types::ULONG },
+    { CL_DEVICE_ERROR_CORRECTION_SUPPORT, "DEVICE_ERROR_CORRECTION_SUPPORT", types::BOOL },
+    { CL_DEVICE_PROFILING_TIMER_RESOLUTION, "DEVICE_PROFILING_TIMER_RESOLUTION", types::SIZE_T },
+    { CL_DEVICE_ENDIAN_LITTLE, "DEVICE_ENDIAN_LITTLE", types::BOOL },
+    { CL_DEVICE_AVAILABLE, "DEVICE_AVAILABLE", types::BOOL },
+    { CL_DEVICE_COMPILER_AVAILABLE, "DEVICE_COMPILER_AVAILABLE", types::BOOL },
+    { CL_DEVICE_EXECUTION_CAPABILITIES, "DEVICE_EXECUTION_CAPABILITIES", types::ULONG },
+    { CL_DEVICE_QUEUE_PROPERTIES, "DEVICE_QUEUE_PROPERTIES", types::ULONG },
+    { CL_DEVICE_NAME, "DEVICE_NAME", types::STRING },
+    { CL_DEVICE_VENDOR, "DEVICE_VENDOR", types::STRING },
+    { CL_DRIVER_VERSION, "DRIVER_VERSION", types::STRING },
+    { CL_DEVICE_PROFILE, "DEVICE_PROFILE", types::STRING },
+    { CL_DEVICE_VERSION, "DEVICE_VERSION", types::STRING },
+    { CL_DEVICE_EXTENSIONS, "DEVICE_EXTENSIONS", types::STRING },
+    { CL_DEVICE_PLATFORM, "DEVICE_PLATFORM", types::PLATFORM },
+    { CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF, "DEVICE_PREFERRED_VECTOR_WIDTH_HALF", types::UINT },
+    { CL_DEVICE_HOST_UNIFIED_MEMORY, "DEVICE_HOST_UNIFIED_MEMORY", types::BOOL },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_CHAR, "DEVICE_NATIVE_VECTOR_WIDTH_CHAR", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_SHORT, "DEVICE_NATIVE_VECTOR_WIDTH_SHORT", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_INT, "DEVICE_NATIVE_VECTOR_WIDTH_INT", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_LONG, "DEVICE_NATIVE_VECTOR_WIDTH_LONG", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, "DEVICE_NATIVE_VECTOR_WIDTH_FLOAT", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE, "DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE", types::UINT },
+    { CL_DEVICE_NATIVE_VECTOR_WIDTH_HALF, "DEVICE_NATIVE_VECTOR_WIDTH_HALF", types::UINT },
+    { CL_DEVICE_OPENCL_C_VERSION, "DEVICE_OPENCL_C_VERSION", types::STRING },
+};
+
+static const size_t deviceInfoTableSize = sizeof(deviceInfoTable) / sizeof(deviceInfoTable[0]);
+
+static int deviceInfoType(cl_device_info param_name)
+{
+    for (size_t i=0; i<deviceInfoTableSize; i++) {
+	if (deviceInfoTable[i].name == param_name)
+	    return deviceInfoTable[i].type;
+    }
+    return types::UNKNOWN;
+}
+
+// Convert a raw info value of the given type to JS.
+static Handle<Value> deviceInfoValue(int type, char *param_value, size_t param_value_size)
+{
+    switch (type) {
+    case types::STRING:
+	return String::New(param_value);
+    case types::UINT:
+    case types::BOOL:
+	return Integer::NewFromUnsigned(*(cl_uint*)param_value);
+    case types::ULONG:
+	return Number::New(*(cl_ulong*)param_value);
+    case types::SIZE_T_V: {
+	size_t num = param_value_size / sizeof(size_t);
+	Local<Array> sizeArray = Array::New(num);
+	for (size_t i=0; i<num; i++) {
+	    size_t s = ((size_t*)param_value)[i];
+	    sizeArray->Set(i, Number::New(s));
+	}
+	return sizeArray;
+    }
+    case types::PLATFORM: {
+	cl_platform_id p = *((cl_platform_id*)param_value);
+	return Platform::New(PlatformWrapper::getNewOrExisting(p))->handle_;
+    }
+    case types::SIZE_T:
+    default:
+	return Number::New(*(size_t*)param_value);
+    }
+}
+
+// Asks for the size first, so long values such as DEVICE_EXTENSIONS are
+// never cut off. value is zeroed and padded, so strings are always
+// terminated and scalars can be read whatever size the device returned.
+static cl_int queryDeviceInfo(DeviceWrapper *dw, cl_device_info param_name,
+			      std::vector<char>& value, size_t *size)
+{
+    *size = 0;
+    cl_int ret = DeviceWrapper::deviceInfoHelper(dw, param_name, 0, 0, size);
+    if (ret != CL_SUCCESS)
+	return ret;
+    value.assign(std::max(*size, sizeof(cl_ulong)) + 1, 0);
+    return DeviceWrapper::deviceInfoHelper(dw, param_name, *size, &value[0], 0);
 }
 
 /* static */
@@ -44,13 +181,10 @@ Handle<Value> Device::getDeviceInfo(const Arguments& args)
     Device *device = ObjectWrap::Unwrap<Device>(args.This());
     Local<Value> v = args[0];
     cl_device_info param_name = v->NumberValue();
+    std::vector<char> param_value;
     size_t param_value_size_ret = 0;
-    char param_value[1024];
-    cl_int ret = DeviceWrapper::deviceInfoHelper(device->getDeviceWrapper(),
-						 param_name,
-						 sizeof(param_value),
-						 param_value,
-						 &param_value_size_ret);
+    cl_int ret = queryDeviceInfo(device->getDeviceWrapper(), param_name,
+				 param_value, &param_value_size_ret);
     if (ret != CL_SUCCESS) {
 	WEBCL_COND_RETURN_THROW(CL_INVALID_DEVICE);
 	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
@@ -59,18 +193,31 @@ Handle<Value> Device::getDeviceInfo(const Arguments& args)
 	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
     }
 
-    switch (param_name) {
-    case CL_DEVICE_NAME:
-    case CL_DEVICE_VENDOR:
-    case CL_DRIVER_VERSION:
-    case CL_DEVICE_PROFILE:
-    case CL_DEVICE_VERSION:
-    case CL_DEVICE_OPENCL_C_VERSION:
-    case CL_DEVICE_EXTENSIONS:
-	return scope.Close(String::New(param_value));
-    default:
-	return scope.Close(Number::New(*(size_t*)param_value));
+    return scope.Close(deviceInfoValue(deviceInfoType(param_name),
+				       &param_value[0], param_value_size_ret));
+}
+
+/* static */
+Handle<Value> Device::getAllDeviceInfo(const Arguments& args)
+{
+    HandleScope scope;
+    Device *device = ObjectWrap::Unwrap<Device>(args.This());
+    Local<Object> info = Object::New();
+    std::vector<char> param_value;
+
+    for (size_t i=0; i<deviceInfoTableSize; i++) {
+	size_t param_value_size_ret = 0;
+	cl_int ret = queryDeviceInfo(device->getDeviceWrapper(), deviceInfoTable[i].name,
+				     param_value, &param_value_size_ret);
+	// properties the device does not know about are left out
+	if (ret != CL_SUCCESS)
+	    continue;
+	info->Set(String::NewSymbol(deviceInfoTable[i].key),
+		  deviceInfoValue(deviceInfoTable[i].type, &param_value[0],
+				  param_value_size_ret));
     }
+
+    return scope.Close(info);
 }
 
 /* static  */
@@ -87,11 +234,19 @@ Device *Device::New(DeviceWrapper* dw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    Device *cached = FindCachedObject<Device>(dw);
+    if (cached) {
+	dw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     Device *device = ObjectWrap::Unwrap<Device>(obj);
     device->dw = dw;
+    CacheObject(dw, device);
 
     return device;
 }
@@ -19,6 +19,7 @@ public:
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
 
     static v8::Handle<v8::Value> getDeviceInfo(const v8::Arguments& args);
+    static v8::Handle<v8::Value> getAllDeviceInfo(const v8::Arguments& args);
     
     DeviceWrapper *getDeviceWrapper() { return dw; };
 
@@ -0,0 +1,90 @@
+
+#include "common.h"
+
+using namespace v8;
+
+namespace {
+
+struct ErrorEntry {
+    cl_int code;
+    const char *name;
+};
+
+#define WEBCL_ERROR_ENTRY(error) { error, #error }
+
+// OpenCL 1.1 error codes, in the order of cl.h
+const ErrorEntry errorTable[] = {
+    WEBCL_ERROR_ENTRY(CL_SUCCESS),
+    WEBCL_ERROR_ENTRY(CL_DEVICE_NOT_FOUND),
+    WEBCL_ERROR_ENTRY(CL_DEVICE_NOT_AVAILABLE),
+    WEBCL_ERROR_ENTRY(CL_COMPILER_NOT_AVAILABLE),
+    WEBCL_ERROR_ENTRY(CL_MEM_OBJECT_ALLOCATION_FAILURE),
+    WEBCL_ERROR_ENTRY(CL_OUT_OF_RESOURCES),
+    WEBCL_ERROR_ENTRY(CL_OUT_OF_HOST_MEMORY),
+    WEBCL_ERROR_ENTRY(CL_PROFILING_INFO_NOT_AVAILABLE),
+    WEBCL_ERROR_ENTRY(CL_MEM_COPY_OVERLAP),
+    WEBCL_ERROR_ENTRY(CL_IMAGE_FORMAT_MISMATCH),
+    WEBCL_ERROR_ENTRY(CL_IMAGE_FORMAT_NOT_SUPPORTED),
+    WEBCL_ERROR_ENTRY(CL_BUILD_PROGRAM_FAILURE),
+    WEBCL_ERROR_ENTRY(CL_MAP_FAILURE),
+    WEBCL_ERROR_ENTRY(CL_MISALIGNED_SUB_BUFFER_OFFSET),
+    WEBCL_ERROR_ENTRY(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST),
+    WEBCL_ERROR_ENTRY(CL_INVALID_VALUE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_DEVICE_TYPE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_PLATFORM),
+    WEBCL_ERROR_ENTRY(CL_INVALID_DEVICE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_CONTEXT),
+    WEBCL_ERROR_ENTRY(CL_INVALID_QUEUE_PROPERTIES),
+    WEBCL_ERROR_ENTRY(CL_INVALID_COMMAND_QUEUE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_HOST_PTR),
+    WEBCL_ERROR_ENTRY(CL_INVALID_MEM_OBJECT),
+    WEBCL_ERROR_ENTRY(CL_INVALID_IMAGE_FORMAT_DESCRIPTOR),
+    WEBCL_ERROR_ENTRY(CL_INVALID_IMAGE_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_SAMPLER),
+    WEBCL_ERROR_ENTRY(CL_INVALID_BINARY),
+    WEBCL_ERROR_ENTRY(CL_INVALID_BUILD_OPTIONS),
+    WEBCL_ERROR_ENTRY(CL_INVALID_PROGRAM),
+    WEBCL_ERROR_ENTRY(CL_INVALID_PROGRAM_EXECUTABLE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_KERNEL_NAME),
+    WEBCL_ERROR_ENTRY(CL_INVALID_KERNEL_DEFINITION),
+    WEBCL_ERROR_ENTRY(CL_INVALID_KERNEL),
+    WEBCL_ERROR_ENTRY(CL_INVALID_ARG_INDEX),
+    WEBCL_ERROR_ENTRY(CL_INVALID_ARG_VALUE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_ARG_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_KERNEL_ARGS),
+    WEBCL_ERROR_ENTRY(CL_INVALID_WORK_DIMENSION),
+    WEBCL_ERROR_ENTRY(CL_INVALID_WORK_GROUP_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_WORK_ITEM_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_GLOBAL_OFFSET),
+    WEBCL_ERROR_ENTRY(CL_INVALID_EVENT_WAIT_LIST),
+    WEBCL_ERROR_ENTRY(CL_INVALID_EVENT),
+    WEBCL_ERROR_ENTRY(CL_INVALID_OPERATION),
+    WEBCL_ERROR_ENTRY(CL_INVALID_GL_OBJECT),
+    WEBCL_ERROR_ENTRY(CL_INVALID_BUFFER_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_MIP_LEVEL),
+    WEBCL_ERROR_ENTRY(CL_INVALID_GLOBAL_WORK_SIZE),
+    WEBCL_ERROR_ENTRY(CL_INVALID_PROPERTY),
+};
+
+#undef WEBCL_ERROR_ENTRY
+
+} // namespace
+
+namespace webcl {
+
+const char *ErrorName(cl_int error)
+{
+    size_t count = sizeof(errorTable) / sizeof(errorTable[0]);
+    for (size_t i = 0; i < count; i++) {
+	if (errorTable[i].code == error)
+	    return errorTable[i].name;
+    }
+    return "UNKNOWN ERROR";
+}
+
+Handle<Value> ThrowError(cl_int error)
+{
+    return ThrowException(Exception::Error(String::New(ErrorName(error))));
+}
+
+} // namespace
@@ -37,7 +37,10 @@ Event::Event(Handle<Object> wrapper) : ew(0)
     
 Event::~Event()
 {
-    if (ew) ew->release();
+    if (ew) {
+	UncacheObject(ew, this);
+	ew->release();
+    }
 }
 
 /* static  */
@@ -66,12 +69,12 @@ Handle<Value> Event::getEventInfo(const Arguments& args)
     switch (param_name) {
     case CL_EVENT_CONTEXT:{
 	cl_context ctx = *((cl_context*)param_value);
-	ContextWrapper *cw = new ContextWrapper(ctx);
+	ContextWrapper *cw = WrapQueriedHandle<ContextWrapper>(ctx, clRetainContext);
 	return scope.Close(CLContext::New(cw)->handle_);
     }
     case CL_EVENT_COMMAND_QUEUE:{
 	cl_command_queue q = *((cl_command_queue*)param_value);
-	CommandQueueWrapper *qw = new CommandQueueWrapper(q);
+	CommandQueueWrapper *qw = WrapQueriedHandle<CommandQueueWrapper>(q, clRetainCommandQueue);
 	return scope.Close(CommandQueue::New(qw)->handle_);
     }
     case CL_EVENT_REFERENCE_COUNT:
@@ -154,11 +157,19 @@ Event *Event::New(EventWrapper* ew)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    Event *cached = FindCachedObject<Event>(ew);
+    if (cached) {
+	ew->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     Event *e = ObjectWrap::Unwrap<Event>(obj);
     e->ew = ew;
+    CacheObject(ew, e);
 
     return e;
 }
@@ -0,0 +1,94 @@
+
+#include "hostalloc.h"
+
+#include <map>
+#include <mutex>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace webcl;
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+struct Block {
+    size_t size;
+    int refs;
+};
+
+std::mutex g_lock;
+// by start address
+std::map<char*, Block> g_blocks;
+
+// Block holding [ptr, ptr + nbytes), g_blocks.end() if none. Call locked.
+std::map<char*, Block>::iterator findBlock(const void *ptr, size_t nbytes)
+{
+    char *p = (char*) ptr;
+    std::map<char*, Block>::iterator it = g_blocks.upper_bound(p);
+    if (it == g_blocks.begin())
+	return g_blocks.end();
+    --it;
+    size_t offset = p - it->first;
+    if (offset >= it->second.size || nbytes > it->second.size - offset)
+	return g_blocks.end();
+    return it;
+}
+
+} // namespace
+
+void *webcl::AllocHost(size_t nbytes, bool hugePages)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t align = page > 0 ? (size_t) page : 4096;
+    if (hugePages)
+	align = HUGE_PAGE_SIZE;
+    if (nbytes == 0 || nbytes > ~(size_t) 0 - align)
+	return 0;
+    size_t size = (nbytes + align - 1) / align * align;
+
+    void *ptr = 0;
+    if (posix_memalign(&ptr, align, size) != 0)
+	return 0;
+#ifdef MADV_HUGEPAGE
+    // only a hint: without THP the block simply stays on small pages
+    if (hugePages)
+	madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+    std::lock_guard<std::mutex> lock(g_lock);
+    Block b = { size, 1 };
+    g_blocks[(char*) ptr] = b;
+    return ptr;
+}
+
+bool webcl::IsHostAllocation(const void *ptr, size_t nbytes)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    return findBlock(ptr, nbytes) != g_blocks.end();
+}
+
+bool webcl::RetainHostAllocation(const void *ptr, size_t nbytes)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::map<char*, Block>::iterator it = findBlock(ptr, nbytes);
+    if (it == g_blocks.end())
+	return false;
+    it->second.refs++;
+    return true;
+}
+
+void webcl::ReleaseHostAllocation(const void *ptr)
+{
+    char *block = 0;
+    {
+	std::lock_guard<std::mutex> lock(g_lock);
+	std::map<char*, Block>::iterator it = findBlock(ptr, 0);
+	if (it == g_blocks.end() || --it->second.refs > 0)
+	    return;
+	block = it->first;
+	g_blocks.erase(it);
+    }
+    free(block);
+}
@@ -0,0 +1,36 @@
+
+#ifndef WEBCL_HOSTALLOC_H_
+#define WEBCL_HOSTALLOC_H_
+
+#include "common.h"
+
+namespace webcl {
+
+// Host memory for zero-copy buffers, handed to JS by WebCL.allocHost.
+//
+// Blocks are page aligned, which covers any CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+// and sized in whole pages, so CPU and integrated devices can use them in
+// place for buffers created with MEM_USE_HOST_PTR. With hugePages they are
+// 2 MB aligned and transparent huge pages are requested for them, which
+// cuts TLB misses when a device walks a large block.
+//
+// A block is freed when its last reference goes: the Buffer holds one,
+// and so does every buffer created over it. The registry is locked, since
+// memory object destructor callbacks run on driver threads.
+
+// A new block of at least nbytes with one reference, 0 on failure.
+void *AllocHost(size_t nbytes, bool hugePages);
+
+// Whether [ptr, ptr + nbytes) lies within one block.
+bool IsHostAllocation(const void *ptr, size_t nbytes);
+
+// Adds a reference to the block holding [ptr, ptr + nbytes); false if
+// there is none.
+bool RetainHostAllocation(const void *ptr, size_t nbytes);
+
+// Drops a reference to the block holding ptr.
+void ReleaseHostAllocation(const void *ptr);
+
+} // namespace
+
+#endif
@@ -5,15 +5,41 @@
 #include "memoryobject.h"
 #include "context.h"
 #include "device.h"
+#include "stats.h"
 #include "wrapper/include/clwrappertypes.h"
 
 #include <iostream>
+#include <cstring>
 
 using namespace v8;
 using namespace webcl;
 
 Persistent<FunctionTemplate> KernelObject::constructor_template;
 
+// Size of one component of an OpenCL vector type, e.g. 4 for FLOAT_V.
+static size_t VectorComponentSize(cl_uint type)
+{
+    switch (type) {
+    case types::CHAR_V:
+    case types::UCHAR_V:
+	return sizeof(cl_char);
+    case types::SHORT_V:
+    case types::USHORT_V:
+    case types::HALF_V:
+	return sizeof(cl_short);
+    case types::INT_V:
+    case types::UINT_V:
+    case types::FLOAT_V:
+	return sizeof(cl_int);
+    case types::LONG_V:
+    case types::ULONG_V:
+    case types::DOUBLE_V:
+	return sizeof(cl_long);
+    default:
+	return 0;
+    }
+}
+
 /* static  */
 void KernelObject::Init(Handle<Object> target)
 {
@@ -32,14 +58,17 @@ void KernelObject::Init(Handle<Object> target)
     target->Set(String::NewSymbol("WebCLKernel"), constructor_template->GetFunction());
 }
 
-KernelObject::KernelObject(Handle<Object> wrapper) : kw(0)
+KernelObject::KernelObject(Handle<Object> wrapper) : kw(0), stats(0)
 {
     Wrap(wrapper);
 }
     
 KernelObject::~KernelObject()
 {
-    if (kw) kw->release();
+    if (kw) {
+	UncacheObject(kw, this);
+	kw->release();
+    }
 }
 
 /* static */
@@ -72,11 +101,11 @@ Handle<Value> KernelObject::getKernelInfo(const Arguments& args)
 	return scope.Close(Number::New(*(size_t*)param_value));
     case CL_KERNEL_CONTEXT: {
 	cl_context ctx = *((cl_context*)param_value);
-	ContextWrapper *cw = new ContextWrapper(ctx);
+	ContextWrapper *cw = WrapQueriedHandle<ContextWrapper>(ctx, clRetainContext);
 	return scope.Close(CLContext::New(cw)->handle_); }
     case CL_KERNEL_PROGRAM: {
 	cl_program p = *((cl_program*)param_value);
-	ProgramWrapper *pw = new ProgramWrapper(p);
+	ProgramWrapper *pw = WrapQueriedHandle<ProgramWrapper>(p, clRetainProgram);
 	return scope.Close(ProgramObject::New(pw)->handle_); }
     default:
 	return scope.Close(Number::New(*(size_t*)param_value));
@@ -252,6 +281,63 @@ Handle<Value> KernelObject::setKernelArg(const Arguments& args)
 	ret = kernelObject->getKernelWrapper()->setArg(arg_index, arg_size, arg_value);
 	break;
     }
+    case types::DOUBLE: {
+	if (!args[1]->IsNumber())
+	    return ThrowException(Exception::Error(String::New("ARG is not of specified type")));
+	cl_double arg = args[1]->NumberValue();
+	arg_value = &arg;
+	arg_size = sizeof(arg);
+	ret = kernelObject->getKernelWrapper()->setArg(arg_index, arg_size, arg_value);
+	break;
+    }
+    case types::LOCAL_MEMORY_SIZE: {
+	// __local arguments only carry a size; the value must be NULL
+	if (!args[1]->IsUint32() || args[1]->Uint32Value() == 0)
+	    return ThrowException(Exception::Error(String::New("ARG is not of specified type")));
+	arg_size = args[1]->Uint32Value();
+	ret = kernelObject->getKernelWrapper()->setArg(arg_index, arg_size, 0);
+	break;
+    }
+    case types::CHAR_V:
+    case types::UCHAR_V:
+    case types::SHORT_V:
+    case types::USHORT_V:
+    case types::HALF_V:
+    case types::INT_V:
+    case types::UINT_V:
+    case types::FLOAT_V:
+    case types::LONG_V:
+    case types::ULONG_V:
+    case types::DOUBLE_V: {
+	// vector values come in as typed arrays, e.g. a Float32Array(4) for float4
+	size_t nbytes = 0;
+	void *ptr = BinaryViewBytes(args[1], &nbytes);
+	size_t comp_size = VectorComponentSize(type);
+	if (!ptr || nbytes % comp_size)
+	    return ThrowException(Exception::Error(String::New("ARG is not of specified type")));
+	size_t n = nbytes / comp_size;
+	if (n != 2 && n != 3 && n != 4 && n != 8 && n != 16)
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_ARG_SIZE")));
+	// 3-component vectors have the size and alignment of 4-component ones
+	cl_ulong vec[16];
+	memset(vec, 0, sizeof(vec));
+	memcpy(vec, ptr, nbytes);
+	arg_value = vec;
+	arg_size = (n == 3 ? 4 : n) * comp_size;
+	ret = kernelObject->getKernelWrapper()->setArg(arg_index, arg_size, arg_value);
+	break;
+    }
+    case types::STRUCT: {
+	// the typed array holds the struct exactly as laid out by the kernel
+	size_t nbytes = 0;
+	void *ptr = BinaryViewBytes(args[1], &nbytes);
+	if (!ptr || !nbytes)
+	    return ThrowException(Exception::Error(String::New("ARG is not of specified type")));
+	arg_value = ptr;
+	arg_size = nbytes;
+	ret = kernelObject->getKernelWrapper()->setArg(arg_index, arg_size, arg_value);
+	break;
+    }
     case types::UNKNOWN:
     default:
 	return ThrowException(Exception::Error(String::New("UNKNOWN TYPE")));
@@ -286,11 +372,20 @@ KernelObject *KernelObject::New(KernelWrapper* kw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    KernelObject *cached = FindCachedObject<KernelObject>(kw);
+    if (cached) {
+	kw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     KernelObject *kernel = ObjectWrap::Unwrap<KernelObject>(obj);
     kernel->kw = kw;
+    kernel->stats = KernelStats(kw);
+    CacheObject(kw, kernel);
 
     return kernel;
 }
@@ -7,6 +7,8 @@
 
 namespace webcl {
 
+struct StatsSeries;
+
 class KernelObject : public node::ObjectWrap
 {
 
@@ -23,6 +25,7 @@ public:
     static v8::Handle<v8::Value> setKernelArg(const v8::Arguments& args);
     
     KernelWrapper *getKernelWrapper() { return kw; };
+    StatsSeries *getStats() { return stats; };
 
  private:
     KernelObject(v8::Handle<v8::Object> wrapper);
@@ -30,6 +33,7 @@ public:
     static v8::Persistent<v8::FunctionTemplate> constructor_template;
 
     KernelWrapper *kw;
+    StatsSeries *stats;
 };
 
 } // namespace
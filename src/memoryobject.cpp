@@ -1,6 +1,7 @@
 
 #include "memoryobject.h"
 #include "node_buffer.h"
+#include "token.h"
 
 #include <iostream>
 
@@ -21,6 +22,8 @@ void MemoryObject::Init(Handle<Object> target)
     constructor_template->SetClassName(String::NewSymbol("WebCLMemoryObject"));
 
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getInfo", getMemObjectInfo);
+    // not in spec
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "getToken", getToken);
 
     // support getGLObjectInfo()?
 
@@ -38,9 +41,24 @@ MemoryObject::MemoryObject(Handle<Object> wrapper) : mw(0)
     Wrap(wrapper);
 }
     
+// Leaves view with no bytes, so it can't reach memory that is no longer
+// mapped; BinaryViewBytes treats such a Buffer as empty.
+static void DetachView(Handle<Object> view)
+{
+    view->SetIndexedPropertiesToExternalArrayData(0, kExternalUnsignedByteArray, 0);
+    view->Set(String::NewSymbol("length"), Integer::New(0));
+}
+
 MemoryObject::~MemoryObject()
 {
-    if (mw) mw->release();
+    for (size_t i = 0; i < mappings.size(); i++) {
+	DetachView(mappings[i].view);
+	mappings[i].view.Dispose();
+    }
+    if (mw) {
+	UncacheObject(mw, this);
+	mw->release();
+    }
 }
 
 /* static  */
@@ -79,7 +97,9 @@ Handle<Value> MemoryObject::getMemObjectInfo(const Arguments& args)
 	return scope.Close(Number::New(*(size_t*)param_value));
     case CL_MEM_ASSOCIATED_MEMOBJECT: {
 	cl_mem mem = *((cl_mem*)param_value);
-	MemoryObjectWrapper *mw = new MemoryObjectWrapper(mem);
+	if (!mem)
+	    return scope.Close(Null());
+	MemoryObjectWrapper *mw = WrapQueriedHandle<MemoryObjectWrapper>(mem, clRetainMemObject);
 	return scope.Close(MemoryObject::New(mw)->handle_);
     }
     case CL_MEM_HOST_PTR: {
@@ -183,6 +203,13 @@ Handle<Value> MemoryObject::createSubBuffer(const Arguments& args)
     return scope.Close(MemoryObject::New(mw)->handle_);
 }
 
+/* static */
+Handle<Value> MemoryObject::getToken(const Arguments& args)
+{
+    MemoryObject *obj = ObjectWrap::Unwrap<MemoryObject>(args.This());
+    return NewToken(TOKEN_MEMORY_OBJECT, obj->getMemoryObjectWrapper());
+}
+
 /* static  */
 Handle<Value> MemoryObject::New(const Arguments& args)
 {
@@ -197,11 +224,54 @@ MemoryObject *MemoryObject::New(MemoryObjectWrapper* mw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    MemoryObject *cached = FindCachedObject<MemoryObject>(mw);
+    if (cached) {
+	mw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     MemoryObject *memobj = ObjectWrap::Unwrap<MemoryObject>(obj);
     memobj->mw = mw;
+    CacheObject(mw, memobj);
 
     return memobj;
 }
+
+void MemoryObject::addMapping(Handle<Object> view, void *ptr)
+{
+    Mapping m;
+    m.view = Persistent<Object>::New(view);
+    m.ptr = ptr;
+    mappings.push_back(m);
+}
+
+void *MemoryObject::findMapping(Handle<Value> view)
+{
+    for (size_t i = 0; i < mappings.size(); i++) {
+	if (mappings[i].view->StrictEquals(view))
+	    return mappings[i].ptr;
+    }
+    return 0;
+}
+
+void MemoryObject::removeMapping(Handle<Value> view)
+{
+    for (size_t i = 0; i < mappings.size(); i++) {
+	if (mappings[i].view->StrictEquals(view)) {
+	    DetachView(mappings[i].view);
+	    mappings[i].view.Dispose();
+	    mappings.erase(mappings.begin() + i);
+	    return;
+	}
+    }
+}
+
+/* static  */
+bool MemoryObject::HasInstance(Handle<Value> val)
+{
+    return val->IsObject() && constructor_template->HasInstance(val);
+}
@@ -4,6 +4,8 @@
 #include "common.h"
 #include "wrapper/include/memoryobjectwrapper.h"
 
+#include <vector>
+
 namespace webcl {
 
 class MemoryObject : public node::ObjectWrap
@@ -16,19 +18,34 @@ public:
 
     static MemoryObject *New(MemoryObjectWrapper* mw);
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
+    static bool HasInstance(v8::Handle<v8::Value> val);
 
     static v8::Handle<v8::Value> getMemObjectInfo(const v8::Arguments& args);
+    static v8::Handle<v8::Value> getToken(const v8::Arguments& args);
     static v8::Handle<v8::Value> getImageInfo(const v8::Arguments& args);
     static v8::Handle<v8::Value> createSubBuffer(const v8::Arguments& args);
 
     MemoryObjectWrapper *getMemoryObjectWrapper() { return mw; };
 
+    // Views returned by enqueueMapBuffer/enqueueMapImage are kept until
+    // they are unmapped, then detached from the driver's memory.
+    void addMapping(v8::Handle<v8::Object> view, void *ptr);
+    // The mapped pointer behind view, 0 if it's not a live mapping.
+    void *findMapping(v8::Handle<v8::Value> view);
+    void removeMapping(v8::Handle<v8::Value> view);
+
  private:
     MemoryObject(v8::Handle<v8::Object> wrapper);
 
     static v8::Persistent<v8::FunctionTemplate> constructor_template;
 
     MemoryObjectWrapper *mw;
+
+    struct Mapping {
+	v8::Persistent<v8::Object> view;
+	void *ptr;
+    };
+    std::vector<Mapping> mappings;
 };
 
 } // namespace
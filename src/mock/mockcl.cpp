@@ -0,0 +1,2320 @@
+
+// Mock OpenCL 1.1 implementation
+//
+// A stand-in for libOpenCL with one CPU-like device, so the binding, the
+// benchmarks and anything scheduling on top of them can be exercised on
+// a machine without an OpenCL driver, with timings that do not move from
+// run to run.
+//
+// Memory objects live in host memory and transfers really move the data.
+// Programs are not compiled: building only finds the __kernel functions
+// and their argument types, which clSetKernelArg checks sizes against,
+// and NDRange launches do not run any code.
+// Native kernels do run.
+//
+// Time is simulated. Each queue has a device clock in nanoseconds that
+// every command advances by its modelled cost:
+//
+//   kernel     MOCKCL_LAUNCH_NS (5000) + MOCKCL_ITEM_NS (1) per work-item
+//   transfer   MOCKCL_TRANSFER_NS (10000) + bytes / MOCKCL_BYTES_PER_NS (8)
+//   other      MOCKCL_COMMAND_NS (1000)
+//
+// and a command starts no earlier than the end of the events it waits
+// for. Commands complete as they are enqueued, even behind a user event
+// that is still pending. Profiling info reports that clock. With
+// MOCKCL_REALTIME=1 the blocking calls (clFinish, clWaitForEvents,
+// blocking transfers and maps) also sleep for the simulated time not yet
+// slept, so wall-clock measurements see it too.
+//
+// Other knobs: MOCKCL_DEVICE_TYPE (cpu, gpu or accelerator),
+// MOCKCL_MAX_ALLOC (bytes, default 128 MB), MOCKCL_COUNTERS, a path
+// the call counters are written to as JSON at exit, and
+// MOCKCL_FAIL_TRANSFER=n, which fails the nth buffer read, write or copy
+// of the process with CL_OUT_OF_RESOURCES, to test error paths.
+//
+
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#include "CL/cl.h"
+#include "mockcl.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+namespace mockcl {
+
+struct Config {
+    cl_ulong launch_ns;
+    cl_ulong item_ns;
+    cl_ulong transfer_ns;
+    cl_ulong bytes_per_ns;
+    cl_ulong command_ns;
+    cl_ulong max_alloc;
+    cl_ulong fail_transfer;
+    cl_device_type type;
+    bool realtime;
+
+    Config()
+    {
+	launch_ns = env("MOCKCL_LAUNCH_NS", 5000);
+	item_ns = env("MOCKCL_ITEM_NS", 1);
+	transfer_ns = env("MOCKCL_TRANSFER_NS", 10000);
+	bytes_per_ns = env("MOCKCL_BYTES_PER_NS", 8);
+	if (bytes_per_ns == 0)
+	    bytes_per_ns = 1;
+	command_ns = env("MOCKCL_COMMAND_NS", 1000);
+	max_alloc = env("MOCKCL_MAX_ALLOC", 128 << 20);
+	fail_transfer = env("MOCKCL_FAIL_TRANSFER", 0);
+	realtime = env("MOCKCL_REALTIME", 0) != 0;
+
+	const char *t = getenv("MOCKCL_DEVICE_TYPE");
+	type = CL_DEVICE_TYPE_CPU;
+	if (t && !strcmp(t, "gpu"))
+	    type = CL_DEVICE_TYPE_GPU;
+	else if (t && !strcmp(t, "accelerator"))
+	    type = CL_DEVICE_TYPE_ACCELERATOR;
+    }
+
+    static cl_ulong env(const char *name, cl_ulong def)
+    {
+	const char *v = getenv(name);
+	return v ? strtoull(v, 0, 0) : def;
+    }
+};
+
+const Config &config()
+{
+    static Config c;
+    return c;
+}
+
+//
+// Counters
+//
+
+struct Counters {
+    std::mutex lock;
+    std::map<std::string, unsigned long> values;
+
+    ~Counters()
+    {
+	const char *path = getenv("MOCKCL_COUNTERS");
+	if (path)
+	    write(path);
+    }
+
+    void add(const char *name, unsigned long n)
+    {
+	std::lock_guard<std::mutex> guard(lock);
+	values[name] += n;
+    }
+
+    int write(const char *path)
+    {
+	std::lock_guard<std::mutex> guard(lock);
+	FILE *f = fopen(path, "w");
+	if (!f)
+	    return -1;
+	fprintf(f, "{");
+	for (std::map<std::string, unsigned long>::iterator i = values.begin();
+	     i != values.end(); ++i)
+	    fprintf(f, "%s\n  \"%s\": %lu", i == values.begin() ? "" : ",",
+		    i->first.c_str(), i->second);
+	fprintf(f, "\n}\n");
+	return fclose(f) == 0 ? 0 : -1;
+    }
+};
+
+Counters &counters()
+{
+    static Counters c;
+    return c;
+}
+
+#define COUNT() counters().add(__func__, 1)
+
+// One lock for all object state; the entry points are short.
+std::mutex g_lock;
+typedef std::lock_guard<std::mutex> Guard;
+
+//
+// Objects
+//
+
+enum Magic {
+    MAGIC_CONTEXT = 0x6d6f6301,
+    MAGIC_QUEUE,
+    MAGIC_MEM,
+    MAGIC_PROGRAM,
+    MAGIC_KERNEL,
+    MAGIC_EVENT,
+    MAGIC_SAMPLER
+};
+
+struct Object {
+    Magic magic;
+    std::atomic<cl_uint> refs;
+
+    Object(Magic m) : magic(m), refs(1) {}
+    virtual ~Object() { magic = Magic(0); }
+};
+
+template<typename T>
+bool valid(T *o, Magic m)
+{
+    return o && static_cast<Object*>(o)->magic == m;
+}
+
+template<typename T>
+cl_int retainObject(T *o, Magic m, cl_int err)
+{
+    if (!valid(o, m))
+	return err;
+    o->refs++;
+    return CL_SUCCESS;
+}
+
+template<typename T>
+cl_int releaseObject(T *o, Magic m, cl_int err)
+{
+    if (!valid(o, m))
+	return err;
+    if (--o->refs == 0)
+	delete o;
+    return CL_SUCCESS;
+}
+
+void setError(cl_int *errcode_ret, cl_int err)
+{
+    if (errcode_ret)
+	*errcode_ret = err;
+}
+
+} // namespace mockcl
+
+using namespace mockcl;
+
+struct _cl_platform_id {
+};
+
+struct _cl_device_id {
+};
+
+struct _cl_context : Object {
+    std::vector<cl_context_properties> properties;
+
+    _cl_context() : Object(MAGIC_CONTEXT) {}
+};
+
+struct _cl_command_queue : Object {
+    cl_context context;
+    cl_command_queue_properties properties;
+    cl_ulong clock;		// simulated device time
+    cl_ulong unslept;		// MOCKCL_REALTIME: simulated time not yet slept
+
+    _cl_command_queue(cl_context c, cl_command_queue_properties p)
+	: Object(MAGIC_QUEUE), context(c), properties(p), clock(0), unslept(0)
+    {
+	clRetainContext(context);
+    }
+    ~_cl_command_queue() { clReleaseContext(context); }
+};
+
+struct _cl_mem : Object {
+    cl_context context;
+    cl_mem_object_type type;
+    cl_mem_flags flags;
+    size_t size;
+    char *data;
+    void *host_ptr;
+    bool owned;
+    cl_mem parent;
+    size_t offset;
+    cl_uint map_count;
+    // images
+    cl_image_format format;
+    size_t element_size;
+    size_t width, height, depth;
+    size_t row_pitch, slice_pitch;
+    std::vector<std::pair<void (CL_CALLBACK *)(cl_mem, void*), void*> > destructors;
+
+    _cl_mem(cl_context c, cl_mem_object_type t, cl_mem_flags f)
+	: Object(MAGIC_MEM), context(c), type(t), flags(f), size(0), data(0),
+	  host_ptr(0), owned(false), parent(0), offset(0), map_count(0),
+	  element_size(1), width(0), height(1), depth(1), row_pitch(0), slice_pitch(0)
+    {
+	memset(&format, 0, sizeof(format));
+	clRetainContext(context);
+    }
+    ~_cl_mem()
+    {
+	// most recently registered first
+	for (size_t i=destructors.size(); i>0; i--)
+	    destructors[i-1].first(this, destructors[i-1].second);
+	if (owned)
+	    free(data);
+	if (parent)
+	    clReleaseMemObject(parent);
+	clReleaseContext(context);
+    }
+};
+
+// A kernel argument as clSetKernelArg checks it: __local ones take a
+// size and no value, the others a value of size bytes, where size is 0
+// for types the mock doesn't know (any size goes).
+struct KernelArg {
+    enum Kind { VALUE, POINTER, LOCAL } kind;
+    size_t size;
+};
+
+typedef std::vector<KernelArg> KernelArgs;
+
+struct _cl_program : Object {
+    cl_context context;
+    std::string source;
+    std::string options;
+    std::string log;
+    cl_build_status status;
+    std::vector<std::pair<std::string, KernelArgs> > kernels;	// name, arguments
+    cl_uint num_kernels;	// live kernel objects
+
+    _cl_program(cl_context c)
+	: Object(MAGIC_PROGRAM), context(c), status(CL_BUILD_NONE), num_kernels(0)
+    {
+	clRetainContext(context);
+    }
+    ~_cl_program() { clReleaseContext(context); }
+};
+
+struct _cl_kernel : Object {
+    cl_program program;
+    std::string name;
+    KernelArgs args;
+    std::vector<bool> arg_set;
+
+    _cl_kernel(cl_program p, const std::string &n, const KernelArgs &a)
+	: Object(MAGIC_KERNEL), program(p), name(n), args(a), arg_set(a.size(), false)
+    {
+	clRetainProgram(program);
+	program->num_kernels++;
+    }
+    ~_cl_kernel()
+    {
+	program->num_kernels--;
+	clReleaseProgram(program);
+    }
+};
+
+struct _cl_event : Object {
+    typedef void (CL_CALLBACK *Callback)(cl_event, cl_int, void*);
+
+    cl_context context;
+    cl_command_queue queue;	// 0 for user events
+    cl_command_type command;
+    cl_int status;
+    cl_ulong queued, submit, start, end;
+    std::vector<std::pair<Callback, void*> > callbacks;
+
+    _cl_event(cl_context c, cl_command_queue q, cl_command_type t)
+	: Object(MAGIC_EVENT), context(c), queue(q), command(t), status(CL_COMPLETE),
+	  queued(0), submit(0), start(0), end(0)
+    {
+	clRetainContext(context);
+	if (queue)
+	    clRetainCommandQueue(queue);
+    }
+    ~_cl_event()
+    {
+	if (queue)
+	    clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+    }
+};
+
+struct _cl_sampler : Object {
+    cl_context context;
+    cl_bool normalized_coords;
+    cl_addressing_mode addressing_mode;
+    cl_filter_mode filter_mode;
+
+    _cl_sampler(cl_context c) : Object(MAGIC_SAMPLER), context(c)
+    {
+	clRetainContext(context);
+    }
+    ~_cl_sampler() { clReleaseContext(context); }
+};
+
+namespace {
+
+_cl_platform_id g_platform;
+_cl_device_id g_device;
+
+// signalled whenever a user event changes status
+std::condition_variable g_event_changed;
+
+//
+// Info queries
+//
+
+cl_int info(size_t size, void *value, size_t *size_ret, const void *src, size_t n)
+{
+    if (value && size < n)
+	return CL_INVALID_VALUE;
+    if (value)
+	memcpy(value, src, n);
+    if (size_ret)
+	*size_ret = n;
+    return CL_SUCCESS;
+}
+
+template<typename T>
+cl_int infoValue(size_t size, void *value, size_t *size_ret, T v)
+{
+    return info(size, value, size_ret, &v, sizeof(T));
+}
+
+cl_int infoString(size_t size, void *value, size_t *size_ret, const std::string &s)
+{
+    return info(size, value, size_ret, s.c_str(), s.size() + 1);
+}
+
+#define INFO(type, v) \
+    return infoValue<type>(param_value_size, param_value, param_value_size_ret, v)
+#define INFO_STRING(s) \
+    return infoString(param_value_size, param_value, param_value_size_ret, s)
+#define INFO_ARRAY(p, n) \
+    return info(param_value_size, param_value, param_value_size_ret, p, n)
+
+//
+// Commands
+//
+
+cl_int checkWaitList(cl_command_queue queue, cl_uint num, const cl_event *events)
+{
+    if ((num == 0) != (events == 0))
+	return CL_INVALID_EVENT_WAIT_LIST;
+    for (cl_uint i=0; i<num; i++) {
+	if (!valid(events[i], MAGIC_EVENT))
+	    return CL_INVALID_EVENT_WAIT_LIST;
+	if (queue && events[i]->context != queue->context)
+	    return CL_INVALID_CONTEXT;
+    }
+    return CL_SUCCESS;
+}
+
+void sleepFor(cl_command_queue queue)
+{
+    if (!config().realtime || queue->unslept == 0)
+	return;
+    std::this_thread::sleep_for(std::chrono::nanoseconds(queue->unslept));
+    queue->unslept = 0;
+}
+
+// Commands complete as they are enqueued; this only moves the clock and
+// hands out the event. Call with g_lock held, after the arguments have
+// been validated.
+void enqueue(cl_command_queue queue, cl_command_type command, cl_ulong cost,
+	     cl_uint num_events, const cl_event *events, cl_event *event, bool blocking)
+{
+    cl_ulong start = queue->clock;
+    for (cl_uint i=0; i<num_events; i++)
+	if (events[i]->end > start)
+	    start = events[i]->end;
+
+    if (event) {
+	cl_event e = new _cl_event(queue->context, queue, command);
+	e->queued = e->submit = queue->clock;
+	e->start = start;
+	e->end = start + cost;
+	*event = e;
+    }
+
+    queue->unslept += start + cost - queue->clock;
+    queue->clock = start + cost;
+    if (blocking)
+	sleepFor(queue);
+}
+
+cl_ulong transferCost(size_t bytes)
+{
+    return config().transfer_ns + bytes / config().bytes_per_ns;
+}
+
+// Whether this buffer read, write or copy is the one MOCKCL_FAIL_TRANSFER
+// picks. Called once per valid transfer, before any data moves.
+bool failTransfer()
+{
+    static std::atomic<cl_ulong> transfers(0);
+    return config().fail_transfer && ++transfers == config().fail_transfer;
+}
+
+// Copies a 3D region of bytes, origins and region[0] in bytes.
+void copyRect(char *dst, const size_t *dst_origin, size_t dst_row, size_t dst_slice,
+	      const char *src, const size_t *src_origin, size_t src_row, size_t src_slice,
+	      const size_t *region)
+{
+    for (size_t z=0; z<region[2]; z++)
+	for (size_t y=0; y<region[1]; y++)
+	    memmove(dst + dst_origin[0] + (dst_origin[1] + y) * dst_row
+		    + (dst_origin[2] + z) * dst_slice,
+		    src + src_origin[0] + (src_origin[1] + y) * src_row
+		    + (src_origin[2] + z) * src_slice,
+		    region[0]);
+}
+
+// Fills in default pitches and checks the region fits in size bytes.
+bool rectFits(const size_t *origin, const size_t *region,
+	      size_t *row_pitch, size_t *slice_pitch, size_t size)
+{
+    if (region[0] == 0 || region[1] == 0 || region[2] == 0)
+	return false;
+    if (*row_pitch == 0)
+	*row_pitch = region[0];
+    if (*slice_pitch == 0)
+	*slice_pitch = region[1] * *row_pitch;
+    if (*row_pitch < region[0] || *slice_pitch < region[1] * *row_pitch)
+	return false;
+    size_t last = origin[0] + region[0] - 1
+	+ (origin[1] + region[1] - 1) * *row_pitch
+	+ (origin[2] + region[2] - 1) * *slice_pitch;
+    return last < size;
+}
+
+bool isBuffer(cl_mem m)
+{
+    return valid(m, MAGIC_MEM) && m->type == CL_MEM_OBJECT_BUFFER;
+}
+
+bool isMem(cl_mem m)
+{
+    return valid(m, MAGIC_MEM);
+}
+
+bool isImage(cl_mem m)
+{
+    return valid(m, MAGIC_MEM) && m->type != CL_MEM_OBJECT_BUFFER;
+}
+
+// Converts an image origin/region in pixels to bytes and checks bounds.
+bool imageRect(cl_mem image, const size_t *origin, const size_t *region,
+	       size_t *byte_origin, size_t *byte_region)
+{
+    if (origin[0] + region[0] > image->width || origin[1] + region[1] > image->height
+	|| origin[2] + region[2] > image->depth)
+	return false;
+    if (region[0] == 0 || region[1] == 0 || region[2] == 0)
+	return false;
+    byte_origin[0] = origin[0] * image->element_size;
+    byte_origin[1] = origin[1];
+    byte_origin[2] = origin[2];
+    byte_region[0] = region[0] * image->element_size;
+    byte_region[1] = region[1];
+    byte_region[2] = region[2];
+    return true;
+}
+
+size_t imageElementSize(const cl_image_format *format)
+{
+    size_t channels;
+    switch (format->image_channel_order) {
+    case CL_R: case CL_A: case CL_INTENSITY: case CL_LUMINANCE: case CL_Rx:
+	channels = 1; break;
+    case CL_RG: case CL_RA: case CL_RGx:
+	channels = 2; break;
+    case CL_RGB: case CL_RGBx:
+	channels = 3; break;
+    case CL_RGBA: case CL_BGRA: case CL_ARGB:
+	channels = 4; break;
+    default:
+	return 0;
+    }
+    switch (format->image_channel_data_type) {
+    case CL_SNORM_INT8: case CL_UNORM_INT8: case CL_SIGNED_INT8: case CL_UNSIGNED_INT8:
+	return channels;
+    case CL_SNORM_INT16: case CL_UNORM_INT16: case CL_SIGNED_INT16:
+    case CL_UNSIGNED_INT16: case CL_HALF_FLOAT:
+	return channels * 2;
+    case CL_SIGNED_INT32: case CL_UNSIGNED_INT32: case CL_FLOAT:
+	return channels * 4;
+    case CL_UNORM_SHORT_565: case CL_UNORM_SHORT_555:
+	return channels == 3 ? 2 : 0;
+    case CL_UNORM_INT_101010:
+	return channels == 3 ? 4 : 0;
+    default:
+	return 0;
+    }
+}
+
+cl_int checkMemFlags(cl_mem_flags flags, void *host_ptr)
+{
+    cl_mem_flags access = flags & (CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY);
+    if (access & (access - 1))
+	return CL_INVALID_VALUE;
+    if ((flags & CL_MEM_USE_HOST_PTR) && (flags & (CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR)))
+	return CL_INVALID_VALUE;
+    if ((host_ptr != 0) != ((flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)) != 0))
+	return CL_INVALID_HOST_PTR;
+    return CL_SUCCESS;
+}
+
+// Allocates (or adopts) the backing store of a new memory object.
+cl_int allocate(cl_mem mem, size_t size, void *host_ptr)
+{
+    mem->size = size;
+    if (mem->flags & CL_MEM_USE_HOST_PTR) {
+	mem->data = (char*)host_ptr;
+	mem->host_ptr = host_ptr;
+	return CL_SUCCESS;
+    }
+    mem->data = (char*)calloc(1, size);
+    if (!mem->data)
+	return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    mem->owned = true;
+    if (mem->flags & CL_MEM_COPY_HOST_PTR)
+	memcpy(mem->data, host_ptr, size);
+    return CL_SUCCESS;
+}
+
+cl_mem createImage(cl_context context, cl_mem_flags flags, const cl_image_format *format,
+		   cl_mem_object_type type, size_t width, size_t height, size_t depth,
+		   size_t row_pitch, size_t slice_pitch, void *host_ptr, cl_int *errcode_ret)
+{
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    cl_int err = checkMemFlags(flags, host_ptr);
+    if (err != CL_SUCCESS) {
+	setError(errcode_ret, err);
+	return 0;
+    }
+    size_t element_size = format ? imageElementSize(format) : 0;
+    if (!element_size) {
+	setError(errcode_ret, format ? CL_IMAGE_FORMAT_NOT_SUPPORTED
+		 : CL_INVALID_IMAGE_FORMAT_DESCRIPTOR);
+	return 0;
+    }
+    if (width == 0 || height == 0 || depth == 0 || width > 8192 || height > 8192
+	|| (type == CL_MEM_OBJECT_IMAGE3D && (depth < 2 || depth > 2048))) {
+	setError(errcode_ret, CL_INVALID_IMAGE_SIZE);
+	return 0;
+    }
+    if (!host_ptr && (row_pitch || slice_pitch)) {
+	setError(errcode_ret, CL_INVALID_IMAGE_SIZE);
+	return 0;
+    }
+    if (row_pitch == 0)
+	row_pitch = width * element_size;
+    if (slice_pitch == 0)
+	slice_pitch = row_pitch * height;
+    if (row_pitch < width * element_size || slice_pitch < row_pitch * height) {
+	setError(errcode_ret, CL_INVALID_IMAGE_SIZE);
+	return 0;
+    }
+
+    cl_mem mem = new _cl_mem(context, type, flags);
+    mem->format = *format;
+    mem->element_size = element_size;
+    mem->width = width;
+    mem->height = height;
+    mem->depth = depth;
+    mem->row_pitch = row_pitch;
+    mem->slice_pitch = type == CL_MEM_OBJECT_IMAGE3D ? slice_pitch : 0;
+    err = allocate(mem, slice_pitch * depth, host_ptr);
+    if (err != CL_SUCCESS) {
+	delete mem;
+	mem = 0;
+    }
+    setError(errcode_ret, err);
+    return mem;
+}
+
+// Size of a scalar or vector type such as "uint" or "float3", 0 if it
+// isn't one.
+size_t typeSize(const std::string &type)
+{
+    static const struct { const char *name; size_t size; } scalars[] = {
+	{ "char", 1 }, { "uchar", 1 }, { "short", 2 }, { "ushort", 2 },
+	{ "int", 4 }, { "uint", 4 }, { "long", 8 }, { "ulong", 8 },
+	{ "half", 2 }, { "float", 4 }, { "double", 8 }
+    };
+    size_t digits = type.find_first_of("0123456789");
+    std::string base = type.substr(0, digits);
+    int n = digits == std::string::npos ? 1 : atoi(type.c_str() + digits);
+    if (n != 1 && n != 2 && n != 3 && n != 4 && n != 8 && n != 16)
+	return 0;
+    if (n != 1 && type.find_first_not_of("0123456789", digits) != std::string::npos)
+	return 0;
+    for (size_t i=0; i<sizeof(scalars)/sizeof(scalars[0]); i++)
+	if (base == scalars[i].name)
+	    return scalars[i].size * (n == 3 ? 4 : n);	// 3-vectors are sized as 4
+    return 0;
+}
+
+// One parameter declaration, e.g. "__global const float *a".
+KernelArg parseArg(const std::string &param)
+{
+    static const char *ignored[] = {
+	"const", "volatile", "restrict", "__private", "private", "__global", "global",
+	"__constant", "constant", "__read_only", "read_only", "__write_only",
+	"write_only", "__read_write", "read_write"
+    };
+    std::vector<std::string> words;
+    bool pointer = false, local = false;
+    for (size_t i = 0; i < param.size(); ) {
+	if (param[i] == '*' || param[i] == '[')
+	    pointer = true;
+	if (!isalnum((unsigned char)param[i]) && param[i] != '_') {
+	    i++;
+	    continue;
+	}
+	size_t begin = i;
+	while (i < param.size() && (isalnum((unsigned char)param[i]) || param[i] == '_'))
+	    i++;
+	std::string word = param.substr(begin, i - begin);
+	bool skip = false;
+	for (size_t q=0; q<sizeof(ignored)/sizeof(ignored[0]); q++)
+	    skip = skip || word == ignored[q];
+	if (word == "__local" || word == "local")
+	    local = true;
+	else if (!skip)
+	    words.push_back(word);
+    }
+
+    KernelArg arg;
+    arg.kind = local ? KernelArg::LOCAL : pointer ? KernelArg::POINTER : KernelArg::VALUE;
+    arg.size = 0;
+    if (arg.kind == KernelArg::POINTER) {
+	arg.size = sizeof(cl_mem);
+    } else if (arg.kind == KernelArg::VALUE && words.size() >= 2) {
+	// the type, then the name
+	std::string type = words[0];
+	if (type == "unsigned")
+	    type = words.size() > 2 ? "u" + words[1] : "uint";
+	else if (words.size() > 2)
+	    type = "";
+	arg.size = typeSize(type);
+    }
+    return arg;
+}
+
+// Finds "__kernel void name(args)" in source. Returns false if a kernel
+// signature is malformed.
+bool parseKernels(const std::string &src, std::vector<std::pair<std::string, KernelArgs> > *kernels)
+{
+    static const char *qualifiers[] = { "__kernel", "kernel" };
+    size_t pos = 0;
+    while (pos < src.size()) {
+	size_t found = std::string::npos, len = 0;
+	for (int q=0; q<2; q++) {
+	    size_t p = src.find(qualifiers[q], pos);
+	    while (p != std::string::npos && p > 0
+		   && (isalnum((unsigned char)src[p-1]) || src[p-1] == '_'))
+		p = src.find(qualifiers[q], p + 1);
+	    if (p < found) {
+		found = p;
+		len = strlen(qualifiers[q]);
+	    }
+	}
+	if (found == std::string::npos)
+	    break;
+	pos = found + len;
+	if (pos < src.size() && (isalnum((unsigned char)src[pos]) || src[pos] == '_'))
+	    continue;
+
+	size_t open = src.find('(', pos);
+	if (open == std::string::npos)
+	    return false;
+	// the name is the last identifier before the parenthesis
+	size_t end = open;
+	while (end > pos && isspace((unsigned char)src[end-1]))
+	    end--;
+	size_t begin = end;
+	while (begin > pos && (isalnum((unsigned char)src[begin-1]) || src[begin-1] == '_'))
+	    begin--;
+	if (begin == end)
+	    return false;
+
+	KernelArgs args;
+	int depth = 1;
+	size_t i, param = open + 1;
+	for (i = open + 1; i < src.size() && depth > 0; i++) {
+	    char c = src[i];
+	    if (c == '(')
+		depth++;
+	    else if (c == ')')
+		depth--;
+	    if ((c == ',' && depth == 1) || depth == 0) {
+		args.push_back(parseArg(src.substr(param, i - param)));
+		param = i + 1;
+	    }
+	}
+	if (depth != 0)
+	    return false;
+	// "()" and "(void)" take no arguments
+	std::string params = src.substr(open + 1, i - open - 2);
+	size_t first = params.find_first_not_of(" \t\r\n");
+	size_t last = params.find_last_not_of(" \t\r\n");
+	if (args.size() == 1
+	    && (first == std::string::npos || params.substr(first, last + 1 - first) == "void"))
+	    args.clear();
+	kernels->push_back(std::make_pair(src.substr(begin, end - begin), args));
+	pos = i;
+    }
+    return true;
+}
+
+} // namespace
+
+//
+// Platform and device
+//
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetPlatformIDs(cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms)
+{
+    COUNT();
+    if ((num_entries == 0 && platforms) || (!platforms && !num_platforms))
+	return CL_INVALID_VALUE;
+    if (platforms)
+	platforms[0] = &g_platform;
+    if (num_platforms)
+	*num_platforms = 1;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetPlatformInfo(cl_platform_id platform, cl_platform_info param_name,
+		  size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (platform != &g_platform)
+	return CL_INVALID_PLATFORM;
+    switch (param_name) {
+    case CL_PLATFORM_PROFILE: INFO_STRING("FULL_PROFILE");
+    case CL_PLATFORM_VERSION: INFO_STRING("OpenCL 1.1 mock");
+    case CL_PLATFORM_NAME: INFO_STRING("Mock OpenCL");
+    case CL_PLATFORM_VENDOR: INFO_STRING("node-webcl");
+    case CL_PLATFORM_EXTENSIONS: INFO_STRING("");
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetDeviceIDs(cl_platform_id platform, cl_device_type device_type, cl_uint num_entries,
+	       cl_device_id *devices, cl_uint *num_devices)
+{
+    COUNT();
+    if (platform != &g_platform)
+	return CL_INVALID_PLATFORM;
+    if ((num_entries == 0 && devices) || (!devices && !num_devices))
+	return CL_INVALID_VALUE;
+    if (device_type != CL_DEVICE_TYPE_ALL && device_type != CL_DEVICE_TYPE_DEFAULT
+	&& !(device_type & config().type))
+	return CL_DEVICE_NOT_FOUND;
+    if (devices)
+	devices[0] = &g_device;
+    if (num_devices)
+	*num_devices = 1;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetDeviceInfo(cl_device_id device, cl_device_info param_name,
+		size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (device != &g_device)
+	return CL_INVALID_DEVICE;
+
+    static const size_t work_item_sizes[3] = { 1024, 1024, 1024 };
+    switch (param_name) {
+    case CL_DEVICE_TYPE: INFO(cl_device_type, config().type);
+    case CL_DEVICE_VENDOR_ID: INFO(cl_uint, 0);
+    case CL_DEVICE_MAX_COMPUTE_UNITS: INFO(cl_uint, 4);
+    case CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS: INFO(cl_uint, 3);
+    case CL_DEVICE_MAX_WORK_ITEM_SIZES: INFO_ARRAY(work_item_sizes, sizeof(work_item_sizes));
+    case CL_DEVICE_MAX_WORK_GROUP_SIZE: INFO(size_t, 1024);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR: INFO(cl_uint, 16);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT: INFO(cl_uint, 8);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT: INFO(cl_uint, 4);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG: INFO(cl_uint, 2);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT: INFO(cl_uint, 4);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE: INFO(cl_uint, 2);
+    case CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF: INFO(cl_uint, 0);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_CHAR: INFO(cl_uint, 16);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_SHORT: INFO(cl_uint, 8);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_INT: INFO(cl_uint, 4);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_LONG: INFO(cl_uint, 2);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT: INFO(cl_uint, 4);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE: INFO(cl_uint, 2);
+    case CL_DEVICE_NATIVE_VECTOR_WIDTH_HALF: INFO(cl_uint, 0);
+    case CL_DEVICE_MAX_CLOCK_FREQUENCY: INFO(cl_uint, 1000);
+    case CL_DEVICE_ADDRESS_BITS: INFO(cl_uint, sizeof(void*) * 8);
+    case CL_DEVICE_MAX_MEM_ALLOC_SIZE: INFO(cl_ulong, config().max_alloc);
+    case CL_DEVICE_IMAGE_SUPPORT: INFO(cl_bool, CL_TRUE);
+    case CL_DEVICE_MAX_READ_IMAGE_ARGS: INFO(cl_uint, 128);
+    case CL_DEVICE_MAX_WRITE_IMAGE_ARGS: INFO(cl_uint, 8);
+    case CL_DEVICE_IMAGE2D_MAX_WIDTH: INFO(size_t, 8192);
+    case CL_DEVICE_IMAGE2D_MAX_HEIGHT: INFO(size_t, 8192);
+    case CL_DEVICE_IMAGE3D_MAX_WIDTH: INFO(size_t, 2048);
+    case CL_DEVICE_IMAGE3D_MAX_HEIGHT: INFO(size_t, 2048);
+    case CL_DEVICE_IMAGE3D_MAX_DEPTH: INFO(size_t, 2048);
+    case CL_DEVICE_MAX_SAMPLERS: INFO(cl_uint, 16);
+    case CL_DEVICE_MAX_PARAMETER_SIZE: INFO(size_t, 1024);
+    case CL_DEVICE_MEM_BASE_ADDR_ALIGN: INFO(cl_uint, 1024);
+    case CL_DEVICE_MIN_DATA_TYPE_ALIGN_SIZE: INFO(cl_uint, 128);
+    case CL_DEVICE_SINGLE_FP_CONFIG:
+	INFO(cl_device_fp_config, CL_FP_DENORM | CL_FP_INF_NAN | CL_FP_ROUND_TO_NEAREST);
+    case CL_DEVICE_GLOBAL_MEM_CACHE_TYPE: INFO(cl_device_mem_cache_type, CL_READ_WRITE_CACHE);
+    case CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE: INFO(cl_uint, 64);
+    case CL_DEVICE_GLOBAL_MEM_CACHE_SIZE: INFO(cl_ulong, 256 << 10);
+    case CL_DEVICE_GLOBAL_MEM_SIZE: INFO(cl_ulong, config().max_alloc * 4);
+    case CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE: INFO(cl_ulong, 64 << 10);
+    case CL_DEVICE_MAX_CONSTANT_ARGS: INFO(cl_uint, 8);
+    case CL_DEVICE_LOCAL_MEM_TYPE: INFO(cl_device_local_mem_type, CL_GLOBAL);
+    case CL_DEVICE_LOCAL_MEM_SIZE: INFO(cl_ulong, 32 << 10);
+    case CL_DEVICE_ERROR_CORRECTION_SUPPORT: INFO(cl_bool, CL_FALSE);
+    case CL_DEVICE_HOST_UNIFIED_MEMORY: INFO(cl_bool, CL_TRUE);
+    case CL_DEVICE_PROFILING_TIMER_RESOLUTION: INFO(size_t, 1);
+    case CL_DEVICE_ENDIAN_LITTLE: INFO(cl_bool, CL_TRUE);
+    case CL_DEVICE_AVAILABLE: INFO(cl_bool, CL_TRUE);
+    case CL_DEVICE_COMPILER_AVAILABLE: INFO(cl_bool, CL_TRUE);
+    case CL_DEVICE_EXECUTION_CAPABILITIES:
+	INFO(cl_device_exec_capabilities, CL_EXEC_KERNEL | CL_EXEC_NATIVE_KERNEL);
+    case CL_DEVICE_QUEUE_PROPERTIES:
+	INFO(cl_command_queue_properties,
+	     CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+    case CL_DEVICE_PLATFORM: INFO(cl_platform_id, &g_platform);
+    case CL_DEVICE_NAME: INFO_STRING("Mock device");
+    case CL_DEVICE_VENDOR: INFO_STRING("node-webcl");
+    case CL_DRIVER_VERSION: INFO_STRING("1.0");
+    case CL_DEVICE_PROFILE: INFO_STRING("FULL_PROFILE");
+    case CL_DEVICE_VERSION: INFO_STRING("OpenCL 1.1 mock");
+    case CL_DEVICE_OPENCL_C_VERSION: INFO_STRING("OpenCL C 1.1");
+    case CL_DEVICE_EXTENSIONS: INFO_STRING("");
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Context
+//
+
+CL_API_ENTRY cl_context CL_API_CALL
+clCreateContext(const cl_context_properties *properties, cl_uint num_devices,
+		const cl_device_id *devices,
+		void (CL_CALLBACK *pfn_notify)(const char*, const void*, size_t, void*),
+		void *user_data, cl_int *errcode_ret)
+{
+    COUNT();
+    if (num_devices == 0 || !devices || (!pfn_notify && user_data)) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    for (cl_uint i=0; i<num_devices; i++) {
+	if (devices[i] != &g_device) {
+	    setError(errcode_ret, CL_INVALID_DEVICE);
+	    return 0;
+	}
+    }
+
+    cl_context context = new _cl_context();
+    for (const cl_context_properties *p = properties; p && p[0]; p += 2) {
+	if (p[0] != CL_CONTEXT_PLATFORM || (cl_platform_id)p[1] != &g_platform) {
+	    delete context;
+	    setError(errcode_ret, p[0] == CL_CONTEXT_PLATFORM ? CL_INVALID_PLATFORM
+		     : CL_INVALID_PROPERTY);
+	    return 0;
+	}
+	context->properties.push_back(p[0]);
+	context->properties.push_back(p[1]);
+    }
+    if (!context->properties.empty())
+	context->properties.push_back(0);
+    setError(errcode_ret, CL_SUCCESS);
+    return context;
+}
+
+CL_API_ENTRY cl_context CL_API_CALL
+clCreateContextFromType(const cl_context_properties *properties, cl_device_type device_type,
+			void (CL_CALLBACK *pfn_notify)(const char*, const void*, size_t, void*),
+			void *user_data, cl_int *errcode_ret)
+{
+    COUNT();
+    if (device_type != CL_DEVICE_TYPE_ALL && device_type != CL_DEVICE_TYPE_DEFAULT
+	&& !(device_type & config().type)) {
+	setError(errcode_ret, CL_DEVICE_NOT_FOUND);
+	return 0;
+    }
+    cl_device_id device = &g_device;
+    return clCreateContext(properties, 1, &device, pfn_notify, user_data, errcode_ret);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainContext(cl_context context)
+{
+    COUNT();
+    return retainObject(context, MAGIC_CONTEXT, CL_INVALID_CONTEXT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseContext(cl_context context)
+{
+    COUNT();
+    return releaseObject(context, MAGIC_CONTEXT, CL_INVALID_CONTEXT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetContextInfo(cl_context context, cl_context_info param_name,
+		 size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT))
+	return CL_INVALID_CONTEXT;
+    cl_device_id device = &g_device;
+    switch (param_name) {
+    case CL_CONTEXT_REFERENCE_COUNT: INFO(cl_uint, context->refs);
+    case CL_CONTEXT_NUM_DEVICES: INFO(cl_uint, 1);
+    case CL_CONTEXT_DEVICES: INFO(cl_device_id, device);
+    case CL_CONTEXT_PROPERTIES:
+	INFO_ARRAY(context->properties.empty() ? 0 : &context->properties[0],
+		   context->properties.size() * sizeof(cl_context_properties));
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Command queue
+//
+
+CL_API_ENTRY cl_command_queue CL_API_CALL
+clCreateCommandQueue(cl_context context, cl_device_id device,
+		     cl_command_queue_properties properties, cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    if (device != &g_device) {
+	setError(errcode_ret, CL_INVALID_DEVICE);
+	return 0;
+    }
+    if (properties & ~(cl_command_queue_properties)(CL_QUEUE_PROFILING_ENABLE
+						    | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    Guard guard(g_lock);
+    setError(errcode_ret, CL_SUCCESS);
+    return new _cl_command_queue(context, properties);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainCommandQueue(cl_command_queue command_queue)
+{
+    COUNT();
+    return retainObject(command_queue, MAGIC_QUEUE, CL_INVALID_COMMAND_QUEUE);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseCommandQueue(cl_command_queue command_queue)
+{
+    COUNT();
+    return releaseObject(command_queue, MAGIC_QUEUE, CL_INVALID_COMMAND_QUEUE);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetCommandQueueInfo(cl_command_queue command_queue, cl_command_queue_info param_name,
+		      size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    switch (param_name) {
+    case CL_QUEUE_CONTEXT: INFO(cl_context, command_queue->context);
+    case CL_QUEUE_DEVICE: INFO(cl_device_id, &g_device);
+    case CL_QUEUE_REFERENCE_COUNT: INFO(cl_uint, command_queue->refs);
+    case CL_QUEUE_PROPERTIES: INFO(cl_command_queue_properties, command_queue->properties);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clFlush(cl_command_queue command_queue)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clFinish(cl_command_queue command_queue)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    Guard guard(g_lock);
+    sleepFor(command_queue);
+    return CL_SUCCESS;
+}
+
+//
+// Memory objects
+//
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr,
+	       cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    cl_int err = checkMemFlags(flags, host_ptr);
+    if (err != CL_SUCCESS) {
+	setError(errcode_ret, err);
+	return 0;
+    }
+    if (size == 0 || size > config().max_alloc) {
+	setError(errcode_ret, CL_INVALID_BUFFER_SIZE);
+	return 0;
+    }
+    cl_mem mem = new _cl_mem(context, CL_MEM_OBJECT_BUFFER, flags);
+    err = allocate(mem, size, host_ptr);
+    if (err != CL_SUCCESS) {
+	delete mem;
+	mem = 0;
+    }
+    setError(errcode_ret, err);
+    return mem;
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateSubBuffer(cl_mem buffer, cl_mem_flags flags, cl_buffer_create_type create_type,
+		  const void *create_info, cl_int *errcode_ret)
+{
+    COUNT();
+    if (!isBuffer(buffer) || buffer->parent) {
+	setError(errcode_ret, CL_INVALID_MEM_OBJECT);
+	return 0;
+    }
+    if (create_type != CL_BUFFER_CREATE_TYPE_REGION || !create_info
+	|| (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR))) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    const cl_buffer_region *region = (const cl_buffer_region*)create_info;
+    if (region->size == 0) {
+	setError(errcode_ret, CL_INVALID_BUFFER_SIZE);
+	return 0;
+    }
+    if (region->origin > buffer->size || region->size > buffer->size - region->origin) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    if (region->origin % 128) {
+	setError(errcode_ret, CL_MISALIGNED_SUB_BUFFER_OFFSET);
+	return 0;
+    }
+
+    if (!(flags & (CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY)))
+	flags |= buffer->flags & (CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY);
+    cl_mem mem = new _cl_mem(buffer->context, CL_MEM_OBJECT_BUFFER,
+			     flags | (buffer->flags & CL_MEM_USE_HOST_PTR));
+    mem->size = region->size;
+    mem->data = buffer->data + region->origin;
+    mem->host_ptr = buffer->host_ptr ? (char*)buffer->host_ptr + region->origin : 0;
+    mem->parent = buffer;
+    mem->offset = region->origin;
+    clRetainMemObject(buffer);
+    setError(errcode_ret, CL_SUCCESS);
+    return mem;
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateImage2D(cl_context context, cl_mem_flags flags, const cl_image_format *image_format,
+		size_t image_width, size_t image_height, size_t image_row_pitch,
+		void *host_ptr, cl_int *errcode_ret)
+{
+    COUNT();
+    return createImage(context, flags, image_format, CL_MEM_OBJECT_IMAGE2D,
+		       image_width, image_height, 1, image_row_pitch, 0, host_ptr, errcode_ret);
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateImage3D(cl_context context, cl_mem_flags flags, const cl_image_format *image_format,
+		size_t image_width, size_t image_height, size_t image_depth,
+		size_t image_row_pitch, size_t image_slice_pitch,
+		void *host_ptr, cl_int *errcode_ret)
+{
+    COUNT();
+    return createImage(context, flags, image_format, CL_MEM_OBJECT_IMAGE3D,
+		       image_width, image_height, image_depth,
+		       image_row_pitch, image_slice_pitch, host_ptr, errcode_ret);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainMemObject(cl_mem memobj)
+{
+    COUNT();
+    return retainObject(memobj, MAGIC_MEM, CL_INVALID_MEM_OBJECT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseMemObject(cl_mem memobj)
+{
+    COUNT();
+    return releaseObject(memobj, MAGIC_MEM, CL_INVALID_MEM_OBJECT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetSupportedImageFormats(cl_context context, cl_mem_flags flags,
+			   cl_mem_object_type image_type, cl_uint num_entries,
+			   cl_image_format *image_formats, cl_uint *num_image_formats)
+{
+    COUNT();
+    static const cl_image_format formats[] = {
+	{ CL_RGBA, CL_UNORM_INT8 },
+	{ CL_RGBA, CL_UNSIGNED_INT8 },
+	{ CL_RGBA, CL_FLOAT },
+	{ CL_BGRA, CL_UNORM_INT8 },
+	{ CL_R, CL_FLOAT },
+	{ CL_R, CL_UNSIGNED_INT8 }
+    };
+    const cl_uint count = sizeof(formats) / sizeof(formats[0]);
+
+    if (!valid(context, MAGIC_CONTEXT))
+	return CL_INVALID_CONTEXT;
+    if ((image_type != CL_MEM_OBJECT_IMAGE2D && image_type != CL_MEM_OBJECT_IMAGE3D)
+	|| (num_entries == 0 && image_formats))
+	return CL_INVALID_VALUE;
+    for (cl_uint i=0; image_formats && i<num_entries && i<count; i++)
+	image_formats[i] = formats[i];
+    if (num_image_formats)
+	*num_image_formats = count;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetMemObjectInfo(cl_mem memobj, cl_mem_info param_name,
+		   size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(memobj, MAGIC_MEM))
+	return CL_INVALID_MEM_OBJECT;
+    switch (param_name) {
+    case CL_MEM_TYPE: INFO(cl_mem_object_type, memobj->type);
+    case CL_MEM_FLAGS: INFO(cl_mem_flags, memobj->flags);
+    case CL_MEM_SIZE: INFO(size_t, memobj->size);
+    case CL_MEM_HOST_PTR: INFO(void*, memobj->host_ptr);
+    case CL_MEM_MAP_COUNT: INFO(cl_uint, memobj->map_count);
+    case CL_MEM_REFERENCE_COUNT: INFO(cl_uint, memobj->refs);
+    case CL_MEM_CONTEXT: INFO(cl_context, memobj->context);
+    case CL_MEM_ASSOCIATED_MEMOBJECT: INFO(cl_mem, memobj->parent);
+    case CL_MEM_OFFSET: INFO(size_t, memobj->offset);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clSetMemObjectDestructorCallback(cl_mem memobj, void (CL_CALLBACK *pfn_notify)(cl_mem, void*),
+				 void *user_data)
+{
+    COUNT();
+    if (!valid(memobj, MAGIC_MEM))
+	return CL_INVALID_MEM_OBJECT;
+    if (!pfn_notify)
+	return CL_INVALID_VALUE;
+    Guard guard(g_lock);
+    memobj->destructors.push_back(std::make_pair(pfn_notify, user_data));
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetImageInfo(cl_mem image, cl_image_info param_name,
+	       size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!isImage(image))
+	return CL_INVALID_MEM_OBJECT;
+    switch (param_name) {
+    case CL_IMAGE_FORMAT: INFO(cl_image_format, image->format);
+    case CL_IMAGE_ELEMENT_SIZE: INFO(size_t, image->element_size);
+    case CL_IMAGE_ROW_PITCH: INFO(size_t, image->row_pitch);
+    case CL_IMAGE_SLICE_PITCH: INFO(size_t, image->slice_pitch);
+    case CL_IMAGE_WIDTH: INFO(size_t, image->width);
+    case CL_IMAGE_HEIGHT: INFO(size_t, image->height);
+    case CL_IMAGE_DEPTH: INFO(size_t, image->type == CL_MEM_OBJECT_IMAGE3D ? image->depth : 0);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Sampler
+//
+
+CL_API_ENTRY cl_sampler CL_API_CALL
+clCreateSampler(cl_context context, cl_bool normalized_coords,
+		cl_addressing_mode addressing_mode, cl_filter_mode filter_mode,
+		cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    if (addressing_mode < CL_ADDRESS_NONE || addressing_mode > CL_ADDRESS_MIRRORED_REPEAT
+	|| (filter_mode != CL_FILTER_NEAREST && filter_mode != CL_FILTER_LINEAR)) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    cl_sampler sampler = new _cl_sampler(context);
+    sampler->normalized_coords = normalized_coords ? CL_TRUE : CL_FALSE;
+    sampler->addressing_mode = addressing_mode;
+    sampler->filter_mode = filter_mode;
+    setError(errcode_ret, CL_SUCCESS);
+    return sampler;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainSampler(cl_sampler sampler)
+{
+    COUNT();
+    return retainObject(sampler, MAGIC_SAMPLER, CL_INVALID_SAMPLER);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseSampler(cl_sampler sampler)
+{
+    COUNT();
+    return releaseObject(sampler, MAGIC_SAMPLER, CL_INVALID_SAMPLER);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetSamplerInfo(cl_sampler sampler, cl_sampler_info param_name,
+		 size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(sampler, MAGIC_SAMPLER))
+	return CL_INVALID_SAMPLER;
+    switch (param_name) {
+    case CL_SAMPLER_REFERENCE_COUNT: INFO(cl_uint, sampler->refs);
+    case CL_SAMPLER_CONTEXT: INFO(cl_context, sampler->context);
+    case CL_SAMPLER_NORMALIZED_COORDS: INFO(cl_bool, sampler->normalized_coords);
+    case CL_SAMPLER_ADDRESSING_MODE: INFO(cl_addressing_mode, sampler->addressing_mode);
+    case CL_SAMPLER_FILTER_MODE: INFO(cl_filter_mode, sampler->filter_mode);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Program
+//
+
+CL_API_ENTRY cl_program CL_API_CALL
+clCreateProgramWithSource(cl_context context, cl_uint count, const char **strings,
+			  const size_t *lengths, cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    if (count == 0 || !strings) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    std::string source;
+    for (cl_uint i=0; i<count; i++) {
+	if (!strings[i]) {
+	    setError(errcode_ret, CL_INVALID_VALUE);
+	    return 0;
+	}
+	if (lengths && lengths[i])
+	    source.append(strings[i], lengths[i]);
+	else
+	    source.append(strings[i]);
+    }
+    cl_program program = new _cl_program(context);
+    program->source = source;
+    setError(errcode_ret, CL_SUCCESS);
+    return program;
+}
+
+// A "binary" is the source it was built from, see CL_PROGRAM_BINARIES.
+CL_API_ENTRY cl_program CL_API_CALL
+clCreateProgramWithBinary(cl_context context, cl_uint num_devices,
+			  const cl_device_id *device_list, const size_t *lengths,
+			  const unsigned char **binaries, cl_int *binary_status,
+			  cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    if (num_devices != 1 || !device_list || !lengths || !binaries
+	|| !binaries[0] || lengths[0] == 0) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    if (device_list[0] != &g_device) {
+	setError(errcode_ret, CL_INVALID_DEVICE);
+	return 0;
+    }
+    cl_program program = new _cl_program(context);
+    program->source.assign((const char*)binaries[0], lengths[0]);
+    if (binary_status)
+	binary_status[0] = CL_SUCCESS;
+    setError(errcode_ret, CL_SUCCESS);
+    return program;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainProgram(cl_program program)
+{
+    COUNT();
+    return retainObject(program, MAGIC_PROGRAM, CL_INVALID_PROGRAM);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseProgram(cl_program program)
+{
+    COUNT();
+    return releaseObject(program, MAGIC_PROGRAM, CL_INVALID_PROGRAM);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id *device_list,
+	       const char *options, void (CL_CALLBACK *pfn_notify)(cl_program, void*),
+	       void *user_data)
+{
+    COUNT();
+    if (!valid(program, MAGIC_PROGRAM))
+	return CL_INVALID_PROGRAM;
+    if ((num_devices == 0) != (device_list == 0) || (!pfn_notify && user_data))
+	return CL_INVALID_VALUE;
+    for (cl_uint i=0; i<num_devices; i++)
+	if (device_list[i] != &g_device)
+	    return CL_INVALID_DEVICE;
+
+    {
+	Guard guard(g_lock);
+	if (program->num_kernels)
+	    return CL_INVALID_OPERATION;
+	program->options = options ? options : "";
+	program->kernels.clear();
+	if (parseKernels(program->source, &program->kernels)) {
+	    program->status = CL_BUILD_SUCCESS;
+	    program->log = "";
+	} else {
+	    program->status = CL_BUILD_ERROR;
+	    program->log = "error: malformed kernel signature\n";
+	    program->kernels.clear();
+	}
+    }
+    if (pfn_notify)
+	pfn_notify(program, user_data);
+    return program->status == CL_BUILD_SUCCESS ? CL_SUCCESS : CL_BUILD_PROGRAM_FAILURE;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clUnloadCompiler(void)
+{
+    COUNT();
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetProgramInfo(cl_program program, cl_program_info param_name,
+		 size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(program, MAGIC_PROGRAM))
+	return CL_INVALID_PROGRAM;
+    Guard guard(g_lock);
+    switch (param_name) {
+    case CL_PROGRAM_REFERENCE_COUNT: INFO(cl_uint, program->refs);
+    case CL_PROGRAM_CONTEXT: INFO(cl_context, program->context);
+    case CL_PROGRAM_NUM_DEVICES: INFO(cl_uint, 1);
+    case CL_PROGRAM_DEVICES: INFO(cl_device_id, &g_device);
+    case CL_PROGRAM_SOURCE: INFO_STRING(program->source);
+    case CL_PROGRAM_BINARY_SIZES:
+	INFO(size_t, program->status == CL_BUILD_SUCCESS ? program->source.size() : 0);
+    case CL_PROGRAM_BINARIES: {
+	// an array of pointers to caller owned storage
+	if (param_value && param_value_size < sizeof(unsigned char*))
+	    return CL_INVALID_VALUE;
+	unsigned char **binaries = (unsigned char**)param_value;
+	if (binaries && binaries[0] && program->status == CL_BUILD_SUCCESS)
+	    memcpy(binaries[0], program->source.data(), program->source.size());
+	if (param_value_size_ret)
+	    *param_value_size_ret = sizeof(unsigned char*);
+	return CL_SUCCESS;
+    }
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetProgramBuildInfo(cl_program program, cl_device_id device,
+		      cl_program_build_info param_name, size_t param_value_size,
+		      void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(program, MAGIC_PROGRAM))
+	return CL_INVALID_PROGRAM;
+    if (device != &g_device)
+	return CL_INVALID_DEVICE;
+    Guard guard(g_lock);
+    switch (param_name) {
+    case CL_PROGRAM_BUILD_STATUS: INFO(cl_build_status, program->status);
+    case CL_PROGRAM_BUILD_OPTIONS: INFO_STRING(program->options);
+    case CL_PROGRAM_BUILD_LOG: INFO_STRING(program->log);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Kernel
+//
+
+CL_API_ENTRY cl_kernel CL_API_CALL
+clCreateKernel(cl_program program, const char *kernel_name, cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(program, MAGIC_PROGRAM)) {
+	setError(errcode_ret, CL_INVALID_PROGRAM);
+	return 0;
+    }
+    if (!kernel_name) {
+	setError(errcode_ret, CL_INVALID_VALUE);
+	return 0;
+    }
+    Guard guard(g_lock);
+    if (program->status != CL_BUILD_SUCCESS) {
+	setError(errcode_ret, CL_INVALID_PROGRAM_EXECUTABLE);
+	return 0;
+    }
+    for (size_t i=0; i<program->kernels.size(); i++) {
+	if (program->kernels[i].first == kernel_name) {
+	    setError(errcode_ret, CL_SUCCESS);
+	    return new _cl_kernel(program, kernel_name, program->kernels[i].second);
+	}
+    }
+    setError(errcode_ret, CL_INVALID_KERNEL_NAME);
+    return 0;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clCreateKernelsInProgram(cl_program program, cl_uint num_kernels, cl_kernel *kernels,
+			 cl_uint *num_kernels_ret)
+{
+    COUNT();
+    if (!valid(program, MAGIC_PROGRAM))
+	return CL_INVALID_PROGRAM;
+    Guard guard(g_lock);
+    if (program->status != CL_BUILD_SUCCESS)
+	return CL_INVALID_PROGRAM_EXECUTABLE;
+    cl_uint count = program->kernels.size();
+    if (kernels && num_kernels < count)
+	return CL_INVALID_VALUE;
+    for (cl_uint i=0; kernels && i<count; i++)
+	kernels[i] = new _cl_kernel(program, program->kernels[i].first,
+				    program->kernels[i].second);
+    if (num_kernels_ret)
+	*num_kernels_ret = count;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainKernel(cl_kernel kernel)
+{
+    COUNT();
+    return retainObject(kernel, MAGIC_KERNEL, CL_INVALID_KERNEL);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseKernel(cl_kernel kernel)
+{
+    COUNT();
+    if (!valid(kernel, MAGIC_KERNEL))
+	return CL_INVALID_KERNEL;
+    Guard guard(g_lock);
+    return releaseObject(kernel, MAGIC_KERNEL, CL_INVALID_KERNEL);
+}
+
+// Argument values are not kept: kernels do not run.
+CL_API_ENTRY cl_int CL_API_CALL
+clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void *arg_value)
+{
+    COUNT();
+    if (!valid(kernel, MAGIC_KERNEL))
+	return CL_INVALID_KERNEL;
+    Guard guard(g_lock);
+    if (arg_index >= kernel->arg_set.size())
+	return CL_INVALID_ARG_INDEX;
+    if (arg_size == 0)
+	return CL_INVALID_ARG_SIZE;
+    const KernelArg &arg = kernel->args[arg_index];
+    if (arg.kind == KernelArg::LOCAL) {
+	if (arg_value)
+	    return CL_INVALID_ARG_VALUE;
+    } else {
+	if (arg.size && arg_size != arg.size)
+	    return CL_INVALID_ARG_SIZE;
+	if (!arg_value && arg.kind == KernelArg::VALUE)
+	    return CL_INVALID_ARG_VALUE;
+    }
+    kernel->arg_set[arg_index] = true;
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetKernelInfo(cl_kernel kernel, cl_kernel_info param_name,
+		size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(kernel, MAGIC_KERNEL))
+	return CL_INVALID_KERNEL;
+    switch (param_name) {
+    case CL_KERNEL_FUNCTION_NAME: INFO_STRING(kernel->name);
+    case CL_KERNEL_NUM_ARGS: INFO(cl_uint, kernel->arg_set.size());
+    case CL_KERNEL_REFERENCE_COUNT: INFO(cl_uint, kernel->refs);
+    case CL_KERNEL_CONTEXT: INFO(cl_context, kernel->program->context);
+    case CL_KERNEL_PROGRAM: INFO(cl_program, kernel->program);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device,
+			 cl_kernel_work_group_info param_name, size_t param_value_size,
+			 void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(kernel, MAGIC_KERNEL))
+	return CL_INVALID_KERNEL;
+    if (device && device != &g_device)
+	return CL_INVALID_DEVICE;
+    static const size_t compile_size[3] = { 0, 0, 0 };
+    switch (param_name) {
+    case CL_KERNEL_WORK_GROUP_SIZE: INFO(size_t, 1024);
+    case CL_KERNEL_COMPILE_WORK_GROUP_SIZE: INFO_ARRAY(compile_size, sizeof(compile_size));
+    case CL_KERNEL_LOCAL_MEM_SIZE: INFO(cl_ulong, 0);
+    case CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE: INFO(size_t, 1);
+    case CL_KERNEL_PRIVATE_MEM_SIZE: INFO(cl_ulong, 0);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Events
+//
+
+CL_API_ENTRY cl_int CL_API_CALL
+clWaitForEvents(cl_uint num_events, const cl_event *event_list)
+{
+    COUNT();
+    if (num_events == 0 || !event_list)
+	return CL_INVALID_VALUE;
+    cl_int err = checkWaitList(0, num_events, event_list);
+    if (err != CL_SUCCESS)
+	return err == CL_INVALID_EVENT_WAIT_LIST ? CL_INVALID_EVENT : err;
+    for (cl_uint i=1; i<num_events; i++)
+	if (event_list[i]->context != event_list[0]->context)
+	    return CL_INVALID_CONTEXT;
+
+    std::unique_lock<std::mutex> guard(g_lock);
+    for (cl_uint i=0; i<num_events; i++) {
+	// only user events can still be pending
+	while (event_list[i]->status > CL_COMPLETE)
+	    g_event_changed.wait(guard);
+	if (event_list[i]->status < 0)
+	    return CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+	if (event_list[i]->queue)
+	    sleepFor(event_list[i]->queue);
+    }
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetEventInfo(cl_event event, cl_event_info param_name,
+	       size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(event, MAGIC_EVENT))
+	return CL_INVALID_EVENT;
+    Guard guard(g_lock);
+    switch (param_name) {
+    case CL_EVENT_COMMAND_QUEUE: INFO(cl_command_queue, event->queue);
+    case CL_EVENT_CONTEXT: INFO(cl_context, event->context);
+    case CL_EVENT_COMMAND_TYPE: INFO(cl_command_type, event->command);
+    case CL_EVENT_COMMAND_EXECUTION_STATUS: INFO(cl_int, event->status);
+    case CL_EVENT_REFERENCE_COUNT: INFO(cl_uint, event->refs);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+CL_API_ENTRY cl_event CL_API_CALL
+clCreateUserEvent(cl_context context, cl_int *errcode_ret)
+{
+    COUNT();
+    if (!valid(context, MAGIC_CONTEXT)) {
+	setError(errcode_ret, CL_INVALID_CONTEXT);
+	return 0;
+    }
+    cl_event event = new _cl_event(context, 0, CL_COMMAND_USER);
+    event->status = CL_SUBMITTED;
+    setError(errcode_ret, CL_SUCCESS);
+    return event;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clRetainEvent(cl_event event)
+{
+    COUNT();
+    return retainObject(event, MAGIC_EVENT, CL_INVALID_EVENT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clReleaseEvent(cl_event event)
+{
+    COUNT();
+    return releaseObject(event, MAGIC_EVENT, CL_INVALID_EVENT);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clSetUserEventStatus(cl_event event, cl_int execution_status)
+{
+    COUNT();
+    if (!valid(event, MAGIC_EVENT) || event->queue)
+	return CL_INVALID_EVENT;
+    if (execution_status > CL_COMPLETE)
+	return CL_INVALID_VALUE;
+
+    std::vector<std::pair<_cl_event::Callback, void*> > callbacks;
+    {
+	Guard guard(g_lock);
+	if (event->status <= CL_COMPLETE)
+	    return CL_INVALID_OPERATION;
+	event->status = execution_status;
+	callbacks.swap(event->callbacks);
+    }
+    g_event_changed.notify_all();
+    for (size_t i=0; i<callbacks.size(); i++)
+	callbacks[i].first(event, execution_status, callbacks[i].second);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clSetEventCallback(cl_event event, cl_int command_exec_callback_type,
+		   void (CL_CALLBACK *pfn_notify)(cl_event, cl_int, void*), void *user_data)
+{
+    COUNT();
+    if (!valid(event, MAGIC_EVENT))
+	return CL_INVALID_EVENT;
+    if (!pfn_notify || command_exec_callback_type != CL_COMPLETE)
+	return CL_INVALID_VALUE;
+    cl_int status;
+    {
+	Guard guard(g_lock);
+	status = event->status;
+	if (status > CL_COMPLETE) {
+	    event->callbacks.push_back(std::make_pair(pfn_notify, user_data));
+	    return CL_SUCCESS;
+	}
+    }
+    pfn_notify(event, status, user_data);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clGetEventProfilingInfo(cl_event event, cl_profiling_info param_name,
+			size_t param_value_size, void *param_value, size_t *param_value_size_ret)
+{
+    COUNT();
+    if (!valid(event, MAGIC_EVENT))
+	return CL_INVALID_EVENT;
+    if (!event->queue || !(event->queue->properties & CL_QUEUE_PROFILING_ENABLE))
+	return CL_PROFILING_INFO_NOT_AVAILABLE;
+    switch (param_name) {
+    case CL_PROFILING_COMMAND_QUEUED: INFO(cl_ulong, event->queued);
+    case CL_PROFILING_COMMAND_SUBMIT: INFO(cl_ulong, event->submit);
+    case CL_PROFILING_COMMAND_START: INFO(cl_ulong, event->start);
+    case CL_PROFILING_COMMAND_END: INFO(cl_ulong, event->end);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+//
+// Enqueued commands
+//
+
+#define CHECK_QUEUE()							\
+    do {								\
+	if (!valid(command_queue, MAGIC_QUEUE))				\
+	    return CL_INVALID_COMMAND_QUEUE;				\
+	cl_int err = checkWaitList(command_queue, num_events_in_wait_list, event_wait_list); \
+	if (err != CL_SUCCESS)						\
+	    return err;							\
+    } while (0)
+
+#define CHECK_MEM(m, pred)						\
+    do {								\
+	if (!pred(m))							\
+	    return CL_INVALID_MEM_OBJECT;				\
+	if ((m)->context != command_queue->context)			\
+	    return CL_INVALID_CONTEXT;					\
+    } while (0)
+
+namespace {
+
+cl_int enqueueKernel(cl_command_queue command_queue, cl_kernel kernel, cl_command_type command,
+		     cl_uint work_dim, const size_t *global_work_offset,
+		     const size_t *global_work_size, const size_t *local_work_size,
+		     cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		     cl_event *event)
+{
+    CHECK_QUEUE();
+    if (!valid(kernel, MAGIC_KERNEL))
+	return CL_INVALID_KERNEL;
+    if (kernel->program->context != command_queue->context)
+	return CL_INVALID_CONTEXT;
+    if (work_dim < 1 || work_dim > 3)
+	return CL_INVALID_WORK_DIMENSION;
+    if (!global_work_size)
+	return CL_INVALID_GLOBAL_WORK_SIZE;
+
+    cl_ulong items = 1;
+    size_t group = 1;
+    for (cl_uint i=0; i<work_dim; i++) {
+	if (global_work_size[i] == 0)
+	    return CL_INVALID_GLOBAL_WORK_SIZE;
+	if (global_work_offset && global_work_offset[i] + global_work_size[i] < global_work_size[i])
+	    return CL_INVALID_GLOBAL_OFFSET;
+	if (local_work_size) {
+	    if (local_work_size[i] == 0 || local_work_size[i] > 1024
+		|| global_work_size[i] % local_work_size[i])
+		return CL_INVALID_WORK_GROUP_SIZE;
+	    group *= local_work_size[i];
+	}
+	items *= global_work_size[i];
+    }
+    if (group > 1024)
+	return CL_INVALID_WORK_GROUP_SIZE;
+
+    Guard guard(g_lock);
+    for (size_t i=0; i<kernel->arg_set.size(); i++)
+	if (!kernel->arg_set[i])
+	    return CL_INVALID_KERNEL_ARGS;
+    counters().add("work_items", items);
+    enqueue(command_queue, command, config().launch_ns + items * config().item_ns,
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+} // namespace
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueNDRangeKernel(cl_command_queue command_queue, cl_kernel kernel, cl_uint work_dim,
+		       const size_t *global_work_offset, const size_t *global_work_size,
+		       const size_t *local_work_size, cl_uint num_events_in_wait_list,
+		       const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    return enqueueKernel(command_queue, kernel, CL_COMMAND_NDRANGE_KERNEL, work_dim,
+			 global_work_offset, global_work_size, local_work_size,
+			 num_events_in_wait_list, event_wait_list, event);
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueTask(cl_command_queue command_queue, cl_kernel kernel,
+	      cl_uint num_events_in_wait_list, const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    const size_t one = 1;
+    return enqueueKernel(command_queue, kernel, CL_COMMAND_TASK, 1, 0, &one, &one,
+			 num_events_in_wait_list, event_wait_list, event);
+}
+
+// Native kernels do run, on the calling thread, with the memory object
+// pointers in the copied argument block swapped for their host storage.
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueNativeKernel(cl_command_queue command_queue, void (CL_CALLBACK *user_func)(void*),
+		      void *args, size_t cb_args, cl_uint num_mem_objects,
+		      const cl_mem *mem_list, const void **args_mem_loc,
+		      cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		      cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    if (!user_func || (!args && (cb_args || num_mem_objects)) || (args && !cb_args)
+	|| (num_mem_objects && (!mem_list || !args_mem_loc)))
+	return CL_INVALID_VALUE;
+
+    std::vector<char> copy((const char*)args, (const char*)args + cb_args);
+    {
+	Guard guard(g_lock);
+	for (cl_uint i=0; i<num_mem_objects; i++) {
+	    if (!isBuffer(mem_list[i]))
+		return CL_INVALID_MEM_OBJECT;
+	    size_t at = (const char*)args_mem_loc[i] - (const char*)args;
+	    if ((const char*)args_mem_loc[i] < (const char*)args || at + sizeof(void*) > cb_args)
+		return CL_INVALID_VALUE;
+	    void *data = mem_list[i]->data;
+	    memcpy(&copy[at], &data, sizeof(void*));
+	}
+	enqueue(command_queue, CL_COMMAND_NATIVE_KERNEL, config().launch_ns,
+		num_events_in_wait_list, event_wait_list, event, false);
+    }
+    user_func(copy.empty() ? 0 : &copy[0]);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueReadBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_read,
+		    size_t offset, size_t cb, void *ptr, cl_uint num_events_in_wait_list,
+		    const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(buffer, isBuffer);
+    if (!ptr || cb == 0 || offset > buffer->size || cb > buffer->size - offset)
+	return CL_INVALID_VALUE;
+    if (failTransfer())
+	return CL_OUT_OF_RESOURCES;
+    Guard guard(g_lock);
+    memcpy(ptr, buffer->data + offset, cb);
+    counters().add("bytes.read", cb);
+    enqueue(command_queue, CL_COMMAND_READ_BUFFER, transferCost(cb),
+	    num_events_in_wait_list, event_wait_list, event, blocking_read);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write,
+		     size_t offset, size_t cb, const void *ptr, cl_uint num_events_in_wait_list,
+		     const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(buffer, isBuffer);
+    if (!ptr || cb == 0 || offset > buffer->size || cb > buffer->size - offset)
+	return CL_INVALID_VALUE;
+    if (failTransfer())
+	return CL_OUT_OF_RESOURCES;
+    Guard guard(g_lock);
+    memcpy(buffer->data + offset, ptr, cb);
+    counters().add("bytes.write", cb);
+    enqueue(command_queue, CL_COMMAND_WRITE_BUFFER, transferCost(cb),
+	    num_events_in_wait_list, event_wait_list, event, blocking_write);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyBuffer(cl_command_queue command_queue, cl_mem src_buffer, cl_mem dst_buffer,
+		    size_t src_offset, size_t dst_offset, size_t cb,
+		    cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		    cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(src_buffer, isBuffer);
+    CHECK_MEM(dst_buffer, isBuffer);
+    if (cb == 0 || src_offset > src_buffer->size || cb > src_buffer->size - src_offset
+	|| dst_offset > dst_buffer->size || cb > dst_buffer->size - dst_offset)
+	return CL_INVALID_VALUE;
+    const char *src = src_buffer->data + src_offset;
+    char *dst = dst_buffer->data + dst_offset;
+    if (src < dst + cb && dst < src + cb)
+	return CL_MEM_COPY_OVERLAP;
+    if (failTransfer())
+	return CL_OUT_OF_RESOURCES;
+    Guard guard(g_lock);
+    memcpy(dst, src, cb);
+    counters().add("bytes.copy", cb);
+    enqueue(command_queue, CL_COMMAND_COPY_BUFFER, transferCost(cb),
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueReadBufferRect(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_read,
+			const size_t *buffer_origin, const size_t *host_origin,
+			const size_t *region, size_t buffer_row_pitch, size_t buffer_slice_pitch,
+			size_t host_row_pitch, size_t host_slice_pitch, void *ptr,
+			cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+			cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(buffer, isBuffer);
+    if (!ptr || !buffer_origin || !host_origin || !region
+	|| !rectFits(buffer_origin, region, &buffer_row_pitch, &buffer_slice_pitch, buffer->size))
+	return CL_INVALID_VALUE;
+    if (host_row_pitch == 0)
+	host_row_pitch = region[0];
+    if (host_slice_pitch == 0)
+	host_slice_pitch = region[1] * host_row_pitch;
+    Guard guard(g_lock);
+    copyRect((char*)ptr, host_origin, host_row_pitch, host_slice_pitch,
+	     buffer->data, buffer_origin, buffer_row_pitch, buffer_slice_pitch, region);
+    size_t bytes = region[0] * region[1] * region[2];
+    counters().add("bytes.read", bytes);
+    enqueue(command_queue, CL_COMMAND_READ_BUFFER_RECT, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, blocking_read);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWriteBufferRect(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write,
+			 const size_t *buffer_origin, const size_t *host_origin,
+			 const size_t *region, size_t buffer_row_pitch, size_t buffer_slice_pitch,
+			 size_t host_row_pitch, size_t host_slice_pitch, const void *ptr,
+			 cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+			 cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(buffer, isBuffer);
+    if (!ptr || !buffer_origin || !host_origin || !region
+	|| !rectFits(buffer_origin, region, &buffer_row_pitch, &buffer_slice_pitch, buffer->size))
+	return CL_INVALID_VALUE;
+    if (host_row_pitch == 0)
+	host_row_pitch = region[0];
+    if (host_slice_pitch == 0)
+	host_slice_pitch = region[1] * host_row_pitch;
+    Guard guard(g_lock);
+    copyRect(buffer->data, buffer_origin, buffer_row_pitch, buffer_slice_pitch,
+	     (const char*)ptr, host_origin, host_row_pitch, host_slice_pitch, region);
+    size_t bytes = region[0] * region[1] * region[2];
+    counters().add("bytes.write", bytes);
+    enqueue(command_queue, CL_COMMAND_WRITE_BUFFER_RECT, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, blocking_write);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyBufferRect(cl_command_queue command_queue, cl_mem src_buffer, cl_mem dst_buffer,
+			const size_t *src_origin, const size_t *dst_origin, const size_t *region,
+			size_t src_row_pitch, size_t src_slice_pitch,
+			size_t dst_row_pitch, size_t dst_slice_pitch,
+			cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+			cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(src_buffer, isBuffer);
+    CHECK_MEM(dst_buffer, isBuffer);
+    if (!src_origin || !dst_origin || !region
+	|| !rectFits(src_origin, region, &src_row_pitch, &src_slice_pitch, src_buffer->size)
+	|| !rectFits(dst_origin, region, &dst_row_pitch, &dst_slice_pitch, dst_buffer->size))
+	return CL_INVALID_VALUE;
+    Guard guard(g_lock);
+    copyRect(dst_buffer->data, dst_origin, dst_row_pitch, dst_slice_pitch,
+	     src_buffer->data, src_origin, src_row_pitch, src_slice_pitch, region);
+    size_t bytes = region[0] * region[1] * region[2];
+    counters().add("bytes.copy", bytes);
+    enqueue(command_queue, CL_COMMAND_COPY_BUFFER_RECT, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueReadImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_read,
+		   const size_t *origin, const size_t *region, size_t row_pitch,
+		   size_t slice_pitch, void *ptr, cl_uint num_events_in_wait_list,
+		   const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(image, isImage);
+    size_t o[3], r[3];
+    if (!ptr || !origin || !region || !imageRect(image, origin, region, o, r))
+	return CL_INVALID_VALUE;
+    if (row_pitch == 0)
+	row_pitch = r[0];
+    if (slice_pitch == 0)
+	slice_pitch = row_pitch * r[1];
+    const size_t zero[3] = { 0, 0, 0 };
+    Guard guard(g_lock);
+    copyRect((char*)ptr, zero, row_pitch, slice_pitch,
+	     image->data, o, image->row_pitch, image->row_pitch * image->height, r);
+    size_t bytes = r[0] * r[1] * r[2];
+    counters().add("bytes.read", bytes);
+    enqueue(command_queue, CL_COMMAND_READ_IMAGE, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, blocking_read);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWriteImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_write,
+		    const size_t *origin, const size_t *region, size_t input_row_pitch,
+		    size_t input_slice_pitch, const void *ptr, cl_uint num_events_in_wait_list,
+		    const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(image, isImage);
+    size_t o[3], r[3];
+    if (!ptr || !origin || !region || !imageRect(image, origin, region, o, r))
+	return CL_INVALID_VALUE;
+    if (input_row_pitch == 0)
+	input_row_pitch = r[0];
+    if (input_slice_pitch == 0)
+	input_slice_pitch = input_row_pitch * r[1];
+    const size_t zero[3] = { 0, 0, 0 };
+    Guard guard(g_lock);
+    copyRect(image->data, o, image->row_pitch, image->row_pitch * image->height,
+	     (const char*)ptr, zero, input_row_pitch, input_slice_pitch, r);
+    size_t bytes = r[0] * r[1] * r[2];
+    counters().add("bytes.write", bytes);
+    enqueue(command_queue, CL_COMMAND_WRITE_IMAGE, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, blocking_write);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyImage(cl_command_queue command_queue, cl_mem src_image, cl_mem dst_image,
+		   const size_t *src_origin, const size_t *dst_origin, const size_t *region,
+		   cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		   cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(src_image, isImage);
+    CHECK_MEM(dst_image, isImage);
+    if (memcmp(&src_image->format, &dst_image->format, sizeof(cl_image_format)))
+	return CL_IMAGE_FORMAT_MISMATCH;
+    size_t so[3], dO[3], r[3];
+    if (!src_origin || !dst_origin || !region
+	|| !imageRect(src_image, src_origin, region, so, r)
+	|| !imageRect(dst_image, dst_origin, region, dO, r))
+	return CL_INVALID_VALUE;
+    Guard guard(g_lock);
+    copyRect(dst_image->data, dO, dst_image->row_pitch, dst_image->row_pitch * dst_image->height,
+	     src_image->data, so, src_image->row_pitch, src_image->row_pitch * src_image->height,
+	     r);
+    size_t bytes = r[0] * r[1] * r[2];
+    counters().add("bytes.copy", bytes);
+    enqueue(command_queue, CL_COMMAND_COPY_IMAGE, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyImageToBuffer(cl_command_queue command_queue, cl_mem src_image,
+			   cl_mem dst_buffer, const size_t *src_origin, const size_t *region,
+			   size_t dst_offset, cl_uint num_events_in_wait_list,
+			   const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(src_image, isImage);
+    CHECK_MEM(dst_buffer, isBuffer);
+    size_t o[3], r[3];
+    if (!src_origin || !region || !imageRect(src_image, src_origin, region, o, r))
+	return CL_INVALID_VALUE;
+    size_t bytes = r[0] * r[1] * r[2];
+    if (dst_offset > dst_buffer->size || bytes > dst_buffer->size - dst_offset)
+	return CL_INVALID_VALUE;
+    const size_t zero[3] = { 0, 0, 0 };
+    Guard guard(g_lock);
+    copyRect(dst_buffer->data + dst_offset, zero, r[0], r[0] * r[1],
+	     src_image->data, o, src_image->row_pitch, src_image->row_pitch * src_image->height,
+	     r);
+    counters().add("bytes.copy", bytes);
+    enqueue(command_queue, CL_COMMAND_COPY_IMAGE_TO_BUFFER, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyBufferToImage(cl_command_queue command_queue, cl_mem src_buffer,
+			   cl_mem dst_image, size_t src_offset, const size_t *dst_origin,
+			   const size_t *region, cl_uint num_events_in_wait_list,
+			   const cl_event *event_wait_list, cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(src_buffer, isBuffer);
+    CHECK_MEM(dst_image, isImage);
+    size_t o[3], r[3];
+    if (!dst_origin || !region || !imageRect(dst_image, dst_origin, region, o, r))
+	return CL_INVALID_VALUE;
+    size_t bytes = r[0] * r[1] * r[2];
+    if (src_offset > src_buffer->size || bytes > src_buffer->size - src_offset)
+	return CL_INVALID_VALUE;
+    const size_t zero[3] = { 0, 0, 0 };
+    Guard guard(g_lock);
+    copyRect(dst_image->data, o, dst_image->row_pitch, dst_image->row_pitch * dst_image->height,
+	     src_buffer->data + src_offset, zero, r[0], r[0] * r[1], r);
+    counters().add("bytes.copy", bytes);
+    enqueue(command_queue, CL_COMMAND_COPY_BUFFER_TO_IMAGE, transferCost(bytes),
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+// Maps hand out the object's own storage, as on a unified memory device.
+CL_API_ENTRY void * CL_API_CALL
+clEnqueueMapBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_map,
+		   cl_map_flags map_flags, size_t offset, size_t cb,
+		   cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		   cl_event *event, cl_int *errcode_ret)
+{
+    COUNT();
+    cl_int err = CL_SUCCESS;
+    if (!valid(command_queue, MAGIC_QUEUE))
+	err = CL_INVALID_COMMAND_QUEUE;
+    else if (!isBuffer(buffer))
+	err = CL_INVALID_MEM_OBJECT;
+    else if (buffer->context != command_queue->context)
+	err = CL_INVALID_CONTEXT;
+    else if (cb == 0 || offset > buffer->size || cb > buffer->size - offset
+	     || (map_flags & ~(cl_map_flags)(CL_MAP_READ | CL_MAP_WRITE)))
+	err = CL_INVALID_VALUE;
+    else
+	err = checkWaitList(command_queue, num_events_in_wait_list, event_wait_list);
+    setError(errcode_ret, err);
+    if (err != CL_SUCCESS)
+	return 0;
+
+    Guard guard(g_lock);
+    buffer->map_count++;
+    enqueue(command_queue, CL_COMMAND_MAP_BUFFER, config().command_ns,
+	    num_events_in_wait_list, event_wait_list, event, blocking_map);
+    return buffer->data + offset;
+}
+
+CL_API_ENTRY void * CL_API_CALL
+clEnqueueMapImage(cl_command_queue command_queue, cl_mem image, cl_bool blocking_map,
+		  cl_map_flags map_flags, const size_t *origin, const size_t *region,
+		  size_t *image_row_pitch, size_t *image_slice_pitch,
+		  cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+		  cl_event *event, cl_int *errcode_ret)
+{
+    COUNT();
+    cl_int err = CL_SUCCESS;
+    size_t o[3], r[3];
+    if (!valid(command_queue, MAGIC_QUEUE))
+	err = CL_INVALID_COMMAND_QUEUE;
+    else if (!isImage(image))
+	err = CL_INVALID_MEM_OBJECT;
+    else if (image->context != command_queue->context)
+	err = CL_INVALID_CONTEXT;
+    else if (!origin || !region || !image_row_pitch
+	     || (image->type == CL_MEM_OBJECT_IMAGE3D && !image_slice_pitch)
+	     || !imageRect(image, origin, region, o, r)
+	     || (map_flags & ~(cl_map_flags)(CL_MAP_READ | CL_MAP_WRITE)))
+	err = CL_INVALID_VALUE;
+    else
+	err = checkWaitList(command_queue, num_events_in_wait_list, event_wait_list);
+    setError(errcode_ret, err);
+    if (err != CL_SUCCESS)
+	return 0;
+
+    Guard guard(g_lock);
+    image->map_count++;
+    *image_row_pitch = image->row_pitch;
+    if (image_slice_pitch)
+	*image_slice_pitch = image->slice_pitch;
+    enqueue(command_queue, CL_COMMAND_MAP_IMAGE, config().command_ns,
+	    num_events_in_wait_list, event_wait_list, event, blocking_map);
+    return image->data + o[0] + o[1] * image->row_pitch
+	+ o[2] * image->row_pitch * image->height;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueUnmapMemObject(cl_command_queue command_queue, cl_mem memobj, void *mapped_ptr,
+			cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+			cl_event *event)
+{
+    COUNT();
+    CHECK_QUEUE();
+    CHECK_MEM(memobj, isMem);
+    Guard guard(g_lock);
+    if (memobj->map_count == 0 || (char*)mapped_ptr < memobj->data
+	|| (char*)mapped_ptr >= memobj->data + memobj->size)
+	return CL_INVALID_VALUE;
+    memobj->map_count--;
+    enqueue(command_queue, CL_COMMAND_UNMAP_MEM_OBJECT, config().command_ns,
+	    num_events_in_wait_list, event_wait_list, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueMarker(cl_command_queue command_queue, cl_event *event)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    if (!event)
+	return CL_INVALID_VALUE;
+    Guard guard(g_lock);
+    enqueue(command_queue, CL_COMMAND_MARKER, 0, 0, 0, event, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWaitForEvents(cl_command_queue command_queue, cl_uint num_events,
+		       const cl_event *event_list)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    if (num_events == 0 || !event_list)
+	return CL_INVALID_VALUE;
+    cl_int err = checkWaitList(command_queue, num_events, event_list);
+    if (err != CL_SUCCESS)
+	return err == CL_INVALID_EVENT_WAIT_LIST ? CL_INVALID_EVENT : err;
+    Guard guard(g_lock);
+    enqueue(command_queue, CL_COMMAND_MARKER, 0, num_events, event_list, 0, false);
+    return CL_SUCCESS;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueBarrier(cl_command_queue command_queue)
+{
+    COUNT();
+    if (!valid(command_queue, MAGIC_QUEUE))
+	return CL_INVALID_COMMAND_QUEUE;
+    return CL_SUCCESS;
+}
+
+//
+// Counters
+//
+
+unsigned long mockclGetCounter(const char *name)
+{
+    Counters &c = counters();
+    std::lock_guard<std::mutex> guard(c.lock);
+    std::map<std::string, unsigned long>::iterator i = c.values.find(name);
+    return i == c.values.end() ? 0 : i->second;
+}
+
+void mockclResetCounters(void)
+{
+    Counters &c = counters();
+    std::lock_guard<std::mutex> guard(c.lock);
+    c.values.clear();
+}
+
+int mockclWriteCounters(const char *path)
+{
+    return counters().write(path);
+}
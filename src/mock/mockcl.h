@@ -0,0 +1,27 @@
+
+#ifndef WEBCL_MOCKCL_H_
+#define WEBCL_MOCKCL_H_
+
+// Extra entry points of the mock OpenCL library (see mockcl.cpp).
+//
+// Every OpenCL entry point bumps a counter under its own name, and the
+// data movement ones also add to the "bytes.write", "bytes.read",
+// "bytes.copy" and "work_items" counters.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Current value of a counter, 0 if it was never touched.
+unsigned long mockclGetCounter(const char *name);
+
+void mockclResetCounters(void);
+
+// Writes all counters as a JSON object; returns 0 on success.
+int mockclWriteCounters(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
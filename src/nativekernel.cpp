@@ -0,0 +1,33 @@
+
+#include "nativekernel.h"
+
+#include <map>
+
+using namespace webcl;
+
+namespace {
+
+std::map<std::string, NativeKernelFunc> nativeKernels;
+
+}
+
+void webcl::RegisterNativeKernel(const std::string& name, NativeKernelFunc fn)
+{
+    if (fn)
+	nativeKernels[name] = fn;
+    else
+	nativeKernels.erase(name);
+}
+
+NativeKernelFunc webcl::FindNativeKernel(const std::string& name)
+{
+    std::map<std::string, NativeKernelFunc>::iterator i = nativeKernels.find(name);
+    return i == nativeKernels.end() ? 0 : i->second;
+}
+
+NativeKernelFunc webcl::NativeKernelFromInfo(const NativeKernelInfo *info)
+{
+    if (!info || info->magic != NATIVE_KERNEL_MAGIC || info->version != NATIVE_KERNEL_VERSION)
+	return 0;
+    return info->fn;
+}
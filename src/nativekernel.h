@@ -0,0 +1,57 @@
+
+#ifndef WEBCL_NATIVEKERNEL_H_
+#define WEBCL_NATIVEKERNEL_H_
+
+#include <CL/cl.h>
+
+#include <string>
+
+namespace webcl {
+
+// Host functions that queues can run as native kernels, ordered with
+// their device work, on devices with CL_EXEC_NATIVE_KERNEL.
+//
+// Another addon makes a function available by exporting, as an External,
+// a NativeKernelInfo describing it:
+//
+//   static void decompress(void *args);
+//   static const webcl::NativeKernelInfo decompressInfo =
+//       { webcl::NATIVE_KERNEL_MAGIC, webcl::NATIVE_KERNEL_VERSION, decompress };
+//   exports->Set(String::New("decompress"), External::New((void*) &decompressInfo));
+//
+// which JS then registers by name:
+//
+//   WebCL.registerNativeKernel("decompress", otherAddon.decompress);
+//
+// An External whose magic or version doesn't match is refused, so an
+// unrelated pointer is never called as a function.
+//
+// The function runs on a driver thread, must not touch V8, and gets a
+// copy of the argument block passed to enqueueNativeKernel with each
+// memory object slot holding the host address of that buffer.
+typedef void (CL_CALLBACK *NativeKernelFunc)(void *args);
+
+enum {
+    NATIVE_KERNEL_MAGIC = 0x6b6e6c77,	// "wlnk"
+    NATIVE_KERNEL_VERSION = 1
+};
+
+struct NativeKernelInfo {
+    cl_uint magic;		// NATIVE_KERNEL_MAGIC
+    cl_uint version;		// NATIVE_KERNEL_VERSION
+    NativeKernelFunc fn;
+};
+
+// The function info describes, 0 unless it is a NativeKernelInfo of this
+// version.
+NativeKernelFunc NativeKernelFromInfo(const NativeKernelInfo *info);
+
+// Registers (or with fn = 0, removes) a function. Main thread only.
+void RegisterNativeKernel(const std::string& name, NativeKernelFunc fn);
+
+// 0 if nothing is registered under name.
+NativeKernelFunc FindNativeKernel(const std::string& name);
+
+} // namespace
+
+#endif
@@ -4,6 +4,7 @@
 #include "device.h"
 
 #include <iostream>
+#include <vector>
 
 using namespace v8;
 using namespace webcl;
@@ -22,6 +23,7 @@ void Platform::Init(Handle<Object> target)
     constructor_template->SetClassName(String::NewSymbol("WebCLPlatform"));
 
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getInfo", getPlatformInfo);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "getAllInfo", getAllPlatformInfo);
     NODE_SET_PROTOTYPE_METHOD(constructor_template, "getDevices", getDevices);
 
     target->Set(String::NewSymbol("WebCLPlatform"), constructor_template->GetFunction());
@@ -34,7 +36,10 @@ Platform::Platform(Handle<Object> wrapper) : pw(0)
     
 Platform::~Platform()
 {
-    if (pw) pw->release();
+    if (pw) {
+	UncacheObject(pw, this);
+	pw->release();
+    }
 }
 
 /* static */
@@ -67,6 +72,19 @@ Handle<Value> Platform::getDevices(const Arguments& args)
     return scope.Close(deviceArray);
 }
 
+// Platform info values are all strings; the size is asked for first so
+// long ones such as PLATFORM_EXTENSIONS are never cut off.
+static cl_int queryPlatformInfo(PlatformWrapper *pw, cl_platform_info param_name,
+				std::vector<char>& value)
+{
+    size_t size = 0;
+    cl_int ret = PlatformWrapper::platformInfoHelper(pw, param_name, 0, 0, &size);
+    if (ret != CL_SUCCESS)
+	return ret;
+    value.assign(size + 1, 0);
+    return PlatformWrapper::platformInfoHelper(pw, param_name, size, &value[0], 0);
+}
+
 /* static */
 Handle<Value> Platform::getPlatformInfo(const Arguments& args)
 {
@@ -74,13 +92,8 @@ Handle<Value> Platform::getPlatformInfo(const Arguments& args)
     Platform *platform = ObjectWrap::Unwrap<Platform>(args.This());
     Local<Value> v = args[0];
     cl_platform_info param_name = v->NumberValue();
-    size_t param_value_size_ret = 0;
-    char param_value[1024];
-    cl_int ret = PlatformWrapper::platformInfoHelper(platform->getPlatformWrapper(),
-						     param_name,
-						     sizeof(param_value),
-						     param_value,
-						     &param_value_size_ret);
+    std::vector<char> param_value;
+    cl_int ret = queryPlatformInfo(platform->getPlatformWrapper(), param_name, param_value);
 
     if (ret != CL_SUCCESS) {
 	WEBCL_COND_RETURN_THROW(CL_INVALID_PLATFORM);
@@ -89,7 +102,37 @@ Handle<Value> Platform::getPlatformInfo(const Arguments& args)
 	return ThrowException(Exception::Error(String::New("UNKNOWN ERROR")));
     }
     
-    return scope.Close(String::New(param_value));
+    return scope.Close(String::New(&param_value[0]));
+}
+
+/* static */
+Handle<Value> Platform::getAllPlatformInfo(const Arguments& args)
+{
+    static const struct {
+	cl_platform_info name;
+	const char *key;
+    } platformInfoTable[] = {
+	{ CL_PLATFORM_PROFILE, "PLATFORM_PROFILE" },
+	{ CL_PLATFORM_VERSION, "PLATFORM_VERSION" },
+	{ CL_PLATFORM_NAME, "PLATFORM_NAME" },
+	{ CL_PLATFORM_VENDOR, "PLATFORM_VENDOR" },
+	{ CL_PLATFORM_EXTENSIONS, "PLATFORM_EXTENSIONS" },
+    };
+
+    HandleScope scope;
+    Platform *platform = ObjectWrap::Unwrap<Platform>(args.This());
+    Local<Object> info = Object::New();
+    std::vector<char> param_value;
+
+    for (size_t i=0; i<sizeof(platformInfoTable)/sizeof(platformInfoTable[0]); i++) {
+	cl_int ret = queryPlatformInfo(platform->getPlatformWrapper(), platformInfoTable[i].name,
+				       param_value);
+	if (ret != CL_SUCCESS)
+	    continue;
+	info->Set(String::NewSymbol(platformInfoTable[i].key), String::New(&param_value[0]));
+    }
+
+    return scope.Close(info);
 }
 
 /* static  */
@@ -106,11 +149,19 @@ Platform *Platform::New(PlatformWrapper* pw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    Platform *cached = FindCachedObject<Platform>(pw);
+    if (cached) {
+	pw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     Platform *platform = ObjectWrap::Unwrap<Platform>(obj);
     platform->pw = pw;
+    CacheObject(pw, platform);
 
     return platform;
 }
@@ -19,6 +19,7 @@ public:
     static v8::Handle<v8::Value> New(const v8::Arguments& args);
 
     static v8::Handle<v8::Value> getPlatformInfo(const v8::Arguments& args);
+    static v8::Handle<v8::Value> getAllPlatformInfo(const v8::Arguments& args);
     static v8::Handle<v8::Value> getDevices(const v8::Arguments& args);
     
     PlatformWrapper *getPlatformWrapper() { return pw; };
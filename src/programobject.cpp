@@ -5,6 +5,7 @@
 #include "context.h"
 
 #include <iostream>
+#include <vector>
 
 using namespace v8;
 using namespace webcl;
@@ -39,22 +40,31 @@ ProgramObject::ProgramObject(Handle<Object> wrapper) : pw(0)
     
 ProgramObject::~ProgramObject()
 {
-    if (pw) pw->release();
+    if (pw) {
+	UncacheObject(pw, this);
+	pw->release();
+    }
 }
 
 Handle<Value> ProgramObject::getProgramInfo(const Arguments& args)
 {
     HandleScope scope;
     ProgramObject *prog = node::ObjectWrap::Unwrap<ProgramObject>(args.This());
-    cl_program_info param_name = args[1]->NumberValue();
+    cl_program_info param_name = args[0]->NumberValue();
     size_t param_value_size_ret = 0;
-    char param_value[4096];
 
+    // query the size first, program sources can be arbitrarily long
     cl_int ret = ProgramWrapper::programInfoHelper(prog->getProgramWrapper(),
-						   param_name,
-						   sizeof(param_value),
-						   param_value,
+						   param_name, 0, 0,
 						   &param_value_size_ret);
+    std::vector<char> param_buf(param_value_size_ret + 1, 0);
+    char *param_value = &param_buf[0];
+    if (ret == CL_SUCCESS)
+	ret = ProgramWrapper::programInfoHelper(prog->getProgramWrapper(),
+						param_name,
+						param_value_size_ret,
+						param_value,
+						&param_value_size_ret);
     if (ret != CL_SUCCESS) {
 	WEBCL_COND_RETURN_THROW(CL_INVALID_VALUE);
 	WEBCL_COND_RETURN_THROW(CL_INVALID_PROGRAM);
@@ -69,7 +79,7 @@ Handle<Value> ProgramObject::getProgramInfo(const Arguments& args)
 	return scope.Close(Integer::NewFromUnsigned(*(cl_uint*)param_value));
     case CL_PROGRAM_CONTEXT: {
 	cl_context ctx = *((cl_context*)param_value);
-	ContextWrapper *cw = new ContextWrapper(ctx);
+	ContextWrapper *cw = WrapQueriedHandle<ContextWrapper>(ctx, clRetainContext);
 	return scope.Close(CLContext::New(cw)->handle_);
     }
     case CL_PROGRAM_DEVICES: {
@@ -77,7 +87,7 @@ Handle<Value> ProgramObject::getProgramInfo(const Arguments& args)
 	Local<Array> deviceArray = Array::New(num_devices);
 	for (size_t i=0; i<num_devices; i++) {
 	    cl_device_id d = ((cl_device_id*)param_value)[i];
-	    DeviceWrapper *dw = new DeviceWrapper(d);
+	    DeviceWrapper *dw = DeviceWrapper::getNewOrExisting(d);
 	    deviceArray->Set(i, Device::New(dw)->handle_);
 	}
 	return scope.Close(deviceArray);
@@ -234,11 +244,19 @@ ProgramObject *ProgramObject::New(ProgramWrapper* pw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    ProgramObject *cached = FindCachedObject<ProgramObject>(pw);
+    if (cached) {
+	pw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     ProgramObject *progobj = ObjectWrap::Unwrap<ProgramObject>(obj);
     progobj->pw = pw;
+    CacheObject(pw, progobj);
 
     return progobj;
 }
@@ -33,7 +33,10 @@ Sampler::Sampler(Handle<Object> wrapper) : sw(0)
     
 Sampler::~Sampler()
 {
-    if (sw) sw->release();
+    if (sw) {
+	UncacheObject(sw, this);
+	sw->release();
+    }
 }
 
 /* static */
@@ -66,7 +69,7 @@ Handle<Value> Sampler::getSamplerInfo(const Arguments& args)
 	return scope.Close(Number::New(*(cl_uint*)param_value));
     case CL_SAMPLER_CONTEXT:{
 	cl_context ctx = *((cl_context*)param_value);
-	ContextWrapper *cw = new ContextWrapper(ctx);
+	ContextWrapper *cw = WrapQueriedHandle<ContextWrapper>(ctx, clRetainContext);
 	return scope.Close(CLContext::New(cw)->handle_);
     }
     case CL_SAMPLER_NORMALIZED_COORDS: {
@@ -93,11 +96,19 @@ Sampler *Sampler::New(SamplerWrapper* sw)
 
     HandleScope scope;
 
+    // one JS object per CL handle, drop the extra reference to the wrapper
+    Sampler *cached = FindCachedObject<Sampler>(sw);
+    if (cached) {
+	sw->release();
+	return cached;
+    }
+
     Local<Value> arg = Integer::NewFromUnsigned(0);
     Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
 
     Sampler *sampler = ObjectWrap::Unwrap<Sampler>(obj);
     sampler->sw = sw;
+    CacheObject(sw, sampler);
 
     return sampler;
 }
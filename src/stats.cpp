@@ -0,0 +1,292 @@
+
+#include "stats.h"
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <cstdio>
+
+using namespace v8;
+
+namespace {
+
+std::mutex g_lock;
+std::map<std::string, webcl::StatsSeries*> g_kernels;
+webcl::StatsSeries g_transfers[webcl::TRANSFER_KINDS];
+
+const char *transferNames[webcl::TRANSFER_KINDS] = { "write", "read", "copy" };
+
+const double quantiles[] = { 0.5, 0.9, 0.99 };
+const char *quantileNames[] = { "p50", "p90", "p99" };
+const int QUANTILES = 3;
+
+int bucketIndex(cl_ulong v)
+{
+    if (v < webcl::LatencyHistogram::SUB_BUCKETS)
+	return (int) v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (int) (v >> (e - 3)) & (webcl::LatencyHistogram::SUB_BUCKETS - 1);
+    return (e - 2) * webcl::LatencyHistogram::SUB_BUCKETS + sub;
+}
+
+// Middle of the bucket's range.
+double bucketValue(int i)
+{
+    if (i < webcl::LatencyHistogram::SUB_BUCKETS)
+	return i;
+    int e = i / webcl::LatencyHistogram::SUB_BUCKETS + 2;
+    int sub = i % webcl::LatencyHistogram::SUB_BUCKETS;
+    double width = (double) (1ULL << (e - 3));
+    return (8 + sub) * width + (width > 1 ? width / 2 : 0);
+}
+
+struct PendingCommand {
+    webcl::StatsSeries *series;
+    size_t bytes;
+};
+
+void CL_CALLBACK onComplete(cl_event event, cl_int status, void *user_data)
+{
+    PendingCommand *p = static_cast<PendingCommand*>(user_data);
+    cl_ulong queued, start, end;
+    if (status < 0) {
+	p->series->errors.fetch_add(1, std::memory_order_relaxed);
+    } else if (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED,
+				       sizeof(cl_ulong), &queued, 0) == CL_SUCCESS &&
+	       clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+				       sizeof(cl_ulong), &start, 0) == CL_SUCCESS &&
+	       clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+				       sizeof(cl_ulong), &end, 0) == CL_SUCCESS) {
+	p->series->queued.record(start > queued ? start - queued : 0);
+	p->series->run.record(end > start ? end - start : 0);
+	p->series->timedBytes.fetch_add(p->bytes, std::memory_order_relaxed);
+    }
+    delete p;
+}
+
+Local<Object> SeriesObject(webcl::StatsSeries *s, bool transfer)
+{
+    Local<Object> obj = Object::New();
+    obj->Set(String::New(transfer ? "transfers" : "launches"),
+	     Number::New(s->commands.load(std::memory_order_relaxed)));
+    obj->Set(String::New("errors"), Number::New(s->errors.load(std::memory_order_relaxed)));
+    if (transfer) {
+	double runSec = s->run.sumNs() / 1e9;
+	obj->Set(String::New("bytes"), Number::New(s->bytes.load(std::memory_order_relaxed)));
+	obj->Set(String::New("bytesPerSecond"),
+		 Number::New(runSec > 0 ? s->timedBytes.load(std::memory_order_relaxed) / runSec : 0));
+    }
+
+    const char *names[] = { "queued", "run" };
+    webcl::LatencyHistogram *hists[] = { &s->queued, &s->run };
+    for (int h = 0; h < 2; h++) {
+	Local<Object> lat = Object::New();
+	cl_ulong n = hists[h]->count();
+	lat->Set(String::New("count"), Number::New(n));
+	lat->Set(String::New("mean"), Number::New(n ? (double) hists[h]->sumNs() / n : 0));
+	for (int q = 0; q < QUANTILES; q++)
+	    lat->Set(String::New(quantileNames[q]), Number::New(hists[h]->percentile(quantiles[q])));
+	obj->Set(String::New(names[h]), lat);
+    }
+    return obj;
+}
+
+// Label values may contain backslash, quote and newline.
+std::string LabelValue(const std::string& s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+	if (s[i] == '\\' || s[i] == '"')
+	    out += '\\';
+	if (s[i] == '\n')
+	    out += "\\n";
+	else
+	    out += s[i];
+    }
+    return out;
+}
+
+void Summary(std::ostringstream& out, const char *name, const std::string& labels,
+	     webcl::LatencyHistogram& h)
+{
+    for (int q = 0; q < QUANTILES; q++)
+	out << name << "{" << labels << ",quantile=\"" << quantiles[q] << "\"} "
+	    << h.percentile(quantiles[q]) / 1e9 << "\n";
+    out << name << "_sum{" << labels << "} " << h.sumNs() / 1e9 << "\n";
+    out << name << "_count{" << labels << "} " << h.count() << "\n";
+}
+
+void Header(std::ostringstream& out, const char *name, const char *type, const char *help)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+} // namespace
+
+namespace webcl {
+
+void LatencyHistogram::record(cl_ulong ns)
+{
+    buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; i++)
+	buckets[i].store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double q) const
+{
+    cl_ulong n = 0;
+    cl_ulong counts[BUCKETS];
+    for (int i = 0; i < BUCKETS; i++) {
+	counts[i] = buckets[i].load(std::memory_order_relaxed);
+	n += counts[i];
+    }
+    if (n == 0)
+	return 0;
+    cl_ulong rank = (cl_ulong) (q * (n - 1)) + 1;
+    cl_ulong seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+	seen += counts[i];
+	if (seen >= rank)
+	    return bucketValue(i);
+    }
+    return bucketValue(BUCKETS - 1);
+}
+
+void StatsSeries::reset()
+{
+    commands.store(0, std::memory_order_relaxed);
+    errors.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    timedBytes.store(0, std::memory_order_relaxed);
+    queued.reset();
+    run.reset();
+}
+
+StatsSeries *KernelStats(KernelWrapper *kw)
+{
+    std::string name;
+    if (kw->getInfo(CL_KERNEL_FUNCTION_NAME, name) != CL_SUCCESS)
+	name = "unknown";
+
+    std::lock_guard<std::mutex> lock(g_lock);
+    StatsSeries *&slot = g_kernels[name];
+    if (!slot)
+	slot = new StatsSeries();
+    return slot;
+}
+
+StatsSeries *TransferStats(TransferKind kind)
+{
+    return &g_transfers[kind];
+}
+
+void RecordCommand(StatsSeries *s, EventWrapper *event, size_t bytes, bool profiling)
+{
+    s->commands.fetch_add(1, std::memory_order_relaxed);
+    s->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    TimeCommand(s, event, bytes, profiling);
+}
+
+void TimeCommand(StatsSeries *s, EventWrapper *event, size_t bytes, bool profiling)
+{
+    if (!profiling || !event)
+	return;
+
+    PendingCommand *p = new PendingCommand();
+    p->series = s;
+    p->bytes = bytes;
+    if (clSetEventCallback(event->getWrapped(), CL_COMPLETE, onComplete, p) != CL_SUCCESS)
+	delete p;
+}
+
+void ResetStats()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    for (std::map<std::string, StatsSeries*>::iterator it = g_kernels.begin();
+	 it != g_kernels.end(); ++it)
+	it->second->reset();
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	g_transfers[i].reset();
+}
+
+Handle<Value> StatsObject()
+{
+    HandleScope scope;
+    std::lock_guard<std::mutex> lock(g_lock);
+
+    Local<Object> kernels = Object::New();
+    for (std::map<std::string, StatsSeries*>::iterator it = g_kernels.begin();
+	 it != g_kernels.end(); ++it)
+	kernels->Set(String::New(it->first.c_str()), SeriesObject(it->second, false));
+
+    Local<Object> transfers = Object::New();
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	transfers->Set(String::New(transferNames[i]), SeriesObject(&g_transfers[i], true));
+
+    Local<Object> obj = Object::New();
+    obj->Set(String::New("kernels"), kernels);
+    obj->Set(String::New("transfers"), transfers);
+    return scope.Close(obj);
+}
+
+std::string StatsText()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::ostringstream out;
+    std::map<std::string, StatsSeries*>::iterator it;
+
+    Header(out, "webcl_kernel_launches_total", "counter", "Kernel launches enqueued.");
+    for (it = g_kernels.begin(); it != g_kernels.end(); ++it)
+	out << "webcl_kernel_launches_total{kernel=\"" << LabelValue(it->first) << "\"} "
+	    << it->second->commands.load(std::memory_order_relaxed) << "\n";
+    Header(out, "webcl_kernel_errors_total", "counter", "Kernel launches that completed with an error.");
+    for (it = g_kernels.begin(); it != g_kernels.end(); ++it)
+	out << "webcl_kernel_errors_total{kernel=\"" << LabelValue(it->first) << "\"} "
+	    << it->second->errors.load(std::memory_order_relaxed) << "\n";
+    Header(out, "webcl_kernel_queued_seconds", "summary", "Time from enqueue to kernel start.");
+    for (it = g_kernels.begin(); it != g_kernels.end(); ++it)
+	Summary(out, "webcl_kernel_queued_seconds",
+		"kernel=\"" + LabelValue(it->first) + "\"", it->second->queued);
+    Header(out, "webcl_kernel_run_seconds", "summary", "Kernel execution time.");
+    for (it = g_kernels.begin(); it != g_kernels.end(); ++it)
+	Summary(out, "webcl_kernel_run_seconds",
+		"kernel=\"" + LabelValue(it->first) + "\"", it->second->run);
+
+    Header(out, "webcl_transfers_total", "counter", "Buffer transfers enqueued.");
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	out << "webcl_transfers_total{direction=\"" << transferNames[i] << "\"} "
+	    << g_transfers[i].commands.load(std::memory_order_relaxed) << "\n";
+    Header(out, "webcl_transfer_bytes_total", "counter", "Bytes moved by buffer transfers.");
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	out << "webcl_transfer_bytes_total{direction=\"" << transferNames[i] << "\"} "
+	    << g_transfers[i].bytes.load(std::memory_order_relaxed) << "\n";
+    Header(out, "webcl_transfer_bytes_per_second", "gauge",
+	   "Bytes per second of device time, over the timed transfers.");
+    for (int i = 0; i < TRANSFER_KINDS; i++) {
+	double runSec = g_transfers[i].run.sumNs() / 1e9;
+	out << "webcl_transfer_bytes_per_second{direction=\"" << transferNames[i] << "\"} "
+	    << (runSec > 0 ? g_transfers[i].timedBytes.load(std::memory_order_relaxed) / runSec : 0)
+	    << "\n";
+    }
+    Header(out, "webcl_transfer_queued_seconds", "summary", "Time from enqueue to transfer start.");
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	Summary(out, "webcl_transfer_queued_seconds",
+		std::string("direction=\"") + transferNames[i] + "\"", g_transfers[i].queued);
+    Header(out, "webcl_transfer_run_seconds", "summary", "Transfer execution time.");
+    for (int i = 0; i < TRANSFER_KINDS; i++)
+	Summary(out, "webcl_transfer_run_seconds",
+		std::string("direction=\"") + transferNames[i] + "\"", g_transfers[i].run);
+
+    return out.str();
+}
+
+} // namespace
@@ -0,0 +1,93 @@
+
+#ifndef WEBCL_STATS_H_
+#define WEBCL_STATS_H_
+
+#include "common.h"
+#include "wrapper/include/kernelwrapper.h"
+#include "wrapper/include/eventwrapper.h"
+
+#include <atomic>
+#include <string>
+
+namespace webcl {
+
+// Always-on launch and transfer statistics.
+//
+// Commands and bytes are counted when a command is enqueued. On queues
+// created with QUEUE_PROFILING_ENABLE a completion callback also records
+// the queued->start and start->end times from the event's profiling
+// timestamps. All updates are atomic, since the callbacks run on driver
+// threads.
+
+// Log-linear histogram of nanosecond latencies: 8 buckets per power of
+// two, so percentiles are within 12.5%.
+class LatencyHistogram
+{
+
+public:
+    enum { SUB_BUCKETS = 8, BUCKETS = 62 * SUB_BUCKETS };
+
+    LatencyHistogram() { reset(); }
+
+    void record(cl_ulong ns);
+    void reset();
+
+    cl_ulong count() const { return total.load(std::memory_order_relaxed); }
+    cl_ulong sumNs() const { return sum.load(std::memory_order_relaxed); }
+    // q in [0, 1]; 0 if nothing was recorded
+    double percentile(double q) const;
+
+ private:
+    std::atomic<cl_ulong> buckets[BUCKETS];
+    std::atomic<cl_ulong> total;
+    std::atomic<cl_ulong> sum;
+};
+
+struct StatsSeries
+{
+    StatsSeries() { reset(); }
+    void reset();
+
+    std::atomic<cl_ulong> commands;
+    std::atomic<cl_ulong> errors;
+    std::atomic<cl_ulong> bytes;
+    // bytes of the commands that have a run time, for bytes per second
+    std::atomic<cl_ulong> timedBytes;
+    LatencyHistogram queued;
+    LatencyHistogram run;
+};
+
+enum TransferKind {
+    TRANSFER_WRITE = 0,
+    TRANSFER_READ,
+    TRANSFER_COPY,
+    TRANSFER_KINDS
+};
+
+// Series of a kernel. Kernels are keyed by function name, so the numbers
+// survive the KernelWrapper and programs rebuilt per request don't grow
+// the table. Series are never freed; KernelObject looks its own up once,
+// when it is created.
+StatsSeries *KernelStats(KernelWrapper *kw);
+
+StatsSeries *TransferStats(TransferKind kind);
+
+// Counts a successfully enqueued command and, if profiling, times it
+// once event completes.
+void RecordCommand(StatsSeries *s, EventWrapper *event, size_t bytes, bool profiling);
+
+// Only the timing half of RecordCommand, for the parts of a command that
+// is counted once as a whole (a chunked transfer).
+void TimeCommand(StatsSeries *s, EventWrapper *event, size_t bytes, bool profiling);
+
+void ResetStats();
+
+// { kernels: { name: series }, transfers: { write|read|copy: series } }
+v8::Handle<v8::Value> StatsObject();
+
+// Prometheus text exposition format
+std::string StatsText();
+
+} // namespace
+
+#endif
@@ -0,0 +1,415 @@
+
+#include "submitter.h"
+#include "kernelobject.h"
+#include "memoryobject.h"
+#include "wrapper/include/contextwrapper.h"
+#include "wrapper/include/eventwrapper.h"
+
+#include "node_buffer.h"
+
+#include <iostream>
+#include <cstring>
+
+using namespace v8;
+using namespace webcl;
+
+Persistent<FunctionTemplate> Submitter::constructor_template;
+
+// The rings are plain memory shared with JS; order the loads and stores
+// of the descriptors against the head/tail words.
+static inline cl_uint loadWord(volatile cl_uint *p)
+{
+    cl_uint v = *p;
+    __sync_synchronize();
+    return v;
+}
+
+static inline void storeWord(volatile cl_uint *p, cl_uint v)
+{
+    __sync_synchronize();
+    *p = v;
+}
+
+// The words of a ring Buffer as a uint32 array for JS, which stores a
+// descriptor word with a plain element store instead of a call. The view
+// keeps the Buffer alive.
+static Local<Object> WordView(Handle<Object> buf, size_t words)
+{
+    Local<Object> view = Object::New();
+    view->SetIndexedPropertiesToExternalArrayData(node::Buffer::Data(buf),
+						  kExternalUnsignedIntArray, words);
+    view->Set(String::NewSymbol("length"), Integer::NewFromUnsigned(words));
+    view->SetHiddenValue(String::NewSymbol("webcl.buffer"), buf);
+    return view;
+}
+
+/* static  */
+void Submitter::Init(Handle<Object> target)
+{
+    HandleScope scope;
+
+    Local<FunctionTemplate> t = FunctionTemplate::New(Submitter::New);
+    constructor_template = Persistent<FunctionTemplate>::New(t);
+
+    constructor_template->InstanceTemplate()->SetInternalFieldCount(1);
+    constructor_template->SetClassName(String::NewSymbol("WebCLSubmitter"));
+
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "registerKernel", registerKernel);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "registerMemoryObject", registerMemoryObject);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "registerHost", registerHost);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "notify", notify);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "consume", consume);
+    NODE_SET_PROTOTYPE_METHOD(constructor_template, "close", close);
+
+    target->Set(String::NewSymbol("WebCLSubmitter"), constructor_template->GetFunction());
+}
+
+Submitter::Submitter(Handle<Object> wrapper)
+    : cw(0), capacity(0), sub(0), comp(0), running(false)
+{
+    Wrap(wrapper);
+}
+
+// A running submitter holds a reference to its JS object (see New), so
+// this only runs once close() has stopped it and never has to block.
+Submitter::~Submitter()
+{
+    stop();
+}
+
+void Submitter::stop()
+{
+    {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!running)
+	    return;
+	running = false;
+    }
+    wake.notify_all();
+    completed.notify_all();
+    submitThread.join();
+    completeThread.join();
+
+    // Commands still in flight may use registered host memory, so wait
+    // for each before it is released below. Their completions are kept
+    // for poll(), in the ring or, if it is full, until consume() makes
+    // room.
+    for (size_t i=0; i<pending.size(); i++) {
+	Pending &p = pending[i];
+	if (p.event) {
+	    std::vector<EventWrapper const*> events(1, p.event);
+	    if (p.status == CL_SUCCESS)
+		p.status = ContextWrapper::waitForEvents(events);
+	    p.event->release();
+	    p.event = 0;
+	}
+	done.push_back(p);
+    }
+    pending.clear();
+    writeDone();
+
+    for (size_t i=0; i<objects.size(); i++) {
+	if (objects[i].w)
+	    objects[i].w->release();
+	if (!objects[i].handle.IsEmpty())
+	    objects[i].handle.Dispose();
+    }
+    objects.clear();
+    submission.Dispose();
+    completion.Dispose();
+    if (cw) cw->release();
+    cw = 0;
+}
+
+cl_uint Submitter::addObject(Entry o)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    objects.push_back(o);
+    return objects.size() - 1;
+}
+
+bool Submitter::getObject(cl_uint id, Entry *o)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (id >= objects.size())
+	return false;
+    *o = objects[id];
+    return true;
+}
+
+/* static */
+Handle<Value> Submitter::registerKernel(const Arguments& args)
+{
+    HandleScope scope;
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    if (!s->running || !args[0]->IsObject())
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+    KernelObject *k = ObjectWrap::Unwrap<KernelObject>(args[0]->ToObject());
+    Entry o = { k->getKernelWrapper(), 0, 0, Persistent<Object>() };
+    o.w->retain();
+    return scope.Close(Integer::NewFromUnsigned(s->addObject(o)));
+}
+
+/* static */
+Handle<Value> Submitter::registerMemoryObject(const Arguments& args)
+{
+    HandleScope scope;
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    if (!s->running || !args[0]->IsObject())
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+    MemoryObject *mo = ObjectWrap::Unwrap<MemoryObject>(args[0]->ToObject());
+    Entry o = { mo->getMemoryObjectWrapper(), 0, 0, Persistent<Object>() };
+    o.w->retain();
+    return scope.Close(Integer::NewFromUnsigned(s->addObject(o)));
+}
+
+// Host memory (a typed array or Buffer) stays pinned in the submitter
+// until it is closed.
+/* static */
+Handle<Value> Submitter::registerHost(const Arguments& args)
+{
+    HandleScope scope;
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    size_t nbytes = 0;
+    char *ptr = (char*)BinaryViewBytes(args[0], &nbytes);
+    if (!s->running || !ptr)
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+    Entry o = { 0, ptr, nbytes, Persistent<Object>::New(args[0]->ToObject()) };
+    return scope.Close(Integer::NewFromUnsigned(s->addObject(o)));
+}
+
+// Publishes every descriptor written before the new submission head
+// args[0] and wakes the submitter thread; one call per batch.
+/* static */
+Handle<Value> Submitter::notify(const Arguments& args)
+{
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    if (!s->running || !args[0]->IsNumber())
+	return Undefined();
+    storeWord(&s->sub[0], args[0]->Uint32Value());
+    // taking the lock orders the store against the thread's idle check
+    { std::lock_guard<std::mutex> guard(s->lock); }
+    s->wake.notify_one();
+    return Undefined();
+}
+
+// Hands the completion entries before args[0] back and returns the
+// completion head, ordered before the entries JS then reads.
+/* static */
+Handle<Value> Submitter::consume(const Arguments& args)
+{
+    HandleScope scope;
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    if (!s->comp || !args[0]->IsNumber())
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+    storeWord(&s->comp[1], args[0]->Uint32Value());
+    if (s->running) {
+	{ std::lock_guard<std::mutex> guard(s->lock); }
+	s->completed.notify_one();
+    } else {
+	s->writeDone();
+    }
+    return scope.Close(Integer::NewFromUnsigned(loadWord(&s->comp[0])));
+}
+
+// Waits for the commands already published and stops the threads. The
+// completions not yet polled stay available to poll().
+/* static */
+Handle<Value> Submitter::close(const Arguments& args)
+{
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(args.This());
+    if (s->running) {
+	s->stop();
+	s->Unref();
+    }
+    return Undefined();
+}
+
+// Writes a completion entry, false if the ring is full. Only ever called
+// by one thread at a time: the completion thread, then after stop() the
+// main thread.
+bool Submitter::writeCompletion(const Pending &p)
+{
+    cl_uint head = comp[0];
+    if (head - loadWord(&comp[1]) >= capacity)
+	return false;
+    volatile cl_uint *dst = comp + HEADER_WORDS + (head % capacity) * COMPLETION_WORDS;
+    dst[0] = p.tag;
+    dst[1] = (cl_uint)p.status;
+    storeWord(&comp[0], head + 1);
+    return true;
+}
+
+void Submitter::writeDone()
+{
+    while (!done.empty() && writeCompletion(done.front()))
+	done.pop_front();
+}
+
+cl_int Submitter::submit(const cl_uint *d, EventWrapper **event)
+{
+    std::vector<EventWrapper*> event_wait_list;
+    Entry a, b;
+
+    switch (d[0]) {
+    case OP_NDRANGE: {
+	cl_uint work_dim = d[3];
+	if (!getObject(d[2], &a) || !a.w || work_dim < 1 || work_dim > 3)
+	    return CL_INVALID_VALUE;
+	std::vector<size_t> global_work_size, local_work_size, global_work_offset;
+	for (cl_uint i=0; i<work_dim; i++) {
+	    global_work_size.push_back(d[4+i]);
+	    if (d[7])
+		local_work_size.push_back(d[7+i]);
+	    global_work_offset.push_back(d[10+i]);
+	}
+	return cw->enqueueNDRangeKernel(static_cast<KernelWrapper*>(a.w), work_dim,
+					global_work_offset, global_work_size,
+					local_work_size, event_wait_list, event);
+    }
+    case OP_WRITE:
+    case OP_READ: {
+	if (!getObject(d[2], &a) || !a.w || !getObject(d[3], &b) || !b.host)
+	    return CL_INVALID_VALUE;
+	size_t offset = d[4], size = d[5], host_offset = d[6];
+	if (host_offset > b.host_len || size > b.host_len - host_offset)
+	    return CL_INVALID_VALUE;
+	MemoryObjectWrapper *mw = static_cast<MemoryObjectWrapper*>(a.w);
+	if (d[0] == OP_WRITE)
+	    return cw->enqueueWriteBuffer(mw, false, offset, size, b.host + host_offset,
+					  event_wait_list, event);
+	return cw->enqueueReadBuffer(mw, false, offset, size, b.host + host_offset,
+				     event_wait_list, event);
+    }
+    case OP_COPY: {
+	if (!getObject(d[2], &a) || !a.w || !getObject(d[3], &b) || !b.w)
+	    return CL_INVALID_VALUE;
+	return cw->enqueueCopyBuffer(static_cast<MemoryObjectWrapper*>(a.w),
+				     static_cast<MemoryObjectWrapper*>(b.w),
+				     d[4], d[5], d[6], event_wait_list, event);
+    }
+    case OP_MARKER:
+	return cw->enqueueMarker(event);
+    default:
+	return CL_INVALID_OPERATION;
+    }
+}
+
+void Submitter::submitLoop()
+{
+    volatile cl_uint *entries = sub + HEADER_WORDS;
+    for (;;) {
+	cl_uint head = loadWord(&sub[0]);
+	cl_uint tail = sub[1];
+
+	if (head == tail) {
+	    // idle: sleep until notify() or stop()
+	    std::unique_lock<std::mutex> guard(lock);
+	    while (running && loadWord(&sub[0]) == tail)
+		wake.wait(guard);
+	    if (!running && loadWord(&sub[0]) == tail)
+		break;
+	    continue;
+	}
+
+	for (; tail != head; tail++) {
+	    cl_uint d[DESCRIPTOR_WORDS];
+	    volatile cl_uint *src = entries + (tail % capacity) * DESCRIPTOR_WORDS;
+	    for (int i=0; i<DESCRIPTOR_WORDS; i++)
+		d[i] = src[i];
+
+	    Pending p = { d[1], CL_SUCCESS, 0 };
+	    p.status = submit(d, &p.event);
+	    // the slot can be reused as soon as the descriptor is copied
+	    storeWord(&sub[1], tail + 1);
+
+	    std::lock_guard<std::mutex> guard(lock);
+	    pending.push_back(p);
+	    completed.notify_one();
+	}
+	cw->flush();
+    }
+}
+
+void Submitter::completeLoop()
+{
+    for (;;) {
+	Pending p;
+	{
+	    std::unique_lock<std::mutex> guard(lock);
+	    while (running && pending.empty())
+		completed.wait(guard);
+	    if (pending.empty())
+		break;
+	    p = pending.front();
+	    pending.pop_front();
+	}
+
+	if (p.event) {
+	    std::vector<EventWrapper const*> events(1, p.event);
+	    if (p.status == CL_SUCCESS)
+		p.status = ContextWrapper::waitForEvents(events);
+	    p.event->release();
+	    p.event = 0;
+	}
+
+	// never drop a completion, wait for JS to make room instead; on
+	// stop() it goes back for stop() to keep
+	std::unique_lock<std::mutex> guard(lock);
+	while (running && !writeCompletion(p))
+	    completed.wait(guard);
+	if (!running && !writeCompletion(p)) {
+	    pending.push_front(p);
+	    return;
+	}
+    }
+}
+
+/* static  */
+Handle<Value> Submitter::New(const Arguments& args)
+{
+    HandleScope scope;
+    Submitter *s = new Submitter(args.This());
+    return args.This();
+}
+
+/* static  */
+Submitter *Submitter::New(CommandQueueWrapper* cw, cl_uint capacity)
+{
+
+    HandleScope scope;
+
+    Local<Value> arg = Integer::NewFromUnsigned(0);
+    Local<Object> obj = constructor_template->GetFunction()->NewInstance(1, &arg);
+
+    Submitter *s = ObjectWrap::Unwrap<Submitter>(obj);
+    s->cw = cw;
+    s->capacity = capacity;
+
+    size_t sub_size = (HEADER_WORDS + capacity * DESCRIPTOR_WORDS) * sizeof(cl_uint);
+    node::Buffer *sub_buf = node::Buffer::New(sub_size);
+    memset(node::Buffer::Data(sub_buf->handle_), 0, sub_size);
+    s->submission = Persistent<Object>::New(sub_buf->handle_);
+    s->sub = (volatile cl_uint*)node::Buffer::Data(sub_buf->handle_);
+    s->sub[2] = capacity;
+
+    size_t comp_size = (HEADER_WORDS + capacity * COMPLETION_WORDS) * sizeof(cl_uint);
+    node::Buffer *comp_buf = node::Buffer::New(comp_size);
+    memset(node::Buffer::Data(comp_buf->handle_), 0, comp_size);
+    s->completion = Persistent<Object>::New(comp_buf->handle_);
+    s->comp = (volatile cl_uint*)node::Buffer::Data(comp_buf->handle_);
+    s->comp[2] = capacity;
+
+    obj->Set(String::NewSymbol("submission"),
+	     WordView(sub_buf->handle_, HEADER_WORDS + capacity * DESCRIPTOR_WORDS));
+    obj->Set(String::NewSymbol("completion"),
+	     WordView(comp_buf->handle_, HEADER_WORDS + capacity * COMPLETION_WORDS));
+
+    // the threads use the rings and registered objects until close()
+    s->Ref();
+    s->running = true;
+    s->submitThread = std::thread(&Submitter::submitLoop, s);
+    s->completeThread = std::thread(&Submitter::completeLoop, s);
+
+    return s;
+}
@@ -0,0 +1,114 @@
+
+#ifndef WEBCL_SUBMITTER_H_
+#define WEBCL_SUBMITTER_H_
+
+#include "common.h"
+#include "wrapper/include/commandqueuewrapper.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace webcl {
+
+// Submission ring drained by a native thread.
+//
+// JS writes fixed size command descriptors into the "submission" ring;
+// the submitter thread enqueues them on the command queue, so a stalling
+// driver never blocks the event loop. Completed tags (with their status)
+// are published in the "completion" ring. Kernels, memory objects and
+// host arrays are referred to by the ids returned from the register*
+// methods.
+//
+// Both rings are a header of HEADER_WORDS uint32 (head, tail, capacity,
+// reserved) followed by capacity entries, shared with JS as uint32
+// arrays. The producer only writes head, the consumer only writes tail.
+// JS has no fences, so it moves its words through notify(head), once for
+// any number of descriptors, and consume(tail), once per poll; both order
+// them against the entries on any CPU.
+//
+// A submitter keeps itself alive until close(), which waits for the
+// commands already published. Their completions stay in the ring, or
+// wait for room in it, until JS polls them.
+class Submitter : public node::ObjectWrap
+{
+
+public:
+    ~Submitter();
+
+    static void Init(v8::Handle<v8::Object> target);
+
+    static Submitter *New(CommandQueueWrapper* cw, cl_uint capacity);
+    static v8::Handle<v8::Value> New(const v8::Arguments& args);
+
+    static v8::Handle<v8::Value> registerKernel(const v8::Arguments& args);
+    static v8::Handle<v8::Value> registerMemoryObject(const v8::Arguments& args);
+    static v8::Handle<v8::Value> registerHost(const v8::Arguments& args);
+    static v8::Handle<v8::Value> notify(const v8::Arguments& args);
+    static v8::Handle<v8::Value> consume(const v8::Arguments& args);
+    static v8::Handle<v8::Value> close(const v8::Arguments& args);
+
+    enum Opcode {
+	OP_NDRANGE = 1,		// kernel, work_dim, global[3], local[3], offset[3]
+	OP_WRITE,		// mem, host, offset, size, host offset
+	OP_READ,		// mem, host, offset, size, host offset
+	OP_COPY,		// src mem, dst mem, src offset, dst offset, size
+	OP_MARKER		// completes when everything before it has
+    };
+
+    enum {
+	HEADER_WORDS = 4,
+	DESCRIPTOR_WORDS = 16,	// opcode, tag, 14 operands
+	COMPLETION_WORDS = 2	// tag, status
+    };
+
+ private:
+    Submitter(v8::Handle<v8::Object> wrapper);
+
+    struct Entry {
+	Wrapper *w;
+	char *host;
+	size_t host_len;
+	v8::Persistent<v8::Object> handle;
+    };
+
+    struct Pending {
+	cl_uint tag;
+	cl_int status;
+	EventWrapper *event;
+    };
+
+    cl_uint addObject(Entry o);
+    bool getObject(cl_uint id, Entry *o);
+    cl_int submit(const cl_uint *d, EventWrapper **event);
+    void submitLoop();
+    void completeLoop();
+    bool writeCompletion(const Pending &p);
+    void writeDone();
+    void stop();
+
+    static v8::Persistent<v8::FunctionTemplate> constructor_template;
+
+    CommandQueueWrapper *cw;
+    cl_uint capacity;
+    v8::Persistent<v8::Object> submission;
+    v8::Persistent<v8::Object> completion;
+    volatile cl_uint *sub;
+    volatile cl_uint *comp;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable completed;
+    std::vector<Entry> objects;
+    std::deque<Pending> pending;
+    std::deque<Pending> done;		// completed after close(), not yet in the ring
+    bool running;
+    std::thread submitThread;
+    std::thread completeThread;
+};
+
+} // namespace
+
+#endif
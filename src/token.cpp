@@ -0,0 +1,68 @@
+
+#include "token.h"
+
+#include <map>
+#include <mutex>
+
+using namespace v8;
+using namespace webcl;
+
+namespace {
+
+struct TokenEntry {
+    TokenKind kind;
+    Wrapper *w;
+};
+
+// shared by every thread that loads the addon
+std::mutex tokenLock;
+std::map<double, TokenEntry> tokens;
+double nextToken = 1;
+
+}
+
+double webcl::ExportToken(TokenKind kind, Wrapper *w)
+{
+    std::lock_guard<std::mutex> lock(tokenLock);
+    if (!w || w->retain() != CL_SUCCESS)
+	return 0;
+    TokenEntry entry = { kind, w };
+    double token = nextToken++;
+    tokens[token] = entry;
+    return token;
+}
+
+bool webcl::ImportToken(double token, TokenKind *kind, Wrapper **w)
+{
+    std::lock_guard<std::mutex> lock(tokenLock);
+    std::map<double, TokenEntry>::iterator i = tokens.find(token);
+    if (i == tokens.end() || i->second.w->retain() != CL_SUCCESS)
+	return false;
+    *kind = i->second.kind;
+    *w = i->second.w;
+    return true;
+}
+
+bool webcl::ReleaseToken(double token)
+{
+    Wrapper *w = 0;
+    {
+	std::lock_guard<std::mutex> lock(tokenLock);
+	std::map<double, TokenEntry>::iterator i = tokens.find(token);
+	if (i == tokens.end())
+	    return false;
+	w = i->second.w;
+	tokens.erase(i);
+    }
+    w->release();
+    return true;
+}
+
+Handle<Value> webcl::NewToken(TokenKind kind, Wrapper *w)
+{
+    HandleScope scope;
+    double token = ExportToken(kind, w);
+    if (!token)
+	return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+    return scope.Close(Number::New(token));
+}
@@ -0,0 +1,32 @@
+
+#ifndef WEBCL_TOKEN_H_
+#define WEBCL_TOKEN_H_
+
+#include "common.h"
+
+namespace webcl {
+
+// Handles that can be passed to another thread as a plain number and
+// turned back into a JS object there. The token holds a reference to the
+// wrapper until it is released.
+enum TokenKind {
+    TOKEN_CONTEXT = 1,
+    TOKEN_COMMAND_QUEUE,
+    TOKEN_MEMORY_OBJECT
+};
+
+// Retains w and returns a new token for it.
+double ExportToken(TokenKind kind, Wrapper *w);
+
+// Looks up a token. On success the wrapper is retained for the caller.
+bool ImportToken(double token, TokenKind *kind, Wrapper **w);
+
+// Drops the token and its reference.
+bool ReleaseToken(double token);
+
+// ExportToken wrapped for JS, throws if the wrapper is already gone.
+v8::Handle<v8::Value> NewToken(TokenKind kind, Wrapper *w);
+
+} // namespace
+
+#endif
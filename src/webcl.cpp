@@ -11,6 +11,11 @@
 #include "commandqueue.h"
 #include "event.h"
 #include "sampler.h"
+#include "token.h"
+#include "submitter.h"
+#include "stats.h"
+#include "nativekernel.h"
+#include "hostalloc.h"
 
 using namespace v8;
 using namespace webcl;
@@ -36,6 +41,23 @@ public:
         // not in spec
 	NODE_SET_PROTOTYPE_METHOD(t, "createContextFromType", createContextFromType);
 	NODE_SET_PROTOTYPE_METHOD(t, "waitForEvents", waitForEvents);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "fromToken", fromToken);
+	NODE_SET_PROTOTYPE_METHOD(t, "releaseToken", releaseToken);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "errorName", errorName);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "setLogLevel", setLogLevel);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "flushLog", flushLog);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "getStats", getStats);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "resetStats", resetStats);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "registerNativeKernel", registerNativeKernel);
+        // not in spec
+	NODE_SET_PROTOTYPE_METHOD(t, "allocHost", allocHost);
 
 	target->Set(String::NewSymbol("WebCL"), t->GetFunction());
     }
@@ -184,6 +206,130 @@ public:
 	return Undefined();
     }
 
+    // Tokens come from getToken() on a context, queue or memory object,
+    // possibly created on another thread.
+    static Handle<Value> fromToken(const Arguments& args)
+    {
+	HandleScope scope;
+	if (!args[0]->IsNumber())
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+
+	TokenKind kind;
+	Wrapper *w = 0;
+	if (!ImportToken(args[0]->NumberValue(), &kind, &w))
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+
+	switch (kind) {
+	case TOKEN_CONTEXT:
+	    return scope.Close(CLContext::New(static_cast<ContextWrapper*>(w))->handle_);
+	case TOKEN_COMMAND_QUEUE:
+	    return scope.Close(CommandQueue::New(static_cast<CommandQueueWrapper*>(w))->handle_);
+	case TOKEN_MEMORY_OBJECT:
+	    return scope.Close(MemoryObject::New(static_cast<MemoryObjectWrapper*>(w))->handle_);
+	default:
+	    w->release();
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	}
+    }
+
+    static Handle<Value> releaseToken(const Arguments& args)
+    {
+	HandleScope scope;
+	if (!args[0]->IsNumber() || !ReleaseToken(args[0]->NumberValue()))
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	return Undefined();
+    }
+
+    // Decodes the status returned by a queue in no-throw mode.
+    static Handle<Value> errorName(const Arguments& args)
+    {
+	HandleScope scope;
+	return scope.Close(String::New(ErrorName(args[0]->Int32Value())));
+    }
+
+    // Run time level (0-5) of CLWrapper's log and trace records, and
+    // optionally the file they go to. Returns the previous level.
+    static Handle<Value> setLogLevel(const Arguments& args)
+    {
+	HandleScope scope;
+	int previous = cl_wrapper_get_log_level();
+	if (args.Length() > 1) {
+	    String::Utf8Value path(args[1]);
+	    if (!cl_wrapper_set_log_file(args[1]->IsNull() ? 0 : *path))
+		return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	}
+	cl_wrapper_set_log_level(args[0]->Int32Value());
+	return scope.Close(Integer::New(previous));
+    }
+
+    static Handle<Value> flushLog(const Arguments& args)
+    {
+	cl_wrapper_flush_log();
+	return Undefined();
+    }
+
+    // Kernel and transfer statistics (see stats.h) as an object, or as
+    // Prometheus text with getStats("prometheus").
+    static Handle<Value> getStats(const Arguments& args)
+    {
+	HandleScope scope;
+	if (args[0]->IsString()) {
+	    String::Utf8Value format(args[0]);
+	    if (std::string(*format) != "prometheus")
+		return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	    std::string text = StatsText();
+	    return scope.Close(String::New(text.c_str(), text.size()));
+	}
+	return scope.Close(StatsObject());
+    }
+
+    static Handle<Value> resetStats(const Arguments& args)
+    {
+	ResetStats();
+	return Undefined();
+    }
+
+    // Makes a host function exported by another addon as an External
+    // available to enqueueNativeKernel (see nativekernel.h). Registering
+    // null removes the name.
+    static Handle<Value> registerNativeKernel(const Arguments& args)
+    {
+	HandleScope scope;
+	if (!args[0]->IsString() || !(args[1]->IsExternal() || args[1]->IsNull()))
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	String::Utf8Value name(args[0]);
+	NativeKernelFunc fn = 0;
+	if (args[1]->IsExternal()) {
+	    fn = NativeKernelFromInfo((const NativeKernelInfo*) External::Unwrap(args[1]));
+	    if (!fn)
+		return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	}
+	RegisterNativeKernel(*name, fn);
+	return Undefined();
+    }
+
+    // Aligned host memory (see hostalloc.h) as a Buffer, with no copy.
+    static Handle<Value> allocHost(const Arguments& args)
+    {
+	HandleScope scope;
+	size_t nbytes;
+	if (!ToSize(args[0], &nbytes) || nbytes == 0)
+	    return ThrowException(Exception::Error(String::New("CL_INVALID_VALUE")));
+	bool hugePages = false;
+	if (args[1]->IsObject())
+	    hugePages = args[1]->ToObject()->Get(String::NewSymbol("hugePages"))->BooleanValue();
+
+	void *ptr = AllocHost(nbytes, hugePages);
+	if (!ptr)
+	    return ThrowException(Exception::Error(String::New("CL_OUT_OF_HOST_MEMORY")));
+	return scope.Close(node::Buffer::New((char*)ptr, nbytes, releaseHost, 0)->handle_);
+    }
+
+    static void releaseHost(char *data, void *hint)
+    {
+	ReleaseHostAllocation(data);
+    }
+
     static Handle<Value> unloadCompiler(const Arguments& args)
     {
 	cl_int ret = ContextWrapper::unloadCompiler();
@@ -210,6 +356,7 @@ extern "C" {
 	CommandQueue::Init(target);
 	Event::Init(target);
 	Sampler::Init(target);
+	Submitter::Init(target);
     }
 
     NODE_MODULE(_webcl, init);
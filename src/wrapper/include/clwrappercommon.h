@@ -50,6 +50,7 @@
 #include <string>
 
 #include <cstdint>
+#include <atomic>
 
 
 /** CL_SUCCEEDED evaluates to true if the OpenCL error value \c err
@@ -108,6 +109,27 @@ typedef cl_int (*InfoFuncExtra)(Wrapper const* aInstance, Wrapper const* aExtra,
 # define CL_W_LOG_LEVEL_INFO      3
 # define CL_W_LOG_LEVEL_DEBUG     4
 #endif //CLWRAPPERCOMMON_INTERNAL_H
+#define CL_W_LOG_LEVEL_TRACE      5
+
+
+/* Run time control of the wrapper's log and trace output. Messages at or
+ * below the current level are recorded into an in-memory ring and written
+ * out by a background thread; level CL_W_LOG_LEVEL_NONE disables them.
+ * CL_W_LOG_LEVEL_TRACE also records every wrapper method entered.
+ */
+void cl_wrapper_set_log_level (int level);
+int cl_wrapper_get_log_level ();
+
+/* Redirects log output to the file at aPath (appending), or to stderr if
+ * aPath is null or empty. Returns false if the file can't be opened.
+ */
+bool cl_wrapper_set_log_file (char const* aPath);
+
+/* Writes out all recorded messages before returning. */
+void cl_wrapper_flush_log ();
+
+/* Number of messages lost because the ring was full. */
+unsigned long cl_wrapper_log_dropped ();
 
 
 /* Explicit template specialization is not allowed within class, even though
@@ -588,6 +610,13 @@ public:
      */
     size_t refCount () const;
 
+    /** Increase the reference count by one unless it already reached zero.
+     * Used by the instance registries to hand out an existing instance
+     * that another thread may be releasing at the same time.
+     * \return true if a reference was taken.
+     */
+    bool tryRetain ();
+
     /** Add a weak reference to the instance.
      * \param aCb Weak reference callback, called when the instance is destroyed.
      * \param aUserData This arbitrary user data is given to the callback as an
@@ -623,6 +652,11 @@ public:
      */
     std::map<std::string, void*> store;
 
+    /** Object of the language binding representing this instance, or 0.
+     * Wrapper does not take ownership of it.
+     */
+    void* binding;
+
 protected:
     /** Public calls to destructor are prevented.
      * Wrappers and derivative classes should never be directly destroyed
@@ -661,10 +695,36 @@ protected:
      */
     virtual cl_int releaseWrapped () const;
 
+    /** A CL handle and the OpenCL call that releases it.
+     * release () takes this before dropping its reference, since once the
+     * count is down the instance may be deleted by another thread.
+     */
+    struct RawHandle {
+        void* handle;
+        cl_int (*release) (void*);
+    };
+
+    /** Adapts a typed OpenCL release call to RawHandle::release. */
+    template <typename H, cl_int (CL_API_CALL *Release) (H)>
+    static cl_int releaseRaw (void* aHandle) {
+        return Release ((H)aHandle);
+    }
+
+    /** The handle and its release call; no release call for handles
+     * that have none. The subclass implements this if it has a handle.
+     */
+    virtual RawHandle rawHandle () const;
+
+    /** Remove this instance from its class's instance registry.
+     * Called by release () for the last reference, before the CL object
+     * is released, so that findAndRetain can no longer return it.
+     */
+    virtual void unregister ();
+
 private:
     Wrapper (Wrapper const&);
     Wrapper& operator= (Wrapper const&);
-    size_t mRefCnt;
+    std::atomic<size_t> mRefCnt;
     std::multimap<WrapperWeakRefCb,void*> mWeakRefs;
 };
 
@@ -120,6 +120,10 @@ enum CLType {
     EVENT_V,
     SAMPLER_V,
 
+    // Kernel argument types
+    LOCAL_MEMORY_SIZE,          // __local allocation, value is the size in bytes
+    STRUCT,                     // packed struct, raw bytes of a typed array
+
     LAST
 };
 }
@@ -67,11 +67,16 @@ public:
                         std::vector<EventWrapper*> const& aWaitList,
                         EventWrapper** aResultOut);
 
-    cl_int enqueueNativeKernel (void (*aUserFunc)(void *),
+    /** Runs aUserFunc on the host, ordered with the queue's other commands.
+     * aArgs is copied; aMemOffsets are the byte offsets in it of pointer
+     * sized slots that the function finds holding the host address of the
+     * matching aMemObjects buffer.
+     */
+    cl_int enqueueNativeKernel (void (CL_CALLBACK *aUserFunc)(void *),
                                 void const* aArgs,
                                 size_t aSizeOfArgs,
-                                std::vector<MemoryObjectWrapper*>& aMemObjects,
-                                std::vector<void const*> aArgsMemLoc,
+                                std::vector<MemoryObjectWrapper*> const& aMemObjects,
+                                std::vector<size_t> const& aMemOffsets,
                                 std::vector<EventWrapper*> const& aWaitList,
                                 EventWrapper** aResultOut);
 
@@ -233,6 +238,11 @@ protected:
     virtual ~CommandQueueWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainCommandQueue (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseCommandQueue (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_command_queue, clReleaseCommandQueue> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     CommandQueueWrapper ();
@@ -240,7 +250,7 @@ private:
 
 public:
     static InstanceRegistry<cl_command_queue, CommandQueueWrapper*> instanceRegistry;
-    static CommandQueueWrapper* getNewOrExisting (cl_command_queue aHandle);
+    static CommandQueueWrapper* getNewOrExisting (cl_command_queue aHandle, bool* aCreatedOut = 0);
 
     static cl_int commandQueueInfoHelper (Wrapper const* aInstance, int aName,
                                           size_t aSize, void* aValueOut, size_t* aSizeOut);
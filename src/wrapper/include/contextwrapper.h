@@ -126,6 +126,11 @@ protected:
     virtual ~ContextWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainContext (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseContext (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_context, clReleaseContext> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     ContextWrapper ();
@@ -133,7 +138,7 @@ private:
 
 public:
     static InstanceRegistry<cl_context, ContextWrapper*> instanceRegistry;
-    static ContextWrapper* getNewOrExisting (cl_context aHandle);
+    static ContextWrapper* getNewOrExisting (cl_context aHandle, bool* aCreatedOut = 0);
 
     static cl_int contextInfoHelper (Wrapper const* aInstance, int aName,
                                      size_t aSize, void* aValueOut, size_t* aSizeOut);
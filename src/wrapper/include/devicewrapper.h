@@ -35,6 +35,7 @@
 #define DEVICEWRAPPER_H
 
 #include "clwrappercommon.h"
+#include "info_cache.h"
 
 
 class DeviceWrapper : public Wrapper {
@@ -50,13 +51,16 @@ protected:
     virtual ~DeviceWrapper ();
     virtual cl_int retainWrapped () const { return CL_SUCCESS; } // No retain for cl_device_id
     virtual cl_int releaseWrapped () const { return CL_SUCCESS; } // No release for cl_device_id
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     DeviceWrapper ();
     cl_device_id mWrapped;
+    // Device properties are immutable, see deviceInfoHelper.
+    mutable InfoCache mInfoCache;
 
 public:
-    static DeviceWrapper* getNewOrExisting (cl_device_id aHandle);
+    static DeviceWrapper* getNewOrExisting (cl_device_id aHandle, bool* aCreatedOut = 0);
     static InstanceRegistry<cl_device_id, DeviceWrapper*> instanceRegistry;
 
     static cl_int deviceInfoHelper (Wrapper const* aInstance, int aName,
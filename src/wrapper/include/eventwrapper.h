@@ -64,6 +64,11 @@ protected:
     virtual ~EventWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainEvent (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseEvent (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_event, clReleaseEvent> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     EventWrapper ();
@@ -71,7 +76,7 @@ private:
 
 public:
     static InstanceRegistry<cl_event, EventWrapper*> instanceRegistry;
-    static EventWrapper* getNewOrExisting (cl_event aHandle);
+    static EventWrapper* getNewOrExisting (cl_event aHandle, bool* aCreatedOut = 0);
 
     static cl_int eventInfoHelper (Wrapper const* aInstance, int aName,
                                    size_t aSize, void* aValueOut, size_t* aSizeOut);
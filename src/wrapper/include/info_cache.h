@@ -0,0 +1,98 @@
+/*
+ * This file is part of WebCL – JavaScript bindings for OpenCL
+ * http://webcl.nokiaresearch.com/
+ *
+ * Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
+ *
+ * Contact: Jari Nikara  ;jari.nikara@nokia.com;
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ *
+ * The package is based on a published Khronos OpenCL 1.1 Specification,
+ * see http://www.khronos.org/opencl/.
+ *
+ * OpenCL is a trademark of Apple Inc.
+ */
+
+/** \file info_cache.h
+ * InfoCache class definition.
+ */
+
+#ifndef _INFO_CACHE_H_
+#define _INFO_CACHE_H_
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <cstring>
+
+
+/** Cache for info parameters that can not change during the lifetime of
+ * the wrapped OpenCL entity, such as device and platform properties.
+ * A value is queried from the implementation the first time it is asked
+ * for and later requests are served from the cached bytes. Failed queries
+ * are not cached.
+ */
+class InfoCache {
+  public:
+    InfoCache () : mValues (), mLock () { }
+    ~InfoCache () { }
+
+    /** Same contract as clGetXInfo: aValueOut may be null to query the
+     * size only, and a too small aSize gives CL_INVALID_VALUE.
+     */
+    template <typename Thandle, typename Tname>
+    cl_int get (Thandle aHandle,
+                cl_int (CL_API_CALL *aQuery)(Thandle, Tname, size_t, void*, size_t*),
+                Tname aName, size_t aSize, void* aValueOut, size_t* aSizeOut) {
+      std::lock_guard<std::mutex> lock (mLock);
+      std::map<cl_uint, std::vector<char> >::iterator i = mValues.find ((cl_uint)aName);
+      if (i == mValues.end ()) {
+        size_t sze = 0;
+        cl_int err = aQuery (aHandle, aName, 0, 0, &sze);
+        if (err != CL_SUCCESS)
+          return err;
+        std::vector<char> value (sze);
+        if (sze > 0) {
+          err = aQuery (aHandle, aName, sze, &value[0], 0);
+          if (err != CL_SUCCESS)
+            return err;
+        }
+        i = mValues.insert (std::make_pair ((cl_uint)aName, value)).first;
+      }
+      size_t sze = i->second.size ();
+      if (aValueOut) {
+        if (aSize < sze)
+          return CL_INVALID_VALUE;
+        if (sze > 0)
+          memcpy (aValueOut, &i->second[0], sze);
+      }
+      if (aSizeOut)
+        *aSizeOut = sze;
+      return CL_SUCCESS;
+    }
+
+  private:
+    /// Copying is not allowed.
+    InfoCache (InfoCache const&);
+    /// Assignment is not allowed.
+    InfoCache& operator= (InfoCache const&);
+
+    std::map<cl_uint, std::vector<char> > mValues;
+    std::mutex mLock;
+};
+
+#endif // _INFO_CACHE_H_
@@ -34,7 +34,9 @@
 #ifndef _INSTANCE_REGISTRY_H_
 #define _INSTANCE_REGISTRY_H_
 
-#include <map>
+#include <functional>
+#include <mutex>
+#include <cstdlib>
 
 
 /** This template class provides an instance registry for WebCL classes.
@@ -42,30 +44,83 @@
  * identity of the instance in the form of a reference to some external entity.
  * In certain occasions it is necessary to find a WebCL instance by the bare
  * external identity reference that may come from e.g. an external library.
+ *
+ * The registry is an open-addressing hash table with linear probing and is
+ * safe to use from multiple threads. Lookups happen on every enqueue (for
+ * the returned event), so they are O(1) and hold the lock only briefly.
  */
 template <class Tid, class Tinstance>
 class InstanceRegistry {
   public:
-    InstanceRegistry () : mInstances () { }
-    ~InstanceRegistry () { }
+    InstanceRegistry ()
+      : mSlots (0), mCapacity (0), mUsed (0), mDeleted (0), mLock () { }
+    ~InstanceRegistry () { free (mSlots); }
 
+    /** Register aInstance as the instance for aId.
+     * An existing entry for aId is replaced; it can only belong to an
+     * instance that is being destroyed.
+     */
     bool add (Tid aId, Tinstance aInstance) {
-      return mInstances.insert (std::make_pair (aId, aInstance)).second;
+      std::lock_guard<std::mutex> lock (mLock);
+      if ((mUsed + mDeleted + 1) * 2 > mCapacity && !rehash ())
+        return false;
+      Slot* slot = lookup (aId);
+      if (slot) {
+        slot->instance = aInstance;
+        return true;
+      }
+      slot = &mSlots[probeStart (aId)];
+      while (slot->state == SLOT_USED)
+        slot = next (slot);
+      if (slot->state == SLOT_DELETED)
+        --mDeleted;
+      slot->id = aId;
+      slot->instance = aInstance;
+      slot->state = SLOT_USED;
+      ++mUsed;
+      return true;
     }
 
     bool remove (Tid aId) {
-      return mInstances.erase (aId) != 0;
+      std::lock_guard<std::mutex> lock (mLock);
+      return erase (lookup (aId));
+    }
+
+    /** Remove the entry for aId only if it still refers to aInstance. */
+    bool remove (Tid aId, Tinstance aInstance) {
+      std::lock_guard<std::mutex> lock (mLock);
+      Slot* slot = lookup (aId);
+      if (!slot || slot->instance != aInstance)
+        return false;
+      return erase (slot);
     }
 
     bool findById (Tid aId, Tinstance* aInstance) {
       if (!aInstance)
         return false;
-      typename std::map<Tid, Tinstance>::iterator i = mInstances.find (aId);
-      if (i != mInstances.end ()) {
-        *aInstance = i->second;
-        return true;
-      }
-      return false;
+      std::lock_guard<std::mutex> lock (mLock);
+      Slot* slot = lookup (aId);
+      if (!slot)
+        return false;
+      *aInstance = slot->instance;
+      return true;
+    }
+
+    /** Find the instance for aId and take a reference to it.
+     * Fails if the instance is already being destroyed. The reference is
+     * taken under the registry lock, so the instance can not be deleted
+     * between the lookup and the retain: its destructor has to remove it
+     * from the registry first.
+     */
+    bool findAndRetain (Tid aId, Tinstance* aInstance) {
+      if (!aInstance)
+        return false;
+      std::lock_guard<std::mutex> lock (mLock);
+      Slot* slot = lookup (aId);
+      if (!slot || !slot->instance || !slot->instance->tryRetain ())
+        return false;
+      *aInstance = slot->instance;
+      return true;
     }
 
   private:
@@ -74,7 +129,78 @@ class InstanceRegistry {
     /// Assignment is not allowed.
     InstanceRegistry& operator= (InstanceRegistry const&);
 
-    std::map <Tid, Tinstance> mInstances;
+    enum SlotState { SLOT_EMPTY = 0, SLOT_USED, SLOT_DELETED };
+
+    struct Slot {
+      Tid id;
+      Tinstance instance;
+      int state;
+    };
+
+    size_t probeStart (Tid aId) const {
+      // CL handles are aligned pointers, mix the bits before masking
+      size_t h = std::hash<Tid> () (aId);
+      h ^= h >> 16;
+      h *= 0x45d9f3b;
+      h ^= h >> 16;
+      return h & (mCapacity - 1);
+    }
+
+    Slot* next (Slot* aSlot) const {
+      return (aSlot + 1 == mSlots + mCapacity) ? mSlots : aSlot + 1;
+    }
+
+    Slot* lookup (Tid aId) const {
+      if (!mCapacity)
+        return 0;
+      Slot* slot = &mSlots[probeStart (aId)];
+      while (slot->state != SLOT_EMPTY) {
+        if (slot->state == SLOT_USED && slot->id == aId)
+          return slot;
+        slot = next (slot);
+      }
+      return 0;
+    }
+
+    bool erase (Slot* aSlot) {
+      if (!aSlot)
+        return false;
+      aSlot->state = SLOT_DELETED;
+      --mUsed;
+      ++mDeleted;
+      return true;
+    }
+
+    /// Grow (or just drop tombstones) so the table stays at most half full.
+    bool rehash () {
+      size_t capacity = mCapacity ? mCapacity : 16;
+      while ((mUsed + 1) * 4 > capacity)
+        capacity *= 2;
+      Slot* slots = (Slot*)calloc (capacity, sizeof (Slot));
+      if (!slots)
+        return false;
+      Slot* old = mSlots;
+      size_t oldCapacity = mCapacity;
+      mSlots = slots;
+      mCapacity = capacity;
+      mDeleted = 0;
+      for (size_t i = 0; i < oldCapacity; ++i) {
+        if (old[i].state != SLOT_USED)
+          continue;
+        Slot* slot = &mSlots[probeStart (old[i].id)];
+        while (slot->state == SLOT_USED)
+          slot = next (slot);
+        *slot = old[i];
+      }
+      free (old);
+      return true;
+    }
+
+    Slot* mSlots;
+    size_t mCapacity;
+    size_t mUsed;
+    size_t mDeleted;
+    std::mutex mLock;
 };
 
 #endif // _INSTANCE_REGISTRY_H_
@@ -59,6 +59,11 @@ protected:
     virtual ~KernelWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainKernel (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseKernel (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_kernel, clReleaseKernel> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     KernelWrapper ();
@@ -66,7 +71,7 @@ private:
 
 public:
     static InstanceRegistry<cl_kernel, KernelWrapper*> instanceRegistry;
-    static KernelWrapper* getNewOrExisting (cl_kernel aHandle);
+    static KernelWrapper* getNewOrExisting (cl_kernel aHandle, bool* aCreatedOut = 0);
 
     static cl_int kernelInfoHelper (Wrapper const* aInstance, int aName,
                                     size_t aSize, void* aValueOut, size_t* aSizeOut);
@@ -70,6 +70,11 @@ protected:
     virtual ~MemoryObjectWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainMemObject (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseMemObject (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_mem, clReleaseMemObject> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     MemoryObjectWrapper ();
@@ -77,7 +82,7 @@ private:
 
 public:
     static InstanceRegistry<cl_mem, MemoryObjectWrapper*> instanceRegistry;
-    static MemoryObjectWrapper* getNewOrExisting (cl_mem aHandle);
+    static MemoryObjectWrapper* getNewOrExisting (cl_mem aHandle, bool* aCreatedOut = 0);
 
     static cl_int memoryObjectInfoHelper (Wrapper const* aInstance, int aName,
                                           size_t aSize, void* aValueOut, size_t* aSizeOut);
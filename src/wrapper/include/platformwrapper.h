@@ -35,6 +35,7 @@
 #define PLATFORMWRAPPER_H
 
 #include "clwrappercommon.h"
+#include "info_cache.h"
 
 #include <vector>
 
@@ -56,13 +57,16 @@ protected:
     virtual ~PlatformWrapper ();
     virtual cl_int retainWrapped () const { return CL_SUCCESS; } // No retain for cl_platform_id
     virtual cl_int releaseWrapped () const { return CL_SUCCESS; } // No release for cl_platform_id
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     PlatformWrapper ();
     cl_platform_id mWrapped;
+    // Platform properties are immutable, see platformInfoHelper.
+    mutable InfoCache mInfoCache;
 
 public:
-    static PlatformWrapper* getNewOrExisting (cl_platform_id aHandle);
+    static PlatformWrapper* getNewOrExisting (cl_platform_id aHandle, bool* aCreatedOut = 0);
     static cl_int getPlatforms (std::vector<PlatformWrapper*>& aPlatformsOut);
 
     static cl_int platformInfoHelper (Wrapper const* aInstance, int aName,
@@ -114,6 +114,11 @@ protected:
     virtual ~ProgramWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainProgram (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseProgram (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_program, clReleaseProgram> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
     /* This function retrieves and returns the value of CL_PROGRAM_BINARIES
      * info parameter. A separate function is necessary since CL_PROGRAM_BINARIES
@@ -131,7 +136,7 @@ private:
 
 public:
     static InstanceRegistry<cl_program, ProgramWrapper*> instanceRegistry;
-    static ProgramWrapper* getNewOrExisting (cl_program aHandle);
+    static ProgramWrapper* getNewOrExisting (cl_program aHandle, bool* aCreatedOut = 0);
 
     static cl_int programInfoHelper (Wrapper const* aInstance, int aName,
                                      size_t aSize, void* aValueOut, size_t* aSizeOut);
@@ -51,6 +51,11 @@ protected:
     virtual ~SamplerWrapper ();
     virtual inline cl_int retainWrapped () const { return clRetainSampler (mWrapped); }
     virtual inline cl_int releaseWrapped () const { return clReleaseSampler (mWrapped); }
+    virtual inline RawHandle rawHandle () const {
+        RawHandle raw = { (void*)mWrapped, &releaseRaw<cl_sampler, clReleaseSampler> };
+        return raw;
+    }
+    virtual inline void unregister () { instanceRegistry.remove (mWrapped, this); }
 
 private:
     SamplerWrapper ();
@@ -58,7 +63,7 @@ private:
 
 public:
     static InstanceRegistry<cl_sampler, SamplerWrapper*> instanceRegistry;
-    static SamplerWrapper* getNewOrExisting (cl_sampler aHandle);
+    static SamplerWrapper* getNewOrExisting (cl_sampler aHandle, bool* aCreatedOut = 0);
 
     static cl_int samplerInfoHelper (Wrapper const* aInstance, int aName,
                                      size_t aSize, void* aValueOut, size_t* aSizeOut);
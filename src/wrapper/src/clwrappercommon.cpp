@@ -69,29 +69,19 @@ using std::multimap;
 using std::make_pair;
 
 
-#define LOGGER_BUF_SIZE 1024
+namespace {
+    void traceV (char const* file, unsigned int line, char const* function,
+                 int level, void const* handle, char const* fmt, va_list ap);
+}
 
 void CLWrapperDetail::logger (char const* file, unsigned int line,
                               char const* function, int level, char const* msg, ...) {
-#ifdef CL_WRAPPER_ENABLE_LOG
-    char* s = (char*)malloc (sizeof(char) * LOGGER_BUF_SIZE);
-    if (s) {
-        if (cl_wrapper_log_check_level(level)) {
-            va_list ap;
-            va_start (ap, msg);
-            vsnprintf (s, LOGGER_BUF_SIZE, msg, ap);
-            va_end (ap);
-            D_PRINT_RAW(" ##LOG## [%s:%d %s] %s", file, line, function, s);
-        }
-        free (s);
+    if (cl_wrapper_log_check_level (level)) {
+        va_list ap;
+        va_start (ap, msg);
+        traceV (file, line, function, level, 0, msg, ap);
+        va_end (ap);
     }
-#else // CL_WRAPPER_ENABLE_LOG
-    (void)file;
-    (void)line;
-    (void)function;
-    (void)level;
-    (void)msg;
-#endif // CL_WRAPPER_ENABLE_LOG
 }
 
 
@@ -392,6 +382,7 @@ IMPL_GET_INFO_WITH_EXTRA_FOR_CLASS_VECTOR (SamplerWrapper, cl_sampler);
 
 Wrapper::Wrapper ()
     : store (),
+      binding (0),
       mRefCnt (1),
       mWeakRefs ()
 {
@@ -403,7 +394,7 @@ Wrapper::~Wrapper () {
         releaseWrapped ();
 
     multimap<WrapperWeakRefCb,void*>::iterator i = mWeakRefs.begin ();
-    while (i != mWeakRefs.end ()) {
+    for (; i != mWeakRefs.end (); ++i) {
       if (i->first) {
         (i->first)(this, i->second);
       } else {
@@ -413,28 +404,48 @@ Wrapper::~Wrapper () {
 }
 
 
+// The reference count is atomic so wrappers can be retained and released
+// from driver callbacks and other threads.
 cl_int Wrapper::retain () {
-    if (mRefCnt > 0) {
-        ++mRefCnt;
-        return retainWrapped();
-    } else {
-        D_LOG (LOG_LEVEL_ERROR, "Invalid addRef on %p when refcount is 0.", this);
-        return CL_INVALID_VALUE;
-    }
+    size_t cnt = mRefCnt.load ();
+    do {
+        if (cnt == 0) {
+            D_LOG (LOG_LEVEL_ERROR, "Invalid addRef on %p when refcount is 0.", this);
+            return CL_INVALID_VALUE;
+        }
+    } while (!mRefCnt.compare_exchange_weak (cnt, cnt + 1));
+    return retainWrapped();
+}
+
+
+bool Wrapper::tryRetain () {
+    size_t cnt = mRefCnt.load ();
+    do {
+        if (cnt == 0)
+            return false;
+    } while (!mRefCnt.compare_exchange_weak (cnt, cnt + 1));
+    retainWrapped ();
+    return true;
 }
 
 
 cl_int Wrapper::release () {
-    if (mRefCnt <= 0) {
+    if (mRefCnt.load () == 0) {
         D_LOG (LOG_LEVEL_ERROR, "Invalid release on %p when refcount already 0.", this);
         return CL_INVALID_VALUE;
-    } else {
-        cl_int err = releaseWrapped();
-        if (--mRefCnt == 0) {
-            delete this;
-        }
-        return err;
     }
+    // Once the count is down another thread may drop the last reference
+    // and delete this, so only the saved handle is used after it.
+    RawHandle raw = rawHandle ();
+    if (mRefCnt.fetch_sub (1) != 1)
+        return raw.release ? raw.release (raw.handle) : CL_SUCCESS;
+
+    // Last reference: tryRetain fails on a count of 0, and once out of
+    // the registry no lookup can find this, so the instance is ours.
+    unregister ();
+    cl_int err = raw.release ? raw.release (raw.handle) : CL_SUCCESS;
+    delete this;
+    return err;
 }
 
 
@@ -495,6 +506,16 @@ cl_int Wrapper::retainWrapped () const {
 }
 
 
+Wrapper::RawHandle Wrapper::rawHandle () const {
+    RawHandle raw = { 0, 0 };
+    return raw;
+}
+
+
+void Wrapper::unregister () {
+}
+
+
 cl_int Wrapper::releaseWrapped () const {
     D_LOG (LOG_LEVEL_WARNING,
            "Unexpected call to Wrapper::releaseWrapped: derived class doesn't implement release!");
@@ -507,76 +528,284 @@ cl_int Wrapper::releaseWrapped () const {
 //============================================================================
 // from clwrappercommon_internal.h:
 
-FILE* cl_wrapper_log_file = stderr;
-int cl_wrapper_log_level = CL_WRAPPER_LOG_LEVEL_DEFAULT;
 
-#ifdef CL_WRAPPER_LOG_TO_FILE
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <functional>
 #include <ctime>
-# ifndef WIN32
-# include <cstring>
-# include <cerrno>
-# endif
+#include <cstring>
+#include <cerrno>
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/syscall.h>
 #endif
 
+#if defined(CL_WRAPPER_TRACK_FUNCTIONS)
+# define CL_WRAPPER_INITIAL_LOG_LEVEL LOG_LEVEL_TRACE
+#elif defined(CL_WRAPPER_ENABLE_LOG)
+# define CL_WRAPPER_INITIAL_LOG_LEVEL CL_WRAPPER_LOG_LEVEL_DEFAULT
+#else
+# define CL_WRAPPER_INITIAL_LOG_LEVEL LOG_LEVEL_NONE
+#endif
+
+// Number of records in the trace ring, must be a power of two.
+#ifndef CL_WRAPPER_TRACE_RING_SIZE
+# define CL_WRAPPER_TRACE_RING_SIZE 4096
+#endif
+
+// Longer messages are truncated.
+#define CL_WRAPPER_TRACE_MSG_SIZE 160
+
+// How often the background thread writes out the ring.
+#define CL_WRAPPER_TRACE_FLUSH_MS 100
+
+FILE* cl_wrapper_log_file = stderr;
+std::atomic<int> cl_wrapper_log_level (CL_WRAPPER_INITIAL_LOG_LEVEL);
+
+
+namespace {
+
+/* A trace record. The seq field follows Dmitry Vyukov's bounded MPMC
+ * queue: the slot for position pos is free for a writer while
+ * seq == pos, and holds a complete record once seq == pos + 1.
+ */
+struct TraceRecord {
+    std::atomic<size_t> seq;
+    unsigned long long time;  // ns since the ring was created
+    unsigned long thread;
+    int level;
+    char const* file;
+    unsigned int line;
+    char const* function;
+    void const* handle;
+    char msg[CL_WRAPPER_TRACE_MSG_SIZE];
+};
+
+/* Writers claim slots with a CAS on head and never block; when the ring
+ * is full the record is dropped and counted. Reading is serialized by
+ * drainLock, which only the flush thread and cl_wrapper_flush_log take.
+ */
+struct TraceRing {
+    TraceRing ();
+
+    TraceRecord* claim (size_t* aPosOut);
+    void drain ();
+
+    TraceRecord slots[CL_WRAPPER_TRACE_RING_SIZE];
+    std::atomic<size_t> head;
+    std::atomic<unsigned long> dropped;
+    size_t tail;
+    std::mutex drainLock;
+    std::chrono::steady_clock::time_point start;
+};
+
+TraceRing::TraceRing ()
+    : head (0),
+      dropped (0),
+      tail (0),
+      start (std::chrono::steady_clock::now ())
+{
+    for (size_t i = 0; i < CL_WRAPPER_TRACE_RING_SIZE; ++i)
+        slots[i].seq.store (i, std::memory_order_relaxed);
+}
+
+TraceRecord* TraceRing::claim (size_t* aPosOut) {
+    size_t pos = head.load (std::memory_order_relaxed);
+    for (;;) {
+        TraceRecord* rec = &slots[pos & (CL_WRAPPER_TRACE_RING_SIZE - 1)];
+        size_t seq = rec->seq.load (std::memory_order_acquire);
+        ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+        if (dif == 0) {
+            if (head.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed)) {
+                *aPosOut = pos;
+                return rec;
+            }
+        } else if (dif < 0) {
+            // Still holds a record from the previous lap.
+            dropped.fetch_add (1, std::memory_order_relaxed);
+            return 0;
+        } else {
+            pos = head.load (std::memory_order_relaxed);
+        }
+    }
+}
+
+void TraceRing::drain () {
+    static char const levelChars[] = "-EWIDT";
+    std::lock_guard<std::mutex> lock (drainLock);
+    bool wrote = false;
+    for (;;) {
+        TraceRecord* rec = &slots[tail & (CL_WRAPPER_TRACE_RING_SIZE - 1)];
+        if (rec->seq.load (std::memory_order_acquire) != tail + 1)
+            break;
+        if (!rec->file) {
+            fprintf (cl_wrapper_log_file, "%s\n", rec->msg);
+        } else {
+            fprintf (cl_wrapper_log_file, " ##LOG## %llu.%06llu %c [tid %lu] [%s:%-4u %s] ",
+                     rec->time / 1000000000ULL, (rec->time / 1000ULL) % 1000000ULL,
+                     levelChars[rec->level < 0 || rec->level > LOG_LEVEL_TRACE ? 0 : rec->level],
+                     rec->thread, rec->file, rec->line, rec->function);
+            if (rec->handle)
+                fprintf (cl_wrapper_log_file, "(%p) ", rec->handle);
+            fprintf (cl_wrapper_log_file, "%s\n", rec->msg);
+        }
+        rec->seq.store (tail + CL_WRAPPER_TRACE_RING_SIZE, std::memory_order_release);
+        ++tail;
+        wrote = true;
+    }
+    if (wrote)
+        fflush (cl_wrapper_log_file);
+}
+
+void flushLoop (TraceRing* aRing) {
+    for (;;) {
+        std::this_thread::sleep_for (std::chrono::milliseconds (CL_WRAPPER_TRACE_FLUSH_MS));
+        aRing->drain ();
+    }
+}
+
+void flushAtExit () {
+    cl_wrapper_flush_log ();
+}
+
+// Created on first use along with its flush thread. Never freed, so that
+// records can still be taken and drained while the process exits.
+TraceRing* gTraceRing = 0;
+std::once_flag gTraceRingOnce;
+
+void createTraceRing () {
+    gTraceRing = new TraceRing ();
+    std::thread (flushLoop, gTraceRing).detach ();
+    atexit (flushAtExit);
+}
+
+TraceRing* traceRing () {
+    std::call_once (gTraceRingOnce, createTraceRing);
+    return gTraceRing;
+}
+
+unsigned long traceThreadId () {
+#ifdef __linux__
+    static __thread unsigned long tid = 0;
+    if (!tid)
+        tid = (unsigned long)syscall (SYS_gettid);
+    return tid;
+#else
+    return (unsigned long)std::hash<std::thread::id> () (std::this_thread::get_id ());
+#endif
+}
+
+void traceV (char const* file, unsigned int line, char const* function,
+             int level, void const* handle, char const* fmt, va_list ap) {
+    TraceRing* ring = traceRing ();
+    size_t pos;
+    TraceRecord* rec = ring->claim (&pos);
+    if (!rec)
+        return;
+    rec->time = std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now () - ring->start).count ();
+    rec->thread = traceThreadId ();
+    rec->level = level;
+    rec->file = file;
+    rec->line = line;
+    rec->function = function;
+    rec->handle = handle;
+    vsnprintf (rec->msg, CL_WRAPPER_TRACE_MSG_SIZE, fmt, ap);
+    rec->seq.store (pos + 1, std::memory_order_release);
+}
+
+// Reads D_LOG_LEVEL and D_LOG_FILE before the first tracepoint is hit.
+struct TraceInit {
+    TraceInit () { cl_wrapper_init_logging (); }
+} traceInit;
+
+} // namespace
+
+
+void cl_wrapper_trace (char const* file, unsigned int line, char const* function,
+                       int level, void const* handle, char const* fmt, ...) {
+    va_list ap;
+    va_start (ap, fmt);
+    traceV (file, line, function, level, handle, fmt, ap);
+    va_end (ap);
+}
+
 
 #ifdef WIN32
 #include "windows.h"
+#endif
+
 void cl_wrapper_init_logging () {
   static bool initialized = false;
-  if (!initialized) {
-    initialized = true;
- #ifdef CL_WRAPPER_LOG_TO_FILE
-    if ((cl_wrapper_log_file = fopen (CL_WRAPPER_LOG_TO_FILE, "a")) == NULL) {
-      cl_wrapper_log_file = stderr;
-      D_PRINT ("Failed to open log file \"%s\".", CL_WRAPPER_LOG_TO_FILE);
+  if (initialized)
+    return;
+  initialized = true;
+
+  char* s = std::getenv ("D_LOG_LEVEL");
+  if (s)
+    cl_wrapper_set_log_level (std::atoi (s));
+
+  char const* path = std::getenv ("D_LOG_FILE");
+#ifdef CL_WRAPPER_LOG_TO_FILE
+  if (!path)
+    path = CL_WRAPPER_LOG_TO_FILE;
+#endif
+  if (path && *path) {
+    if (!cl_wrapper_set_log_file (path)) {
+      D_PRINT ("Failed to open log file \"%s\": %s", path, strerror (errno));
     } else {
-      time_t t = time(NULL);
-      struct tm *tmp = localtime(&t);
+      time_t t = time (NULL);
+      struct tm *tmp = localtime (&t);
       char timeStr[30] = {0};
-      strftime (timeStr, 30, "%Y-%m-%d %M:%H:%S %Z", tmp);
+      strftime (timeStr, 30, "%Y-%m-%d %H:%M:%S %Z", tmp);
       D_PRINT_RAW (" =============================================================================\n"
                    "  CL Wrapper log file opened %s.\n"
-                   " =============================================================================\n",
+                   " =============================================================================",
                    timeStr);
     }
- #else //CL_WRAPPER_LOG_TO_FILE
+  }
+#if defined(WIN32) && !defined(CL_WRAPPER_LOG_TO_FILE)
+  else if (cl_wrapper_log_check_level (LOG_LEVEL_ERROR)) {
     AllocConsole();
     freopen("conin$", "r", stdin);
     freopen("conout$", "w", stdout);
     freopen("conout$", "w", stderr);
- #endif //CL_WRAPPER_LOG_TO_FILE
   }
+#endif
 }
-#else //WIN32
-void cl_wrapper_init_logging () {
-  static bool initialized = false;
-  if (!initialized) {
-    char* s = std::getenv("D_LOG_LEVEL");
-    if (s) {
-      cl_wrapper_log_level = std::atoi(s);
-    }
-    initialized = true;
- #ifdef CL_WRAPPER_LOG_TO_FILE
-    if ((cl_wrapper_log_file = std::fopen (CL_WRAPPER_LOG_TO_FILE, "a")) == NULL) {
-      cl_wrapper_log_file = stderr;
-      D_PRINT ("Failed to open log file \"%s\": %s", CL_WRAPPER_LOG_TO_FILE, strerror(errno));
-    } else {
-      time_t t = time(NULL);
-      struct tm *tmp = localtime(&t);
-      char timeStr[30] = {0};
-      strftime (timeStr, 30, "%Y-%m-%d %M:%H:%S %Z", tmp);
-      D_PRINT_RAW (" =============================================================================\n"
-                   "  CL Wrapper log file opened %s.\n"
-                   " =============================================================================\n",
-                   timeStr);
-    }
- #endif //CL_WRAPPER_LOG_TO_FILE
-  }
+
+
+void cl_wrapper_set_log_level (int level) {
+    cl_wrapper_log_level.store (level, std::memory_order_relaxed);
 }
-#endif //WIN32
 
+int cl_wrapper_get_log_level () {
+    return cl_wrapper_log_level.load (std::memory_order_relaxed);
+}
 
-bool cl_wrapper_log_check_level (int level) {
-  return level <= cl_wrapper_log_level;
+bool cl_wrapper_set_log_file (char const* aPath) {
+    FILE* f = stderr;
+    if (aPath && *aPath) {
+        f = std::fopen (aPath, "a");
+        if (!f)
+            return false;
+    }
+    TraceRing* ring = traceRing ();
+    ring->drain ();
+    std::lock_guard<std::mutex> lock (ring->drainLock);
+    if (cl_wrapper_log_file != stderr)
+        std::fclose (cl_wrapper_log_file);
+    cl_wrapper_log_file = f;
+    return true;
 }
 
+void cl_wrapper_flush_log () {
+    traceRing ()->drain ();
+}
+
+unsigned long cl_wrapper_log_dropped () {
+    return traceRing ()->dropped.load (std::memory_order_relaxed);
+}
@@ -42,81 +42,91 @@
 #define LOG_LEVEL_WARNING   2
 #define LOG_LEVEL_INFO      3
 #define LOG_LEVEL_DEBUG     4
+#define LOG_LEVEL_TRACE     5
 
 #ifndef CL_WRAPPER_LOG_LEVEL_DEFAULT
 # define CL_WRAPPER_LOG_LEVEL_DEFAULT 2
 #endif
 
-#ifdef CL_WRAPPER_ENABLE_LOG
 #include <cstdlib>
 #include <cstdio>
-
-extern std::FILE* cl_wrapper_log_file;  // default: stderr or CL_WRAPPER_LOG_TO_FILE
-extern int cl_wrapper_log_level;   // default: CL_WRAPPER_LOG_LEVEL_DEFAULT
+#include <atomic>
+
+/* Tracepoints are always compiled in. Whether a record is taken is decided
+ * at run time against cl_wrapper_log_level, which starts out as
+ * LOG_LEVEL_NONE (or CL_WRAPPER_LOG_LEVEL_DEFAULT when built with
+ * CL_WRAPPER_ENABLE_LOG), can be set with the D_LOG_LEVEL environment
+ * variable and changed with cl_wrapper_set_log_level. A disabled
+ * tracepoint costs one relaxed load and a compare.
+ *
+ * Records go to an in-memory ring and are written out to
+ * cl_wrapper_log_file by a background thread, see clwrappercommon.cpp.
+ */
+extern std::FILE* cl_wrapper_log_file;  // default: stderr, D_LOG_FILE or CL_WRAPPER_LOG_TO_FILE
+extern std::atomic<int> cl_wrapper_log_level;
 void cl_wrapper_init_logging ();
-bool cl_wrapper_log_check_level (int level);
+void cl_wrapper_trace (char const* file, unsigned int line, char const* function,
+                       int level, void const* handle, char const* fmt, ...);
+
+inline bool cl_wrapper_log_check_level (int level) {
+    return level <= cl_wrapper_log_level.load (std::memory_order_relaxed);
+}
 
 
 /**
  * \fn D_PRINT_RAW(...)
- * A variadic macro for printing arbitrary text to log output. In operation
- * only if logging is enabled.
+ * A variadic macro for printing arbitrary text to log output. The text is
+ * recorded regardless of the current logging level.
  */
-# define D_PRINT_RAW(...) do{cl_wrapper_init_logging(); fprintf(cl_wrapper_log_file, __VA_ARGS__);\
-     fprintf(cl_wrapper_log_file, "\n"); fflush(cl_wrapper_log_file);}while(0)
+# define D_PRINT_RAW(...) cl_wrapper_trace (0, 0, 0, LOG_LEVEL_NONE, 0, __VA_ARGS__)
 
 /** \fn D_PRINT(fmt, ...)
  * A variadic macro for printing arbitrary text with source line information
- * to log output. In operation only if logging is enabled.
+ * to log output, regardless of the current logging level.
+ * \param fmt Format argument similar to printf.
+ * \see printf
+ */
+# define D_PRINT(...) cl_wrapper_trace (__FILE__, __LINE__, __FUNCTION__, \
+                                        LOG_LEVEL_NONE, 0, __VA_ARGS__)
+
+/** \fn D_TRACE(lev, handle, fmt, ...)
+ * A variadic macro for recording a trace message about an OpenCL object.
+ * The record carries a timestamp, the calling thread's id and \c handle.
+ * Nothing is evaluated beyond the level check unless \c lev is lower than
+ * or equal to the current logging level.
+ * \param lev Logging level assigned to the following message.
+ * \param handle OpenCL handle the message is about, or 0.
  * \param fmt Format argument similar to printf.
+ * \see cl_wrapper_log_level
  * \see printf
  */
-# define D_PRINT(fmt, ...) D_PRINT_RAW (" # # # [%s:%-4d] " fmt "\n  ", \
-                                        __FILE__,__LINE__,##__VA_ARGS__)
+# define D_TRACE(lev, handle, ...) \
+     do{ if(cl_wrapper_log_check_level(lev)){ cl_wrapper_trace (__FILE__, __LINE__, \
+         __FUNCTION__, lev, (void const*)(handle), __VA_ARGS__);} }while(0)
 
 /** \fn D_LOG(lev, fmt, ...)
- * A variadic macro for printing log messages to log output webcl_log_file.
- * The message is sent to output if the value of \c lev is lower than
- * the current logging level.
- * In operation only if logging is enabled.
+ * A variadic macro for printing log messages to log output
+ * cl_wrapper_log_file. The message is recorded if the value of \c lev is
+ * lower than or equal to the current logging level.
  * \param lev Logging level assigned to the following message.
  * \param fmt Format argument similar to printf.
- * \see webcl_log_file
- * \see webcl_log_level
+ * \see cl_wrapper_log_file
+ * \see cl_wrapper_log_level
  * \see printf
  */
-#  define D_LOG(lev, fmt, ...)\
-     do{ if(cl_wrapper_log_check_level(lev)){ D_PRINT_RAW(" ##LOG## [%s:%-4d %s] " fmt,\
-         __FILE__,__LINE__,__FUNCTION__,##__VA_ARGS__);} }while(0)
-
-#else // CL_WRAPPER_ENABLE_LOG
-# ifdef WIN32
-// MSVC
-#  define D_PRINT_RAW(...) do{}while(0)
-#  define D_PRINT(...) do{}while(0)
-#  define D_LOG(...) do{}while(0)
-# else
-#  define D_PRINT_RAW(args...) do{}while(0)
-#  define D_PRINT(args...) do{}while(0)
-#  define D_LOG(args...) do{}while(0)
-# endif
-#endif // CL_WRAPPER_ENABLE_LOG
-
-
-// Function tracking (D_METHOD_START)
-#ifdef CL_WRAPPER_TRACK_FUNCTIONS
-# define D_METHOD_START D_PRINT_RAW(" ##LOG## [%s:%-4d] ============ Entering function %s ============\n", \
-                                    __FILE__, __LINE__,__FUNCTION__)
-#else //CL_WRAPPER_TRACK_FUNCTIONS
-# define D_METHOD_START do{}while(0)
-#endif //CL_WRAPPER_TRACK_FUNCTIONS
+# define D_LOG(lev, ...) D_TRACE (lev, 0, __VA_ARGS__)
+
+
+// Function tracking (D_METHOD_START), recorded at LOG_LEVEL_TRACE.
+// Building with CL_WRAPPER_TRACK_FUNCTIONS makes that the default level.
+#define D_METHOD_START D_TRACE (LOG_LEVEL_TRACE, 0, "Entering function")
 
 
 // Memory allocation tracking
 #ifdef CL_WRAPPER_TRACK_ALLOCS
-# define D_TRACK_ALLOC(bytes,type,p) D_PRINT_RAW(" ##LOG## [%s:%-4d %s]  ALLOC  %ld bytes in (" #type "*)%p\n", \
+# define D_TRACK_ALLOC(bytes,type,p) D_PRINT_RAW(" ##LOG## [%s:%-4d %s]  ALLOC  %ld bytes in (" #type "*)%p", \
                                     __FILE__, __LINE__,__FUNCTION__, bytes, type, p)
-# define D_TRACK_RELEASE(type,p) D_PRINT_RAW(" ##LOG## [%s:%-4d %s]  RELEASE  (" #type "*)%p\n", \
+# define D_TRACK_RELEASE(type,p) D_PRINT_RAW(" ##LOG## [%s:%-4d %s]  RELEASE  (" #type "*)%p", \
                                     __FILE__, __LINE__,__FUNCTION__, type, p)
 #else //CL_WRAPPER_TRACK_ALLOCS
 # define D_TRACK_ALLOC do{}while(0)
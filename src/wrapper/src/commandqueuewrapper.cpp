@@ -57,7 +57,7 @@ CommandQueueWrapper::CommandQueueWrapper (cl_command_queue aHandle)
 
 
 CommandQueueWrapper::~CommandQueueWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -166,9 +166,11 @@ cl_int CommandQueueWrapper::enqueueNDRangeKernel (KernelWrapper* aKernel,
     if (localSize) free (localSize);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueNDRangeKernel failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueNDRangeKernel failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueNDRangeKernel kernel %p dim %u event %p",
+             aKernel->getWrapped (), aWorkDim, event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
@@ -196,9 +198,10 @@ cl_int CommandQueueWrapper::enqueueTask (KernelWrapper* aKernel,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueTask failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueTask failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueTask kernel %p event %p", aKernel->getWrapped (), event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
@@ -206,127 +209,79 @@ cl_int CommandQueueWrapper::enqueueTask (KernelWrapper* aKernel,
 }
 
 
-#if 0
-// WARNING: This function is implemented for completeness' sake and has not
-//          been tested properly. For that reason it is disabled for now.
-cl_int CommandQueueWrapper::enqueueNativeKernel (void (*aUserFunc)(void *),
+cl_int CommandQueueWrapper::enqueueNativeKernel (void (CL_CALLBACK *aUserFunc)(void *),
                                                  void const* aArgs,
                                                  size_t aSizeOfArgs,
-                                                 std::vector<MemoryObjectWrapper*>& aMemObjects,
-                                                 std::vector<void const*> aArgsMemLoc,
+                                                 std::vector<MemoryObjectWrapper*> const& aMemObjects,
+                                                 std::vector<size_t> const& aMemOffsets,
                                                  std::vector<EventWrapper*> const& aWaitList,
                                                  EventWrapper** aResultOut) {
     D_METHOD_START;
     cl_int err = CL_SUCCESS;
     VALIDATE_ARG_POINTER (aResultOut, &err, err);
+    VALIDATE_ARG_POINTER (aUserFunc, &err, err);
 
-    cl_event* clEvWaitList = 0;
-    cl_uint clEvWaitListLen = 0;
-    if (!unwrapEventList (aWaitList, &clEvWaitList, &clEvWaitListLen))
-        return CL_INVALID_EVENT;  /* NOTE: synthetic error code! */
-
-    cl_uint memObjListLen = aMemObjects.size ();
-    cl_mem* memObjList = (cl_mem*)malloc (sizeof(cl_mem) * memObjListLen);
-    if (memObjList) {
-        vector<MemoryObjectWrapper*>::iterator i = aMemObjects.begin ();
-        size_t cnt = 0;
-        while (i != aMemObjects.end ()) {
-            memObjList[cnt++] = (*i)->getWrapped ();
-            ++i;
-        }
-    } else {
-        if (clEvWaitList) free (clEvWaitList);
-        D_LOG (LOG_LEVEL_ERROR, "Memory allocation failed.");
-        return CL_OUT_OF_HOST_MEMORY;
-    }
-
-    if (aArgsMemLoc.size () != aMemObjects.size ()) {
-        if (clEvWaitList) free (clEvWaitList);
-        if (memObjList) free (memObjList);
+    if (aMemOffsets.size () != aMemObjects.size ()) {
         D_LOG (LOG_LEVEL_ERROR,
-               "The length of aArgsMemLoc (%u) does not match the length of aMemObjects (%u).",
-               aArgsMemLoc.size (), aMemObjects.size ());
+               "The length of aMemOffsets (%u) does not match the length of aMemObjects (%u).",
+               (unsigned)aMemOffsets.size (), (unsigned)aMemObjects.size ());
         return CL_INVALID_VALUE; // NOTE: synthetic err code.
     }
-    void const** argsMemLocList = (void const**)malloc (sizeof(void const*) * memObjListLen);
-    if (!argsMemLocList) {
-        if (clEvWaitList) free (clEvWaitList);
-        if (memObjList) free (memObjList);
-        D_LOG (LOG_LEVEL_ERROR, "Memory allocation failed.");
-        return CL_OUT_OF_HOST_MEMORY;
-    } else {
-        vector<void const*>::iterator i = aArgsMemLoc.begin ();
-        size_t cnt = 0;
-        while (i != aArgsMemLoc.end ()) {
-            argsMemLocList[cnt++] = *i;
-            ++i;
+    if (aSizeOfArgs > 0 && !aArgs)
+        return CL_INVALID_VALUE;
+
+    // The driver copies the argument block too, but the memory object
+    // slots are filled in here, so work on our own copy. args_mem_loc
+    // must point into the block that is passed, i.e. the copy.
+    std::vector<char> args ((char const*)aArgs, (char const*)aArgs + aSizeOfArgs);
+    std::vector<cl_mem> memObjList (aMemObjects.size ());
+    std::vector<void const*> argsMemLocList (aMemObjects.size ());
+    for (size_t i = 0; i < aMemObjects.size (); ++i) {
+        size_t offset = aMemOffsets[i];
+        if (!aMemObjects[i] || offset % sizeof(cl_mem) != 0
+            || aSizeOfArgs < sizeof(cl_mem) || offset > aSizeOfArgs - sizeof(cl_mem)) {
+            D_TRACE (LOG_LEVEL_ERROR, mWrapped,
+                     "Invalid memory object %p at argument offset %lu (block of %lu bytes).",
+                     aMemObjects[i], (unsigned long)offset, (unsigned long)aSizeOfArgs);
+            return CL_INVALID_VALUE;
         }
-    }
-
-    // We take a copy of the args buffer because it might be necessary to
-    // modify it to replace any MemoryObjectWrapper pointers with cl_mem pointers.
-    void* args = (void*)malloc (aSizeOfArgs);
-    if (!args) {
-        if (clEvWaitList) free (clEvWaitList);
-        if (memObjList) free (memObjList);
-        D_LOG (LOG_LEVEL_ERROR, "Memory allocation failed.");
-        return CL_OUT_OF_HOST_MEMORY;
-    }
-    memcpy (args, aArgs, aSizeOfArgs);
-
-    // memObjListLen equals to the length of argsMemLocList
-    // TODO: We should probably assume that any mem objects on aArgs are
-    // actually pointers to MemoryObjectWrappers and they should be translated
-    // to cl_mems here. This can be done based on aArgsMemLoc.
-    for (cl_uint i = 0; i < memObjListLen; ++i) {
-
-        // Validate the pointer: it must be within aArgs..aArgs+aSizeOfArgs.
-        if (((char*)(argsMemLocList[i]) > (char*)aArgs)
-            && ((char*)argsMemLocList[i] < ((char*)aArgs + aSizeOfArgs))) {
-            MemoryObjectWrapper const* wrapper = *(MemoryObjectWrapper const**)(argsMemLocList[i]);
-            // Translate the address to our copy of aArgs
-            size_t offset = (char*)(argsMemLocList[i]) - (char*)aArgs;
-            void* target = (char*)args + offset;
-
-            *((cl_mem*)target) = wrapper->getWrapped ();
-        } else {
-            D_LOG (LOG_LEVEL_WARNING,
-                   "Ignoring invalid argsMemLoc pointer %p at index %u: not within aArgs memory block.",
-                   argsMemLocList[i], i + 1);
-            // NOTE: Error message index starts from 1.
+        for (size_t j = 0; j < i; ++j) {
+            if (aMemOffsets[j] == offset) {
+                D_TRACE (LOG_LEVEL_ERROR, mWrapped,
+                         "Two memory objects at argument offset %lu.", (unsigned long)offset);
+                return CL_INVALID_VALUE;
+            }
         }
+        memObjList[i] = aMemObjects[i]->getWrapped ();
+        memcpy (&args[offset], &memObjList[i], sizeof(cl_mem));
+        argsMemLocList[i] = &args[offset];
     }
 
+    cl_event* clEvWaitList = 0;
+    cl_uint clEvWaitListLen = 0;
+    if (!unwrapEventList (aWaitList, &clEvWaitList, &clEvWaitListLen))
+        return CL_INVALID_EVENT;  /* NOTE: synthetic error code! */
+
     cl_event event;
-    err = clEnqueueNativeKernel (mWrapped, aUserFunc, args, aSizeOfArgs,
-                                 memObjListLen, memObjList, argsMemLocList,
+    err = clEnqueueNativeKernel (mWrapped, aUserFunc,
+                                 args.empty () ? 0 : &args[0], args.size (),
+                                 memObjList.size (),
+                                 memObjList.empty () ? 0 : &memObjList[0],
+                                 argsMemLocList.empty () ? 0 : &argsMemLocList[0],
                                  clEvWaitListLen, clEvWaitList, &event);
     if (clEvWaitList) free (clEvWaitList);
-    if (memObjList) free (memObjList);
-    if (argsMemLocList) free (argsMemLocList);
-    if (args) free (args);
 
     if (CL_FAILED (err)) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueNativeKernel failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueNativeKernel failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueNativeKernel function %p event %p",
+             (void*)aUserFunc, event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
     return err;
 }
-#else
-cl_int CommandQueueWrapper::enqueueNativeKernel (void (*)(void *),
-                                                 void const*,
-                                                 size_t,
-                                                 std::vector<MemoryObjectWrapper*>&,
-                                                 std::vector<void const*>,
-                                                 std::vector<EventWrapper*> const&,
-                                                 EventWrapper**) {
-  D_LOG (LOG_LEVEL_ERROR, "NOT IMPLEMENTED!");
-  return CL_INVALID_COMMAND_QUEUE;
-}
-#endif
 
 
 
@@ -355,9 +310,11 @@ cl_int CommandQueueWrapper::enqueueWriteBuffer (MemoryObjectWrapper* aBuffer,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueWriteBuffer failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueWriteBuffer failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueWriteBuffer mem %p offset %lu size %lu event %p",
+             aBuffer->getWrapped (), (unsigned long)aOffset, (unsigned long)aSize, event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
@@ -390,9 +347,11 @@ cl_int CommandQueueWrapper::enqueueReadBuffer (MemoryObjectWrapper* aBuffer,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueReadBuffer failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueReadBuffer failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueReadBuffer mem %p offset %lu size %lu event %p",
+             aBuffer->getWrapped (), (unsigned long)aOffset, (unsigned long)aSize, event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
@@ -426,9 +385,11 @@ cl_int CommandQueueWrapper::enqueueCopyBuffer (MemoryObjectWrapper* aSrcBuffer,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueCopyBuffer failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueCopyBuffer failed. (error %d)", err);
         return err;
     }
+    D_TRACE (LOG_LEVEL_DEBUG, mWrapped, "clEnqueueCopyBuffer mem %p -> %p size %lu event %p",
+             aSrcBuffer->getWrapped (), aDstBuffer->getWrapped (), (unsigned long)aSize, event);
 
     *aResultOut = EventWrapper::getNewOrExisting (event);
     if (!*aResultOut) return CL_OUT_OF_HOST_MEMORY;
@@ -470,7 +431,7 @@ cl_int CommandQueueWrapper::enqueueWriteBufferRect (MemoryObjectWrapper* aBuffer
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueWriteBufferRect failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueWriteBufferRect failed. (error %d)", err);
         return err;
     }
 
@@ -521,7 +482,7 @@ cl_int CommandQueueWrapper::enqueueReadBufferRect (MemoryObjectWrapper* aBuffer,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueReadBufferRect failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueReadBufferRect failed. (error %d)", err);
         return err;
     }
 
@@ -572,7 +533,7 @@ cl_int CommandQueueWrapper::enqueueCopyBufferRect (MemoryObjectWrapper* aSrcBuff
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueCopyBufferRect failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueCopyBufferRect failed. (error %d)", err);
         return err;
     }
 
@@ -617,7 +578,7 @@ cl_int CommandQueueWrapper::enqueueWriteImage (MemoryObjectWrapper* aImage,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueWriteImage failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueWriteImage failed. (error %d)", err);
         return err;
     }
 
@@ -654,7 +615,7 @@ cl_int CommandQueueWrapper::enqueueReadImage (MemoryObjectWrapper* aImage,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueReadImage failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueReadImage failed. (error %d)", err);
         return err;
     }
 
@@ -690,7 +651,7 @@ cl_int CommandQueueWrapper::enqueueCopyImage (MemoryObjectWrapper* aSrcImage,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueCopyImage failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueCopyImage failed. (error %d)", err);
         return err;
     }
 
@@ -726,7 +687,7 @@ cl_int CommandQueueWrapper::enqueueCopyImageToBuffer (MemoryObjectWrapper* aSrcI
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueCopyImageToBuffer failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueCopyImageToBuffer failed. (error %d)", err);
         return err;
     }
 
@@ -762,7 +723,7 @@ cl_int CommandQueueWrapper::enqueueCopyBufferToImage (MemoryObjectWrapper* aSrcB
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueCopyBufferToImage failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueCopyBufferToImage failed. (error %d)", err);
         return err;
     }
 
@@ -799,7 +760,7 @@ cl_int CommandQueueWrapper::enqueueMapBuffer (MemoryObjectWrapper* aBuffer,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueMapBuffer failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueMapBuffer failed. (error %d)", err);
         return err;
     }
 
@@ -841,7 +802,7 @@ cl_int CommandQueueWrapper::enqueueMapImage (MemoryObjectWrapper* aImage,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueMapImage failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueMapImage failed. (error %d)", err);
         return err;
     }
 
@@ -871,7 +832,7 @@ cl_int CommandQueueWrapper::enqueueUnmapMemObject (MemoryObjectWrapper* aMemObj,
     if (clEvWaitList) free (clEvWaitList);
 
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueUnmapMemObject failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueUnmapMemObject failed. (error %d)", err);
         return err;
     }
 
@@ -889,7 +850,7 @@ cl_int CommandQueueWrapper::enqueueMarker (EventWrapper** aEventOut) {
     cl_event event;
     err = clEnqueueMarker (mWrapped, &event);
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueMarker failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueMarker failed. (error %d)", err);
         return err;
     }
 
@@ -909,7 +870,7 @@ cl_int CommandQueueWrapper::enqueueWaitForEvents (std::vector<EventWrapper*> con
 
     cl_int err = clEnqueueWaitForEvents (mWrapped, clEvWaitListLen, clEvWaitList);
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueWaitForEvents failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueWaitForEvents failed. (error %d)", err);
     }
 
     return err;
@@ -920,18 +881,17 @@ cl_int CommandQueueWrapper::enqueueBarrier () {
     D_METHOD_START;
     cl_int err = clEnqueueBarrier (mWrapped);
     if (err != CL_SUCCESS) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueBarrier failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueBarrier failed. (error %d)", err);
     }
     return err;
 }
 
 
 cl_int CommandQueueWrapper::flush () {
-    D_METHOD_START;
     D_METHOD_START;
     cl_int err = clFlush (mWrapped);
     if (err != CL_SUCCESS)
-        D_LOG (LOG_LEVEL_ERROR, "clFlush failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clFlush failed. (error %d)", err);
     return err;
 }
 
@@ -940,7 +900,7 @@ cl_int CommandQueueWrapper::finish () {
     D_METHOD_START;
     cl_int err = clFinish (mWrapped);
     if (err != CL_SUCCESS)
-        D_LOG (LOG_LEVEL_ERROR, "clFinish failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clFinish failed. (error %d)", err);
     return err;
 }
 
@@ -979,7 +939,7 @@ cl_int CommandQueueWrapper::enqueueAcquireGLObjects (std::vector<MemoryObjectWra
     if (memObjList) free (memObjList);
 
     if (CL_FAILED (err)) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueAcquireGLObjects failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueAcquireGLObjects failed. (error %d)", err);
         return err;
     }
 
@@ -1029,7 +989,7 @@ cl_int CommandQueueWrapper::enqueueReleaseGLObjects (std::vector<MemoryObjectWra
     if (memObjList) free (memObjList);
 
     if (CL_FAILED (err)) {
-        D_LOG (LOG_LEVEL_ERROR, "clEnqueueReleaseGLObjects failed. (error %d)", err);
+        D_TRACE (LOG_LEVEL_ERROR, mWrapped, "clEnqueueReleaseGLObjects failed. (error %d)", err);
         return err;
     }
 
@@ -1047,14 +1007,15 @@ cl_int CommandQueueWrapper::enqueueReleaseGLObjects (std::vector<MemoryObjectWra
 
 
 /* static */
-CommandQueueWrapper* CommandQueueWrapper::getNewOrExisting (cl_command_queue aHandle) {
+CommandQueueWrapper* CommandQueueWrapper::getNewOrExisting (cl_command_queue aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     CommandQueueWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) CommandQueueWrapper (aHandle);
+    res = new(std::nothrow) CommandQueueWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
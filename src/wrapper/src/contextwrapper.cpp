@@ -63,7 +63,7 @@ ContextWrapper::ContextWrapper (cl_context aHandle)
 
 
 ContextWrapper::~ContextWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -444,14 +444,15 @@ cl_int ContextWrapper::createFromGLRenderbuffer (cl_mem_flags aFlags,
 
 
 /* static */
-ContextWrapper* ContextWrapper::getNewOrExisting (cl_context aHandle) {
+ContextWrapper* ContextWrapper::getNewOrExisting (cl_context aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     ContextWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) ContextWrapper (aHandle);
+    res = new(std::nothrow) ContextWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
@@ -48,19 +48,20 @@ DeviceWrapper::DeviceWrapper (cl_device_id aHandle)
 
 
 DeviceWrapper::~DeviceWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
 /* static */
-DeviceWrapper* DeviceWrapper::getNewOrExisting (cl_device_id aHandle) {
+DeviceWrapper* DeviceWrapper::getNewOrExisting (cl_device_id aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     DeviceWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) DeviceWrapper (aHandle);
+    res = new(std::nothrow) DeviceWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
@@ -70,5 +71,10 @@ cl_int DeviceWrapper::deviceInfoHelper (Wrapper const* aInstance, int aName,
     cl_int err = CL_SUCCESS;
     DeviceWrapper const* instance = dynamic_cast<DeviceWrapper const*>(aInstance);
     VALIDATE_ARG_POINTER (instance, &err, err);
-    return clGetDeviceInfo (instance->getWrapped (), aName, aSize, aValueOut, aSizeOut);
+    // CL_DEVICE_AVAILABLE may change, everything else is fixed for the
+    // lifetime of the device and served from the cache after first use.
+    if (aName == CL_DEVICE_AVAILABLE)
+        return clGetDeviceInfo (instance->getWrapped (), aName, aSize, aValueOut, aSizeOut);
+    return instance->mInfoCache.get (instance->getWrapped (), clGetDeviceInfo,
+                                     (cl_device_info)aName, aSize, aValueOut, aSizeOut);
 }
@@ -47,7 +47,7 @@ EventWrapper::EventWrapper (cl_event aHandle)
 
 
 EventWrapper::~EventWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -82,14 +82,15 @@ cl_int EventWrapper::setEventCallback (cl_int aCommandExecCallbackType,
 
 
 /* static */
-EventWrapper* EventWrapper::getNewOrExisting (cl_event aHandle) {
+EventWrapper* EventWrapper::getNewOrExisting (cl_event aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     EventWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) EventWrapper (aHandle);
+    res = new(std::nothrow) EventWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
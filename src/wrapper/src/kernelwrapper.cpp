@@ -54,7 +54,7 @@ KernelWrapper::KernelWrapper (cl_kernel aHandle)
 
 
 KernelWrapper::~KernelWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -69,14 +69,15 @@ cl_int KernelWrapper::setArg (cl_uint aIndex, size_t aSize, void* aValue) {
 
 
 /* static */
-KernelWrapper* KernelWrapper::getNewOrExisting (cl_kernel aHandle) {
+KernelWrapper* KernelWrapper::getNewOrExisting (cl_kernel aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     KernelWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) KernelWrapper (aHandle);
+    res = new(std::nothrow) KernelWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
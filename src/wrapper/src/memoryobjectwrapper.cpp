@@ -47,7 +47,7 @@ MemoryObjectWrapper::MemoryObjectWrapper (cl_mem aHandle)
 
 
 MemoryObjectWrapper::~MemoryObjectWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -97,14 +97,15 @@ cl_int MemoryObjectWrapper::getGLObjectInfo (cl_gl_object_type *aGLObjectTypeOut
 
 
 /* static */
-MemoryObjectWrapper* MemoryObjectWrapper::getNewOrExisting (cl_mem aHandle) {
+MemoryObjectWrapper* MemoryObjectWrapper::getNewOrExisting (cl_mem aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     MemoryObjectWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) MemoryObjectWrapper (aHandle);
+    res = new(std::nothrow) MemoryObjectWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
@@ -53,7 +53,7 @@ PlatformWrapper::PlatformWrapper (cl_platform_id aHandle)
 
 
 PlatformWrapper::~PlatformWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -88,14 +88,15 @@ cl_int PlatformWrapper::getDevices (int aType, std::vector<DeviceWrapper*>& aDev
 
 
 /* static */
-PlatformWrapper* PlatformWrapper::getNewOrExisting (cl_platform_id aHandle) {
+PlatformWrapper* PlatformWrapper::getNewOrExisting (cl_platform_id aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     PlatformWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) PlatformWrapper (aHandle);
+    res = new(std::nothrow) PlatformWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
@@ -105,7 +106,8 @@ cl_int PlatformWrapper::platformInfoHelper (Wrapper const* aInstance, int aName,
     cl_int err = CL_SUCCESS;
     PlatformWrapper const* instance = dynamic_cast<PlatformWrapper const*>(aInstance);
     VALIDATE_ARG_POINTER (instance, &err, err);
-    return clGetPlatformInfo (instance->getWrapped (), aName, aSize, aValueOut, aSizeOut);
+    return instance->mInfoCache.get (instance->getWrapped (), clGetPlatformInfo,
+                                     (cl_platform_info)aName, aSize, aValueOut, aSizeOut);
 }
 
 
@@ -63,7 +63,7 @@ ProgramWrapper::ProgramWrapper (cl_program aHandle)
 
 
 ProgramWrapper::~ProgramWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
@@ -234,14 +234,15 @@ done:
 
 
 /* static */
-ProgramWrapper* ProgramWrapper::getNewOrExisting (cl_program aHandle) {
+ProgramWrapper* ProgramWrapper::getNewOrExisting (cl_program aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     ProgramWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) ProgramWrapper (aHandle);
+    res = new(std::nothrow) ProgramWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
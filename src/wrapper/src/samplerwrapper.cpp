@@ -47,19 +47,20 @@ SamplerWrapper::SamplerWrapper (cl_sampler aHandle)
 
 
 SamplerWrapper::~SamplerWrapper () {
-    instanceRegistry.remove (mWrapped);
+    instanceRegistry.remove (mWrapped, this);
 }
 
 
 /* static */
-SamplerWrapper* SamplerWrapper::getNewOrExisting (cl_sampler aHandle) {
+SamplerWrapper* SamplerWrapper::getNewOrExisting (cl_sampler aHandle, bool* aCreatedOut) {
     D_METHOD_START;
     SamplerWrapper* res = 0;
-    if (instanceRegistry.findById (aHandle, &res) && res) {
-        res->retain ();
+    if (aCreatedOut) *aCreatedOut = false;
+    if (instanceRegistry.findAndRetain (aHandle, &res))
         return res;
-    }
-    return new(std::nothrow) SamplerWrapper (aHandle);
+    res = new(std::nothrow) SamplerWrapper (aHandle);
+    if (aCreatedOut) *aCreatedOut = (res != 0);
+    return res;
 }
 
 
@@ -0,0 +1,120 @@
+//
+// Submission rings
+//
+// queue.createSubmitter(capacity) returns a WebCLSubmitter holding two
+// Buffers shared with a native thread. Commands written here are enqueued
+// by that thread, so a driver stalling in clEnqueue* or clFlush never
+// blocks the event loop:
+//
+//   var sub = queue.createSubmitter(256);
+//   var k = sub.registerKernel(kernel);
+//   var a = sub.registerMemoryObject(buf), h = sub.registerHost(array);
+//   sub.write(1, a, h, 0, array.byteLength);
+//   sub.ndrange(2, k, [1024], [64]);
+//   sub.read(3, a, h, 0, array.byteLength);
+//   sub.flush();
+//   sub.poll(function(tag, status) { ... });
+//
+// Commands are written to the ring without a native call and handed to
+// the thread together by flush(). Every command carries a caller chosen
+// tag; poll() reports the tags whose commands completed, with their CL
+// status. Kernel arguments are read when the thread enqueues the launch,
+// so set them before flushing it and leave them alone until its
+// completion is seen. close() waits for the flushed commands; poll()
+// still reports their completions afterwards.
+//
+
+// must match Submitter in src/submitter.h
+var HEADER_WORDS = 4;
+var DESCRIPTOR_WORDS = 16;
+var COMPLETION_WORDS = 2;
+
+var OP_NDRANGE = 1;
+var OP_WRITE = 2;
+var OP_READ = 3;
+var OP_COPY = 4;
+var OP_MARKER = 5;
+
+// Writes a descriptor after the last one written, to be published by
+// flush(). Returns false, writing nothing, if the ring is full.
+function publish(sub, op, tag, operands) {
+    var ring = sub.submission;
+    var head = sub._head === undefined ? ring[0] : sub._head;
+    var capacity = ring[2];
+    if (((head - ring[1]) >>> 0) >= capacity)
+        return false;
+
+    var base = HEADER_WORDS + (head % capacity) * DESCRIPTOR_WORDS;
+    ring[base] = op;
+    ring[base + 1] = tag >>> 0;
+    for (var i = 0; i < DESCRIPTOR_WORDS - 2; i++)
+        ring[base + 2 + i] = i < operands.length ? operands[i] >>> 0 : 0;
+    sub._head = (head + 1) >>> 0;
+    return true;
+}
+
+function triple(v) {
+    v = v || [];
+    return [v[0] || 0, v[1] || 0, v[2] || 0];
+}
+
+//  boolean ndrange(uint tag, uint kernel, uint[] globalWorkSize,
+//                  optional uint[] localWorkSize, optional uint[] globalWorkOffset);
+exports.ndrange = function(tag, kernel, globalWorkSize, localWorkSize, globalWorkOffset) {
+    return publish(this, OP_NDRANGE, tag,
+                   [kernel, globalWorkSize.length].concat(triple(globalWorkSize),
+                                                         triple(localWorkSize),
+                                                         triple(globalWorkOffset)));
+};
+
+//  boolean write(uint tag, uint mem, uint host, uint offset, uint size, optional uint hostOffset);
+exports.write = function(tag, mem, host, offset, size, hostOffset) {
+    return publish(this, OP_WRITE, tag, [mem, host, offset, size, hostOffset || 0]);
+};
+
+//  boolean read(uint tag, uint mem, uint host, uint offset, uint size, optional uint hostOffset);
+exports.read = function(tag, mem, host, offset, size, hostOffset) {
+    return publish(this, OP_READ, tag, [mem, host, offset, size, hostOffset || 0]);
+};
+
+//  boolean copy(uint tag, uint src, uint dst, uint srcOffset, uint dstOffset, uint size);
+exports.copy = function(tag, src, dst, srcOffset, dstOffset, size) {
+    return publish(this, OP_COPY, tag, [src, dst, srcOffset, dstOffset, size]);
+};
+
+//  boolean marker(uint tag);
+exports.marker = function(tag) {
+    return publish(this, OP_MARKER, tag, []);
+};
+
+//  void flush();
+//
+// Hands every command written since the last flush to the thread, with
+// one native call; the native side stores the head after a fence.
+exports.flush = function() {
+    if (this._head !== undefined && this._head !== this._flushed) {
+        this._flushed = this._head;
+        this.notify(this._head);
+    }
+};
+
+//  uint poll(function callback(uint tag, int status));
+//
+// Calls back once per completed command and returns how many there were.
+// The entries read are handed back to the thread by the next poll, in
+// the same consume call that reads the new head.
+exports.poll = function(callback) {
+    var ring = this.completion;
+    var tail = this._tail === undefined ? ring[1] : this._tail;
+    var capacity = ring[2];
+    var head = this.consume(tail);
+    var n = 0;
+    while (tail != head) {
+        var base = HEADER_WORDS + (tail % capacity) * COMPLETION_WORDS;
+        var tag = ring[base], status = ring[base + 1] | 0;
+        this._tail = tail = (tail + 1) >>> 0;
+        n++;
+        callback(tag, status);
+    }
+    return n;
+};
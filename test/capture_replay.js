@@ -0,0 +1,141 @@
+#!/usr/bin/env node
+//
+// Captures (capture.js) replayed by bench/replay.js, against the mock
+// OpenCL library (node-waf configure --opencl-lib=mock).
+//
+//   node test/capture_replay.js
+//
+// A short session, with a transfer larger than the capture's write
+// buffer, is captured and replayed: every call must be made again
+// without errors. The same capture with half a record appended, as left
+// by a process that died while writing, must replay up to that record.
+// Then a record that fails half way through stops the capture, which
+// must still end at a record boundary.
+//
+// Exits 0 without running anything if the binding isn't on the mock.
+//
+
+var WebCL = require('../webcl');
+var assert = require('assert');
+var fs = require('fs');
+var path = require('path');
+
+var capture = WebCL.capture;
+var dir = process.env.TMPDIR || '/tmp';
+var base = path.join(dir, 'capture_replay.' + process.pid);
+
+function onMock() {
+    var platform = WebCL.getPlatforms()[0];
+    return platform.getInfo(WebCL.PLATFORM_NAME) == "Mock OpenCL";
+}
+
+// The calls of a session; returns how many were made.
+function session(extra) {
+    var platform = WebCL.getPlatforms()[0];
+    var device = platform.getDevices(WebCL.DEVICE_TYPE_ALL)[0];
+    var ctx = WebCL.createContext([WebCL.CONTEXT_PLATFORM, platform], [device]);
+    var queue = ctx.createCommandQueue(device, 0);
+    var big = new Uint8Array(100 * 1024);
+    var buf = ctx.createBuffer(WebCL.MEM_READ_WRITE, big.length);
+    queue.enqueueWriteBuffer(buf, true, 0, big.length, big, []);
+    queue.enqueueReadBuffer(buf, true, 0, 16, new Uint8Array(16), []);
+    queue.finish();
+    if (extra)
+        extra(queue, big);
+    return 8;
+}
+
+// Runs bench/replay.js on file and calls back with its report.
+function replay(file, callback) {
+    var out = file + '.json';
+    var child = require('child_process').spawn(process.execPath,
+        [path.join(__dirname, '..', 'bench', 'replay.js'), '--trace', file, '--out', out]);
+    var stderr = '';
+    child.stdout.on('data', function(d) { process.stdout.write(d); });
+    child.stderr.on('data', function(d) { stderr += d; });
+    child.on('exit', function(code) {
+        assert.equal(code, 0, "replay of " + file + " failed: " + stderr);
+        var report = JSON.parse(fs.readFileSync(out, 'utf8'));
+        fs.unlinkSync(out);
+        callback(report);
+    });
+}
+
+function checkReport(report, calls, what) {
+    assert.equal(report.calls, calls, what + ": calls");
+    for (var name in report.methods) {
+        var m = report.methods[name];
+        assert.equal(m.errors, 0, what + ": " + name + " failed on replay");
+        assert.equal(m.skipped, 0, what + ": " + name + " skipped on replay");
+    }
+    assert.equal(report.methods.enqueueWriteBuffer.calls, 1, what + ": enqueueWriteBuffer");
+}
+
+function roundTrip(next) {
+    var file = base + '.wclt';
+    capture.start(file, { contents: true });
+    var calls = session();
+    capture.stop();
+    assert.equal(capture.error(), null);
+
+    replay(file, function(report) {
+        checkReport(report, calls, "whole capture");
+        assert.ok(!report.truncated, "whole capture reported truncated");
+
+        // the start of a call record: kind, target, and half its name index
+        var torn = base + '.torn.wclt';
+        var bytes = fs.readFileSync(file);
+        var tail = new Buffer([2, 1, 0, 0, 0, 3]);
+        var all = new Buffer(bytes.length + tail.length);
+        bytes.copy(all, 0);
+        tail.copy(all, bytes.length);
+        fs.writeFileSync(torn, all);
+        fs.unlinkSync(file);
+
+        replay(torn, function(report) {
+            checkReport(report, calls, "torn capture");
+            assert.ok(report.truncated, "torn capture not reported truncated");
+            fs.unlinkSync(torn);
+            next();
+        });
+    });
+}
+
+// An argument the capture can't encode: reading its constructor throws.
+function Unreadable() {
+}
+Unreadable.prototype = {
+    get constructor() { throw new Error("unreadable"); }
+};
+
+function failedRecord(next) {
+    var file = base + '.failed.wclt';
+    capture.start(file, { contents: true });
+    var calls = session(function(queue, big) {
+        // the big array is encoded before the argument that fails
+        queue.finish(big, new Unreadable());
+    });
+    assert.ok(!capture.capturing(), "capture still running after a failed record");
+    assert.ok(/unreadable/.test(String(capture.error())), "capture.error()");
+
+    replay(file, function(report) {
+        checkReport(report, calls, "capture stopped by a failed record");
+        assert.ok(!report.truncated, "failed record left in the file");
+        fs.unlinkSync(file);
+        next();
+    });
+}
+
+function main() {
+    if (!onMock()) {
+        console.log("skipped, not on the mock OpenCL library");
+        return;
+    }
+    roundTrip(function() {
+        failedRecord(function() {
+            console.log("ok");
+        });
+    });
+}
+
+main();
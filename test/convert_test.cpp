@@ -0,0 +1,195 @@
+//
+// Host element conversions (src/convert.cpp).
+//
+// Every half is converted to float and double and checked against a
+// value computed with ldexp, and back. Floats are swept over every sign,
+// exponent and upper mantissa pattern, with the low bits that decide
+// rounding set to 0, 1, half-way and all ones; the bulk conversions
+// (F16C, AVX or SSE2 where the CPU has them) must match the scalar ones,
+// and rounding a float via double must give the same half. Then the
+// edge cases: subnormals, ties, overflow, NaN, and doubles that would
+// round the wrong way through float.
+//
+
+#include <CL/cl.h>
+
+#include "src/convert.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace webcl;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char *what, unsigned long long value)
+{
+    if (!ok && failures++ < 20)
+	fprintf(stderr, "FAIL: %s (0x%llx)\n", what, value);
+}
+
+cl_uint floatBits(float f)
+{
+    cl_uint x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+float bitsFloat(cl_uint x)
+{
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+bool isNaNHalf(cl_half h)
+{
+    return (h & 0x7c00) == 0x7c00 && (h & 0x3ff);
+}
+
+// The value of h, computed without any bit tricks.
+double referenceHalf(cl_half h)
+{
+    int exp = (h >> 10) & 0x1f;
+    int m = h & 0x3ff;
+    double v;
+    if (exp == 0)
+	v = ldexp((double) m, -24);
+    else if (exp == 31)
+	v = m ? NAN : INFINITY;
+    else
+	v = ldexp((double) (m | 0x400), exp - 25);
+    return (h & 0x8000) ? -v : v;
+}
+
+void halves()
+{
+    std::vector<cl_half> all(65536);
+    for (size_t i = 0; i < all.size(); i++)
+	all[i] = (cl_half) i;
+    std::vector<float> f(all.size());
+    std::vector<double> d(all.size());
+    ConvertElements(types::HALF, &all[0], types::FLOAT, &f[0], all.size());
+    ConvertElements(types::HALF, &all[0], types::DOUBLE, &d[0], all.size());
+
+    for (size_t i = 0; i < all.size(); i++) {
+	cl_half h = all[i];
+	double ref = referenceHalf(h);
+	float scalar = HalfToFloat(h);
+	if (isNaNHalf(h)) {
+	    check(std::isnan(scalar) && std::isnan(f[i]) && std::isnan(d[i]) &&
+		  std::isnan(HalfToDouble(h)), "half NaN not NaN", h);
+	    // quiet NaNs keep their payload both ways
+	    if (h & 0x200)
+		check(FloatToHalf(scalar) == h && DoubleToHalf(HalfToDouble(h)) == h,
+		      "NaN payload lost", h);
+	    continue;
+	}
+	check(floatBits(scalar) == floatBits((float) ref), "HalfToFloat", h);
+	check(floatBits(f[i]) == floatBits(scalar), "bulk half -> float", h);
+	check(HalfToDouble(h) == ref && std::signbit(HalfToDouble(h)) == std::signbit(ref),
+	      "HalfToDouble", h);
+	check(d[i] == ref && std::signbit(d[i]) == std::signbit(ref), "bulk half -> double", h);
+	check(FloatToHalf(scalar) == h, "float round trip", h);
+	check(DoubleToHalf(ref) == h, "double round trip", h);
+    }
+}
+
+void floats()
+{
+    // low mantissa bits: 0, 1, half of a normal half's unit, its
+    // neighbours, and all ones
+    static const cl_uint low[] = { 0x0000, 0x0001, 0x0fff, 0x1000, 0x1001, 0x1fff };
+    const size_t nlow = sizeof(low) / sizeof(low[0]);
+    const size_t CHUNK = 1 << 16;
+    std::vector<float> f(CHUNK * nlow);
+    std::vector<cl_half> bulk(f.size());
+    std::vector<cl_half> viaDouble(f.size());
+    std::vector<double> d(f.size());
+
+    for (cl_uint hi = 0; hi < (1u << 19); hi += CHUNK) {
+	for (size_t i = 0; i < CHUNK; i++) {
+	    for (size_t j = 0; j < nlow; j++)
+		f[i * nlow + j] = bitsFloat(((hi + (cl_uint) i) << 13) | low[j]);
+	}
+	ConvertElements(types::FLOAT, &f[0], types::HALF, &bulk[0], f.size());
+	ConvertElements(types::FLOAT, &f[0], types::DOUBLE, &d[0], f.size());
+	ConvertElements(types::DOUBLE, &d[0], types::HALF, &viaDouble[0], d.size());
+	for (size_t i = 0; i < f.size(); i++) {
+	    cl_half h = FloatToHalf(f[i]);
+	    if (std::isnan(f[i])) {
+		check(isNaNHalf(bulk[i]) && isNaNHalf(viaDouble[i]) && isNaNHalf(h),
+		      "float NaN not NaN", floatBits(f[i]));
+		continue;
+	    }
+	    check(bulk[i] == h, "bulk float -> half", floatBits(f[i]));
+	    check(viaDouble[i] == h, "float -> double -> half", floatBits(f[i]));
+	    check(floatBits((float) d[i]) == floatBits(f[i]), "bulk float -> double",
+		  floatBits(f[i]));
+	}
+    }
+}
+
+void cases()
+{
+    struct { double v; cl_half h; } c[] = {
+	{ 0.0, 0x0000 },
+	{ -0.0, 0x8000 },
+	{ 1.0, 0x3c00 },
+	{ -2.0, 0xc000 },
+	{ 65504.0, 0x7bff },		// largest half
+	{ 65519.99, 0x7bff },		// just below the overflow tie
+	{ 65520.0, 0x7c00 },		// tie rounds to even: infinity
+	{ 1e300, 0x7c00 },
+	{ -1e300, 0xfc00 },
+	{ INFINITY, 0x7c00 },
+	{ ldexp(1.0, -14), 0x0400 },	// smallest normal
+	{ ldexp(1023.0, -24), 0x03ff },	// largest subnormal
+	{ ldexp(1.0, -24), 0x0001 },	// smallest subnormal
+	{ ldexp(1.0, -25), 0x0000 },	// tie between 0 and it: even
+	{ ldexp(1.0, -25) * (1 + 1e-12), 0x0001 },
+	{ ldexp(3.0, -25), 0x0002 },	// tie between 1 and 2 units: even
+	{ ldexp(5.0, -25), 0x0002 },	// tie between 2 and 3 units: even
+	{ 1.0 + ldexp(1.0, -11), 0x3c00 },	// tie: even
+	{ 1.0 + ldexp(3.0, -11), 0x3c02 },	// tie: even, upwards
+	// above a tie by less than a float can hold: through float this
+	// becomes the tie itself and rounds down
+	{ 1.0 + ldexp(1.0, -11) + ldexp(1.0, -40), 0x3c01 },
+	{ ldexp(1.0, -25) + ldexp(1.0, -60), 0x0001 },
+	{ 2049.0 + ldexp(1.0, -30), 0x6801 },
+    };
+    for (size_t i = 0; i < sizeof(c) / sizeof(c[0]); i++) {
+	check(DoubleToHalf(c[i].v) == c[i].h, "DoubleToHalf case", i);
+	cl_half bulk;
+	ConvertElements(types::DOUBLE, &c[i].v, types::HALF, &bulk, 1);
+	check(bulk == c[i].h, "bulk double -> half case", i);
+    }
+
+    // signalling NaNs come back quiet
+    check(FloatToHalf(bitsFloat(0x7f800001)) == 0x7e00, "float sNaN", 0x7f800001);
+    double snan;
+    cl_ulong bits = 0x7ff0000000000001ULL;
+    memcpy(&snan, &bits, sizeof(snan));
+    check(DoubleToHalf(snan) == 0x7e00, "double sNaN", bits);
+    check(FloatToHalf(-NAN) & 0x8000, "NaN sign", 0);
+}
+
+} // namespace
+
+int main()
+{
+    halves();
+    floats();
+    cases();
+    if (failures) {
+	fprintf(stderr, "%d failures\n", failures);
+	return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
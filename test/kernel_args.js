@@ -0,0 +1,72 @@
+#!/usr/bin/env node
+//
+// kernel.setArg for vectors and __local arguments, against the mock
+// OpenCL library (node-waf configure --opencl-lib=mock), which checks
+// argument sizes against the kernel's signature the way drivers do.
+//
+//   node test/kernel_args.js
+//
+// A 3-component vector is passed with the size of a 4-component one, so
+// a Float32Array(3) must set a float3 argument; other lengths must throw
+// CL_INVALID_ARG_SIZE. A LOCAL_MEMORY_SIZE argument is passed as a size
+// with a NULL value, which the driver requires, and a size of 0 must
+// throw. With every argument set, the kernel must launch.
+//
+// Exits 0 without running anything if the binding isn't on the mock.
+//
+
+var WebCL = require('../webcl');
+var assert = require('assert');
+
+var source = [
+    "__kernel void args(__global float *out, float3 v, __local float *tmp, uint4 u, float s)",
+    "{",
+    "}"
+].join("\n");
+
+function setup() {
+    var platform = WebCL.getPlatforms()[0];
+    if (platform.getInfo(WebCL.PLATFORM_NAME) != "Mock OpenCL")
+        return null;
+    var device = platform.getDevices(WebCL.DEVICE_TYPE_ALL)[0];
+    var ctx = WebCL.createContext([WebCL.CONTEXT_PLATFORM, platform], [device]);
+    return { ctx: ctx, device: device, queue: ctx.createCommandQueue(device, 0) };
+}
+
+function main() {
+    var env = setup();
+    if (!env) {
+        console.log("skipped, not on the mock OpenCL library");
+        return;
+    }
+    var types = WebCL.types;
+    var program = env.ctx.createProgram(source);
+    program.build([env.device], "");
+    var kernel = program.createKernel("args");
+    var out = env.ctx.createBuffer(WebCL.MEM_WRITE_ONLY, 64);
+
+    kernel.setArg(0, out, types.MEMORY_OBJECT);
+    kernel.setArg(1, new Float32Array([1, 2, 3]), types.FLOAT_V);
+    kernel.setArg(1, new Float32Array([1, 2, 3, 0]), types.FLOAT_V);
+    assert.throws(function() {
+        kernel.setArg(1, new Float32Array(5), types.FLOAT_V);
+    }, /CL_INVALID_ARG_SIZE/, "float vector of 5");
+    assert.throws(function() {
+        kernel.setArg(1, new Float32Array(2), types.FLOAT_V);
+    }, /CL_INVALID_ARG_SIZE/, "float2 for a float3");
+
+    kernel.setArg(2, 256, types.LOCAL_MEMORY_SIZE);
+    assert.throws(function() {
+        kernel.setArg(2, 0, types.LOCAL_MEMORY_SIZE);
+    }, /ARG is not of specified type/, "__local size of 0");
+
+    kernel.setArg(3, new Uint32Array([1, 2, 3, 4]), types.UINT_V);
+    kernel.setArg(4, 0.5, types.FLOAT);
+
+    var event = env.queue.enqueueNDRangeKernel(kernel, 1, [], [16], [16], []);
+    env.queue.finish();
+    assert.equal(event.getInfo(WebCL.EVENT_COMMAND_EXECUTION_STATUS), WebCL.COMPLETE);
+    console.log("ok");
+}
+
+main();
@@ -0,0 +1,171 @@
+//
+// Native kernels (CommandQueueWrapper::enqueueNativeKernel and
+// src/nativekernel.cpp), run by the mock on the enqueueing thread.
+//
+// A kernel gets an argument block with two memory objects around a
+// plain value. In the copy it runs on, each memory object slot must hold
+// the host address of that buffer, and the value must be untouched; the
+// caller's block must not change. Memory offsets that are misaligned,
+// repeated, past the end of the block, or given for a block too small to
+// hold a pointer must fail with CL_INVALID_VALUE, without running the
+// kernel. Then NativeKernelFromInfo must refuse infos whose magic or
+// version doesn't match.
+//
+
+#include <CL/cl.h>
+
+#include "commandqueuewrapper.h"
+#include "memoryobjectwrapper.h"
+#include "eventwrapper.h"
+#include "src/nativekernel.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace webcl;
+
+namespace {
+
+const size_t SIZE = 64;
+const cl_uint VALUE = 0x12345678;
+
+int failures = 0;
+int runs = 0;
+
+void check(bool ok, const char *what)
+{
+    if (!ok && failures++ < 10)
+	fprintf(stderr, "FAIL: %s\n", what);
+}
+
+struct Args {
+    cl_mem src;
+    cl_uint value;
+    cl_mem dst;
+};
+
+// Copies src to dst, as host memory.
+void CL_CALLBACK copyKernel(void *p)
+{
+    Args *args = (Args*) p;
+    runs++;
+    check(args->value == VALUE, "plain argument changed");
+    if (args->value == VALUE)
+	memcpy(args->dst, args->src, SIZE);
+}
+
+cl_int enqueue(CommandQueueWrapper *queue, const void *args, size_t size,
+	       std::vector<MemoryObjectWrapper*> const& mems,
+	       std::vector<size_t> const& offsets)
+{
+    EventWrapper *event = 0;
+    cl_int err = queue->enqueueNativeKernel(copyKernel, args, size, mems, offsets,
+					    std::vector<EventWrapper*>(), &event);
+    if (event)
+	event->release();
+    return err;
+}
+
+void rejected(CommandQueueWrapper *queue, const void *args, size_t size,
+	      std::vector<MemoryObjectWrapper*> const& mems,
+	      std::vector<size_t> const& offsets, const char *what)
+{
+    int before = runs;
+    check(enqueue(queue, args, size, mems, offsets) == CL_INVALID_VALUE, what);
+    check(runs == before, "kernel run for a rejected argument block");
+}
+
+} // namespace
+
+int main()
+{
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_int err;
+    if (clGetPlatformIDs(1, &platform, 0) != CL_SUCCESS ||
+	clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, 0) != CL_SUCCESS)
+	return EXIT_FAILURE;
+    cl_context ctx = clCreateContext(0, 1, &device, 0, 0, &err);
+    if (err != CL_SUCCESS)
+	return EXIT_FAILURE;
+    cl_command_queue q = clCreateCommandQueue(ctx, device, 0, &err);
+    cl_mem srcMem = clCreateBuffer(ctx, CL_MEM_READ_WRITE, SIZE, 0, &err);
+    cl_mem dstMem = clCreateBuffer(ctx, CL_MEM_READ_WRITE, SIZE, 0, &err);
+    if (err != CL_SUCCESS)
+	return EXIT_FAILURE;
+
+    // the wrappers take over these references
+    CommandQueueWrapper *queue = CommandQueueWrapper::getNewOrExisting(q);
+    MemoryObjectWrapper *src = MemoryObjectWrapper::getNewOrExisting(srcMem);
+    MemoryObjectWrapper *dst = MemoryObjectWrapper::getNewOrExisting(dstMem);
+    if (!queue || !src || !dst)
+	return EXIT_FAILURE;
+
+    unsigned char pattern[SIZE], zero[SIZE], result[SIZE];
+    for (size_t i = 0; i < SIZE; i++)
+	pattern[i] = (unsigned char) (i * 7 + 1);
+    memset(zero, 0, SIZE);
+    clEnqueueWriteBuffer(q, srcMem, CL_TRUE, 0, SIZE, pattern, 0, 0, 0);
+    clEnqueueWriteBuffer(q, dstMem, CL_TRUE, 0, SIZE, zero, 0, 0, 0);
+
+    std::vector<MemoryObjectWrapper*> mems;
+    mems.push_back(src);
+    mems.push_back(dst);
+    std::vector<size_t> offsets;
+    offsets.push_back(offsetof(Args, src));
+    offsets.push_back(offsetof(Args, dst));
+
+    // whatever the caller left in the slots is replaced
+    Args args;
+    memset(&args, 0xab, sizeof(args));
+    args.value = VALUE;
+    Args original = args;
+    check(enqueue(queue, &args, sizeof(args), mems, offsets) == CL_SUCCESS,
+	  "enqueueNativeKernel");
+    check(runs == 1, "kernel not run");
+    check(memcmp(&args, &original, sizeof(args)) == 0, "caller's argument block changed");
+    clEnqueueReadBuffer(q, dstMem, CL_TRUE, 0, SIZE, result, 0, 0, 0);
+    check(memcmp(result, pattern, SIZE) == 0, "slots not replaced by host addresses");
+
+    std::vector<size_t> bad(offsets);
+    bad[1] = offsetof(Args, dst) - 4;
+    rejected(queue, &args, sizeof(args), mems, bad, "misaligned offset");
+    bad[1] = offsetof(Args, src);
+    rejected(queue, &args, sizeof(args), mems, bad, "repeated offset");
+    bad[1] = sizeof(args);
+    rejected(queue, &args, sizeof(args), mems, bad, "offset past the block");
+    bad[1] = offsetof(Args, dst);
+    rejected(queue, &args, sizeof(args) - 4, mems, bad, "slot running past the block");
+    rejected(queue, &args, sizeof(cl_uint), std::vector<MemoryObjectWrapper*>(1, src),
+	     std::vector<size_t>(1, 0), "block smaller than a pointer");
+    rejected(queue, &args, sizeof(args), mems, std::vector<size_t>(1, 0),
+	     "fewer offsets than memory objects");
+    std::vector<MemoryObjectWrapper*> noMem(mems);
+    noMem[1] = 0;
+    rejected(queue, &args, sizeof(args), noMem, bad, "null memory object");
+    clFinish(q);
+
+    NativeKernelInfo info = { NATIVE_KERNEL_MAGIC, NATIVE_KERNEL_VERSION, copyKernel };
+    check(NativeKernelFromInfo(&info) == copyKernel, "matching info refused");
+    info.magic = NATIVE_KERNEL_MAGIC + 1;
+    check(NativeKernelFromInfo(&info) == 0, "wrong magic accepted");
+    info.magic = NATIVE_KERNEL_MAGIC;
+    info.version = NATIVE_KERNEL_VERSION + 1;
+    check(NativeKernelFromInfo(&info) == 0, "wrong version accepted");
+    check(NativeKernelFromInfo(0) == 0, "null info accepted");
+
+    dst->release();
+    src->release();
+    queue->release();
+    clReleaseContext(ctx);
+
+    if (failures) {
+	fprintf(stderr, "%d failures\n", failures);
+	return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#!/usr/bin/env node
+//
+// Scatter/gather transfers (scatter.js) and host-mirrored buffers
+// (mirror.js), against the mock OpenCL library (node-waf configure
+// --opencl-lib=mock).
+//
+//   node test/scatter_mirror.js
+//
+// The mock runs no NDRange kernels, so only the rect fallback is checked:
+// fewer than MIN_KERNEL_RANGES ranges, and more that overlap, must land
+// at their offsets and leave the bytes between them alone, both ways.
+// Ranges that are malformed or reach past the host view or the buffer
+// must throw CL_INVALID_VALUE before anything is enqueued. Then a mirror
+// tracking pages must upload everything on its first sync, and after
+// that only the pages changed since.
+//
+// Exits 0 without running anything if the binding isn't on the mock.
+//
+
+var WebCL = require('../webcl');
+var scatter = require('../scatter');
+var assert = require('assert');
+
+var SIZE = 1024;
+var PAGE = 64;
+
+function setup() {
+    var platform = WebCL.getPlatforms()[0];
+    if (platform.getInfo(WebCL.PLATFORM_NAME) != "Mock OpenCL")
+        return null;
+    var device = platform.getDevices(WebCL.DEVICE_TYPE_ALL)[0];
+    var ctx = WebCL.createContext([WebCL.CONTEXT_PLATFORM, platform], [device]);
+    return { ctx: ctx, queue: ctx.createCommandQueue(device, 0) };
+}
+
+function pattern(n, seed) {
+    var a = new Uint8Array(n);
+    for (var i = 0; i < n; i++)
+        a[i] = (i * 7 + seed) & 0xff;
+    return a;
+}
+
+function assertBytes(actual, expected, what) {
+    assert.equal(actual.length, expected.length, what + ": length");
+    for (var i = 0; i < expected.length; i++) {
+        if (actual[i] !== expected[i])
+            assert.fail(actual[i], expected[i], what + ": byte " + i, "!==");
+    }
+}
+
+// What a buffer holding before looks like after ranges of src land in it.
+function applied(before, ranges, src) {
+    var expected = new Uint8Array(before);
+    for (var i = 0; i < ranges.length; i += 2)
+        expected.set(src.subarray(ranges[i], ranges[i] + ranges[i + 1]), ranges[i]);
+    return expected;
+}
+
+function contents(queue, buf) {
+    var dst = new Uint8Array(SIZE);
+    queue.enqueueReadBuffer(buf, true, 0, SIZE, dst, []);
+    return dst;
+}
+
+function rectFallback(env) {
+    var ctx = env.ctx, queue = env.queue;
+    var buf = ctx.createBuffer(WebCL.MEM_READ_WRITE, SIZE);
+    var zero = new Uint8Array(SIZE);
+
+    // a strided run of three, which becomes one rect, a lone range and
+    // an empty one; then more than MIN_KERNEL_RANGES that overlap
+    var few = [0, 16, 100, 16, 200, 16, 517, 5, 900, 0];
+    var overlapping = [];
+    for (var i = 0; i < scatter.MIN_KERNEL_RANGES + 2; i++)
+        overlapping.push(i * 24, 32);
+    var cases = [ ["few ranges", few], ["overlapping ranges", overlapping] ];
+
+    for (var c = 0; c < cases.length; c++) {
+        var what = cases[c][0], ranges = cases[c][1];
+        var src = pattern(SIZE, c + 1);
+
+        queue.enqueueWriteBuffer(buf, true, 0, SIZE, zero, []);
+        queue.enqueueWriteScatter(buf, ranges, src, []);
+        queue.finish();
+        assertBytes(contents(queue, buf), applied(zero, ranges, src), "scatter, " + what);
+
+        // gather back into a view of a different type
+        var full = pattern(SIZE, c + 50);
+        queue.enqueueWriteBuffer(buf, true, 0, SIZE, full, []);
+        var words = new Uint32Array(SIZE / 4);
+        queue.enqueueReadGather(buf, ranges, words, []);
+        var gathered = new Uint8Array(words.buffer);
+        assertBytes(gathered, applied(zero, ranges, full), "gather, " + what);
+    }
+}
+
+function bounds(env) {
+    var ctx = env.ctx, queue = env.queue;
+    var buf = ctx.createBuffer(WebCL.MEM_READ_WRITE, SIZE);
+    var zero = new Uint8Array(SIZE);
+    queue.enqueueWriteBuffer(buf, true, 0, SIZE, zero, []);
+
+    var src = pattern(SIZE, 3), big = pattern(2 * SIZE, 4), small = pattern(SIZE / 2, 5);
+    var cases = [
+        ["odd count", [0, 16, 32], src],
+        ["negative offset", [-1, 16], src],
+        ["negative length", [16, -1], src],
+        ["fractional offset", [0.5, 16], src],
+        ["fractional length", [0, 16.5], src],
+        ["past the host view", [0, 16, SIZE / 2 - 8, 16], small],
+        ["past the buffer", [0, 16, SIZE - 8, 16], big]
+    ];
+    for (var c = 0; c < cases.length; c++) {
+        var what = cases[c][0], ranges = cases[c][1], host = cases[c][2];
+        assert.throws(function() {
+            queue.enqueueWriteScatter(buf, ranges, host, []);
+        }, /CL_INVALID_VALUE/, "scatter, " + what);
+        assert.throws(function() {
+            queue.enqueueReadGather(buf, ranges, host, []);
+        }, /CL_INVALID_VALUE/, "gather, " + what);
+    }
+    queue.finish();
+    assertBytes(contents(queue, buf), zero, "buffer after rejected ranges");
+
+    // the whole host view and the whole buffer are fine
+    queue.enqueueWriteScatter(buf, [0, SIZE / 2], small, []);
+    queue.enqueueWriteScatter(buf, [SIZE / 2, SIZE / 2], big, []);
+    queue.finish();
+    var expected = new Uint8Array(SIZE);
+    expected.set(small);
+    expected.set(big.subarray(SIZE / 2, SIZE), SIZE / 2);
+    assertBytes(contents(queue, buf), expected, "ranges up to the limits");
+}
+
+function pageTracking(env) {
+    var ctx = env.ctx, queue = env.queue;
+    var host = pattern(SIZE, 6);
+    var m = ctx.createMirroredBuffer(WebCL.MEM_READ_WRITE, host,
+                                     { track: 'pages', pageSize: PAGE, mergeGap: 0 });
+
+    assert.deepEqual(m.dirtyRanges(), [0, SIZE], "first sync uploads everything");
+    assert.ok(m.sync(queue, []), "first sync");
+    queue.finish();
+    assertBytes(contents(queue, m.buffer), host, "after the first sync");
+    assert.deepEqual(m.dirtyRanges(), [], "nothing changed");
+    assert.equal(m.sync(queue, []), null, "sync with nothing changed");
+
+    // Overwrite the device copy behind the mirror's back: the pages sync
+    // doesn't upload keep this, so they show which ones it did.
+    var marker = pattern(SIZE, 200);
+    queue.enqueueWriteBuffer(m.buffer, true, 0, SIZE, marker, []);
+
+    // one byte in the second page, two in the fifth and the last byte
+    host[PAGE + 3] ^= 0xff;
+    host[4 * PAGE] ^= 0xff;
+    host[5 * PAGE - 1] ^= 0xff;
+    host[SIZE - 1] ^= 0xff;
+    var pages = [PAGE, PAGE, 4 * PAGE, PAGE, SIZE - PAGE, PAGE];
+    assert.deepEqual(m.dirtyRanges(), pages, "changed pages");
+
+    m.sync(queue, []);
+    queue.finish();
+    assertBytes(contents(queue, m.buffer), applied(marker, pages, host),
+                "only the changed pages uploaded");
+    assert.deepEqual(m.dirtyRanges(), [], "nothing changed after sync");
+}
+
+function main() {
+    var env = setup();
+    if (!env) {
+        console.log("skipped, not on the mock OpenCL library");
+        return;
+    }
+    rectFallback(env);
+    bounds(env);
+    pageTracking(env);
+    console.log("ok");
+}
+
+main();
@@ -0,0 +1,119 @@
+//
+// The wrapper's lock-free trace ring (src/wrapper/src/clwrappercommon.cpp).
+//
+// Several threads log numbered messages at once, into a temporary log
+// file. First few enough to fit in the ring, so every message must be
+// written out, each thread's in the order it logged them. Then far more
+// than fit between two drains of the flush thread: messages are dropped,
+// but the ones written out must still be in order per thread, and
+// together with cl_wrapper_log_dropped() must account for every message
+// logged. Both are checked right after cl_wrapper_flush_log() returns,
+// which must have written out everything recorded before it.
+//
+
+#include <CL/cl.h>
+
+#include "clwrappercommon.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+const int THREADS = 4;
+const int FEW = 500;		// THREADS * FEW fits in the ring
+const int MANY = 50000;
+
+int failures = 0;
+
+void check(bool ok, const char *what)
+{
+    if (!ok && failures++ < 10)
+	fprintf(stderr, "FAIL: %s\n", what);
+}
+
+void producer(const char *tag, int id, int count, std::atomic<int> *ready)
+{
+    ready->fetch_add(1);
+    while (ready->load() < THREADS)
+	;
+    for (int i = 0; i < count; i++)
+	CL_W_LOGGER(CL_W_LOG_LEVEL_ERROR, "%s %d %d", tag, id, i);
+}
+
+// Logs count messages from each of THREADS threads, flushes, and returns
+// how many of them are in the log at path. Checks the order per thread.
+int run(const char *path, const char *tag, int count)
+{
+    std::atomic<int> ready(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+	threads.push_back(std::thread(producer, tag, t, count, &ready));
+    for (int t = 0; t < THREADS; t++)
+	threads[t].join();
+    cl_wrapper_flush_log();
+
+    FILE *f = fopen(path, "r");
+    check(f != 0, "log file not readable");
+    if (!f)
+	return 0;
+    std::vector<int> last(THREADS, -1);
+    int written = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+	char *msg = strstr(line, tag);
+	int id, i;
+	if (!msg || sscanf(msg + strlen(tag), " %d %d", &id, &i) != 2)
+	    continue;
+	check(id >= 0 && id < THREADS, "message from an unknown thread");
+	if (id < 0 || id >= THREADS)
+	    continue;
+	check(i > last[id], "messages of a thread out of order");
+	last[id] = i;
+	written++;
+    }
+    fclose(f);
+    return written;
+}
+
+} // namespace
+
+int main()
+{
+    char path[] = "/tmp/trace_ring_test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+	perror("mkstemp");
+	return EXIT_FAILURE;
+    }
+    close(fd);
+    check(cl_wrapper_set_log_file(path), "cl_wrapper_set_log_file");
+    cl_wrapper_set_log_level(CL_W_LOG_LEVEL_ERROR);
+
+    unsigned long dropped = cl_wrapper_log_dropped();
+    check(run(path, "trace-few", FEW) == THREADS * FEW, "messages lost with room in the ring");
+    check(cl_wrapper_log_dropped() == dropped, "messages dropped with room in the ring");
+
+    dropped = cl_wrapper_log_dropped();
+    int written = run(path, "trace-many", MANY);
+    unsigned long lost = cl_wrapper_log_dropped() - dropped;
+    check(lost > 0, "nothing dropped from a full ring");
+    check(written + lost == (unsigned long) THREADS * MANY,
+	  "written and dropped messages don't add up");
+
+    cl_wrapper_set_log_level(CL_W_LOG_LEVEL_NONE);
+    cl_wrapper_set_log_file(0);
+    unlink(path);
+
+    if (failures) {
+	fprintf(stderr, "%d failures\n", failures);
+	return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
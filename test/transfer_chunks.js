@@ -0,0 +1,152 @@
+#!/usr/bin/env node
+//
+// Buffer transfers split by setTransferChunkSize, against the mock
+// OpenCL library (node-waf configure --opencl-lib=mock).
+//
+//   node test/transfer_chunks.js
+//
+// Writes, reads and copies of sizes and offsets that don't line up with
+// the chunk size must round-trip, blocking or not, and each counts as
+// one transfer in WebCL.getStats(). Then, in a child process run with
+// MOCKCL_FAIL_TRANSFER, one chunk of a blocking write fails to enqueue:
+// the call must throw, the chunks before it must have landed and the
+// queue must still work.
+//
+// Exits 0 without running anything if the binding isn't on the mock.
+//
+
+var WebCL = require('../webcl');
+var assert = require('assert');
+
+var CHUNK = 16;
+var SIZE = 256;
+
+function setup() {
+    var platform = WebCL.getPlatforms()[0];
+    if (platform.getInfo(WebCL.PLATFORM_NAME) != "Mock OpenCL")
+        return null;
+    var device = platform.getDevices(WebCL.DEVICE_TYPE_ALL)[0];
+    var ctx = WebCL.createContext([WebCL.CONTEXT_PLATFORM, platform], [device]);
+    return { ctx: ctx, queue: ctx.createCommandQueue(device, 0) };
+}
+
+function pattern(n, seed) {
+    var a = new Uint8Array(n);
+    for (var i = 0; i < n; i++)
+        a[i] = (i * 7 + seed) & 0xff;
+    return a;
+}
+
+function assertBytes(actual, expected, what) {
+    assert.equal(actual.length, expected.length, what + ": length");
+    for (var i = 0; i < expected.length; i++) {
+        if (actual[i] !== expected[i])
+            assert.fail(actual[i], expected[i], what + ": byte " + i, "!==");
+    }
+}
+
+function roundTrips(env) {
+    var ctx = env.ctx, queue = env.queue;
+    var a = ctx.createBuffer(WebCL.MEM_READ_WRITE, SIZE);
+    var b = ctx.createBuffer(WebCL.MEM_READ_WRITE, SIZE);
+
+    var previous = queue.setTransferChunkSize(CHUNK);
+    assert.ok(previous > 0, "default chunk size");
+    assert.equal(queue.setTransferChunkSize(CHUNK), CHUNK);
+
+    // one chunk, a partial last chunk, an exact multiple, and off the
+    // chunk boundaries on both sides
+    var cases = [ [0, CHUNK], [0, 3 * CHUNK + 5], [0, SIZE], [3, 2 * CHUNK + 9],
+                  [CHUNK + 1, SIZE - CHUNK - 1] ];
+    for (var c = 0; c < cases.length; c++) {
+        var offset = cases[c][0], n = cases[c][1];
+        var what = "offset " + offset + ", " + n + " bytes";
+        var src = pattern(n, c);
+        var dst = new Uint8Array(n);
+
+        queue.enqueueWriteBuffer(a, true, offset, n, src, []);
+        queue.enqueueReadBuffer(a, true, offset, n, dst, []);
+        assertBytes(dst, src, "blocking write/read, " + what);
+
+        // non-blocking: the returned event covers every chunk
+        var src2 = pattern(n, c + 100);
+        var dst2 = new Uint8Array(n);
+        queue.enqueueWriteBuffer(a, false, offset, n, src2, []);
+        var ev = queue.enqueueReadBuffer(a, false, offset, n, dst2, []);
+        queue.finish();
+        assert.equal(ev.getInfo(WebCL.EVENT_COMMAND_EXECUTION_STATUS), WebCL.COMPLETE);
+        assertBytes(dst2, src2, "non-blocking write/read, " + what);
+
+        // copy to a different offset in the other buffer
+        var dstOffset = SIZE - n - offset;
+        var copied = new Uint8Array(n);
+        queue.enqueueCopyBuffer(a, b, offset, dstOffset, n, []);
+        queue.enqueueReadBuffer(b, true, dstOffset, n, copied, []);
+        assertBytes(copied, src2, "copy, " + what);
+    }
+
+    // the chunks of a transfer are counted once, with all of its bytes
+    WebCL.WebCL.resetStats();
+    queue.enqueueWriteBuffer(a, true, 0, SIZE, pattern(SIZE, 1), []);
+    queue.enqueueCopyBuffer(a, b, 0, 0, SIZE, []);
+    queue.finish();
+    var stats = WebCL.WebCL.getStats().transfers;
+    assert.equal(stats.write.transfers, 1, "chunked write counted once");
+    assert.equal(stats.write.bytes, SIZE);
+    assert.equal(stats.copy.transfers, 1, "chunked copy counted once");
+    assert.equal(stats.copy.bytes, SIZE);
+
+    queue.setTransferChunkSize(previous);
+    queue.finish();
+}
+
+// Run with MOCKCL_FAIL_TRANSFER=3: the zeroing write is transfer 1, so
+// the second chunk of the patterned write fails.
+function failure(env) {
+    var ctx = env.ctx, queue = env.queue;
+    var buf = ctx.createBuffer(WebCL.MEM_READ_WRITE, SIZE);
+    queue.enqueueWriteBuffer(buf, true, 0, SIZE, new Uint8Array(SIZE), []);
+
+    queue.setTransferChunkSize(CHUNK);
+    var src = pattern(4 * CHUNK, 1);
+    assert.throws(function() {
+        queue.enqueueWriteBuffer(buf, true, 0, src.length, src, []);
+    }, /CL_OUT_OF_RESOURCES/);
+    queue.finish();
+
+    queue.setTransferChunkSize(0);
+    var dst = new Uint8Array(SIZE);
+    queue.enqueueReadBuffer(buf, true, 0, SIZE, dst, []);
+    var expected = new Uint8Array(SIZE);
+    expected.set(src.subarray(0, CHUNK));
+    assertBytes(dst, expected, "after a failed chunk");
+}
+
+function main() {
+    var env = setup();
+    if (!env) {
+        console.log("skipped, not on the mock OpenCL library");
+        return;
+    }
+    if (process.argv[2] == 'fail') {
+        failure(env);
+        return;
+    }
+
+    roundTrips(env);
+
+    var childEnv = {};
+    for (var k in process.env)
+        childEnv[k] = process.env[k];
+    childEnv.MOCKCL_FAIL_TRANSFER = '3';
+    var child = require('child_process').spawn(process.execPath, [__filename, 'fail'],
+                                               { env: childEnv });
+    child.stdout.on('data', function(d) { process.stdout.write(d); });
+    child.stderr.on('data', function(d) { process.stderr.write(d); });
+    child.on('exit', function(code) {
+        assert.equal(code, 0, "failure case");
+        console.log("ok");
+    });
+}
+
+main();
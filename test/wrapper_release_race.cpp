@@ -0,0 +1,118 @@
+//
+// Races MemoryObjectWrapper::getNewOrExisting against the release of the
+// last reference to the wrapper it finds.
+//
+// Each thread looks up the same cl_mem, checks the wrapper and releases
+// it again, so wrappers keep dying while other threads look them up. A
+// lookup must either take a reference before the count reaches 0 or miss
+// and make a new wrapper; it must never return one that is being deleted.
+//
+// New wrappers take over a CL reference they did not retain, so a lookup
+// that reports it created the wrapper retains one for it, the way the
+// binding wraps queried handles. At the end only the test's own
+// reference may be left.
+//
+
+#include <CL/cl.h>
+
+#include "memoryobjectwrapper.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int THREADS = 4;
+const int LOOKUPS = 100000;
+const size_t SIZE = 256;
+
+std::atomic<int> failures(0);
+std::atomic<bool> destroyed(false);
+
+void check(bool ok, const char *what)
+{
+    if (!ok && failures++ < 10)
+	fprintf(stderr, "FAIL: %s\n", what);
+}
+
+void CL_CALLBACK onDestroy(cl_mem, void *)
+{
+    destroyed = true;
+}
+
+void lookups(cl_mem mem, std::atomic<int> *ready)
+{
+    ready->fetch_add(1);
+    while (ready->load() < THREADS)
+	;
+    for (int i = 0; i < LOOKUPS; i++) {
+	bool created = false;
+	MemoryObjectWrapper *w = MemoryObjectWrapper::getNewOrExisting(mem, &created);
+	check(w != 0, "lookup failed");
+	if (!w)
+	    continue;
+	if (created)
+	    clRetainMemObject(mem);
+	check(w->getWrapped() == mem, "wrapper for another handle");
+	check(w->refCount() > 0, "wrapper with no references");
+	size_t size = 0;
+	check(w->getInfo(CL_MEM_SIZE, size) == CL_SUCCESS && size == SIZE,
+	      "wrapper with a dead handle");
+	check(w->release() == CL_SUCCESS, "release failed");
+    }
+}
+
+} // namespace
+
+int main()
+{
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_int err;
+    if (clGetPlatformIDs(1, &platform, 0) != CL_SUCCESS ||
+	clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, 0) != CL_SUCCESS)
+	return EXIT_FAILURE;
+    cl_context ctx = clCreateContext(0, 1, &device, 0, 0, &err);
+    if (err != CL_SUCCESS)
+	return EXIT_FAILURE;
+    cl_mem mem = clCreateBuffer(ctx, CL_MEM_READ_WRITE, SIZE, 0, &err);
+    if (err != CL_SUCCESS)
+	return EXIT_FAILURE;
+    clSetMemObjectDestructorCallback(mem, onDestroy, 0);
+
+    std::atomic<int> ready(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREADS; i++)
+	threads.push_back(std::thread(lookups, mem, &ready));
+    for (size_t i = 0; i < threads.size(); i++)
+	threads[i].join();
+
+    // Every wrapper is gone, so the next lookup makes a fresh one.
+    bool created = false;
+    MemoryObjectWrapper *w = MemoryObjectWrapper::getNewOrExisting(mem, &created);
+    check(w && created && w->refCount() == 1, "stale wrapper left in the registry");
+    check(!destroyed, "handle released too often");
+    if (w) {
+	clRetainMemObject(mem);
+	w->release();
+    }
+
+    // A retain for every wrapper created and a release for every one
+    // deleted leaves ours.
+    cl_uint refs = 0;
+    clGetMemObjectInfo(mem, CL_MEM_REFERENCE_COUNT, sizeof(refs), &refs, 0);
+    check(refs == 1, "creations reported wrongly");
+    clReleaseMemObject(mem);
+    check(destroyed, "handle not released");
+    clReleaseContext(ctx);
+
+    if (failures) {
+	fprintf(stderr, "%d failures\n", failures.load());
+	return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+//
+// Warm-start manifests
+//
+// The first launch of a kernel pays for compilation and driver warm-up.
+// warmup() builds every program listed in a manifest and launches each
+// kernel once on scratch buffers, so a worker can do that before it
+// starts taking requests.
+//
+// A manifest is a JSON object (or the path of a file holding one):
+//
+//   { "programs": [
+//       { "file": "kernels/sgemm.cl",       // or "source": "..."
+//         "options": "-cl-mad-enable",
+//         "kernels": [
+//           { "name": "sgemm",
+//             "global": [1024, 1024], "local": [16, 16],
+//             "args": [ { "type": "MEM", "size": 4194304 },
+//                       { "type": "UINT", "value": 1024 },
+//                       { "type": "LOCAL_MEMORY_SIZE", "value": 1024 } ] } ] } ] }
+//
+// Arguments of type MEM get a fresh read/write scratch buffer of "size"
+// bytes; every other type is passed to setArg as is, with types named as
+// in WebCL.types.
+//
+
+var fs = require('fs');
+var path = require('path');
+
+function loadManifest(manifest) {
+    if (typeof manifest != 'string')
+        return { manifest: manifest, dir: process.cwd() };
+    return { manifest: JSON.parse(fs.readFileSync(manifest, 'utf8')),
+             dir: path.dirname(manifest) };
+}
+
+function elapsed(start) {
+    return Date.now() - start;
+}
+
+function warmKernel(WebCL, ctx, queue, program, k) {
+    var report = { name: k.name };
+    var start = Date.now();
+    try {
+        var kernel = program.createKernel(k.name);
+        var args = k.args || [];
+        for (var i = 0; i < args.length; i++) {
+            var type = WebCL.types[args[i].type];
+            if (type === undefined)
+                throw new Error("unknown argument type " + args[i].type);
+            if (type == WebCL.types.MEMORY_OBJECT)
+                kernel.setArg(i, ctx.createBuffer(WebCL.MEM_READ_WRITE, args[i].size || 4096), type);
+            else
+                kernel.setArg(i, args[i].value, type);
+        }
+        var ev = queue.enqueueNDRangeKernel(kernel, k.global.length, k.offset || [],
+                                            k.global, k.local || [], []);
+        queue.finish();
+        report.launchTime = elapsed(start);
+        report.kernelTime = ev.getProfilingInfo(WebCL.PROFILING_COMMAND_END) -
+            ev.getProfilingInfo(WebCL.PROFILING_COMMAND_START);
+    } catch (e) {
+        report.launchTime = elapsed(start);
+        report.error = e.message;
+    }
+    return report;
+}
+
+//  Object warmup(WebCLContext ctx, WebCLDevice device, (Object or DOMString) manifest);
+//
+// Returns a report with per-program build times and per-kernel launch
+// times in milliseconds (kernelTime is device time in nanoseconds), and
+// ok = false if anything failed. Failures are reported, not thrown, so
+// one bad entry does not keep the rest cold.
+exports.warmup = function(ctx, device, manifest) {
+    var WebCL = require('./webcl');
+    var m = loadManifest(manifest);
+    var queue = ctx.createCommandQueue(device, WebCL.QUEUE_PROFILING_ENABLE);
+    var report = { programs: [], ok: true };
+    var start = Date.now();
+
+    var programs = m.manifest.programs || [];
+    for (var i = 0; i < programs.length; i++) {
+        var p = programs[i];
+        var pr = { name: p.name || p.file || ('program' + i), kernels: [] };
+        report.programs.push(pr);
+
+        var t = Date.now();
+        var program;
+        try {
+            var source = p.source;
+            if (source === undefined)
+                source = fs.readFileSync(path.resolve(m.dir, p.file), 'utf8');
+            program = ctx.createProgram(source);
+            program.build([device], p.options || "");
+            pr.buildTime = elapsed(t);
+        } catch (e) {
+            pr.buildTime = elapsed(t);
+            pr.error = e.message;
+            if (program) {
+                try {
+                    pr.buildLog = program.getBuildInfo(device, WebCL.PROGRAM_BUILD_LOG);
+                } catch (e2) {}
+            }
+            report.ok = false;
+            continue;
+        }
+
+        var kernels = p.kernels || [];
+        for (var j = 0; j < kernels.length; j++) {
+            var kr = warmKernel(WebCL, ctx, queue, program, kernels[j]);
+            if (kr.error)
+                report.ok = false;
+            pr.kernels.push(kr);
+        }
+    }
+
+    report.totalTime = elapsed(start);
+    return report;
+};
@@ -14,6 +14,111 @@ exports.WebCLMemoryObject = cl.WebCLMemoryObject;
 exports.WebCLPlatform = cl.WebCLPlatform;
 exports.WebCLProgram = cl.WebCLProgram;
 exports.WebCLSampler = cl.WebCLSampler;
+exports.WebCLSubmitter = cl.WebCLSubmitter;
+
+//
+// Local work-size and build-option autotuning (see autotune.js)
+//
+
+var autotune = require('./autotune');
+exports.autotune = autotune;
+
+var enqueueNDRangeKernel = cl.WebCLCommandQueue.prototype.enqueueNDRangeKernel;
+
+// An omitted localWorkSize picks up the tuned value, if there is one.
+cl.WebCLCommandQueue.prototype.enqueueNDRangeKernel =
+    function(kernel, workDim, globalWorkOffset, globalWorkSize, localWorkSize, eventWaitList) {
+    if ((!localWorkSize || localWorkSize.length == 0) && autotune.enabled) {
+        if (!this._device)
+            this._device = this.getInfo(exports.QUEUE_DEVICE);
+        localWorkSize = autotune.lookup(this._device, kernel, globalWorkSize);
+    }
+    return enqueueNDRangeKernel.call(this, kernel, workDim, globalWorkOffset || [],
+                                     globalWorkSize, localWorkSize || [],
+                                     eventWaitList || []);
+};
+
+var build = cl.WebCLProgram.prototype.build;
+
+// Builds pick up the tuned option set, see autotune.tuneBuildOptions.
+cl.WebCLProgram.prototype.build = function(devices, options) {
+    options = options || "";
+    if (autotune.enabled && !this._tuning && devices.length > 0)
+        options = autotune.buildOptions(devices[0], this, options);
+    var ret = build.call(this, devices, options);
+    // a specialized variant built explicitly isn't built again on use
+    delete this._specialized;
+    return ret;
+};
+
+//
+// Compile-time specialization (see specialize.js)
+//
+
+var specialize = require('./specialize');
+exports.specialize = specialize;
+
+//  not in spec
+//  WebCLProgram specialize(Object defines, optional DOMString options);
+cl.WebCLProgram.prototype.specialize = specialize.specialize;
+
+var createKernel = cl.WebCLProgram.prototype.createKernel;
+var createKernelsInProgram = cl.WebCLProgram.prototype.createKernelsInProgram;
+
+// Variants are built on first use.
+cl.WebCLProgram.prototype.createKernel = function(name) {
+    specialize.ensureBuilt(this);
+    return createKernel.call(this, name);
+};
+
+cl.WebCLProgram.prototype.createKernelsInProgram = function() {
+    specialize.ensureBuilt(this);
+    return createKernelsInProgram.call(this);
+};
+
+//
+// Warm-start manifests (see warmup.js)
+//
+
+//  not in spec
+//  Object warmup(WebCLContext ctx, WebCLDevice device, (Object or DOMString) manifest);
+exports.warmup = function(ctx, device, manifest) {
+    return require('./warmup').warmup(ctx, device, manifest);
+};
+
+//
+// Submission rings drained by a native thread (see submitter.js)
+//
+
+var submitter = require('./submitter');
+['ndrange', 'write', 'read', 'copy', 'marker', 'flush', 'poll'].forEach(function(name) {
+    cl.WebCLSubmitter.prototype[name] = submitter[name];
+});
+
+//
+// Scatter/gather transfers (see scatter.js)
+//
+
+var scatter = require('./scatter');
+//  not in spec
+cl.WebCLCommandQueue.prototype.enqueueWriteScatter = scatter.enqueueWriteScatter;
+//  not in spec
+cl.WebCLCommandQueue.prototype.enqueueReadGather = scatter.enqueueReadGather;
+
+//
+// Host-mirrored buffers (see mirror.js)
+//
+
+var mirror = require('./mirror');
+exports.WebCLMirror = mirror.WebCLMirror;
+cl.WebCLContext.prototype.createMirroredBuffer = mirror.createMirroredBuffer;
+
+//
+// API call capture (see capture.js and bench/replay.js)
+//
+
+var capture = require('./capture');
+exports.capture = capture;
 
 //
 // WebCL Interface
@@ -46,6 +151,38 @@ exports.waitForEvents = function() {
     return webcl.waitForEvents(arguments);
 };
 
+//  not in spec
+//  Sharing with other threads: getToken() on a context, command queue or
+//  memory object returns a number that can be posted to another thread,
+//  where fromToken() turns it back into an object for the same handle.
+//  The token keeps the handle alive until releaseToken().
+exports.fromToken = function(token) {
+    return webcl.fromToken(token);
+};
+
+exports.releaseToken = function(token) {
+    return webcl.releaseToken(token);
+};
+
+//  not in spec
+//  Host functions from other addons for enqueueNativeKernel(name, args,
+//  memObjects, memOffsets, events); fn is an External holding a
+//  NativeKernelInfo, see src/nativekernel.h.
+exports.registerNativeKernel = function(name, fn) {
+    return webcl.registerNativeKernel(name, fn);
+};
+
+//  not in spec
+//  Buffer allocHost(uint bytes, optional Object options);
+//  Page aligned host memory (2 MB aligned on transparent huge pages with
+//  options.hugePages) for ctx.createBuffer(MEM_USE_HOST_PTR, size, host):
+//  CPU and integrated devices use it in place, and reads and writes
+//  between such a buffer and its own memory skip the copy. It is the only
+//  host memory MEM_USE_HOST_PTR accepts. See src/hostalloc.h.
+exports.allocHost = function(bytes, options) {
+    return webcl.allocHost(bytes, options);
+};
+
 //  void unloadCompiler();
 exports.unloadCompiler = function() { 
     return webcl.unloadCompiler();
@@ -477,4 +614,14 @@ exports.types.KERNEL_V = cnt++;
 exports.types.EVENT_V = cnt++;
 exports.types.SAMPLER_V = cnt++;
 
+// Kernel argument types
+exports.types.LOCAL_MEMORY_SIZE = cnt++;          // __local allocation, value is the size in bytes
+exports.types.STRUCT = cnt++;                     // packed struct, raw bytes of a typed array
+
 exports.types.LAST = cnt;
+
+// Started last, so the capture wraps the methods as extended above.
+if (process.env.WEBCL_CAPTURE) {
+    capture.start(process.env.WEBCL_CAPTURE);
+    process.on('exit', capture.stop);
+}